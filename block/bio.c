@@ -31,6 +31,7 @@
 #include <scsi/sg.h>		/* for struct sg_iovec */
 
 #include <trace/events/block.h>
+#include "blk.h"
 
 /*
  * Test patch to inline a certain number of bi_io_vec's inside the bio
@@ -884,6 +885,11 @@ static void submit_bio_wait_endio(struct bio *bio, int error)
 	complete(&ret->event);
 }
 
+static bool submit_bio_wait_done(void *data)
+{
+	return completion_done(data);
+}
+
 /**
  * submit_bio_wait - submit a bio, and wait until it completes
  * @rw: whether to %READ or %WRITE, or maybe to %READA (read ahead)
@@ -901,6 +907,9 @@ int submit_bio_wait(int rw, struct bio *bio)
 	bio->bi_private = &ret;
 	bio->bi_end_io = submit_bio_wait_endio;
 	submit_bio(rw, bio);
+	if (!(rw & WRITE))
+		blk_poll(bdev_get_queue(bio->bi_bdev), submit_bio_wait_done,
+			 &ret.event);
 	wait_for_completion(&ret.event);
 
 	return ret.error;
@@ -1793,6 +1802,8 @@ void bio_endio(struct bio *bio, int error)
 		if (!atomic_dec_and_test(&bio->bi_remaining))
 			return;
 
+		blk_iolatency_done(bio);
+
 		/*
 		 * Need to have a real endio function for chained bios,
 		 * otherwise various corner cases will break (like stacking
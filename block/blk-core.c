@@ -719,6 +719,9 @@ blk_init_allocated_queue(struct request_queue *q, request_fn_proc *rfn,
 	if (blk_init_rl(&q->root_rl, q, GFP_KERNEL))
 		goto fail;
 
+	if (blk_wbt_init(q))
+		goto fail;
+
 	q->request_fn		= rfn;
 	q->prep_rq_fn		= NULL;
 	q->unprep_rq_fn		= NULL;
@@ -1361,6 +1364,9 @@ void __blk_put_request(struct request_queue *q, struct request *req)
 
 	elv_completed_request(q, req);
 
+	/* also gives back the slot of a request merged into another */
+	blk_wbt_done(q, req);
+
 	/* this is a bio leak */
 	WARN_ON(req->bio != NULL);
 
@@ -1557,6 +1563,7 @@ void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	int el_ret, rw_flags, where = ELEVATOR_INSERT_SORT;
 	struct request *req;
 	unsigned int request_count = 0;
+	unsigned char wbt_flags;
 
 	/*
 	 * low level driver can indicate that it wants pages above a
@@ -1604,6 +1611,12 @@ void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	}
 
 get_rq:
+	/*
+	 * Background writeback may have to wait for in-flight writes to
+	 * complete first, this can drop the queue lock.
+	 */
+	wbt_flags = blk_wbt_wait(q, bio);
+
 	/*
 	 * This sync check and mask will be re-done in init_request_from_bio(),
 	 * but we need to set it earlier to expose the sync flag to the
@@ -1619,9 +1632,11 @@ get_rq:
 	 */
 	req = get_request(q, rw_flags, bio, GFP_NOIO);
 	if (IS_ERR(req)) {
+		blk_wbt_release(q, wbt_flags);
 		bio_endio(bio, PTR_ERR(req));	/* @q is dead */
 		goto out_unlock;
 	}
+	blk_wbt_set_rq(req, wbt_flags);
 
 	/*
 	 * After dropping the lock and possibly sleeping here, our request
@@ -1841,6 +1856,8 @@ generic_make_request_checks(struct bio *bio)
 	if (blk_throtl_bio(q, bio))
 		return false;	/* throttled, will be resubmitted later */
 
+	blk_iolatency_bio(q, bio);
+
 	trace_block_bio_queue(q, bio);
 	return true;
 
@@ -2365,6 +2382,7 @@ void blk_start_request(struct request *req)
 
 	BUG_ON(test_bit(REQ_ATOM_COMPLETE, &req->atomic_flags));
 	blk_add_timer(req);
+	blk_wbt_issue(req->q, req);
 }
 EXPORT_SYMBOL(blk_start_request);
 
@@ -0,0 +1,493 @@
+/*
+ * Per-cgroup I/O latency targets on a request queue
+ *
+ * A group sets a completion latency target for a device in
+ * blkio.iolatency.target_device.  Groups with a target are protected:
+ * their bios are timed from submission to completion over 100ms windows,
+ * and a window in which more than a tenth of them missed the target
+ * tightens the queue.  Tightening halves the number of bios every group
+ * with a looser target, or none at all, may have in flight on the device.
+ * Two windows in a row without a miss relax it one step again.
+ *
+ * The hooks sit in generic_make_request_checks() and bio_endio(), so both
+ * request_fn and blk-mq queues are covered.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/swap.h>
+#include <linux/wait.h>
+#include <linux/ktime.h>
+#include "blk-cgroup.h"
+#include "blk.h"
+
+/* Length of a sampling window */
+#define IOLAT_WINDOW		(HZ / 10)
+
+/* A window misses when more than 1/IOLAT_MISS_RATIO of its bios were late */
+#define IOLAT_MISS_RATIO	10
+
+static struct blkcg_policy blkcg_policy_iolat;
+
+struct iolat_data {
+	struct request_queue *queue;
+	spinlock_t lock;
+
+	/* number of groups on this queue with a target */
+	unsigned int nr_targets;
+
+	/* throttled groups may have nr_requests >> scale_step in flight */
+	unsigned int scale_step;
+	/* groups with a target looser than this get throttled */
+	u64 throttle_target_ns;
+	unsigned long last_miss;
+	unsigned long last_relax;
+
+	/* stats */
+	unsigned long scale_downs;
+	unsigned long scale_ups;
+};
+
+struct iolat_grp {
+	/* must be the first member */
+	struct blkg_policy_data pd;
+
+	u64 target_ns;			/* 0 means no target */
+
+	atomic_t inflight;
+	wait_queue_head_t wait;
+
+	spinlock_t lock;		/* protects the window and stats */
+	unsigned long window_start;
+	unsigned int window_nr;
+	unsigned int window_missed;
+
+	/* stats */
+	u64 nr_ios;
+	u64 nr_missed;
+	u64 total_lat_ns;
+	u64 nr_throttled;
+};
+
+static inline struct iolat_grp *pd_to_iolat(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct iolat_grp, pd) : NULL;
+}
+
+static inline struct iolat_grp *blkg_to_iolat(struct blkcg_gq *blkg)
+{
+	return pd_to_iolat(blkg_to_pd(blkg, &blkcg_policy_iolat));
+}
+
+static unsigned int iolat_depth(struct request_queue *q,
+				struct iolat_data *ild)
+{
+	return max(q->nr_requests >> ild->scale_step, 1UL);
+}
+
+static bool iolat_inc_below(atomic_t *v, int below)
+{
+	int cur = atomic_read(v);
+	int old;
+
+	while (cur < below) {
+		old = atomic_cmpxchg(v, cur, cur + 1);
+		if (old == cur)
+			return true;
+		cur = old;
+	}
+	return false;
+}
+
+/*
+ * A protected group just missed its target: cut the depth of everybody
+ * whose target is looser than @target_ns.
+ */
+static void iolat_scale_down(struct request_queue *q, struct iolat_data *ild,
+			     u64 target_ns)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ild->lock, flags);
+	if (!ild->throttle_target_ns || target_ns < ild->throttle_target_ns)
+		ild->throttle_target_ns = target_ns;
+	if ((q->nr_requests >> ild->scale_step) > 1) {
+		ild->scale_step++;
+		ild->scale_downs++;
+	}
+	ild->last_miss = jiffies;
+	spin_unlock_irqrestore(&ild->lock, flags);
+}
+
+static void iolat_maybe_relax(struct iolat_data *ild)
+{
+	unsigned long now = jiffies;
+	unsigned long flags;
+
+	if (!ACCESS_ONCE(ild->scale_step))
+		return;
+	if (time_before(now, ACCESS_ONCE(ild->last_miss) + 2 * IOLAT_WINDOW) ||
+	    time_before(now, ACCESS_ONCE(ild->last_relax) + IOLAT_WINDOW))
+		return;
+
+	spin_lock_irqsave(&ild->lock, flags);
+	if (ild->scale_step &&
+	    time_after_eq(now, ild->last_miss + 2 * IOLAT_WINDOW) &&
+	    time_after_eq(now, ild->last_relax + IOLAT_WINDOW)) {
+		ild->scale_step--;
+		ild->scale_ups++;
+		ild->last_relax = now;
+		if (!ild->scale_step)
+			ild->throttle_target_ns = 0;
+	}
+	spin_unlock_irqrestore(&ild->lock, flags);
+}
+
+static bool iolat_should_throttle(struct iolat_data *ild,
+				  struct iolat_grp *grp, struct bio *bio)
+{
+	u64 throttle_target_ns;
+
+	if (!ACCESS_ONCE(ild->scale_step))
+		return false;
+
+	/* somebody may be waiting on these, don't invert priorities */
+	if ((bio->bi_rw & (REQ_META | REQ_PRIO)) || current_is_kswapd())
+		return false;
+
+	throttle_target_ns = ACCESS_ONCE(ild->throttle_target_ns);
+	return !grp->target_ns || grp->target_ns > throttle_target_ns;
+}
+
+/*
+ * Take one of the group's in-flight slots, unless it is throttled and all
+ * of them are taken.
+ */
+static bool iolat_get_slot(struct request_queue *q, struct iolat_data *ild,
+			   struct iolat_grp *grp, struct bio *bio)
+{
+	if (!iolat_should_throttle(ild, grp, bio)) {
+		atomic_inc(&grp->inflight);
+		return true;
+	}
+	return iolat_inc_below(&grp->inflight, iolat_depth(q, ild));
+}
+
+/*
+ * Called from generic_make_request_checks() for every bio.  Looks up the
+ * submitter's group, waits for a slot if the group is being throttled and
+ * stamps the bio so that blk_iolatency_done() can account it.  Nothing at
+ * all happens until some group on @q sets a target.
+ *
+ * A bio submitted from within a make_request_fn is only charged: the bios
+ * queued on current->bio_list before it are not issued until that returns,
+ * so waiting for completions here could deadlock a stacked device.
+ */
+void blk_iolatency_bio(struct request_queue *q, struct bio *bio)
+{
+	struct iolat_data *ild = q->iolat;
+	struct blkcg *blkcg;
+	struct blkcg_gq *blkg;
+	struct iolat_grp *grp;
+
+	if (!ild || !ACCESS_ONCE(ild->nr_targets))
+		return;
+
+	/* a stacking driver remapped it, it is accounted at the top */
+	if (bio->bi_iolat_blkg)
+		return;
+
+	rcu_read_lock();
+	spin_lock_irq(q->queue_lock);
+	blkcg = bio_blkcg(bio);
+	if (blkcg == &blkcg_root)
+		blkg = q->root_blkg;
+	else
+		blkg = blkg_lookup_create(blkcg, q);
+	if (unlikely(IS_ERR_OR_NULL(blkg))) {
+		spin_unlock_irq(q->queue_lock);
+		rcu_read_unlock();
+		return;
+	}
+	blkg_get(blkg);
+	spin_unlock_irq(q->queue_lock);
+	rcu_read_unlock();
+
+	grp = blkg_to_iolat(blkg);
+
+	iolat_maybe_relax(ild);
+
+	if (!iolat_get_slot(q, ild, grp, bio)) {
+		spin_lock_irq(&grp->lock);
+		grp->nr_throttled++;
+		spin_unlock_irq(&grp->lock);
+
+		if (current->bio_list)
+			atomic_inc(&grp->inflight);
+		else
+			wait_event(grp->wait, iolat_get_slot(q, ild, grp, bio));
+	}
+
+	bio->bi_iolat_blkg = blkg;
+	bio->bi_iolat_issue_ns = ktime_get_ns();
+}
+
+/*
+ * Close the group's window once it has run its length.  Returns true if
+ * the window missed.
+ */
+static bool iolat_window_check(struct iolat_grp *grp)
+{
+	bool missed;
+
+	if (time_before(jiffies, grp->window_start + IOLAT_WINDOW))
+		return false;
+
+	missed = grp->window_missed * IOLAT_MISS_RATIO > grp->window_nr;
+
+	grp->window_start = jiffies;
+	grp->window_nr = 0;
+	grp->window_missed = 0;
+	return missed;
+}
+
+/*
+ * Called from bio_endio() once the last reference on @bio's completion is
+ * gone.  Safe from any context.
+ */
+void blk_iolatency_done(struct bio *bio)
+{
+	struct blkcg_gq *blkg = bio->bi_iolat_blkg;
+	struct iolat_data *ild;
+	struct iolat_grp *grp;
+	unsigned long flags;
+	u64 lat, target_ns;
+	bool missed = false;
+
+	if (!blkg)
+		return;
+	bio->bi_iolat_blkg = NULL;
+
+	ild = blkg->q->iolat;
+	grp = blkg_to_iolat(blkg);
+	lat = ktime_get_ns() - bio->bi_iolat_issue_ns;
+
+	/* waiters only recheck from here, let them see a relaxed depth */
+	iolat_maybe_relax(ild);
+
+	atomic_dec(&grp->inflight);
+	/* pairs with the barrier in wait_event()'s prepare_to_wait() */
+	smp_mb__after_atomic();
+	if (waitqueue_active(&grp->wait))
+		wake_up(&grp->wait);
+
+	target_ns = ACCESS_ONCE(grp->target_ns);
+
+	spin_lock_irqsave(&grp->lock, flags);
+	grp->nr_ios++;
+	grp->total_lat_ns += lat;
+	if (target_ns) {
+		grp->window_nr++;
+		if (lat > target_ns) {
+			grp->window_missed++;
+			grp->nr_missed++;
+		}
+		missed = iolat_window_check(grp);
+	}
+	spin_unlock_irqrestore(&grp->lock, flags);
+
+	if (missed)
+		iolat_scale_down(blkg->q, ild, target_ns);
+
+	blkg_put(blkg);
+}
+
+static void iolat_pd_init(struct blkcg_gq *blkg)
+{
+	struct iolat_grp *grp = blkg_to_iolat(blkg);
+
+	atomic_set(&grp->inflight, 0);
+	init_waitqueue_head(&grp->wait);
+	spin_lock_init(&grp->lock);
+	grp->window_start = jiffies;
+}
+
+static void iolat_pd_offline(struct blkcg_gq *blkg)
+{
+	struct iolat_grp *grp = blkg_to_iolat(blkg);
+	struct iolat_data *ild = blkg->q->iolat;
+
+	if (grp->target_ns) {
+		grp->target_ns = 0;
+		ild->nr_targets--;
+	}
+}
+
+static void iolat_pd_reset_stats(struct blkcg_gq *blkg)
+{
+	struct iolat_grp *grp = blkg_to_iolat(blkg);
+	unsigned long flags;
+
+	spin_lock_irqsave(&grp->lock, flags);
+	grp->nr_ios = 0;
+	grp->nr_missed = 0;
+	grp->total_lat_ns = 0;
+	grp->nr_throttled = 0;
+	spin_unlock_irqrestore(&grp->lock, flags);
+}
+
+static u64 iolat_prfill_target(struct seq_file *sf,
+			       struct blkg_policy_data *pd, int off)
+{
+	struct iolat_grp *grp = pd_to_iolat(pd);
+
+	if (!grp->target_ns)
+		return 0;
+	return __blkg_prfill_u64(sf, pd, div_u64(grp->target_ns,
+						 NSEC_PER_USEC));
+}
+
+static int iolat_print_target(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)), iolat_prfill_target,
+			  &blkcg_policy_iolat, 0, false);
+	return 0;
+}
+
+/*
+ * "MAJ:MIN USECS", 0 drops the target
+ */
+static ssize_t iolat_set_target(struct kernfs_open_file *of,
+				char *buf, size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct blkg_conf_ctx ctx;
+	struct iolat_data *ild;
+	struct iolat_grp *grp;
+	u64 target_ns;
+	int ret;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iolat, buf, &ctx);
+	if (ret)
+		return ret;
+
+	grp = blkg_to_iolat(ctx.blkg);
+	ild = ctx.blkg->q->iolat;
+	target_ns = ctx.v * NSEC_PER_USEC;
+
+	if (!grp->target_ns && target_ns)
+		ild->nr_targets++;
+	else if (grp->target_ns && !target_ns)
+		ild->nr_targets--;
+	grp->target_ns = target_ns;
+
+	spin_lock(&grp->lock);
+	grp->window_start = jiffies;
+	grp->window_nr = 0;
+	grp->window_missed = 0;
+	spin_unlock(&grp->lock);
+
+	/* the group may have just become unthrottled */
+	wake_up_all(&grp->wait);
+
+	blkg_conf_finish(&ctx);
+	return nbytes;
+}
+
+static u64 iolat_prfill_stats(struct seq_file *sf,
+			      struct blkg_policy_data *pd, int off)
+{
+	struct iolat_grp *grp = pd_to_iolat(pd);
+	struct request_queue *q = pd_to_blkg(pd)->q;
+	struct iolat_data *ild = q->iolat;
+	u64 nr_ios, nr_missed, total_lat_ns, nr_throttled;
+
+	/* some drivers (floppy) instantiate a queue w/o disk registered */
+	if (!q->backing_dev_info.dev)
+		return 0;
+
+	spin_lock(&grp->lock);
+	nr_ios = grp->nr_ios;
+	nr_missed = grp->nr_missed;
+	total_lat_ns = grp->total_lat_ns;
+	nr_throttled = grp->nr_throttled;
+	spin_unlock(&grp->lock);
+
+	seq_printf(sf, "%s ios=%llu missed=%llu avg_lat_usec=%llu "
+		   "throttled=%llu inflight=%d depth=%u scale_step=%u "
+		   "scale_downs=%lu scale_ups=%lu\n",
+		   dev_name(q->backing_dev_info.dev), nr_ios, nr_missed,
+		   nr_ios ? div64_u64(total_lat_ns, nr_ios * NSEC_PER_USEC) : 0,
+		   nr_throttled, atomic_read(&grp->inflight),
+		   iolat_depth(q, ild), ild->scale_step,
+		   ild->scale_downs, ild->scale_ups);
+	return 0;
+}
+
+static int iolat_print_stats(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)), iolat_prfill_stats,
+			  &blkcg_policy_iolat, 0, false);
+	return 0;
+}
+
+static struct cftype iolat_files[] = {
+	{
+		.name = "iolatency.target_device",
+		.seq_show = iolat_print_target,
+		.write = iolat_set_target,
+	},
+	{
+		.name = "iolatency.stats",
+		.seq_show = iolat_print_stats,
+	},
+	{ }	/* terminate */
+};
+
+static struct blkcg_policy blkcg_policy_iolat = {
+	.pd_size		= sizeof(struct iolat_grp),
+	.cftypes		= iolat_files,
+
+	.pd_init_fn		= iolat_pd_init,
+	.pd_offline_fn		= iolat_pd_offline,
+	.pd_reset_stats_fn	= iolat_pd_reset_stats,
+};
+
+int blk_iolatency_init(struct request_queue *q)
+{
+	struct iolat_data *ild;
+	int ret;
+
+	ild = kzalloc_node(sizeof(*ild), GFP_KERNEL, q->node);
+	if (!ild)
+		return -ENOMEM;
+
+	spin_lock_init(&ild->lock);
+	ild->queue = q;
+	q->iolat = ild;
+
+	ret = blkcg_activate_policy(q, &blkcg_policy_iolat);
+	if (ret) {
+		q->iolat = NULL;
+		kfree(ild);
+	}
+	return ret;
+}
+
+void blk_iolatency_exit(struct request_queue *q)
+{
+	if (!q->iolat)
+		return;
+	blkcg_deactivate_policy(q, &blkcg_policy_iolat);
+	kfree(q->iolat);
+	q->iolat = NULL;
+}
+
+static int __init iolat_init(void)
+{
+	return blkcg_policy_register(&blkcg_policy_iolat);
+}
+
+module_init(iolat_init);
@@ -0,0 +1,169 @@
+/*
+ * Polled completion of synchronous reads
+ *
+ * A caller that is about to sleep on a read it just submitted can spin on
+ * the driver's completion path for a little while first, and save the
+ * interrupt, the wakeup and the context switch when the device is fast.
+ * The spin is bounded by an adaptive window: twice the mean time it took
+ * polled reads to complete, never more than io_poll_max_usec.  Polls that
+ * run out of window widen the mean; once it no longer fits, only one call
+ * in BLK_POLL_SAMPLE still polls, to notice when the device speeds up.
+ *
+ * Stats are updated without locking and may lose the odd count.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/interrupt.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
+
+#include "blk.h"
+
+/* While polling is off, poll once every BLK_POLL_SAMPLE calls */
+#define BLK_POLL_SAMPLE		16
+
+static u64 blk_poll_window(struct blk_poll_stats *ps, bool *skip)
+{
+	u64 max_ns = (u64)ps->max_usec * NSEC_PER_USEC;
+	u64 mean_ns = ACCESS_ONCE(ps->mean_ns);
+
+	*skip = false;
+	if (!mean_ns)
+		return max_ns;
+	if (2 * mean_ns > max_ns) {
+		*skip = ps->calls % BLK_POLL_SAMPLE;
+		return max_ns;
+	}
+	return 2 * mean_ns;
+}
+
+/**
+ * blk_poll - spin on @q's completions before sleeping on a read
+ * @q:		queue the read was submitted to
+ * @done:	returns true once the read has completed
+ * @data:	passed to @done
+ *
+ * Description:
+ *    Calls the driver's poll_fn until @done returns true, the poll window
+ *    runs out or somebody else wants the CPU.  Completions the driver
+ *    reaps run their softirq part here too, so that @done can see them.
+ *    Only meant for small synchronous reads the caller is about to wait
+ *    for; it still has to wait afterwards if this returns false.
+ *
+ *    Returns true if @done was seen while polling.
+ **/
+bool blk_poll(struct request_queue *q, bool (*done)(void *), void *data)
+{
+	struct blk_poll_stats *ps = &q->poll_stat;
+	u64 window_ns, start, elapsed, mean_ns;
+	bool skip;
+	int reaped;
+
+	if (!q->poll_fn || !test_bit(QUEUE_FLAG_POLL, &q->queue_flags))
+		return false;
+
+	/* inside generic_make_request(), nothing has been issued yet */
+	if (current->bio_list)
+		return false;
+
+	ps->calls++;
+	window_ns = blk_poll_window(ps, &skip);
+	if (skip) {
+		ps->skipped++;
+		return false;
+	}
+
+	/* a plugged read would never show up at the driver */
+	blk_flush_plug(current);
+
+	start = ktime_get_ns();
+	do {
+		if (done(data)) {
+			elapsed = ktime_get_ns() - start;
+			mean_ns = ps->mean_ns;
+			ps->mean_ns = mean_ns ? (3 * mean_ns + elapsed) / 4 :
+						elapsed;
+			ps->hits++;
+			return true;
+		}
+		/* not the device being slow, leave the window alone */
+		if (need_resched())
+			return false;
+
+		local_bh_disable();
+		reaped = q->poll_fn(q);
+		local_bh_enable();
+		if (reaped)
+			ps->reaped += reaped;
+		else
+			cpu_relax();
+	} while (ktime_get_ns() - start < window_ns);
+
+	/*
+	 * Slower than we thought, widen the window.  Past max_usec it only
+	 * decides whether to sample, so keep the mean there: it then takes
+	 * a few hits, not dozens, to come back once the device is fast.
+	 */
+	mean_ns = ps->mean_ns;
+	ps->mean_ns = min(max(mean_ns + mean_ns / 2, window_ns / 2 + 1),
+			  (u64)ps->max_usec * NSEC_PER_USEC);
+	ps->timeouts++;
+	return false;
+}
+EXPORT_SYMBOL(blk_poll);
+
+ssize_t blk_poll_max_show(struct request_queue *q, char *page)
+{
+	return sprintf(page, "%u\n", q->poll_stat.max_usec);
+}
+
+ssize_t blk_poll_max_store(struct request_queue *q, const char *page,
+			   size_t count)
+{
+	unsigned int val;
+	int err;
+
+	err = kstrtouint(page, 10, &val);
+	if (err)
+		return err;
+
+	q->poll_stat.max_usec = val;
+	/* relearn against the new bound */
+	q->poll_stat.mean_ns = 0;
+	return count;
+}
+
+ssize_t blk_poll_stats_show(struct request_queue *q, char *page)
+{
+	struct blk_poll_stats *ps = &q->poll_stat;
+	bool skip;
+
+	return sprintf(page,
+		       "calls %lu\n"
+		       "hits %lu\n"
+		       "timeouts %lu\n"
+		       "skipped %lu\n"
+		       "reaped %lu\n"
+		       "mean_usec %llu\n"
+		       "window_usec %llu\n",
+		       ps->calls, ps->hits, ps->timeouts, ps->skipped,
+		       ps->reaped, div_u64(ps->mean_ns, NSEC_PER_USEC),
+		       div_u64(blk_poll_window(ps, &skip), NSEC_PER_USEC));
+}
+
+/*
+ * Any write resets the counters, the learned mean is kept.
+ */
+ssize_t blk_poll_stats_store(struct request_queue *q, const char *page,
+			     size_t count)
+{
+	struct blk_poll_stats *ps = &q->poll_stat;
+
+	ps->calls = 0;
+	ps->hits = 0;
+	ps->timeouts = 0;
+	ps->skipped = 0;
+	ps->reaped = 0;
+	return count;
+}
@@ -99,6 +99,25 @@ void blk_queue_lld_busy(struct request_queue *q, lld_busy_fn *fn)
 }
 EXPORT_SYMBOL_GPL(blk_queue_lld_busy);
 
+/**
+ * blk_queue_poll - set driver's completion poll function for the queue
+ * @q:  the request queue for the device
+ * @fn: reaps completed requests without waiting for the interrupt,
+ *	returns the number it completed
+ *
+ * Description:
+ *    Turns on polled completion of synchronous reads, see blk_poll().
+ *    @fn is called from process context with bottom halves disabled and
+ *    has to take whatever locks the interrupt handler takes.
+ **/
+void blk_queue_poll(struct request_queue *q, poll_fn *fn)
+{
+	q->poll_fn = fn;
+	q->poll_stat.max_usec = BLK_POLL_DEF_MAX_USEC;
+	queue_flag_set_unlocked(QUEUE_FLAG_POLL, q);
+}
+EXPORT_SYMBOL_GPL(blk_queue_poll);
+
 /**
  * blk_set_default_limits - reset limits to default values
  * @lim:  the queue_limits structure to reset
@@ -0,0 +1,312 @@
+/*
+ * Buffered writeback throttling on a request queue
+ *
+ * Background writes are only allowed a limited number of requests in
+ * flight, kswapd and everybody else (the flusher threads) each with their
+ * own limit.  The limits follow the completion latency of synchronous I/O:
+ * a window in which the fastest synchronous request still took longer
+ * than the target halves them, a window that met the target, or had no
+ * synchronous I/O at all, doubles them back towards the queue depth.
+ *
+ * Everything runs under the queue lock, so request_fn queues only.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/swap.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
+
+#include "blk.h"
+
+/* Default latency targets, usecs */
+#define WBT_DEF_LAT_NONROT	2000
+#define WBT_DEF_LAT_ROT		75000
+
+/* Length of a sampling window */
+#define WBT_WINDOW		(HZ / 10)
+
+enum {
+	WBT_KSWAPD,
+	WBT_BACKGROUND,
+	WBT_NR,
+};
+
+/* rq->wbt_flags is the class plus one, zero for untracked requests */
+#define WBT_FLAGS(class)	((class) + 1)
+#define WBT_CLASS(flags)	((flags) - 1)
+
+struct rq_wb {
+	int lat_target;			/* usecs, 0 disables, -1 default */
+	unsigned int scale_step;	/* limits are queue depth >> step */
+
+	unsigned int inflight[WBT_NR];
+	wait_queue_head_t wait[WBT_NR];
+
+	/* current sampling window */
+	unsigned long window_start;
+	unsigned int window_sync;	/* synchronous completions */
+	unsigned int window_writes;	/* tracked write completions */
+	u64 window_min_ns;		/* fastest synchronous completion */
+
+	/* stats */
+	u64 last_min_ns;
+	unsigned long throttled[WBT_NR];
+	unsigned long scale_downs;
+	unsigned long scale_ups;
+};
+
+static int wbt_lat_target(struct request_queue *q, struct rq_wb *rwb)
+{
+	if (rwb->lat_target >= 0)
+		return rwb->lat_target;
+	return blk_queue_nonrot(q) ? WBT_DEF_LAT_NONROT : WBT_DEF_LAT_ROT;
+}
+
+static unsigned int wbt_limit(struct request_queue *q, struct rq_wb *rwb,
+			      int class)
+{
+	unsigned int depth = max(q->nr_requests >> rwb->scale_step, 1UL);
+
+	/*
+	 * kswapd is cleaning pages somebody is waiting to allocate, it
+	 * gets the whole depth, the flushers half of it.
+	 */
+	if (class == WBT_BACKGROUND)
+		depth = max(depth / 2, 1U);
+	return depth;
+}
+
+static void wbt_wake_all(struct rq_wb *rwb)
+{
+	int i;
+
+	for (i = 0; i < WBT_NR; i++)
+		wake_up_all(&rwb->wait[i]);
+}
+
+static void wbt_window_reset(struct rq_wb *rwb)
+{
+	rwb->window_start = jiffies;
+	rwb->window_sync = 0;
+	rwb->window_writes = 0;
+	rwb->window_min_ns = U64_MAX;
+}
+
+/*
+ * Close the window once it has run its length, and move the limits.
+ */
+static void wbt_window_check(struct request_queue *q, struct rq_wb *rwb)
+{
+	u64 target_ns;
+
+	if (time_before(jiffies, rwb->window_start + WBT_WINDOW))
+		return;
+
+	target_ns = (u64)wbt_lat_target(q, rwb) * NSEC_PER_USEC;
+
+	if (rwb->window_sync) {
+		rwb->last_min_ns = rwb->window_min_ns;
+		if (rwb->window_min_ns > target_ns) {
+			if ((q->nr_requests >> rwb->scale_step) > 1) {
+				rwb->scale_step++;
+				rwb->scale_downs++;
+			}
+		} else if (rwb->scale_step) {
+			rwb->scale_step--;
+			rwb->scale_ups++;
+			wbt_wake_all(rwb);
+		}
+	} else if (rwb->window_writes && rwb->scale_step) {
+		/* only writeback around, nothing to protect */
+		rwb->scale_step--;
+		rwb->scale_ups++;
+		wbt_wake_all(rwb);
+	}
+
+	wbt_window_reset(rwb);
+}
+
+static bool wbt_should_throttle(struct bio *bio)
+{
+	if (bio_data_dir(bio) != WRITE)
+		return false;
+	return !(bio->bi_rw & (REQ_SYNC | REQ_FLUSH | REQ_FUA | REQ_DISCARD));
+}
+
+/*
+ * Called from blk_queue_bio() before a request is allocated for @bio.  May
+ * drop the queue lock and sleep until the submitter's class is under its
+ * limit.  Returns the flags the new request has to carry, which hold one
+ * slot until blk_wbt_done() or blk_wbt_release().
+ */
+unsigned char blk_wbt_wait(struct request_queue *q, struct bio *bio)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	int class;
+	DEFINE_WAIT(wait);
+
+	if (!rwb || !wbt_lat_target(q, rwb) || !wbt_should_throttle(bio))
+		return 0;
+
+	class = current_is_kswapd() ? WBT_KSWAPD : WBT_BACKGROUND;
+
+	if (rwb->inflight[class] >= wbt_limit(q, rwb, class)) {
+		rwb->throttled[class]++;
+		do {
+			prepare_to_wait_exclusive(&rwb->wait[class], &wait,
+						  TASK_UNINTERRUPTIBLE);
+			if (rwb->inflight[class] < wbt_limit(q, rwb, class))
+				break;
+			spin_unlock_irq(q->queue_lock);
+			io_schedule();
+			spin_lock_irq(q->queue_lock);
+		} while (1);
+		finish_wait(&rwb->wait[class], &wait);
+	}
+
+	rwb->inflight[class]++;
+	return WBT_FLAGS(class);
+}
+
+/*
+ * Give back a slot that never became a completed request: the bio was
+ * merged after all, or the request was merged into another one.
+ */
+void blk_wbt_release(struct request_queue *q, unsigned char flags)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	int class;
+
+	if (!rwb || !flags)
+		return;
+
+	class = WBT_CLASS(flags);
+	rwb->inflight[class]--;
+	if (rwb->inflight[class] < wbt_limit(q, rwb, class))
+		wake_up(&rwb->wait[class]);
+}
+
+void blk_wbt_issue(struct request_queue *q, struct request *rq)
+{
+	if (q->rq_wb)
+		rq->wbt_issue_ns = ktime_get_ns();
+}
+
+void blk_wbt_done(struct request_queue *q, struct request *rq)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return;
+
+	if (rq->wbt_flags) {
+		blk_wbt_release(q, rq->wbt_flags);
+		rq->wbt_flags = 0;
+		rwb->window_writes++;
+	} else if (rq->cmd_type == REQ_TYPE_FS && rq_is_sync(rq) &&
+		   rq->wbt_issue_ns) {
+		u64 lat = ktime_get_ns() - rq->wbt_issue_ns;
+
+		rwb->window_sync++;
+		if (lat < rwb->window_min_ns)
+			rwb->window_min_ns = lat;
+	}
+
+	wbt_window_check(q, rwb);
+}
+
+int blk_wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+	int i;
+
+	rwb = kzalloc_node(sizeof(*rwb), GFP_KERNEL, q->node);
+	if (!rwb)
+		return -ENOMEM;
+
+	rwb->lat_target = -1;
+	for (i = 0; i < WBT_NR; i++)
+		init_waitqueue_head(&rwb->wait[i]);
+	wbt_window_reset(rwb);
+
+	q->rq_wb = rwb;
+	return 0;
+}
+
+void blk_wbt_exit(struct request_queue *q)
+{
+	kfree(q->rq_wb);
+	q->rq_wb = NULL;
+}
+
+ssize_t blk_wbt_lat_show(struct request_queue *q, char *page)
+{
+	if (!q->rq_wb)
+		return -EINVAL;
+	return sprintf(page, "%d\n", wbt_lat_target(q, q->rq_wb));
+}
+
+/*
+ * 0 turns throttling off, -1 goes back to the default for the device
+ */
+ssize_t blk_wbt_lat_store(struct request_queue *q, const char *page,
+			  size_t count)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	int val, err;
+
+	if (!rwb)
+		return -EINVAL;
+
+	err = kstrtoint(page, 10, &val);
+	if (err)
+		return err;
+	if (val < -1)
+		return -EINVAL;
+
+	spin_lock_irq(q->queue_lock);
+	rwb->lat_target = val;
+	rwb->scale_step = 0;
+	wbt_window_reset(rwb);
+	wbt_wake_all(rwb);
+	spin_unlock_irq(q->queue_lock);
+
+	return count;
+}
+
+ssize_t blk_wbt_stats_show(struct request_queue *q, char *page)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	ssize_t len;
+
+	if (!rwb)
+		return -EINVAL;
+
+	spin_lock_irq(q->queue_lock);
+	len = sprintf(page,
+		      "scale_step %u\n"
+		      "scale_downs %lu\n"
+		      "scale_ups %lu\n"
+		      "min_sync_lat_usec %llu\n"
+		      "kswapd_limit %u\n"
+		      "kswapd_inflight %u\n"
+		      "kswapd_throttled %lu\n"
+		      "background_limit %u\n"
+		      "background_inflight %u\n"
+		      "background_throttled %lu\n",
+		      rwb->scale_step, rwb->scale_downs, rwb->scale_ups,
+		      div_u64(rwb->last_min_ns, NSEC_PER_USEC),
+		      wbt_limit(q, rwb, WBT_KSWAPD),
+		      rwb->inflight[WBT_KSWAPD],
+		      rwb->throttled[WBT_KSWAPD],
+		      wbt_limit(q, rwb, WBT_BACKGROUND),
+		      rwb->inflight[WBT_BACKGROUND],
+		      rwb->throttled[WBT_BACKGROUND]);
+	spin_unlock_irq(q->queue_lock);
+
+	return len;
+}
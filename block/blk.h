@@ -287,4 +287,69 @@ static inline int blk_throtl_init(struct request_queue *q) { return 0; }
 static inline void blk_throtl_exit(struct request_queue *q) { }
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
+/*
+ * Internal cgroup I/O latency interface
+ */
+#ifdef CONFIG_BLK_CGROUP_IOLATENCY
+extern void blk_iolatency_bio(struct request_queue *q, struct bio *bio);
+extern void blk_iolatency_done(struct bio *bio);
+extern int blk_iolatency_init(struct request_queue *q);
+extern void blk_iolatency_exit(struct request_queue *q);
+#else /* CONFIG_BLK_CGROUP_IOLATENCY */
+static inline void blk_iolatency_bio(struct request_queue *q,
+				     struct bio *bio) { }
+static inline void blk_iolatency_done(struct bio *bio) { }
+static inline int blk_iolatency_init(struct request_queue *q) { return 0; }
+static inline void blk_iolatency_exit(struct request_queue *q) { }
+#endif /* CONFIG_BLK_CGROUP_IOLATENCY */
+
+/*
+ * Writeback throttling, all but init/exit and the sysfs helpers are
+ * called with the queue lock held
+ */
+#ifdef CONFIG_BLK_WBT
+extern int blk_wbt_init(struct request_queue *q);
+extern void blk_wbt_exit(struct request_queue *q);
+extern unsigned char blk_wbt_wait(struct request_queue *q, struct bio *bio);
+extern void blk_wbt_release(struct request_queue *q, unsigned char flags);
+extern void blk_wbt_issue(struct request_queue *q, struct request *rq);
+extern void blk_wbt_done(struct request_queue *q, struct request *rq);
+extern ssize_t blk_wbt_lat_show(struct request_queue *q, char *page);
+extern ssize_t blk_wbt_lat_store(struct request_queue *q, const char *page,
+				 size_t count);
+extern ssize_t blk_wbt_stats_show(struct request_queue *q, char *page);
+
+static inline void blk_wbt_set_rq(struct request *rq, unsigned char flags)
+{
+	rq->wbt_flags = flags;
+}
+#else /* CONFIG_BLK_WBT */
+static inline int blk_wbt_init(struct request_queue *q) { return 0; }
+static inline void blk_wbt_exit(struct request_queue *q) { }
+static inline unsigned char blk_wbt_wait(struct request_queue *q,
+					 struct bio *bio)
+{
+	return 0;
+}
+static inline void blk_wbt_release(struct request_queue *q,
+				   unsigned char flags) { }
+static inline void blk_wbt_issue(struct request_queue *q,
+				 struct request *rq) { }
+static inline void blk_wbt_done(struct request_queue *q,
+				struct request *rq) { }
+static inline void blk_wbt_set_rq(struct request *rq, unsigned char flags) { }
+#endif /* CONFIG_BLK_WBT */
+
+/*
+ * Polled completion of sync reads
+ */
+#define BLK_POLL_DEF_MAX_USEC	200
+
+extern ssize_t blk_poll_max_show(struct request_queue *q, char *page);
+extern ssize_t blk_poll_max_store(struct request_queue *q, const char *page,
+				  size_t count);
+extern ssize_t blk_poll_stats_show(struct request_queue *q, char *page);
+extern ssize_t blk_poll_stats_store(struct request_queue *q, const char *page,
+				    size_t count);
+
 #endif /* BLK_INTERNAL_H */
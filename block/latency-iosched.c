@@ -0,0 +1,575 @@
+/*
+ *  Latency target i/o scheduler for flash storage.
+ *
+ *  Based on the deadline i/o scheduler, Copyright (C) 2002 Jens Axboe.
+ *
+ *  Flash has no seek penalty, so requests are served in FIFO order per
+ *  class instead of being sorted by sector.  Synchronous reads always go
+ *  ahead of writes (bounded by writes_starved), reads from tasks in the
+ *  RT io priority class go ahead of everything else, and the number of
+ *  asynchronous writes in flight is cut back whenever the observed read
+ *  latency goes above target_latency_us.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+#include <linux/ioprio.h>
+#include <linux/iocontext.h>
+#include <linux/ktime.h>
+
+static const int target_latency = 2000;	/* read latency target, usecs */
+static const int max_async_depth = 32;	/* async writes in flight, upper bound */
+static const int writes_starved = 2;	/* max times reads can starve a write */
+static const int write_expire = 5 * HZ;	/* async writes bypass the throttle after this */
+static const int adjust_interval = HZ / 10;	/* min time between depth changes */
+
+enum {
+	LAT_RT,		/* RT io priority class, any direction */
+	LAT_READ,	/* synchronous reads */
+	LAT_SYNC_WRITE,	/* synchronous (O_SYNC, fsync) writes */
+	LAT_ASYNC,	/* buffered writeback */
+	LAT_NR_CLASSES,
+};
+
+static const char *const lat_class_name[LAT_NR_CLASSES] = {
+	[LAT_RT]		= "rt",
+	[LAT_READ]		= "read",
+	[LAT_SYNC_WRITE]	= "sync_write",
+	[LAT_ASYNC]		= "async",
+};
+
+/* log2 buckets of completion latency in usecs, the last one open ended */
+#define LAT_HIST_BUCKETS	24
+
+struct lat_hist {
+	unsigned long nr;
+	unsigned long bucket[LAT_HIST_BUCKETS];
+};
+
+struct latency_data {
+	struct request_queue *q;
+
+	/*
+	 * requests are on one fifo per class, and on a sort_list per data
+	 * direction which is only used to find front merges
+	 */
+	struct rb_root sort_list[2];
+	struct list_head fifo_list[LAT_NR_CLASSES];
+
+	unsigned int starved;		/* times reads have starved writes */
+	int async_in_flight;
+	int async_depth;		/* current async write limit */
+	bool async_blocked;		/* dispatch held back an async write */
+
+	unsigned int read_lat_avg;	/* ewma of read latency, usecs */
+	unsigned long last_adjust;	/* jiffies of last async_depth change */
+	unsigned long last_read;	/* jiffies of last read completion */
+
+	struct lat_hist hist[LAT_NR_CLASSES];
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int target_latency;
+	int max_async_depth;
+	int writes_starved;
+	int write_expire;
+	int front_merges;
+};
+
+/*
+ * The insertion time and class are kept in the request's elevator private
+ * data.  Only the low 32 bits of the usec clock are stored, latencies are
+ * computed modulo 2^32 which is fine for anything shorter than an hour.
+ */
+static inline u32 lat_now_us(void)
+{
+	return (u32)ktime_to_us(ktime_get());
+}
+
+static inline int lat_rq_class(struct request *rq)
+{
+	return (int)(unsigned long)rq->elv.priv[1];
+}
+
+static inline struct rb_root *
+lat_rb_root(struct latency_data *ld, struct request *rq)
+{
+	return &ld->sort_list[rq_data_dir(rq)];
+}
+
+/*
+ * Classify the request in the context of the task that submits it, so the
+ * io priority of the foreground task is what counts.
+ */
+static int lat_set_request(struct request_queue *q, struct request *rq,
+			   struct bio *bio, gfp_t gfp_mask)
+{
+	struct io_context *ioc = current->io_context;
+	int class;
+
+	if (ioc && IOPRIO_PRIO_CLASS(ioc->ioprio) == IOPRIO_CLASS_RT &&
+	    rq_is_sync(rq))
+		class = LAT_RT;
+	else if (rq_data_dir(rq) == READ)
+		class = LAT_READ;
+	else if (rq_is_sync(rq))
+		class = LAT_SYNC_WRITE;
+	else
+		class = LAT_ASYNC;
+
+	rq->elv.priv[1] = (void *)(unsigned long)class;
+	return 0;
+}
+
+/*
+ * add rq to rbtree and its class fifo
+ */
+static void lat_add_request(struct request_queue *q, struct request *rq)
+{
+	struct latency_data *ld = q->elevator->elevator_data;
+
+	elv_rb_add(lat_rb_root(ld, rq), rq);
+
+	rq->elv.priv[0] = (void *)(unsigned long)lat_now_us();
+	rq->fifo_time = jiffies + ld->write_expire;
+	list_add_tail(&rq->queuelist, &ld->fifo_list[lat_rq_class(rq)]);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void lat_remove_request(struct request_queue *q, struct request *rq)
+{
+	struct latency_data *ld = q->elevator->elevator_data;
+
+	rq_fifo_clear(rq);
+	elv_rb_del(lat_rb_root(ld, rq), rq);
+}
+
+static int
+lat_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct latency_data *ld = q->elevator->elevator_data;
+	struct request *__rq;
+
+	/*
+	 * check for front merge
+	 */
+	if (ld->front_merges) {
+		sector_t sector = bio_end_sector(bio);
+
+		__rq = elv_rb_find(&ld->sort_list[bio_data_dir(bio)], sector);
+		if (__rq) {
+			BUG_ON(sector != blk_rq_pos(__rq));
+
+			if (elv_rq_merge_ok(__rq, bio)) {
+				*req = __rq;
+				return ELEVATOR_FRONT_MERGE;
+			}
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void lat_merged_request(struct request_queue *q,
+			       struct request *req, int type)
+{
+	struct latency_data *ld = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(lat_rb_root(ld, req), req);
+		elv_rb_add(lat_rb_root(ld, req), req);
+	}
+}
+
+static void
+lat_merged_requests(struct request_queue *q, struct request *req,
+		    struct request *next)
+{
+	/*
+	 * if next was queued before rq, take over its place in the fifo
+	 * and its insertion time, so the merged request is not penalised
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist) &&
+	    lat_rq_class(req) == lat_rq_class(next)) {
+		if (time_before(next->fifo_time, req->fifo_time)) {
+			list_move(&req->queuelist, &next->queuelist);
+			req->fifo_time = next->fifo_time;
+			req->elv.priv[0] = next->elv.priv[0];
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	lat_remove_request(q, next);
+}
+
+/*
+ * move request from the fifo to dispatch queue.
+ */
+static void lat_move_to_dispatch(struct latency_data *ld, struct request *rq)
+{
+	if (lat_rq_class(rq) == LAT_ASYNC)
+		ld->async_in_flight++;
+
+	lat_remove_request(ld->q, rq);
+	elv_dispatch_add_tail(ld->q, rq);
+}
+
+/*
+ * May another async write go to the driver?  A write that has waited past
+ * write_expire goes regardless, so writeback can't be starved forever by a
+ * read latency that the writes are not responsible for.
+ */
+static bool lat_may_dispatch_async(struct latency_data *ld, int force)
+{
+	struct request *rq;
+
+	if (force || ld->async_in_flight < ld->async_depth)
+		return true;
+
+	rq = rq_entry_fifo(ld->fifo_list[LAT_ASYNC].next);
+	return time_after_eq(jiffies, rq->fifo_time);
+}
+
+static int lat_dispatch_requests(struct request_queue *q, int force)
+{
+	struct latency_data *ld = q->elevator->elevator_data;
+	const int reads = !list_empty(&ld->fifo_list[LAT_READ]);
+	const int sync_writes = !list_empty(&ld->fifo_list[LAT_SYNC_WRITE]);
+	const int async = !list_empty(&ld->fifo_list[LAT_ASYNC]);
+	int class;
+
+	/*
+	 * RT io priority requests go first.  Nothing here idles waiting for
+	 * the next request of a stream: flash has no seek to save.
+	 */
+	if (!list_empty(&ld->fifo_list[LAT_RT])) {
+		class = LAT_RT;
+		goto dispatch;
+	}
+
+	if (reads) {
+		if ((sync_writes || async) &&
+		    ld->starved++ >= ld->writes_starved)
+			goto dispatch_writes;
+
+		class = LAT_READ;
+		goto dispatch;
+	}
+
+dispatch_writes:
+	ld->starved = 0;
+
+	if (sync_writes) {
+		class = LAT_SYNC_WRITE;
+		goto dispatch;
+	}
+
+	if (async) {
+		/*
+		 * Without recent reads there is no latency to protect, let
+		 * writeback use the whole queue again.
+		 */
+		if (time_after(jiffies, ld->last_read + HZ))
+			ld->async_depth = ld->max_async_depth;
+
+		if (lat_may_dispatch_async(ld, force)) {
+			class = LAT_ASYNC;
+			goto dispatch;
+		}
+		ld->async_blocked = true;
+	}
+
+	/* Writes were picked over reads but could not go, serve the read */
+	if (reads) {
+		class = LAT_READ;
+		goto dispatch;
+	}
+
+	return 0;
+
+dispatch:
+	lat_move_to_dispatch(ld, rq_entry_fifo(ld->fifo_list[class].next));
+	return 1;
+}
+
+/*
+ * Additive increase, multiplicative decrease of the async write depth,
+ * driven by an ewma of read latency.  At most one step per adjust_interval
+ * so a burst of slow completions only halves the depth once.
+ */
+static void lat_update_async_depth(struct latency_data *ld, u32 lat)
+{
+	ld->read_lat_avg = (ld->read_lat_avg * 7 + lat) / 8;
+	ld->last_read = jiffies;
+
+	if (time_before(jiffies, ld->last_adjust + adjust_interval))
+		return;
+
+	if (ld->read_lat_avg > ld->target_latency) {
+		ld->async_depth = max(ld->async_depth / 2, 1);
+		ld->last_adjust = jiffies;
+	} else if (ld->read_lat_avg < ld->target_latency / 2 &&
+		   ld->async_depth < ld->max_async_depth) {
+		ld->async_depth++;
+		ld->last_adjust = jiffies;
+	}
+}
+
+static void lat_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct latency_data *ld = q->elevator->elevator_data;
+	int class = lat_rq_class(rq);
+	u32 lat = lat_now_us() - (u32)(unsigned long)rq->elv.priv[0];
+	struct lat_hist *hist = &ld->hist[class];
+
+	hist->nr++;
+	hist->bucket[min(fls(lat), LAT_HIST_BUCKETS - 1)]++;
+
+	if (class == LAT_RT || class == LAT_READ)
+		lat_update_async_depth(ld, lat);
+
+	if (class == LAT_ASYNC) {
+		ld->async_in_flight--;
+		/*
+		 * Not every driver reruns the queue after a completion, the
+		 * write held back above must not wait for the next request.
+		 */
+		if (ld->async_blocked) {
+			ld->async_blocked = false;
+			blk_run_queue_async(q);
+		}
+	}
+}
+
+static void lat_exit_queue(struct elevator_queue *e)
+{
+	struct latency_data *ld = e->elevator_data;
+	int i;
+
+	for (i = 0; i < LAT_NR_CLASSES; i++)
+		BUG_ON(!list_empty(&ld->fifo_list[i]));
+
+	kfree(ld);
+}
+
+/*
+ * initialize elevator private data (latency_data).
+ */
+static int lat_init_queue(struct request_queue *q, struct elevator_type *e)
+{
+	struct latency_data *ld;
+	struct elevator_queue *eq;
+	int i;
+
+	eq = elevator_alloc(q, e);
+	if (!eq)
+		return -ENOMEM;
+
+	ld = kzalloc_node(sizeof(*ld), GFP_KERNEL, q->node);
+	if (!ld) {
+		kobject_put(&eq->kobj);
+		return -ENOMEM;
+	}
+	eq->elevator_data = ld;
+
+	ld->q = q;
+	for (i = 0; i < LAT_NR_CLASSES; i++)
+		INIT_LIST_HEAD(&ld->fifo_list[i]);
+	ld->sort_list[READ] = RB_ROOT;
+	ld->sort_list[WRITE] = RB_ROOT;
+	ld->target_latency = target_latency;
+	ld->max_async_depth = max_async_depth;
+	ld->async_depth = max_async_depth;
+	ld->writes_starved = writes_starved;
+	ld->write_expire = write_expire;
+	ld->front_merges = 1;
+	ld->last_adjust = jiffies;
+	ld->last_read = jiffies;
+
+	spin_lock_irq(q->queue_lock);
+	q->elevator = eq;
+	spin_unlock_irq(q->queue_lock);
+	return 0;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+lat_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+lat_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct latency_data *ld = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return lat_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(lat_target_latency_us_show, ld->target_latency, 0);
+SHOW_FUNCTION(lat_max_async_depth_show, ld->max_async_depth, 0);
+SHOW_FUNCTION(lat_async_depth_show, ld->async_depth, 0);
+SHOW_FUNCTION(lat_writes_starved_show, ld->writes_starved, 0);
+SHOW_FUNCTION(lat_write_expire_show, ld->write_expire, 1);
+SHOW_FUNCTION(lat_front_merges_show, ld->front_merges, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct latency_data *ld = e->elevator_data;			\
+	int __data;							\
+	int ret = lat_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(lat_target_latency_us_store, &ld->target_latency, 1, INT_MAX, 0);
+STORE_FUNCTION(lat_max_async_depth_store, &ld->max_async_depth, 1, INT_MAX, 0);
+STORE_FUNCTION(lat_writes_starved_store, &ld->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(lat_write_expire_store, &ld->write_expire, 0, INT_MAX, 1);
+STORE_FUNCTION(lat_front_merges_store, &ld->front_merges, 0, 1, 0);
+#undef STORE_FUNCTION
+
+/*
+ * Upper bound, in usecs, of the bucket holding the pct'th percentile.
+ */
+static unsigned long lat_hist_pct(const struct lat_hist *hist, int pct)
+{
+	u64 want = div_u64((u64)hist->nr * pct + 99, 100);
+	unsigned long seen = 0;
+	int i;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen >= want)
+			return 1UL << i;
+	}
+	return 1UL << (LAT_HIST_BUCKETS - 1);
+}
+
+static ssize_t lat_latency_stats_show(struct elevator_queue *e, char *page)
+{
+	struct latency_data *ld = e->elevator_data;
+	struct lat_hist hist;
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < LAT_NR_CLASSES; i++) {
+		spin_lock_irq(ld->q->queue_lock);
+		hist = ld->hist[i];
+		spin_unlock_irq(ld->q->queue_lock);
+
+		if (!hist.nr) {
+			len += sprintf(page + len, "%s 0 0 0 0\n",
+				       lat_class_name[i]);
+			continue;
+		}
+		len += sprintf(page + len, "%s %lu %lu %lu %lu\n",
+			       lat_class_name[i], hist.nr,
+			       lat_hist_pct(&hist, 50),
+			       lat_hist_pct(&hist, 90),
+			       lat_hist_pct(&hist, 99));
+	}
+	return len;
+}
+
+/*
+ * Any write clears the histograms.
+ */
+static ssize_t lat_latency_stats_store(struct elevator_queue *e,
+				       const char *page, size_t count)
+{
+	struct latency_data *ld = e->elevator_data;
+
+	spin_lock_irq(ld->q->queue_lock);
+	memset(ld->hist, 0, sizeof(ld->hist));
+	spin_unlock_irq(ld->q->queue_lock);
+	return count;
+}
+
+#define LAT_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, lat_##name##_show, \
+				      lat_##name##_store)
+
+static struct elv_fs_entry lat_attrs[] = {
+	LAT_ATTR(target_latency_us),
+	LAT_ATTR(max_async_depth),
+	__ATTR(async_depth, S_IRUGO, lat_async_depth_show, NULL),
+	LAT_ATTR(writes_starved),
+	LAT_ATTR(write_expire),
+	LAT_ATTR(front_merges),
+	LAT_ATTR(latency_stats),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_latency = {
+	.ops = {
+		.elevator_merge_fn = 		lat_merge,
+		.elevator_merged_fn =		lat_merged_request,
+		.elevator_merge_req_fn =	lat_merged_requests,
+		.elevator_dispatch_fn =		lat_dispatch_requests,
+		.elevator_add_req_fn =		lat_add_request,
+		.elevator_completed_req_fn =	lat_completed_request,
+		.elevator_set_req_fn =		lat_set_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_init_fn =		lat_init_queue,
+		.elevator_exit_fn =		lat_exit_queue,
+	},
+
+	.elevator_attrs = lat_attrs,
+	.elevator_name = "latency",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init latency_init(void)
+{
+	return elv_register(&iosched_latency);
+}
+
+static void __exit latency_exit(void)
+{
+	elv_unregister(&iosched_latency);
+}
+
+module_init(latency_init);
+module_exit(latency_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("latency target IO scheduler for flash");
@@ -20,6 +20,7 @@
 #include <linux/cpumask.h>
 #include <linux/cpufreq.h>
 #include <linux/ipa.h>
+#include <linux/irq_work.h>
 #include <linux/module.h>
 #include <linux/moduleparam.h>
 #include <linux/rwsem.h>
@@ -63,6 +64,10 @@ struct cpufreq_interactive_cpuinfo {
 	u64 loc_hispeed_val_time; /* per-cpu hispeed_validate_time */
 	struct rw_semaphore enable_sem;
 	int governor_enabled;
+	int cpu;
+	struct update_util_data update_util;
+	u64 target_set_time; /* last change of target_freq */
+	u64 demand_time; /* load first exceeded the current speed */
 };
 
 static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, cpuinfo);
@@ -71,6 +76,7 @@ static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, cpuinfo);
 struct task_struct *speedchange_task;
 static cpumask_t speedchange_cpumask;
 static spinlock_t speedchange_cpumask_lock;
+static struct irq_work speedchange_irq_work;
 static struct mutex gov_lock;
 
 /* Target load.  Lower values result in higher CPU speeds. */
@@ -125,6 +131,18 @@ struct cpufreq_interactive_tunables {
 	int timer_slack_val;
 	bool io_is_busy;
 
+	/*
+	 * Pick frequencies from the scheduler's load tracking, as tasks are
+	 * enqueued and dequeued, rather than from idle time on the timer.
+	 * The rate limits are the minimum time between two changes of the
+	 * target made from scheduler callbacks, up and down.
+	 */
+	bool sched_driven;
+#define DEFAULT_SCHED_UP_RATE_LIMIT (500)
+	unsigned long sched_up_rate_limit;
+#define DEFAULT_SCHED_DOWN_RATE_LIMIT DEFAULT_TIMER_RATE
+	unsigned long sched_down_rate_limit;
+
 	/* handle for get cpufreq_policy */
 	unsigned int *policy;
 };
@@ -350,39 +368,25 @@ static u64 update_load(int cpu)
 	return now;
 }
 
-static void cpufreq_interactive_timer(unsigned long data)
+/*
+ * Picks a new target for @cpu from @loadadjfreq, its load in percent times
+ * the current frequency, and hands it to the speedchange task.  From the
+ * scheduler hook the rq lock is held, so the task is kicked through an
+ * irq_work instead of being woken directly.
+ */
+static void cpufreq_interactive_eval(struct cpufreq_interactive_cpuinfo *pcpu,
+				     int cpu, u64 now, unsigned int loadadjfreq,
+				     bool from_sched)
 {
-	u64 now;
-	unsigned int delta_time;
-	u64 cputime_speedadj;
-	int cpu_load;
-	struct cpufreq_interactive_cpuinfo *pcpu =
-		&per_cpu(cpuinfo, data);
 	struct cpufreq_interactive_tunables *tunables =
 		pcpu->policy->governor_data;
 	unsigned int new_freq;
-	unsigned int loadadjfreq;
 	unsigned int index;
 	unsigned long flags;
 	u64 max_fvtime;
-
-	if (!down_read_trylock(&pcpu->enable_sem))
-		return;
-	if (!pcpu->governor_enabled)
-		goto exit;
-
-	spin_lock_irqsave(&pcpu->load_lock, flags);
-	now = update_load(data);
-	delta_time = (unsigned int)(now - pcpu->cputime_speedadj_timestamp);
-	cputime_speedadj = pcpu->cputime_speedadj;
-	spin_unlock_irqrestore(&pcpu->load_lock, flags);
-
-	if (WARN_ON_ONCE(!delta_time))
-		goto rearm;
+	int cpu_load;
 
 	spin_lock_irqsave(&pcpu->target_freq_lock, flags);
-	do_div(cputime_speedadj, delta_time);
-	loadadjfreq = (unsigned int)cputime_speedadj * 100;
 	cpu_load = loadadjfreq / pcpu->policy->cur;
 	tunables->boosted = tunables->boost_val || now < tunables->boostpulse_endtime;
 
@@ -404,22 +408,28 @@ static void cpufreq_interactive_timer(unsigned long data)
 
 	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
 					   new_freq, CPUFREQ_RELATION_L,
-					   &index)) {
-		spin_unlock_irqrestore(&pcpu->target_freq_lock, flags);
-		goto rearm;
-	}
+					   &index))
+		goto unlock;
 
 	new_freq = pcpu->freq_table[index].frequency;
 
+	/* The scheduler calls in far more often than the timer fires */
+	if (from_sched &&
+	    ((new_freq > pcpu->target_freq &&
+	      now - pcpu->target_set_time < tunables->sched_up_rate_limit) ||
+	     (new_freq < pcpu->target_freq &&
+	      now - pcpu->target_set_time < tunables->sched_down_rate_limit)))
+		goto unlock;
+
 	if (pcpu->policy->cur >= tunables->hispeed_freq &&
 	    new_freq > pcpu->policy->cur &&
 	    now - pcpu->pol_hispeed_val_time <
 	    freq_to_above_hispeed_delay(tunables, pcpu->policy->cur)) {
 		trace_cpufreq_interactive_notyet(
-			data, cpu_load, pcpu->target_freq,
+			cpu, cpu_load, pcpu->target_freq,
 			pcpu->policy->cur, new_freq);
-		spin_unlock_irqrestore(&pcpu->target_freq_lock, flags);
-		goto target_update;
+		pcpu->target_freq = pcpu->policy->cur;
+		goto unlock;
 	}
 
 	pcpu->loc_hispeed_val_time = now;
@@ -433,10 +443,9 @@ static void cpufreq_interactive_timer(unsigned long data)
 	    pcpu->target_freq >= pcpu->policy->cur) {
 		if (now - max_fvtime < tunables->min_sample_time) {
 			trace_cpufreq_interactive_notyet(
-				data, cpu_load, pcpu->target_freq,
+				cpu, cpu_load, pcpu->target_freq,
 				pcpu->policy->cur, new_freq);
-			spin_unlock_irqrestore(&pcpu->target_freq_lock, flags);
-			goto rearm;
+			goto unlock;
 		}
 	}
 
@@ -458,26 +467,143 @@ static void cpufreq_interactive_timer(unsigned long data)
 	if (pcpu->target_freq == new_freq &&
 			pcpu->target_freq <= pcpu->policy->cur) {
 		trace_cpufreq_interactive_already(
-			data, cpu_load, pcpu->target_freq,
+			cpu, cpu_load, pcpu->target_freq,
 			pcpu->policy->cur, new_freq);
-		spin_unlock_irqrestore(&pcpu->target_freq_lock, flags);
-		goto rearm;
+		goto unlock;
 	}
 
-	trace_cpufreq_interactive_target(data, cpu_load, pcpu->target_freq,
+	trace_cpufreq_interactive_target(cpu, cpu_load, pcpu->target_freq,
 					 pcpu->policy->cur, new_freq);
 
+	if (new_freq > pcpu->policy->cur && pcpu->demand_time) {
+		trace_cpufreq_interactive_ramp(cpu, pcpu->policy->cur,
+					       new_freq,
+					       now - pcpu->demand_time,
+					       from_sched);
+		pcpu->demand_time = 0;
+	}
+
 	pcpu->target_freq = new_freq;
+	pcpu->target_set_time = now;
 	spin_unlock_irqrestore(&pcpu->target_freq_lock, flags);
 	spin_lock_irqsave(&speedchange_cpumask_lock, flags);
-	cpumask_set_cpu(data, &speedchange_cpumask);
+	cpumask_set_cpu(cpu, &speedchange_cpumask);
 	spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
-	wake_up_process(speedchange_task);
 
-	goto rearm;
+	if (from_sched)
+		irq_work_queue(&speedchange_irq_work);
+	else
+		wake_up_process(speedchange_task);
+	return;
+
+unlock:
+	spin_unlock_irqrestore(&pcpu->target_freq_lock, flags);
+}
+
+#ifdef CONFIG_SCHED_HMP
+/*
+ * The load of @cpu in the form choose_freq() takes, from the scheduler's
+ * load tracking rather than from idle time.
+ */
+static unsigned int sched_loadadjfreq(struct cpufreq_interactive_cpuinfo *pcpu,
+				      int cpu)
+{
+	bool freq_invariant;
+	unsigned long util = hmp_cpu_util(cpu, &freq_invariant);
+	unsigned int freq = freq_invariant ? pcpu->policy->max :
+					     pcpu->policy->cur;
+
+	return (u64)util * freq * 100 >> 10;
+}
+
+/*
+ * Scheduler callback, rq lock held.  The hook is removed and
+ * synchronize_sched() waited for before the governor goes away, so no
+ * enable_sem here: taking it could mean a wakeup under the rq lock.
+ */
+static void cpufreq_interactive_update_util(struct update_util_data *data,
+					    u64 time, unsigned int flags)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu =
+		container_of(data, struct cpufreq_interactive_cpuinfo,
+			     update_util);
+	struct cpufreq_interactive_tunables *tunables;
+	unsigned int loadadjfreq;
+	unsigned long irqflags;
+	u64 now;
+
+	if (!pcpu->governor_enabled)
+		return;
+
+	tunables = pcpu->policy->governor_data;
+	if (!tunables->sched_driven &&
+	    !trace_cpufreq_interactive_ramp_enabled())
+		return;
+
+	now = ktime_to_us(ktime_get());
+	loadadjfreq = sched_loadadjfreq(pcpu, pcpu->cpu);
+
+	/*
+	 * Note when the load first went beyond what the current speed is
+	 * meant to carry, for the ramp latency tracepoint.  The timer mode
+	 * gets the same, to compare against.
+	 */
+	spin_lock_irqsave(&pcpu->target_freq_lock, irqflags);
+	if (loadadjfreq / pcpu->policy->cur >
+	    freq_to_targetload(tunables, pcpu->policy->cur)) {
+		if (!pcpu->demand_time)
+			pcpu->demand_time = now;
+	} else {
+		pcpu->demand_time = 0;
+	}
+	spin_unlock_irqrestore(&pcpu->target_freq_lock, irqflags);
+
+	if (tunables->sched_driven)
+		cpufreq_interactive_eval(pcpu, pcpu->cpu, now, loadadjfreq,
+					 true);
+}
+#else
+static inline unsigned int sched_loadadjfreq(
+	struct cpufreq_interactive_cpuinfo *pcpu, int cpu)
+{
+	return 0;
+}
+#endif
+
+static void cpufreq_interactive_timer(unsigned long data)
+{
+	u64 now;
+	unsigned int delta_time;
+	u64 cputime_speedadj;
+	struct cpufreq_interactive_cpuinfo *pcpu =
+		&per_cpu(cpuinfo, data);
+	struct cpufreq_interactive_tunables *tunables =
+		pcpu->policy->governor_data;
+	unsigned int loadadjfreq;
+	unsigned long flags;
 
-target_update:
-	pcpu->target_freq = pcpu->policy->cur;
+	if (!down_read_trylock(&pcpu->enable_sem))
+		return;
+	if (!pcpu->governor_enabled)
+		goto exit;
+
+	spin_lock_irqsave(&pcpu->load_lock, flags);
+	now = update_load(data);
+	delta_time = (unsigned int)(now - pcpu->cputime_speedadj_timestamp);
+	cputime_speedadj = pcpu->cputime_speedadj;
+	spin_unlock_irqrestore(&pcpu->load_lock, flags);
+
+	if (WARN_ON_ONCE(!delta_time))
+		goto rearm;
+
+	do_div(cputime_speedadj, delta_time);
+	loadadjfreq = (unsigned int)cputime_speedadj * 100;
+
+	/* Still runs to ramp down cpus that went idle, from the same load */
+	if (tunables->sched_driven)
+		loadadjfreq = sched_loadadjfreq(pcpu, data);
+
+	cpufreq_interactive_eval(pcpu, data, now, loadadjfreq, false);
 
 rearm:
 	if (!timer_pending(&pcpu->cpu_timer))
@@ -512,6 +638,11 @@ static void cpufreq_interactive_idle_end(void)
 	up_read(&pcpu->enable_sem);
 }
 
+static void cpufreq_interactive_irq_work(struct irq_work *work)
+{
+	wake_up_process(speedchange_task);
+}
+
 static int cpufreq_interactive_speedchange_task(void *data)
 {
 	unsigned int cpu;
@@ -994,6 +1125,67 @@ static ssize_t store_io_is_busy(struct cpufreq_interactive_tunables *tunables,
 	return count;
 }
 
+static ssize_t show_sched_driven(struct cpufreq_interactive_tunables *tunables,
+		char *buf)
+{
+	return sprintf(buf, "%u\n", tunables->sched_driven);
+}
+
+static ssize_t store_sched_driven(struct cpufreq_interactive_tunables *tunables,
+		const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	if (val && !IS_ENABLED(CONFIG_SCHED_HMP))
+		return -EINVAL;
+	tunables->sched_driven = val;
+	return count;
+}
+
+static ssize_t show_sched_up_rate_limit(
+		struct cpufreq_interactive_tunables *tunables, char *buf)
+{
+	return sprintf(buf, "%lu\n", tunables->sched_up_rate_limit);
+}
+
+static ssize_t store_sched_up_rate_limit(
+		struct cpufreq_interactive_tunables *tunables,
+		const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	tunables->sched_up_rate_limit = val;
+	return count;
+}
+
+static ssize_t show_sched_down_rate_limit(
+		struct cpufreq_interactive_tunables *tunables, char *buf)
+{
+	return sprintf(buf, "%lu\n", tunables->sched_down_rate_limit);
+}
+
+static ssize_t store_sched_down_rate_limit(
+		struct cpufreq_interactive_tunables *tunables,
+		const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	tunables->sched_down_rate_limit = val;
+	return count;
+}
+
 /*
  * Create show/store routines
  * - sys: One governor instance for complete SYSTEM
@@ -1041,6 +1233,9 @@ show_store_gov_pol_sys(boost);
 store_gov_pol_sys(boostpulse);
 show_store_gov_pol_sys(boostpulse_duration);
 show_store_gov_pol_sys(io_is_busy);
+show_store_gov_pol_sys(sched_driven);
+show_store_gov_pol_sys(sched_up_rate_limit);
+show_store_gov_pol_sys(sched_down_rate_limit);
 
 #define gov_sys_attr_rw(_name)						\
 static struct global_attr _name##_gov_sys =				\
@@ -1064,6 +1259,9 @@ gov_sys_pol_attr_rw(timer_slack);
 gov_sys_pol_attr_rw(boost);
 gov_sys_pol_attr_rw(boostpulse_duration);
 gov_sys_pol_attr_rw(io_is_busy);
+gov_sys_pol_attr_rw(sched_driven);
+gov_sys_pol_attr_rw(sched_up_rate_limit);
+gov_sys_pol_attr_rw(sched_down_rate_limit);
 
 static struct global_attr boostpulse_gov_sys =
 	__ATTR(boostpulse, 0200, NULL, store_boostpulse_gov_sys);
@@ -1084,6 +1282,9 @@ static struct attribute *interactive_attributes_gov_sys[] = {
 	&boostpulse_gov_sys.attr,
 	&boostpulse_duration_gov_sys.attr,
 	&io_is_busy_gov_sys.attr,
+	&sched_driven_gov_sys.attr,
+	&sched_up_rate_limit_gov_sys.attr,
+	&sched_down_rate_limit_gov_sys.attr,
 	NULL,
 };
 
@@ -1105,6 +1306,9 @@ static struct attribute *interactive_attributes_gov_pol[] = {
 	&boostpulse_gov_pol.attr,
 	&boostpulse_duration_gov_pol.attr,
 	&io_is_busy_gov_pol.attr,
+	&sched_driven_gov_pol.attr,
+	&sched_up_rate_limit_gov_pol.attr,
+	&sched_down_rate_limit_gov_pol.attr,
 	NULL,
 };
 
@@ -1179,6 +1383,10 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			tunables->timer_rate = DEFAULT_TIMER_RATE;
 			tunables->boostpulse_duration_val = DEFAULT_MIN_SAMPLE_TIME;
 			tunables->timer_slack_val = DEFAULT_TIMER_SLACK;
+			tunables->sched_up_rate_limit =
+				DEFAULT_SCHED_UP_RATE_LIMIT;
+			tunables->sched_down_rate_limit =
+				DEFAULT_SCHED_DOWN_RATE_LIMIT;
 		} else {
 			memcpy(tunables, tuned_parameters[policy->cpu], sizeof(*tunables));
 			kfree(tuned_parameters[policy->cpu]);
@@ -1262,12 +1470,18 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			pcpu->loc_floor_val_time = pcpu->pol_floor_val_time;
 			pcpu->pol_hispeed_val_time = pcpu->pol_floor_val_time;
 			pcpu->loc_hispeed_val_time = pcpu->pol_floor_val_time;
+			pcpu->target_set_time = pcpu->pol_floor_val_time;
+			pcpu->demand_time = 0;
 			down_write(&pcpu->enable_sem);
 			del_timer_sync(&pcpu->cpu_timer);
 			del_timer_sync(&pcpu->cpu_slack_timer);
 			cpufreq_interactive_timer_start(tunables, j);
 			pcpu->governor_enabled = 1;
 			up_write(&pcpu->enable_sem);
+#ifdef CONFIG_SCHED_HMP
+			cpufreq_add_update_util_hook(j, &pcpu->update_util,
+					cpufreq_interactive_update_util);
+#endif
 		}
 
 		mutex_unlock(&gov_lock);
@@ -1275,6 +1489,11 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 
 	case CPUFREQ_GOV_STOP:
 		mutex_lock(&gov_lock);
+#ifdef CONFIG_SCHED_HMP
+		for_each_cpu(j, policy->cpus)
+			cpufreq_remove_update_util_hook(j);
+		synchronize_sched();
+#endif
 		for_each_cpu(j, policy->cpus) {
 			pcpu = &per_cpu(cpuinfo, j);
 			down_write(&pcpu->enable_sem);
@@ -1562,9 +1781,11 @@ static int __init cpufreq_interactive_init(void)
 		spin_lock_init(&pcpu->load_lock);
 		spin_lock_init(&pcpu->target_freq_lock);
 		init_rwsem(&pcpu->enable_sem);
+		pcpu->cpu = i;
 	}
 
 	spin_lock_init(&speedchange_cpumask_lock);
+	init_irq_work(&speedchange_irq_work, cpufreq_interactive_irq_work);
 	mutex_init(&gov_lock);
 
 	speedchange_task =
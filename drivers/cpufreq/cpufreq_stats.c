@@ -20,6 +20,9 @@
 
 static spinlock_t cpufreq_stats_lock;
 
+/* Transition latency histogram buckets: < 1us, < 2us, ... , >= 16ms */
+#define CPUFREQ_LAT_BUCKETS	16
+
 struct cpufreq_stats {
 	unsigned int cpu;
 	unsigned int total_trans;
@@ -31,7 +34,28 @@ struct cpufreq_stats {
 	unsigned int *freq_table;
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	unsigned int *trans_table;
+	/* the same, per requester, for drivers that report them */
+	unsigned int last_req;
+	u64 *req_time_in_state;
+	unsigned int *req_trans_table;
 #endif
+	/* reported by the driver through cpufreq_stats_transition() */
+	unsigned int lat_count;
+	unsigned int lat_hist[CPUFREQ_PHASE_NR][CPUFREQ_LAT_BUCKETS];
+	u64 lat_total[CPUFREQ_PHASE_NR];
+	u64 lat_max[CPUFREQ_PHASE_NR];
+};
+
+static const char * const cpufreq_requester_names[CPUFREQ_REQ_NR] = {
+	[CPUFREQ_REQ_GOVERNOR]	= "governor",
+	[CPUFREQ_REQ_PM_QOS]	= "pm_qos",
+	[CPUFREQ_REQ_THERMAL]	= "thermal",
+};
+
+static const char * const cpufreq_phase_names[CPUFREQ_PHASE_NR] = {
+	[CPUFREQ_PHASE_REQUEST]	= "request",
+	[CPUFREQ_PHASE_SWITCH]	= "switch",
+	[CPUFREQ_PHASE_NOTIFY]	= "notify",
 };
 
 struct all_cpufreq_stats {
@@ -82,6 +106,12 @@ static int cpufreq_stats_update(unsigned int cpu)
 		if (all_stat)
 			all_stat->time_in_state[stat->last_index] +=
 					cur_time - stat->last_time;
+#ifdef CONFIG_CPU_FREQ_STAT_DETAILS
+		if (stat->req_time_in_state)
+			stat->req_time_in_state[stat->last_req *
+				stat->max_state + stat->last_index] +=
+					cur_time - stat->last_time;
+#endif
 	}
 	stat->last_time = cur_time;
 	spin_unlock(&cpufreq_stats_lock);
@@ -256,16 +286,124 @@ static ssize_t show_trans_table(struct cpufreq_policy *policy, char *buf)
 	return len;
 }
 cpufreq_freq_attr_ro(trans_table);
+
+static ssize_t show_requester_time_in_state(struct cpufreq_policy *policy,
+		char *buf)
+{
+	ssize_t len = 0;
+	int i, r;
+	struct cpufreq_stats *stat = per_cpu(cpufreq_stats_table, policy->cpu);
+	if (!stat)
+		return 0;
+	cpufreq_stats_update(stat->cpu);
+	len += scnprintf(buf + len, PAGE_SIZE - len, "freq");
+	for (r = 0; r < CPUFREQ_REQ_NR; r++)
+		len += scnprintf(buf + len, PAGE_SIZE - len, " %s",
+				cpufreq_requester_names[r]);
+	len += scnprintf(buf + len, PAGE_SIZE - len, "\n");
+	for (i = 0; i < stat->state_num; i++) {
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%u",
+				stat->freq_table[i]);
+		for (r = 0; r < CPUFREQ_REQ_NR; r++)
+			len += scnprintf(buf + len, PAGE_SIZE - len, " %llu",
+				(unsigned long long)jiffies_64_to_clock_t(
+				stat->req_time_in_state[r * stat->max_state + i]));
+		len += scnprintf(buf + len, PAGE_SIZE - len, "\n");
+	}
+	return len;
+}
+cpufreq_freq_attr_ro(requester_time_in_state);
+
+/*
+ * One "requester from to count" line per transition that happened, the
+ * full matrices would not fit a page.
+ */
+static ssize_t show_requester_trans_table(struct cpufreq_policy *policy,
+		char *buf)
+{
+	ssize_t len = 0;
+	unsigned int count;
+	int i, j, r;
+	struct cpufreq_stats *stat = per_cpu(cpufreq_stats_table, policy->cpu);
+	if (!stat)
+		return 0;
+	spin_lock(&cpufreq_stats_lock);
+	for (r = 0; r < CPUFREQ_REQ_NR; r++) {
+		for (i = 0; i < stat->state_num; i++) {
+			for (j = 0; j < stat->state_num; j++) {
+				count = stat->req_trans_table[(r *
+					stat->max_state + i) *
+					stat->max_state + j];
+				if (!count)
+					continue;
+				len += scnprintf(buf + len, PAGE_SIZE - len,
+					"%s %u %u %u\n",
+					cpufreq_requester_names[r],
+					stat->freq_table[i],
+					stat->freq_table[j], count);
+			}
+		}
+	}
+	spin_unlock(&cpufreq_stats_lock);
+	return len;
+}
+cpufreq_freq_attr_ro(requester_trans_table);
 #endif
 
+/*
+ * Histograms of how long each part of a transition took, from the same
+ * numbers the cpu_frequency_transition tracepoint reports.  Only filled in
+ * by drivers that call cpufreq_stats_transition().
+ */
+static ssize_t show_transition_latency(struct cpufreq_policy *policy,
+		char *buf)
+{
+	ssize_t len = 0;
+	int i, p;
+	char label[12];
+	struct cpufreq_stats *stat = per_cpu(cpufreq_stats_table, policy->cpu);
+	if (!stat)
+		return 0;
+	spin_lock(&cpufreq_stats_lock);
+	len += scnprintf(buf + len, PAGE_SIZE - len, "transitions %u\n",
+			stat->lat_count);
+	len += scnprintf(buf + len, PAGE_SIZE - len, "%-8s %8s %8s",
+			"usecs", "mean", "max");
+	for (i = 0; i < CPUFREQ_LAT_BUCKETS; i++) {
+		if (i < CPUFREQ_LAT_BUCKETS - 1)
+			snprintf(label, sizeof(label), "<%u", 1U << i);
+		else
+			snprintf(label, sizeof(label), ">=%u", 1U << (i - 1));
+		len += scnprintf(buf + len, PAGE_SIZE - len, " %7s", label);
+	}
+	len += scnprintf(buf + len, PAGE_SIZE - len, "\n");
+	for (p = 0; p < CPUFREQ_PHASE_NR; p++) {
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%-8s %8llu %8llu",
+			cpufreq_phase_names[p],
+			stat->lat_count ? div_u64(div_u64(stat->lat_total[p],
+				stat->lat_count), NSEC_PER_USEC) : 0,
+			div_u64(stat->lat_max[p], NSEC_PER_USEC));
+		for (i = 0; i < CPUFREQ_LAT_BUCKETS; i++)
+			len += scnprintf(buf + len, PAGE_SIZE - len, " %7u",
+					stat->lat_hist[p][i]);
+		len += scnprintf(buf + len, PAGE_SIZE - len, "\n");
+	}
+	spin_unlock(&cpufreq_stats_lock);
+	return len;
+}
+
 cpufreq_freq_attr_ro(total_trans);
 cpufreq_freq_attr_ro(time_in_state);
+cpufreq_freq_attr_ro(transition_latency);
 
 static struct attribute *default_attrs[] = {
 	&total_trans.attr,
 	&time_in_state.attr,
+	&transition_latency.attr,
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	&trans_table.attr,
+	&requester_time_in_state.attr,
+	&requester_trans_table.attr,
 #endif
 	NULL
 };
@@ -300,6 +438,9 @@ static void __cpufreq_stats_free_table(struct cpufreq_policy *policy)
 
 	sysfs_remove_group(&policy->kobj, &stats_attr_group);
 	kfree(stat->time_in_state);
+#ifdef CONFIG_CPU_FREQ_STAT_DETAILS
+	kfree(stat->req_time_in_state);
+#endif
 	kfree(stat);
 	per_cpu(cpufreq_stats_table, policy->cpu) = NULL;
 }
@@ -395,6 +536,16 @@ static int __cpufreq_stats_create_table(struct cpufreq_policy *policy,
 
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	stat->trans_table = stat->freq_table + count;
+
+	alloc_size = CPUFREQ_REQ_NR * count * sizeof(u64) +
+		CPUFREQ_REQ_NR * count * count * sizeof(int);
+	stat->req_time_in_state = kzalloc(alloc_size, GFP_KERNEL);
+	if (!stat->req_time_in_state) {
+		ret = -ENOMEM;
+		goto error_alloc_req;
+	}
+	stat->req_trans_table = (unsigned int *)
+		(stat->req_time_in_state + CPUFREQ_REQ_NR * count);
 #endif
 	i = 0;
 	cpufreq_for_each_valid_entry(pos, table)
@@ -406,6 +557,10 @@ static int __cpufreq_stats_create_table(struct cpufreq_policy *policy,
 	stat->last_index = freq_table_get_index(stat, policy->cur);
 	spin_unlock(&cpufreq_stats_lock);
 	return 0;
+#ifdef CONFIG_CPU_FREQ_STAT_DETAILS
+error_alloc_req:
+	kfree(stat->time_in_state);
+#endif
 error_alloc:
 	sysfs_remove_group(&policy->kobj, &stats_attr_group);
 error_out:
@@ -663,6 +818,56 @@ static int cpufreq_stat_notifier_trans(struct notifier_block *nb,
 	return 0;
 }
 
+#if IS_BUILTIN(CONFIG_CPU_FREQ_STAT)
+/**
+ * cpufreq_stats_transition - account a transition the driver has timed
+ * @policy:	policy the transition was made on
+ * @old_freq:	frequency before
+ * @new_freq:	frequency after
+ * @req:	whom the transition was made for
+ * @phase_ns:	CPUFREQ_PHASE_NR durations, in ns
+ *
+ * To be called after the transition notifiers have run.  Time at
+ * @new_freq is accounted to @req until the next call.
+ */
+void cpufreq_stats_transition(struct cpufreq_policy *policy,
+		unsigned int old_freq, unsigned int new_freq,
+		enum cpufreq_requester req, const u64 *phase_ns)
+{
+	struct cpufreq_stats *stat;
+	int p, bucket;
+#ifdef CONFIG_CPU_FREQ_STAT_DETAILS
+	int old_index, new_index;
+#endif
+
+	stat = per_cpu(cpufreq_stats_table, policy->cpu);
+	if (!stat || req >= CPUFREQ_REQ_NR)
+		return;
+
+	cpufreq_stats_update(stat->cpu);
+
+	spin_lock(&cpufreq_stats_lock);
+	for (p = 0; p < CPUFREQ_PHASE_NR; p++) {
+		bucket = fls64(div_u64(phase_ns[p], NSEC_PER_USEC));
+		stat->lat_hist[p][min(bucket, CPUFREQ_LAT_BUCKETS - 1)]++;
+		stat->lat_total[p] += phase_ns[p];
+		stat->lat_max[p] = max(stat->lat_max[p], phase_ns[p]);
+	}
+	stat->lat_count++;
+
+#ifdef CONFIG_CPU_FREQ_STAT_DETAILS
+	old_index = freq_table_get_index(stat, old_freq);
+	new_index = freq_table_get_index(stat, new_freq);
+	if (old_index != -1 && new_index != -1)
+		stat->req_trans_table[(req * stat->max_state + old_index) *
+				      stat->max_state + new_index]++;
+	stat->last_req = req;
+#endif
+	spin_unlock(&cpufreq_stats_lock);
+}
+EXPORT_SYMBOL_GPL(cpufreq_stats_transition);
+#endif
+
 static struct notifier_block notifier_policy_block = {
 	.notifier_call = cpufreq_stat_notifier_policy
 };
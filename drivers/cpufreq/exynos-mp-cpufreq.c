@@ -47,6 +47,7 @@
 #include <soc/samsung/tmu.h>
 #include <soc/samsung/ect_parser.h>
 #include <trace/events/exynos.h>
+#include <trace/events/power.h>
 
 #ifdef CONFIG_SEC_BSP
 #include <linux/sec_bsp.h>
@@ -67,6 +68,8 @@ static DEFINE_MUTEX(cpufreq_lock);
 static DEFINE_MUTEX(cpufreq_scale_lock);
 
 unsigned int g_clamp_cpufreqs[CL_END];
+/* who the request exynos_target() is handling is for, see exynos_driver_target() */
+static enum cpufreq_requester target_requester[CL_END];
 
 /* Include CPU mask of each cluster */
 static struct cpumask cluster_cpus[CL_END];
@@ -326,7 +329,8 @@ struct lpj_info {
 static struct lpj_info global_lpj_ref;
 #endif
 
-static int exynos_cpufreq_scale(unsigned int target_freq, unsigned int cpu)
+static int exynos_cpufreq_scale(unsigned int target_freq, unsigned int cpu,
+				u64 *phase_ns)
 {
 	unsigned int cur = get_cur_cluster(cpu);
 	struct cpufreq_frequency_table *freq_table = exynos_info[cur]->freq_table;
@@ -334,6 +338,7 @@ static int exynos_cpufreq_scale(unsigned int target_freq, unsigned int cpu)
 	struct cpufreq_policy *policy = cpufreq_cpu_get(cpu);
 	unsigned int new_index, old_index;
 	unsigned int volt, safe_volt = 0;
+	u64 start, t;
 	int ret = 0;
 
 	if (!policy)
@@ -368,8 +373,11 @@ static int exynos_cpufreq_scale(unsigned int target_freq, unsigned int cpu)
 
 	volt = get_limit_voltage(volt_table[new_index]);
 
+	start = ktime_get_ns();
+
 	/* Update policy current frequency */
 	cpufreq_freq_transition_begin(policy, freqs[cur]);
+	phase_ns[CPUFREQ_PHASE_NOTIFY] = ktime_get_ns() - start;
 
 	if (old_index > new_index)
 		if (exynos_info[cur]->set_int_skew)
@@ -420,7 +428,9 @@ static int exynos_cpufreq_scale(unsigned int target_freq, unsigned int cpu)
 #endif
 #endif
 
+	t = ktime_get_ns();
 	cpufreq_freq_transition_end(policy, freqs[cur], 0);
+	phase_ns[CPUFREQ_PHASE_NOTIFY] += ktime_get_ns() - t;
 
 	/* When the new frequency is lower than current frequency */
 	if ((old_index < new_index) || ((old_index > new_index) && safe_volt)) {
@@ -442,6 +452,9 @@ static int exynos_cpufreq_scale(unsigned int target_freq, unsigned int cpu)
 		exynos_cl_dvfs_start(CLUSTER_ID(cur));
 #endif
 
+	phase_ns[CPUFREQ_PHASE_SWITCH] = ktime_get_ns() - start -
+					 phase_ns[CPUFREQ_PHASE_NOTIFY];
+
 	cpufreq_cpu_put(policy);
 
 	return 0;
@@ -504,6 +517,27 @@ static unsigned int exynos_verify_pm_qos_limit(struct cpufreq_policy *policy,
 	return target_freq;
 }
 
+/*
+ * Whom the frequency exynos_target() settled on is down to: a limit that
+ * moved it away from the @req_freq asked for, else the caller.  Thermal
+ * caps come in both through the IPA clamp and as an IPA PM QoS maximum.
+ */
+static enum cpufreq_requester exynos_target_requester(cluster_type cur,
+		unsigned int req_freq, unsigned int target_freq)
+{
+	bool thermal_cap = target_freq == g_clamp_cpufreqs[cur] ||
+		(pm_qos_request_active(&ipa_max_qos[cur]) &&
+		 target_freq == ipa_max_qos[cur].node.prio);
+
+	if (target_freq < req_freq)
+		return thermal_cap ? CPUFREQ_REQ_THERMAL : CPUFREQ_REQ_PM_QOS;
+	if (target_freq > req_freq)
+		return CPUFREQ_REQ_PM_QOS;
+	if (target_requester[cur] == CPUFREQ_REQ_PM_QOS && thermal_cap)
+		return CPUFREQ_REQ_THERMAL;
+	return target_requester[cur];
+}
+
 static void exynos_qos_nop(void *info)
 {
 }
@@ -532,7 +566,10 @@ static int exynos_target(struct cpufreq_policy *policy,
 {
 	cluster_type cur = get_cur_cluster(policy->cpu);
 	struct cpufreq_frequency_table *freq_table = exynos_info[cur]->freq_table;
-	unsigned int index;
+	unsigned int index, req_freq, old_freq;
+	enum cpufreq_requester requester;
+	u64 phase_ns[CPUFREQ_PHASE_NR] = { 0 };
+	u64 start = ktime_get_ns();
 	int ret = 0;
 #ifdef CONFIG_CPU_THERMAL_IPA_DEBUG
 	trace_printk("IPA:%s:%d Called by %x, with target_freq %d", __PRETTY_FUNCTION__, __LINE__,
@@ -562,7 +599,9 @@ static int exynos_target(struct cpufreq_policy *policy,
 	}
 
 	/* verify pm_qos_lock */
+	req_freq = target_freq;
 	target_freq = exynos_verify_pm_qos_limit(policy, target_freq, cur);
+	requester = exynos_target_requester(cur, req_freq, target_freq);
 
 #ifdef CONFIG_CPU_THERMAL_IPA_DEBUG
 	trace_printk("IPA:%s:%d will apply %d ", __PRETTY_FUNCTION__, __LINE__, target_freq);
@@ -587,7 +626,9 @@ static int exynos_target(struct cpufreq_policy *policy,
 	trace_exynos_cpufreq_in(cur, freqs[cur]->old, target_freq);
 
 	/* frequency and volt scaling */
-	ret = exynos_cpufreq_scale(target_freq, policy->cpu);
+	old_freq = freqs[cur]->old;
+	phase_ns[CPUFREQ_PHASE_REQUEST] = ktime_get_ns() - start;
+	ret = exynos_cpufreq_scale(target_freq, policy->cpu, phase_ns);
 
 	exynos_ss_freq(cur, freqs[cur]->old, target_freq, ESS_FLAG_OUT);
 	trace_exynos_cpufreq_out(cur, freqs[cur]->old, target_freq);
@@ -602,6 +643,17 @@ static int exynos_target(struct cpufreq_policy *policy,
 	/* save current frequency */
 	freqs[cur]->old = target_freq;
 
+	/* no switch time means the table index did not change */
+	if (phase_ns[CPUFREQ_PHASE_SWITCH]) {
+		trace_cpu_frequency_transition(policy->cpu, old_freq,
+				target_freq, requester,
+				phase_ns[CPUFREQ_PHASE_REQUEST],
+				phase_ns[CPUFREQ_PHASE_SWITCH],
+				phase_ns[CPUFREQ_PHASE_NOTIFY]);
+		cpufreq_stats_transition(policy, old_freq, target_freq,
+					 requester, phase_ns);
+	}
+
 out:
 	mutex_unlock(&cpufreq_lock);
 
@@ -763,6 +815,25 @@ int get_real_max_freq(cluster_type cluster)
 	return freq_max[cluster];
 }
 
+/*
+ * __cpufreq_driver_target() on behalf of someone other than the governor,
+ * so that cpufreq stats can tell the requesters apart.  A governor request
+ * racing with this one may be accounted to @req, or the other way around.
+ */
+static int exynos_driver_target(struct cpufreq_policy *policy,
+				unsigned int target_freq,
+				enum cpufreq_requester req)
+{
+	cluster_type cl = get_cur_cluster(policy->cpu);
+	int ret;
+
+	target_requester[cl] = req;
+	ret = __cpufreq_driver_target(policy, target_freq, CPUFREQ_RELATION_H);
+	target_requester[cl] = CPUFREQ_REQ_GOVERNOR;
+
+	return ret;
+}
+
 void ipa_set_clamp(int cpu, unsigned int clamp_freq, unsigned int gov_target)
 {
 	unsigned int freq = 0;
@@ -806,7 +877,7 @@ void ipa_set_clamp(int cpu, unsigned int clamp_freq, unsigned int gov_target)
 		     __PRETTY_FUNCTION__, __LINE__, cpu, clamp_freq, freq);
 #endif
 
-	__cpufreq_driver_target(policy, new_freq, CPUFREQ_RELATION_H);
+	exynos_driver_target(policy, new_freq, CPUFREQ_REQ_THERMAL);
 	cpufreq_cpu_put(policy);
 }
 
@@ -1771,7 +1842,7 @@ static int exynos_cluster0_min_qos_handler(struct notifier_block *b,
 	}
 #endif
 
-	ret = __cpufreq_driver_target(policy, val, CPUFREQ_RELATION_H);
+	ret = exynos_driver_target(policy, val, CPUFREQ_REQ_PM_QOS);
 	cpufreq_cpu_put(policy);
 
 	if (ret < 0)
@@ -1825,7 +1896,7 @@ static int exynos_cluster1_min_qos_handler(struct notifier_block *b,
 	}
 #endif
 
-	ret = __cpufreq_driver_target(policy, val, CPUFREQ_RELATION_H);
+	ret = exynos_driver_target(policy, val, CPUFREQ_REQ_PM_QOS);
 	cpufreq_cpu_put(policy);
 
 	if (ret < 0)
@@ -1872,7 +1943,7 @@ static int exynos_cluster0_max_qos_handler(struct notifier_block *b,
 	}
 #endif
 
-	ret = __cpufreq_driver_target(policy, val, CPUFREQ_RELATION_H);
+	ret = exynos_driver_target(policy, val, CPUFREQ_REQ_PM_QOS);
 	cpufreq_cpu_put(policy);
 
 	if (ret < 0)
@@ -1919,7 +1990,7 @@ static int exynos_cluster1_max_qos_handler(struct notifier_block *b,
 	}
 #endif
 
-	ret = __cpufreq_driver_target(policy, val, CPUFREQ_RELATION_H);
+	ret = exynos_driver_target(policy, val, CPUFREQ_REQ_PM_QOS);
 	cpufreq_cpu_put(policy);
 
 	if (ret < 0)
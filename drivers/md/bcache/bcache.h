@@ -370,6 +370,7 @@ struct cached_dev {
 	unsigned		bypass_torture_test:1;
 
 	unsigned		partial_stripes_expensive:1;
+	unsigned		flash_backing:1;
 	unsigned		writeback_metadata:1;
 	unsigned		writeback_running:1;
 	unsigned char		writeback_percent;
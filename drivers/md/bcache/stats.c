@@ -48,6 +48,8 @@ read_attribute(cache_hit_ratio);
 read_attribute(cache_readaheads);
 read_attribute(cache_miss_collisions);
 read_attribute(bypassed);
+read_attribute(writeback_runs);
+read_attribute(written_back);
 
 SHOW(bch_stats)
 {
@@ -66,6 +68,8 @@ SHOW(bch_stats)
 	var_print(cache_readaheads);
 	var_print(cache_miss_collisions);
 	sysfs_hprint(bypassed,	var(sectors_bypassed) << 9);
+	var_print(writeback_runs);
+	sysfs_hprint(written_back, var(sectors_written_back) << 9);
 #undef var
 	return 0;
 }
@@ -88,6 +92,8 @@ static struct attribute *bch_stats_files[] = {
 	&sysfs_cache_readaheads,
 	&sysfs_cache_miss_collisions,
 	&sysfs_bypassed,
+	&sysfs_writeback_runs,
+	&sysfs_written_back,
 	NULL
 };
 static KTYPE(bch_stats);
@@ -110,7 +116,7 @@ void bch_cache_accounting_clear(struct cache_accounting *acc)
 {
 	memset(&acc->total.cache_hits,
 	       0,
-	       sizeof(unsigned long) * 7);
+	       sizeof(unsigned long) * 9);
 }
 
 void bch_cache_accounting_destroy(struct cache_accounting *acc)
@@ -143,6 +149,8 @@ static void scale_stats(struct cache_stats *stats, unsigned long rescale_at)
 		scale_stat(&stats->cache_readaheads);
 		scale_stat(&stats->cache_miss_collisions);
 		scale_stat(&stats->sectors_bypassed);
+		scale_stat(&stats->writeback_runs);
+		scale_stat(&stats->sectors_written_back);
 	}
 }
 
@@ -166,6 +174,8 @@ static void scale_accounting(unsigned long data)
 	move_stat(cache_readaheads);
 	move_stat(cache_miss_collisions);
 	move_stat(sectors_bypassed);
+	move_stat(writeback_runs);
+	move_stat(sectors_written_back);
 
 	scale_stats(&acc->total, 0);
 	scale_stats(&acc->day, DAY_RESCALE);
@@ -224,6 +234,19 @@ void bch_mark_sectors_bypassed(struct cache_set *c, struct cached_dev *dc,
 	atomic_add(sectors, &c->accounting.collector.sectors_bypassed);
 }
 
+void bch_mark_writeback_run(struct cache_set *c, struct cached_dev *dc)
+{
+	atomic_inc(&dc->accounting.collector.writeback_runs);
+	atomic_inc(&c->accounting.collector.writeback_runs);
+}
+
+void bch_mark_sectors_written_back(struct cache_set *c, struct cached_dev *dc,
+				   int sectors)
+{
+	atomic_add(sectors, &dc->accounting.collector.sectors_written_back);
+	atomic_add(sectors, &c->accounting.collector.sectors_written_back);
+}
+
 void bch_cache_accounting_init(struct cache_accounting *acc,
 			       struct closure *parent)
 {
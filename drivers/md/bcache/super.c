@@ -1171,6 +1171,19 @@ static int cached_dev_init(struct cached_dev *dc, unsigned block_size)
 	if (dc->disk.stripe_size)
 		dc->partial_stripes_expensive =
 			q->limits.raid_partial_stripes_expensive;
+	else if (blk_queue_nonrot(q) &&
+		 q->limits.discard_granularity > PAGE_SIZE) {
+		/*
+		 * Flash backing device, e.g. an SD card: account dirty data
+		 * per erase unit, so that writeback goes out in whole units
+		 * instead of the small random writes such devices are worst
+		 * at.
+		 */
+		dc->disk.stripe_size =
+			rounddown_pow_of_two(q->limits.discard_granularity >> 9);
+		dc->partial_stripes_expensive = 1;
+		dc->flash_backing = 1;
+	}
 
 	ret = bcache_device_init(&dc->disk, block_size,
 			 dc->bdev->bd_part->nr_sects - dc->sb.data_offset);
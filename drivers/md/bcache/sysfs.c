@@ -86,6 +86,7 @@ read_attribute(writeback_rate_debug);
 
 read_attribute(stripe_size);
 read_attribute(partial_stripes_expensive);
+read_attribute(flash_backing);
 
 rw_attribute(synchronous);
 rw_attribute(journal_delay_ms);
@@ -168,6 +169,7 @@ SHOW(__bch_cached_dev)
 
 	sysfs_hprint(stripe_size,	dc->disk.stripe_size << 9);
 	var_printf(partial_stripes_expensive,	"%u");
+	var_printf(flash_backing,		"%u");
 
 	var_hprint(sequential_cutoff);
 	var_hprint(readahead);
@@ -329,6 +331,7 @@ static struct attribute *bch_cached_dev_files[] = {
 	&sysfs_dirty_data,
 	&sysfs_stripe_size,
 	&sysfs_partial_stripes_expensive,
+	&sysfs_flash_backing,
 	&sysfs_sequential_cutoff,
 	&sysfs_clear_stats,
 	&sysfs_running,
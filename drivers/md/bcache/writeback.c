@@ -155,6 +155,23 @@ static void write_dirty_finish(struct closure *cl)
 
 		if (ret)
 			trace_bcache_writeback_collision(&w->key);
+		else
+			bch_mark_sectors_written_back(dc->disk.c, dc,
+						      KEY_SIZE(&w->key));
+
+		/*
+		 * With a flash backing device the cache is there for reads:
+		 * once written back, data that was only written goes before
+		 * anything read since, which gets its prio back on a hit.
+		 */
+		if (!ret && dc->flash_backing)
+			for (i = 0; i < KEY_PTRS(&w->key); i++) {
+				struct cache_set *c = dc->disk.c;
+
+				if (!ptr_stale(c, &w->key, i))
+					PTR_BUCKET(c, &w->key, i)->prio =
+						c->min_prio;
+			}
 
 		atomic_long_inc(ret
 				? &dc->disk.c->writeback_keys_failed
@@ -214,9 +231,24 @@ static void read_dirty_submit(struct closure *cl)
 	continue_at(cl, write_dirty, io->dc->writeback_write_wq);
 }
 
+/*
+ * Whether @k starts a new run of writeback: a discontiguous extent, or on a
+ * flash backing device a different erase unit.
+ */
+static bool writeback_new_run(struct cached_dev *dc, struct bkey *k)
+{
+	if (dc->flash_backing)
+		return !dc->last_read ||
+			offset_to_stripe(&dc->disk, KEY_START(k)) !=
+			offset_to_stripe(&dc->disk, dc->last_read - 1);
+
+	return KEY_START(k) != dc->last_read;
+}
+
 static void read_dirty(struct cached_dev *dc)
 {
 	unsigned delay = 0;
+	bool new_run;
 	struct keybuf_key *w;
 	struct dirty_io *io;
 	struct closure cl;
@@ -237,8 +269,11 @@ static void read_dirty(struct cached_dev *dc)
 
 		BUG_ON(ptr_stale(dc->disk.c, &w->key, 0));
 
-		if (KEY_START(&w->key) != dc->last_read ||
-		    jiffies_to_msecs(delay) > 50)
+		new_run = writeback_new_run(dc, &w->key);
+		if (new_run)
+			bch_mark_writeback_run(dc->disk.c, dc);
+
+		if (new_run || jiffies_to_msecs(delay) > 50)
 			while (!kthread_should_stop() && delay)
 				delay = schedule_timeout_interruptible(delay);
 
@@ -76,6 +76,10 @@ static inline bool should_writeback(struct cached_dev *dc, struct bio *bio,
 	if (would_skip)
 		return false;
 
+	/* Random writes are what a flash backing device does worst */
+	if (dc->flash_backing)
+		return true;
+
 	return bio->bi_rw & REQ_SYNC ||
 		in_use <= CUTOFF_WRITEBACK;
 }
@@ -0,0 +1,473 @@
+/*
+ * Test and benchmark of the batched btree calls
+ *
+ * Checks dm_btree_insert_many() and dm_btree_lookup_many() against the
+ * single key dm_btree_insert() and dm_btree_lookup(), and times both.
+ * The metadata is built on the block device given as @dev, whose
+ * contents are DESTROYED:
+ *
+ *	modprobe dm-btree-test dev=/dev/sdX1 nr_keys=65536 batch=256
+ *
+ * Results go to the kernel log in the form mmc_test uses.
+ *
+ * This file is released under the GPL.
+ */
+
+#include "dm-btree.h"
+#include "dm-space-map.h"
+#include "dm-transaction-manager.h"
+
+#include <linux/blkdev.h>
+#include <linux/device-mapper.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#define DM_MSG_PREFIX "btree test"
+
+#define RESULT_OK		0
+#define RESULT_FAIL		1
+
+#define TEST_BLOCK_SIZE		4096
+#define TEST_CACHE_SIZE		64
+#define TEST_MAX_HELD		5
+
+/* Every key lives under this first level key */
+#define TEST_PREFIX		7
+
+static char *dev;
+module_param(dev, charp, 0444);
+MODULE_PARM_DESC(dev, "Block device to test on, its contents are destroyed");
+
+static unsigned nr_keys = 16384;
+module_param(nr_keys, uint, 0444);
+MODULE_PARM_DESC(nr_keys, "Number of keys per tree");
+
+static unsigned batch = 256;
+module_param(batch, uint, 0444);
+MODULE_PARM_DESC(batch, "Number of keys per batched call");
+
+static int testcase;
+module_param(testcase, int, 0444);
+MODULE_PARM_DESC(testcase, "Test case to run, 0 for all");
+
+struct btree_test {
+	struct block_device *bdev;
+	struct dm_block_manager *bm;
+	struct dm_transaction_manager *tm;
+	struct dm_space_map *sm;
+	struct dm_btree_info info;
+
+	uint64_t *keys;
+	__le64 *values;
+	__le64 *out;
+	unsigned long *found;
+};
+
+struct btree_test_case {
+	const char *name;
+
+	int (*run)(struct btree_test *);
+};
+
+/*
+ * Keys come in a scrambled order and are all even, so key | 1 is a key
+ * that is never in the tree.  The odd multiplier keeps them distinct.
+ */
+static uint64_t test_key(unsigned i)
+{
+	return (i * 0x9e3779b97f4a7c15ULL) << 1;
+}
+
+static __le64 test_value(uint64_t key)
+{
+	return cpu_to_le64(~key);
+}
+
+static int build_single(struct btree_test *test, dm_block_t *root)
+{
+	uint64_t full_keys[2] = { TEST_PREFIX, 0 };
+	unsigned i;
+	int r;
+
+	r = dm_btree_empty(&test->info, root);
+	if (r)
+		return r;
+
+	for (i = 0; i < nr_keys; i++) {
+		full_keys[1] = test->keys[i];
+		__dm_bless_for_disk(&test->values[i]);
+		r = dm_btree_insert(&test->info, *root, full_keys,
+				    &test->values[i], root);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+static int build_batched(struct btree_test *test, dm_block_t *root)
+{
+	uint64_t prefix = TEST_PREFIX;
+	unsigned i, n;
+	int r;
+
+	r = dm_btree_empty(&test->info, root);
+	if (r)
+		return r;
+
+	for (i = 0; i < nr_keys; i += n) {
+		n = min(batch, nr_keys - i);
+		r = dm_btree_insert_many(&test->info, *root, &prefix,
+					 test->keys + i, n,
+					 test->values + i, root);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+static int lookup_single(struct btree_test *test, dm_block_t root,
+			 uint64_t key, __le64 *value)
+{
+	uint64_t full_keys[2] = { TEST_PREFIX, key };
+
+	return dm_btree_lookup(&test->info, root, full_keys, value);
+}
+
+/*
+ * Checks every key of @root, present or not, with a single lookup.
+ */
+static int check_tree(struct btree_test *test, dm_block_t root)
+{
+	__le64 value;
+	unsigned i;
+	int r;
+
+	for (i = 0; i < nr_keys; i++) {
+		r = lookup_single(test, root, test->keys[i], &value);
+		if (r)
+			return r;
+		if (value != test->values[i])
+			return RESULT_FAIL;
+
+		r = lookup_single(test, root, test->keys[i] | 1, &value);
+		if (r != -ENODATA)
+			return r ? r : RESULT_FAIL;
+	}
+
+	return RESULT_OK;
+}
+
+/*
+ * Looks @nr keys up in one batch and compares the result with the single
+ * key lookups.  Returns the number found or an error.
+ */
+static int check_lookup_many(struct btree_test *test, dm_block_t root,
+			     uint64_t *prefix, uint64_t *keys, unsigned nr)
+{
+	__le64 value;
+	unsigned i;
+	int r, count;
+
+	count = dm_btree_lookup_many(&test->info, root, prefix, keys, nr,
+				     test->out, test->found);
+	if (count < 0)
+		return count;
+
+	for (i = 0; i < nr; i++) {
+		uint64_t full_keys[2] = { *prefix, keys[i] };
+
+		r = dm_btree_lookup(&test->info, root, full_keys, &value);
+		if (r && r != -ENODATA)
+			return r;
+		if (!r != !!test_bit(i, test->found))
+			return -EINVAL;
+		if (!r && value != test->out[i])
+			return -EINVAL;
+	}
+
+	return count;
+}
+
+/*
+ * Test cases
+ */
+
+static int btree_test_insert_many(struct btree_test *test)
+{
+	dm_block_t root;
+	int r;
+
+	r = build_batched(test, &root);
+	if (r)
+		return r;
+
+	r = check_tree(test, root);
+	dm_btree_del(&test->info, root);
+
+	return r;
+}
+
+static int btree_test_lookup_many(struct btree_test *test)
+{
+	uint64_t prefix = TEST_PREFIX, *keys;
+	unsigned i, n;
+	dm_block_t root;
+	int r;
+
+	keys = kmalloc(batch * sizeof(*keys), GFP_KERNEL);
+	if (!keys)
+		return -ENOMEM;
+
+	r = build_single(test, &root);
+	if (r)
+		goto out;
+
+	/* Every other key of the batch is absent */
+	for (i = 0; i < nr_keys; i += n) {
+		unsigned k;
+
+		n = min(batch, nr_keys - i);
+		for (k = 0; k < n; k++)
+			keys[k] = test->keys[i + k] | (k & 1);
+
+		r = check_lookup_many(test, root, &prefix, keys, n);
+		if (r < 0)
+			goto del;
+		if (r != (n + 1) / 2) {
+			r = RESULT_FAIL;
+			goto del;
+		}
+	}
+
+	/* A missing prefix finds nothing */
+	prefix = TEST_PREFIX + 1;
+	r = check_lookup_many(test, root, &prefix, test->keys,
+			      min(batch, nr_keys));
+	if (r > 0)
+		r = RESULT_FAIL;
+
+del:
+	dm_btree_del(&test->info, root);
+out:
+	kfree(keys);
+	return r == -EINVAL ? RESULT_FAIL : r;
+}
+
+static void print_rate(const char *what, ktime_t start, ktime_t end)
+{
+	u64 ns = ktime_to_ns(ktime_sub(end, start));
+
+	pr_info("dm-btree-test: %-8s %u keys in %llu ns (%llu ns/key)\n",
+		what, nr_keys, ns, div_u64(ns, max(nr_keys, 1U)));
+}
+
+static int btree_test_insert_perf(struct btree_test *test)
+{
+	dm_block_t root_single, root_batched;
+	ktime_t t0, t1, t2;
+	int r;
+
+	t0 = ktime_get();
+	r = build_single(test, &root_single);
+	t1 = ktime_get();
+	if (r)
+		return r;
+
+	r = build_batched(test, &root_batched);
+	t2 = ktime_get();
+	if (r)
+		goto out;
+
+	print_rate("single", t0, t1);
+	print_rate("batched", t1, t2);
+
+	dm_btree_del(&test->info, root_batched);
+out:
+	dm_btree_del(&test->info, root_single);
+	return r;
+}
+
+static int btree_test_lookup_perf(struct btree_test *test)
+{
+	uint64_t prefix = TEST_PREFIX;
+	ktime_t t0, t1, t2;
+	dm_block_t root;
+	__le64 value;
+	unsigned i, n;
+	int r;
+
+	r = build_single(test, &root);
+	if (r)
+		return r;
+
+	/* Both passes walk a warm block cache */
+	t0 = ktime_get();
+	for (i = 0; i < nr_keys; i++) {
+		r = lookup_single(test, root, test->keys[i], &value);
+		if (r)
+			goto out;
+	}
+	t1 = ktime_get();
+
+	for (i = 0; i < nr_keys; i += n) {
+		n = min(batch, nr_keys - i);
+		r = dm_btree_lookup_many(&test->info, root, &prefix,
+					 test->keys + i, n,
+					 test->out, test->found);
+		if (r < 0)
+			goto out;
+	}
+	t2 = ktime_get();
+	r = 0;
+
+	print_rate("single", t0, t1);
+	print_rate("batched", t1, t2);
+
+out:
+	dm_btree_del(&test->info, root);
+	return r;
+}
+
+static const struct btree_test_case btree_test_cases[] = {
+	{
+		.name = "Batched insert read back by single lookups",
+		.run = btree_test_insert_many,
+	},
+
+	{
+		.name = "Batched lookup matches single lookups",
+		.run = btree_test_lookup_many,
+	},
+
+	{
+		.name = "Insert performance, single vs batched",
+		.run = btree_test_insert_perf,
+	},
+
+	{
+		.name = "Lookup performance, single vs batched",
+		.run = btree_test_lookup_perf,
+	},
+};
+
+static void btree_test_run(struct btree_test *test)
+{
+	int i, ret;
+
+	for (i = 0; i < ARRAY_SIZE(btree_test_cases); i++) {
+		if (testcase && testcase != i + 1)
+			continue;
+
+		pr_info("dm-btree-test: Test case %d. %s...\n",
+			i + 1, btree_test_cases[i].name);
+
+		ret = btree_test_cases[i].run(test);
+		switch (ret) {
+		case RESULT_OK:
+			pr_info("dm-btree-test: Result: OK\n");
+			break;
+		case RESULT_FAIL:
+			pr_info("dm-btree-test: Result: FAILED\n");
+			break;
+		default:
+			pr_info("dm-btree-test: Result: ERROR (%d)\n", ret);
+		}
+	}
+}
+
+static int btree_test_alloc(struct btree_test *test)
+{
+	unsigned i;
+
+	test->keys = vmalloc(nr_keys * sizeof(*test->keys));
+	test->values = vmalloc(nr_keys * sizeof(*test->values));
+	test->out = kmalloc(batch * sizeof(*test->out), GFP_KERNEL);
+	test->found = kcalloc(BITS_TO_LONGS(batch), sizeof(long), GFP_KERNEL);
+	if (!test->keys || !test->values || !test->out || !test->found)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_keys; i++) {
+		test->keys[i] = test_key(i);
+		test->values[i] = test_value(test->keys[i]);
+	}
+
+	return 0;
+}
+
+static void btree_test_free(struct btree_test *test)
+{
+	kfree(test->found);
+	kfree(test->out);
+	vfree(test->values);
+	vfree(test->keys);
+}
+
+static int __init dm_btree_test_init(void)
+{
+	struct btree_test test = { };
+	int r;
+
+	if (!dev || !nr_keys || !batch) {
+		DMERR("dev, nr_keys and batch must be set");
+		return -EINVAL;
+	}
+
+	r = btree_test_alloc(&test);
+	if (r)
+		goto out_free;
+
+	test.bdev = blkdev_get_by_path(dev, FMODE_READ | FMODE_WRITE |
+				       FMODE_EXCL, &test);
+	if (IS_ERR(test.bdev)) {
+		r = PTR_ERR(test.bdev);
+		DMERR("couldn't open %s", dev);
+		goto out_free;
+	}
+
+	test.bm = dm_block_manager_create(test.bdev, TEST_BLOCK_SIZE,
+					  TEST_CACHE_SIZE, TEST_MAX_HELD);
+	if (IS_ERR(test.bm)) {
+		r = PTR_ERR(test.bm);
+		DMERR("couldn't create block manager");
+		goto out_bdev;
+	}
+
+	r = dm_tm_create_with_sm(test.bm, 0, &test.tm, &test.sm);
+	if (r) {
+		DMERR("couldn't create transaction manager");
+		goto out_bm;
+	}
+
+	test.info.tm = test.tm;
+	test.info.levels = 2;
+	test.info.value_type.size = sizeof(__le64);
+
+	pr_info("dm-btree-test: Starting tests on %s...\n", dev);
+	btree_test_run(&test);
+	pr_info("dm-btree-test: Tests completed.\n");
+
+	dm_sm_destroy(test.sm);
+	dm_tm_destroy(test.tm);
+out_bm:
+	dm_block_manager_destroy(test.bm);
+out_bdev:
+	blkdev_put(test.bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+out_free:
+	btree_test_free(&test);
+
+	return r;
+}
+
+static void __exit dm_btree_test_exit(void)
+{
+}
+
+module_init(dm_btree_test_init);
+module_exit(dm_btree_test_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Test and benchmark of the batched persistent-data btree calls");
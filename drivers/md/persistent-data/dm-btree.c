@@ -10,6 +10,7 @@
 
 #include <linux/export.h>
 #include <linux/device-mapper.h>
+#include <linux/sort.h>
 
 #define DM_MSG_PREFIX "btree"
 
@@ -749,6 +750,247 @@ int dm_btree_insert_notify(struct dm_btree_info *info, dm_block_t root,
 }
 EXPORT_SYMBOL_GPL(dm_btree_insert_notify);
 
+/*----------------------------------------------------------------
+ * Batched lookup and insert
+ *
+ * The keys of a batch share all but the last level.  They are sorted,
+ * the outer levels are walked once, and consecutive keys that land in
+ * the same leaf share the walk down to it.  On the way down, the
+ * children the rest of the batch is going to need are prefetched, so
+ * that the reads of sibling leaves overlap.
+ *--------------------------------------------------------------*/
+#define MAX_BATCH_PREFETCH 16
+
+struct batch_key {
+	uint64_t key;
+	unsigned index;
+};
+
+static int cmp_batch_key(const void *l, const void *r)
+{
+	const struct batch_key *lk = l, *rk = r;
+
+	if (lk->key < rk->key)
+		return -1;
+
+	return lk->key > rk->key;
+}
+
+static struct batch_key *sort_batch(uint64_t *keys, unsigned nr)
+{
+	unsigned i;
+	struct batch_key *b;
+
+	b = kmalloc(nr * sizeof(*b), GFP_NOIO);
+	if (!b)
+		return NULL;
+
+	for (i = 0; i < nr; i++) {
+		b[i].key = keys[i];
+		b[i].index = i;
+	}
+	sort(b, nr, sizeof(*b), cmp_batch_key, NULL);
+
+	return b;
+}
+
+/*
+ * Finds the root of the bottom level tree for @prefix.
+ */
+static int find_subtree(struct dm_btree_info *info, dm_block_t root,
+			uint64_t *prefix, dm_block_t *subtree)
+{
+	int r = 0;
+	unsigned level;
+	uint64_t rkey;
+	__le64 root_le;
+	struct ro_spine spine;
+
+	init_ro_spine(&spine, info);
+	for (level = 0; level < info->levels - 1; level++) {
+		r = btree_lookup_raw(&spine, root, prefix[level], lower_bound,
+				     &rkey, &root_le, sizeof(root_le));
+		if (!r && rkey != prefix[level])
+			r = -ENODATA;
+		if (r)
+			break;
+
+		root = le64_to_cpu(root_le);
+	}
+	exit_ro_spine(&spine);
+
+	*subtree = root;
+	return r;
+}
+
+static void prefetch_range(struct dm_btree_info *info,
+			   struct btree_node *n, int from, int to)
+{
+	struct dm_block_manager *bm = dm_tm_get_bm(info->tm);
+
+	if (to >= from + MAX_BATCH_PREFETCH)
+		to = from + MAX_BATCH_PREFETCH - 1;
+
+	for (; from <= to; from++)
+		dm_bm_prefetch(bm, value64(n, from));
+}
+
+/*
+ * Steps down to the leaf that would hold @key, prefetching the children
+ * up to the one holding @last_key.  Every key below @hi lives in the same
+ * leaf.
+ */
+static int find_leaf(struct ro_spine *s, dm_block_t block, uint64_t key,
+		     uint64_t last_key, uint64_t *hi)
+{
+	int i, r;
+	uint32_t nr_entries;
+	struct btree_node *n;
+
+	*hi = U64_MAX;
+	for (;;) {
+		r = ro_step(s, block);
+		if (r < 0)
+			return r;
+
+		n = ro_node(s);
+		if (le32_to_cpu(n->header.flags) & LEAF_NODE)
+			return 0;
+
+		nr_entries = le32_to_cpu(n->header.nr_entries);
+		i = max(lower_bound(n, key), 0);
+		if (i + 1 < nr_entries)
+			*hi = min(*hi, le64_to_cpu(n->keys[i + 1]));
+
+		prefetch_range(s->info, n, i + 1, lower_bound(n, last_key));
+		block = value64(n, i);
+	}
+}
+
+/*
+ * Looks up the sorted keys of @b in the tree at @subtree.  With @values_le
+ * NULL this only reads the leaves in, ahead of an insert.
+ */
+static int lookup_sorted(struct dm_btree_info *info, dm_block_t subtree,
+			 struct batch_key *b, unsigned nr,
+			 void *values_le, unsigned long *found)
+{
+	int i, r = 0;
+	unsigned k, count = 0;
+	size_t size = info->value_type.size;
+	uint64_t hi = 0;
+	bool have_leaf = false;
+	struct btree_node *leaf;
+	struct ro_spine spine;
+
+	init_ro_spine(&spine, info);
+	for (k = 0; k < nr; k++) {
+		if (!have_leaf || b[k].key >= hi) {
+			r = find_leaf(&spine, subtree, b[k].key,
+				      b[nr - 1].key, &hi);
+			if (r < 0)
+				break;
+			have_leaf = true;
+		}
+
+		if (!values_le)
+			continue;
+
+		leaf = ro_node(&spine);
+		i = lower_bound(leaf, b[k].key);
+		if (i < 0 || i >= le32_to_cpu(leaf->header.nr_entries) ||
+		    le64_to_cpu(leaf->keys[i]) != b[k].key)
+			continue;
+
+		memcpy(values_le + b[k].index * size, value_ptr(leaf, i), size);
+		set_bit(b[k].index, found);
+		count++;
+	}
+	exit_ro_spine(&spine);
+
+	return r < 0 ? r : count;
+}
+
+int dm_btree_lookup_many(struct dm_btree_info *info, dm_block_t root,
+			 uint64_t *prefix, uint64_t *keys, unsigned nr,
+			 void *values_le, unsigned long *found)
+{
+	int r;
+	dm_block_t subtree;
+	struct batch_key *b;
+
+	bitmap_zero(found, nr);
+	if (!nr)
+		return 0;
+
+	r = find_subtree(info, root, prefix, &subtree);
+	if (r == -ENODATA)
+		return 0;
+	if (r < 0)
+		return r;
+
+	b = sort_batch(keys, nr);
+	if (!b)
+		return -ENOMEM;
+
+	r = lookup_sorted(info, subtree, b, nr, values_le, found);
+	kfree(b);
+
+	return r;
+}
+EXPORT_SYMBOL_GPL(dm_btree_lookup_many);
+
+int dm_btree_insert_many(struct dm_btree_info *info, dm_block_t root,
+			 uint64_t *prefix, uint64_t *keys, unsigned nr,
+			 void *values, dm_block_t *new_root)
+{
+	int r = 0;
+	unsigned k, last_level = info->levels - 1;
+	size_t size = info->value_type.size;
+	dm_block_t subtree;
+	uint64_t *full_keys;
+	struct batch_key *b;
+
+	*new_root = root;
+	if (!nr)
+		return 0;
+
+	full_keys = kmalloc(info->levels * sizeof(*full_keys), GFP_NOIO);
+	if (!full_keys)
+		return -ENOMEM;
+
+	b = sort_batch(keys, nr);
+	if (!b) {
+		kfree(full_keys);
+		return -ENOMEM;
+	}
+
+	/*
+	 * Read the leaves in first, prefetched in bulk, so that the shadow
+	 * walks below find them in the cache.  A missing subtree is created
+	 * by the first insert.
+	 */
+	if (!find_subtree(info, root, prefix, &subtree))
+		r = lookup_sorted(info, subtree, b, nr, NULL, NULL);
+	if (r < 0)
+		goto out;
+
+	memcpy(full_keys, prefix, last_level * sizeof(*full_keys));
+	for (k = 0; k < nr; k++) {
+		full_keys[last_level] = b[k].key;
+		r = insert(info, *new_root, full_keys,
+			   values + b[k].index * size, new_root, NULL);
+		if (r < 0)
+			break;
+	}
+
+out:
+	kfree(b);
+	kfree(full_keys);
+	return r < 0 ? r : 0;
+}
+EXPORT_SYMBOL_GPL(dm_btree_insert_many);
+
 /*----------------------------------------------------------------*/
 
 static int find_key(struct ro_spine *s, dm_block_t block, bool find_highest,
@@ -126,6 +126,30 @@ int dm_btree_insert_notify(struct dm_btree_info *info, dm_block_t root,
 			   int *inserted)
 			   __dm_written_to_disk(value);
 
+/*
+ * Batched variants for keys that only differ in the last level, such as
+ * the mappings of one thin device.  @prefix holds the keys of the outer
+ * (levels - 1) levels, @keys the last level keys in any order.
+ */
+
+/*
+ * Looks up @nr keys.  The value of keys[i] goes to the i'th value sized
+ * slot of @values_le, and bit i of @found is set if it was present.
+ * Returns the number of keys found.
+ */
+int dm_btree_lookup_many(struct dm_btree_info *info, dm_block_t root,
+			 uint64_t *prefix, uint64_t *keys, unsigned nr,
+			 void *values_le, unsigned long *found);
+
+/*
+ * Inserts or overwrites @nr distinct keys, with the value of keys[i] in
+ * the i'th value sized slot of @values.  On error @new_root holds the
+ * keys inserted up to then.
+ */
+int dm_btree_insert_many(struct dm_btree_info *info, dm_block_t root,
+			 uint64_t *prefix, uint64_t *keys, unsigned nr,
+			 void *values, dm_block_t *new_root);
+
 /*
  * Remove a key if present.  This doesn't remove empty sub trees.  Normally
  * subtrees represent a separate entity, like a snapshot map, so this is
@@ -120,6 +120,7 @@ struct mmc_blk_data {
 #define MMC_BLK_WRITE		BIT(1)
 #define MMC_BLK_DISCARD		BIT(2)
 #define MMC_BLK_SECDISCARD	BIT(3)
+#define MMC_BLK_CMDQ		BIT(4)
 
 	/*
 	 * Only set in main mmc_blk_data associated
@@ -1232,6 +1233,14 @@ static inline int mmc_blk_part_switch(struct mmc_card *card,
 	int ret;
 	struct mmc_blk_data *main_md = mmc_get_drvdata(card);
 
+	/*
+	 * Whoever switches partitions goes on with the legacy commands,
+	 * which the card rejects in command queue mode.
+	 */
+	ret = mmc_cmdq_switch(card, false);
+	if (ret)
+		return ret;
+
 	if (main_md->part_curr == md->part_type)
 		return 0;
 
@@ -2204,6 +2213,28 @@ free:
 	return check;
 }
 
+/*
+ * Adjust the sg list so it is the same size as the
+ * request.
+ */
+static void mmc_blk_trim_sg(struct mmc_blk_request *brq, struct request *req)
+{
+	if (brq->data.blocks != blk_rq_sectors(req)) {
+		int i, data_size = brq->data.blocks << 9;
+		struct scatterlist *sg;
+
+		for_each_sg(brq->data.sg, sg, brq->data.sg_len, i) {
+			data_size -= sg->length;
+			if (data_size <= 0) {
+				sg->length += data_size;
+				i++;
+				break;
+			}
+		}
+		brq->data.sg_len = i;
+	}
+}
+
 static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 			       struct mmc_card *card,
 			       int disable_multi,
@@ -2342,24 +2373,7 @@ static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
 	brq->data.sg = mqrq->sg;
 	brq->data.sg_len = mmc_queue_map_sg(mq, mqrq);
 
-	/*
-	 * Adjust the sg list so it is the same size as the
-	 * request.
-	 */
-	if (brq->data.blocks != blk_rq_sectors(req)) {
-		int i, data_size = brq->data.blocks << 9;
-		struct scatterlist *sg;
-
-		for_each_sg(brq->data.sg, sg, brq->data.sg_len, i) {
-			data_size -= sg->length;
-			if (data_size <= 0) {
-				sg->length += data_size;
-				i++;
-				break;
-			}
-		}
-		brq->data.sg_len = i;
-	}
+	mmc_blk_trim_sg(brq, req);
 
 	mqrq->mmc_active.mrq = &brq->mrq;
 	mqrq->mmc_active.err_check = mmc_blk_err_check;
@@ -2934,6 +2948,335 @@ out:
 	return ret;
 }
 
+/*
+ * eMMC command queueing
+ *
+ * Requests are queued on the card under a free task id with CMD44/CMD45
+ * and executed with CMD46/CMD47 in the order the card reports them ready
+ * in its Queue Status Register.  The host still moves one transfer at a
+ * time, but the card sees what is coming and picks the order, which is
+ * what random reads gain from.
+ *
+ * The card stays in command queue mode between bursts; partition
+ * switches, ioctls, discards, flushes and suspend turn it off again.
+ */
+
+/* Queue up this many tasks before executing while requests keep coming */
+#define MMC_CMDQ_BATCH		4
+/* Times a failed task is requeued before it is failed for good */
+#define MMC_CMDQ_RETRIES	3
+/* Polling of the Queue Status Register while no task is ready */
+#define MMC_CMDQ_QSR_POLL_US	100
+#define MMC_CMDQ_QSR_TIMEOUT_MS	1000
+
+static void mmc_blk_cmdq_rq_prep(struct mmc_queue_req *mqrq,
+				 struct mmc_card *card,
+				 struct mmc_queue *mq)
+{
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct request *req = mqrq->req;
+	struct mmc_blk_data *md = mq->data;
+
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+
+	/* the data address is sent with CMD45, see mmc_blk_cmdq_queue_rq() */
+	brq->cmd.arg = blk_rq_pos(req);
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_R1 | MMC_CMD_ADTC;
+	brq->data.blksz = 512;
+
+	/* the task block count is 16 bits */
+	brq->data.blocks = min3(blk_rq_sectors(req),
+				card->host->max_blk_count, 0xffffU);
+
+	if (rq_data_dir(req) == READ) {
+		brq->cmd.opcode = MMC_EXECUTE_READ_TASK;
+		brq->data.flags = MMC_DATA_READ;
+	} else {
+		brq->cmd.opcode = MMC_EXECUTE_WRITE_TASK;
+		brq->data.flags = MMC_DATA_WRITE;
+		if (mmc_req_rel_wr(req) && (md->flags & MMC_BLK_REL_WR))
+			mmc_apply_rel_rw(brq, card, req);
+	}
+
+	mmc_set_data_timeout(&brq->data, card);
+
+	brq->data.sg = mqrq->sg;
+	brq->data.sg_len = mmc_queue_map_sg(mq, mqrq);
+	mmc_blk_trim_sg(brq, req);
+}
+
+/*
+ * Queue @req on the card under the lowest free task id.
+ */
+static int mmc_blk_cmdq_queue_rq(struct mmc_queue *mq, struct request *req)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_cmdq *cmdq = mq->cmdq;
+	struct mmc_queue_req *mqrq;
+	struct mmc_blk_request *brq;
+	unsigned int tag;
+	u32 params, addr;
+	int err;
+
+	tag = ffz(cmdq->tags);
+	mqrq = &cmdq->mqrq[tag];
+	brq = &mqrq->brq;
+
+	mqrq->req = req;
+	mmc_blk_cmdq_rq_prep(mqrq, card, mq);
+
+	params = MMC_CMDQ_TASK_ID(tag) | brq->data.blocks;
+	if (rq_data_dir(req) == READ)
+		params |= MMC_CMDQ_DATA_DIR_READ;
+	else if (mmc_req_rel_wr(req) && (md->flags & MMC_BLK_REL_WR))
+		params |= MMC_CMDQ_REL_WR;
+	if (req->cmd_flags & (REQ_META | REQ_PRIO))
+		params |= MMC_CMDQ_PRIO;
+
+	addr = brq->cmd.arg;
+	brq->cmd.arg = MMC_CMDQ_TASK_ID(tag);
+
+	err = mmc_cmdq_queue_task(card, params, addr);
+	if (err) {
+		mqrq->req = NULL;
+		return err;
+	}
+
+	__set_bit(tag, &cmdq->tags);
+	return 0;
+}
+
+/*
+ * Execute one task the card has ready, waiting up to
+ * MMC_CMDQ_QSR_TIMEOUT_MS for one to become ready.  On error *failed is
+ * the request of the task that failed, if it got that far.
+ */
+static int mmc_blk_cmdq_execute(struct mmc_queue *mq, struct request **failed)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_cmdq *cmdq = mq->cmdq;
+	struct mmc_queue_req *mqrq;
+	struct mmc_blk_request *brq;
+	struct request *req;
+	unsigned long timeout;
+	unsigned int tag, gen_err = 0;
+	u32 qsr;
+	int err;
+
+	if (!cmdq->tags)
+		return 0;
+
+	timeout = jiffies + msecs_to_jiffies(MMC_CMDQ_QSR_TIMEOUT_MS);
+	for (;;) {
+		err = mmc_cmdq_status(card, &qsr);
+		if (err)
+			return err;
+
+		qsr &= cmdq->tags;
+		if (qsr)
+			break;
+
+		if (time_after(jiffies, timeout)) {
+			pr_err("%s: no task ready after %d ms, %lu queued\n",
+			       md->disk->disk_name, MMC_CMDQ_QSR_TIMEOUT_MS,
+			       hweight_long(cmdq->tags));
+			return -ETIMEDOUT;
+		}
+		usleep_range(MMC_CMDQ_QSR_POLL_US, 2 * MMC_CMDQ_QSR_POLL_US);
+	}
+
+	tag = __ffs(qsr);
+	mqrq = &cmdq->mqrq[tag];
+	brq = &mqrq->brq;
+	req = mqrq->req;
+
+	mmc_wait_for_req(card->host, &brq->mrq);
+
+	err = brq->cmd.error ? brq->cmd.error : brq->data.error;
+	if (!err && (brq->cmd.resp[0] & CMD_ERRORS))
+		err = -EIO;
+	/* reliable writes are only durable once the card is out of busy */
+	if (!err && mmc_req_rel_wr(req) && (md->flags & MMC_BLK_REL_WR))
+		err = card_busy_detect(card, MMC_BLK_TIMEOUT_MS, false, req,
+				       &gen_err);
+	if (err) {
+		pr_err("%s: task %u failed: cmd %d data %d resp %#x\n",
+		       req->rq_disk->disk_name, tag, brq->cmd.error,
+		       brq->data.error, brq->cmd.resp[0]);
+		*failed = req;
+		return err;
+	}
+
+	__clear_bit(tag, &cmdq->tags);
+	mqrq->req = NULL;
+	mmc_blk_reset_success(md, MMC_BLK_CMDQ);
+
+	/* whatever did not fit into the task goes round again */
+	if (blk_end_request(req, 0, brq->data.bytes_xfered)) {
+		spin_lock_irq(mq->queue->queue_lock);
+		blk_requeue_request(mq->queue, req);
+		spin_unlock_irq(mq->queue->queue_lock);
+	}
+
+	return 0;
+}
+
+/*
+ * Get the card out of command queue mode with nothing queued, and give
+ * every queued request back to the block layer.  @failed, the request
+ * that hit the error, is failed once it ran out of retries.
+ */
+static void mmc_blk_cmdq_recover(struct mmc_queue *mq, struct request *failed,
+				 int error)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_cmdq *cmdq = mq->cmdq;
+	struct request_queue *q = mq->queue;
+	unsigned int tag;
+	int err;
+
+	pr_err("%s: command queue error %d, requeueing %lu tasks\n",
+	       md->disk->disk_name, error, hweight_long(cmdq->tags));
+
+	err = 0;
+	if (card->ext_csd.cmdq_en) {
+		err = mmc_cmdq_discard_queue(card);
+		if (!err)
+			err = mmc_cmdq_switch(card, false);
+	}
+	if (err) {
+		/* the card state is unknown, start over */
+		err = mmc_blk_reset(md, card->host, MMC_BLK_CMDQ);
+		if (err && err != -ENODEV) {
+			pr_err("%s: unable to leave command queue mode, falling back to single requests\n",
+			       md->disk->disk_name);
+			cmdq->disabled = true;
+		}
+	}
+
+	spin_lock_irq(q->queue_lock);
+	for_each_set_bit(tag, &cmdq->tags, cmdq->depth) {
+		struct request *req = cmdq->mqrq[tag].req;
+
+		cmdq->mqrq[tag].req = NULL;
+		if (req != failed)
+			blk_requeue_request(q, req);
+	}
+	cmdq->tags = 0;
+
+	if (failed) {
+		if (++failed->errors <= MMC_CMDQ_RETRIES)
+			blk_requeue_request(q, failed);
+		else
+			__blk_end_request_all(failed, -EIO);
+	}
+	spin_unlock_irq(q->queue_lock);
+}
+
+/*
+ * Run every queued task, before a request that needs the legacy commands.
+ */
+static int mmc_blk_cmdq_drain(struct mmc_queue *mq)
+{
+	struct request *failed = NULL;
+	int err;
+
+	while (mq->cmdq->tags) {
+		err = mmc_blk_cmdq_execute(mq, &failed);
+		if (err) {
+			mmc_blk_cmdq_recover(mq, failed, err);
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+static int mmc_blk_cmdq_issue_rq(struct mmc_queue *mq, struct request *req)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_cmdq *cmdq = mq->cmdq;
+	struct request *failed = NULL;
+	int ret = 1, err;
+
+	if (req && !cmdq->host_claimed) {
+		mmc_get_card(card);
+		cmdq->host_claimed = true;
+
+#ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
+		if (mmc_bus_needs_resume(card->host))
+			mmc_resume_bus(card->host);
+#endif
+	}
+
+	if (req && (req->cmd_flags & MMC_REQ_SPECIAL_MASK)) {
+		/*
+		 * Discard and flush are legacy commands: drain the queue
+		 * and leave command queue mode first.  A drain error has
+		 * left the card out of it already.
+		 */
+		mmc_blk_cmdq_drain(mq);
+		ret = mmc_blk_part_switch(card, md);
+		if (ret) {
+			blk_end_request_all(req, -EIO);
+			ret = 0;
+		} else if (req->cmd_flags & REQ_DISCARD) {
+			if (req->cmd_flags & REQ_SECURE)
+				ret = mmc_blk_issue_secdiscard_rq(mq, req);
+			else
+				ret = mmc_blk_issue_discard_rq(mq, req);
+		} else {
+			ret = mmc_blk_issue_flush(mq, req);
+		}
+		goto out;
+	}
+
+	if (req) {
+		err = 0;
+		/* nobody switched partitions while the queue was on */
+		if (!card->ext_csd.cmdq_en) {
+			err = mmc_blk_part_switch(card, md);
+			if (!err)
+				err = mmc_cmdq_switch(card, true);
+		}
+		if (!err)
+			err = mmc_blk_cmdq_queue_rq(mq, req);
+		if (err) {
+			mmc_blk_cmdq_recover(mq, req, err);
+			ret = 0;
+			goto out;
+		}
+	}
+
+	/*
+	 * Let the queue fill up a little while requests keep coming, so
+	 * the card has something to choose from.
+	 */
+	if (!req || hweight_long(cmdq->tags) >= MMC_CMDQ_BATCH) {
+		err = mmc_blk_cmdq_execute(mq, &failed);
+		if (err) {
+			mmc_blk_cmdq_recover(mq, failed, err);
+			ret = 0;
+		}
+	}
+
+out:
+	/* release host once nothing is queued on the card */
+	if (!cmdq->tags && cmdq->host_claimed) {
+		cmdq->host_claimed = false;
+		mmc_put_card(card);
+	}
+	return ret;
+}
+
 static inline int mmc_blk_readonly(struct mmc_card *card)
 {
 	return mmc_card_readonly(card) ||
@@ -2997,6 +3340,7 @@ static struct mmc_blk_data *mmc_blk_alloc_req(struct mmc_card *card,
 		goto err_putdisk;
 
 	md->queue.issue_fn = mmc_blk_issue_rq;
+	md->queue.cmdq_issue_fn = mmc_blk_cmdq_issue_rq;
 	md->queue.data = md;
 
 	md->disk->major	= MMC_BLOCK_MAJOR;
@@ -3050,8 +3394,15 @@ static struct mmc_blk_data *mmc_blk_alloc_req(struct mmc_card *card,
 		blk_queue_flush(md->queue.queue, REQ_FLUSH | REQ_FUA);
 	}
 
+	/* Packed commands are not allowed in command queue mode */
+	if (mmc_card_mmc(card) &&
+	    (area_type == MMC_BLK_DATA_AREA_MAIN) &&
+	    mmc_card_cmdq(card))
+		mmc_cmdq_init(&md->queue, card);
+
 	if (mmc_card_mmc(card) &&
 	    (area_type == MMC_BLK_DATA_AREA_MAIN) &&
+	    !md->queue.cmdq &&
 	    (md->flags & MMC_BLK_CMD23) &&
 	    card->ext_csd.packed_event_en) {
 		if (!mmc_packed_init(&md->queue, card))
@@ -3161,6 +3512,7 @@ static void mmc_blk_remove_req(struct mmc_blk_data *md)
 		mmc_cleanup_queue(&md->queue);
 		if (md->flags & MMC_BLK_PACKED_CMD)
 			mmc_packed_clean(&md->queue);
+		mmc_cmdq_clean(&md->queue);
 		if (md->disk->flags & GENHD_FL_UP) {
 			device_remove_file(disk_to_dev(md->disk), &md->force_ro);
 			if ((md->area_type & MMC_BLK_DATA_AREA_BOOT) &&
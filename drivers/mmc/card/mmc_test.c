@@ -2330,6 +2330,72 @@ static int mmc_test_profile_sglen_r_nonblock_perf(struct mmc_test_card *test)
 	return mmc_test_rw_multiple_sg_len(test, &test_data);
 }
 
+/*
+ * Sequential throughput of the same transfers issued one at a time and
+ * with the next request prepared while the current one runs, to see what
+ * the host's pre_req/post_req buys.
+ */
+static int mmc_test_seq_pipeline_perf(struct mmc_test_card *test, int write)
+{
+	struct mmc_test_area *t = &test->area;
+	unsigned long sizes[] = {1 << 16, 1 << 17, 1 << 18, 1 << 19};
+	struct mmc_host *host = test->card->host;
+	struct timespec ts1, ts2, ts;
+	unsigned int rate[2], cnt, i;
+	unsigned long sz;
+	int nonblock, ret;
+
+	if (!host->ops->pre_req || !host->ops->post_req) {
+		pr_info("%s: host has no pre_req/post_req\n",
+			mmc_hostname(host));
+		return RESULT_UNSUP_HOST;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		sz = min_t(unsigned long, sizes[i], t->max_tfr);
+		cnt = t->max_sz / sz;
+		if (i && sz == min_t(unsigned long, sizes[i - 1], t->max_tfr))
+			break;
+
+		for (nonblock = 0; nonblock < 2; nonblock++) {
+			getnstimeofday(&ts1);
+			ret = mmc_test_area_io_seq(test, sz, t->dev_addr, write,
+						   0, 0, cnt, nonblock, 0);
+			if (ret)
+				return ret;
+			getnstimeofday(&ts2);
+
+			mmc_test_print_avg_rate(test, sz, cnt, &ts1, &ts2);
+			ts = timespec_sub(ts2, ts1);
+			rate[nonblock] = mmc_test_rate((uint64_t)sz * cnt, &ts);
+		}
+
+		pr_info("%s: %lu KiB requests: non-blocking %u KiB/s, "
+			"blocking %u KiB/s (%+d%%)\n",
+			mmc_hostname(host), sz >> 10, rate[1] / 1024,
+			rate[0] / 1024, rate[0] ?
+			(int)div_u64((u64)rate[1] * 100, rate[0]) - 100 : 0);
+	}
+
+	return 0;
+}
+
+/*
+ * Sequential read throughput, blocking vs non-blocking requests.
+ */
+static int mmc_test_seq_pipeline_read_perf(struct mmc_test_card *test)
+{
+	return mmc_test_seq_pipeline_perf(test, 0);
+}
+
+/*
+ * Sequential write throughput, blocking vs non-blocking requests.
+ */
+static int mmc_test_seq_pipeline_write_perf(struct mmc_test_card *test)
+{
+	return mmc_test_seq_pipeline_perf(test, 1);
+}
+
 /*
  * eMMC hardware reset.
  */
@@ -2682,6 +2748,20 @@ static const struct mmc_test_case mmc_test_cases[] = {
 		.name = "eMMC hardware reset",
 		.run = mmc_test_hw_reset,
 	},
+
+	{
+		.name = "Sequential read throughput, blocking vs non-blocking req",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_seq_pipeline_read_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Sequential write throughput, blocking vs non-blocking req",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_seq_pipeline_write_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
@@ -49,10 +49,86 @@ static int mmc_prep_request(struct request_queue *q, struct request *req)
 	return BLKPREP_OK;
 }
 
+/*
+ * One pass of the queue thread: fetch the next request and hand it to
+ * issue_fn together with the one still in flight.  Returns false when
+ * there was nothing to do.
+ */
+static bool mmc_queue_thread_step(struct mmc_queue *mq)
+{
+	struct request_queue *q = mq->queue;
+	struct request *req = NULL;
+	struct mmc_queue_req *tmp;
+	unsigned int cmd_flags = 0;
+
+	spin_lock_irq(q->queue_lock);
+	set_current_state(TASK_INTERRUPTIBLE);
+	if (mq->mqrq_prev->req &&
+			(mq->card && (mq->card->type == MMC_TYPE_SD) &&
+			mq->card->host->pm_progress))
+		req = NULL;
+	else
+		req = blk_fetch_request(q);
+	mq->mqrq_cur->req = req;
+	spin_unlock_irq(q->queue_lock);
+
+	if (!req && !mq->mqrq_prev->req)
+		return false;
+
+	set_current_state(TASK_RUNNING);
+	cmd_flags = req ? req->cmd_flags : 0;
+	mq->issue_fn(mq, req);
+	if (mq->flags & MMC_QUEUE_NEW_REQUEST) {
+		mq->flags &= ~MMC_QUEUE_NEW_REQUEST;
+		return true; /* fetch again */
+	}
+
+	/*
+	 * Current request becomes previous request
+	 * and vice versa.
+	 * In case of special requests, current request
+	 * has been finished. Do not assign it to previous
+	 * request.
+	 */
+	if (cmd_flags & MMC_REQ_SPECIAL_MASK)
+		mq->mqrq_cur->req = NULL;
+
+	mq->mqrq_prev->brq.mrq.data = NULL;
+	mq->mqrq_prev->req = NULL;
+	tmp = mq->mqrq_prev;
+	mq->mqrq_prev = mq->mqrq_cur;
+	mq->mqrq_cur = tmp;
+	return true;
+}
+
+/*
+ * Command queue version: keep fetching while a task id is free, and call
+ * cmdq_issue_fn as long as anything is queued on the card or the host is
+ * still held, so it gets to execute and complete the queued tasks.
+ */
+static bool mmc_cmdq_thread_step(struct mmc_queue *mq)
+{
+	struct request_queue *q = mq->queue;
+	struct mmc_cmdq *cmdq = mq->cmdq;
+	struct request *req = NULL;
+
+	spin_lock_irq(q->queue_lock);
+	set_current_state(TASK_INTERRUPTIBLE);
+	if (hweight_long(cmdq->tags) < cmdq->depth)
+		req = blk_fetch_request(q);
+	spin_unlock_irq(q->queue_lock);
+
+	if (!req && !cmdq->tags && !cmdq->host_claimed)
+		return false;
+
+	set_current_state(TASK_RUNNING);
+	mq->cmdq_issue_fn(mq, req);
+	return true;
+}
+
 static int mmc_queue_thread(void *d)
 {
 	struct mmc_queue *mq = d;
-	struct request_queue *q = mq->queue;
 	struct sched_param scheduler_params = {0};
 
 	scheduler_params.sched_priority = 1;
@@ -63,54 +139,22 @@ static int mmc_queue_thread(void *d)
 
 	down(&mq->thread_sem);
 	do {
-		struct request *req = NULL;
-		struct mmc_queue_req *tmp;
-		unsigned int cmd_flags = 0;
-
-		spin_lock_irq(q->queue_lock);
-		set_current_state(TASK_INTERRUPTIBLE);
-		if (mq->mqrq_prev->req &&
-				(mq->card && (mq->card->type == MMC_TYPE_SD) &&
-				mq->card->host->pm_progress))
-			req = NULL;
+		bool busy;
+
+		if (mq->cmdq && !mq->cmdq->disabled)
+			busy = mmc_cmdq_thread_step(mq);
 		else
-			req = blk_fetch_request(q);
-		mq->mqrq_cur->req = req;
-		spin_unlock_irq(q->queue_lock);
+			busy = mmc_queue_thread_step(mq);
+		if (busy)
+			continue;
 
-		if (req || mq->mqrq_prev->req) {
+		if (kthread_should_stop()) {
 			set_current_state(TASK_RUNNING);
-			cmd_flags = req ? req->cmd_flags : 0;
-			mq->issue_fn(mq, req);
-			if (mq->flags & MMC_QUEUE_NEW_REQUEST) {
-				mq->flags &= ~MMC_QUEUE_NEW_REQUEST;
-				continue; /* fetch again */
-			}
-
-			/*
-			 * Current request becomes previous request
-			 * and vice versa.
-			 * In case of special requests, current request
-			 * has been finished. Do not assign it to previous
-			 * request.
-			 */
-			if (cmd_flags & MMC_REQ_SPECIAL_MASK)
-				mq->mqrq_cur->req = NULL;
-
-			mq->mqrq_prev->brq.mrq.data = NULL;
-			mq->mqrq_prev->req = NULL;
-			tmp = mq->mqrq_prev;
-			mq->mqrq_prev = mq->mqrq_cur;
-			mq->mqrq_cur = tmp;
-		} else {
-			if (kthread_should_stop()) {
-				set_current_state(TASK_RUNNING);
-				break;
-			}
-			up(&mq->thread_sem);
-			schedule();
-			down(&mq->thread_sem);
+			break;
 		}
+		up(&mq->thread_sem);
+		schedule();
+		down(&mq->thread_sem);
 	} while (1);
 	up(&mq->thread_sem);
 
@@ -442,6 +486,67 @@ void mmc_packed_clean(struct mmc_queue *mq)
 	mqrq_prev->packed = NULL;
 }
 
+/*
+ * Set up the per task id requests.  The main area only, and only without
+ * a bounce buffer: one per task id would be too much memory.
+ */
+int mmc_cmdq_init(struct mmc_queue *mq, struct mmc_card *card)
+{
+	struct mmc_host *host = card->host;
+	struct mmc_cmdq *cmdq;
+	int i, ret;
+
+	if (mq->mqrq[0].bounce_buf)
+		return -EINVAL;
+
+	cmdq = kzalloc(sizeof(struct mmc_cmdq), GFP_KERNEL);
+	if (!cmdq)
+		return -ENOMEM;
+
+	cmdq->depth = min_t(unsigned int, card->ext_csd.cmdq_depth,
+			    MMC_CMDQ_MAX_DEPTH);
+	cmdq->mqrq = kcalloc(cmdq->depth, sizeof(struct mmc_queue_req),
+			     GFP_KERNEL);
+	if (!cmdq->mqrq) {
+		ret = -ENOMEM;
+		goto free_cmdq;
+	}
+
+	for (i = 0; i < cmdq->depth; i++) {
+		cmdq->mqrq[i].sg = mmc_alloc_sg(host->max_segs, &ret);
+		if (ret)
+			goto free_sg;
+	}
+
+	mq->cmdq = cmdq;
+	return 0;
+
+ free_sg:
+	while (--i >= 0)
+		kfree(cmdq->mqrq[i].sg);
+	kfree(cmdq->mqrq);
+ free_cmdq:
+	kfree(cmdq);
+	pr_warn("%s: unable to allocate command queue\n",
+		mmc_card_name(card));
+	return ret;
+}
+
+void mmc_cmdq_clean(struct mmc_queue *mq)
+{
+	struct mmc_cmdq *cmdq = mq->cmdq;
+	int i;
+
+	if (!cmdq)
+		return;
+
+	mq->cmdq = NULL;
+	for (i = 0; i < cmdq->depth; i++)
+		kfree(cmdq->mqrq[i].sg);
+	kfree(cmdq->mqrq);
+	kfree(cmdq);
+}
+
 /**
  * mmc_queue_suspend - suspend a MMC request queue
  * @mq: MMC queue to suspend
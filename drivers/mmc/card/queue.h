@@ -43,6 +43,20 @@ struct mmc_queue_req {
 	struct mmc_packed	*packed;
 };
 
+/*
+ * eMMC command queue: each task id owns one mmc_queue_req for the whole
+ * time its request is queued on the card.
+ */
+#define MMC_CMDQ_MAX_DEPTH	32
+
+struct mmc_cmdq {
+	unsigned int		depth;
+	unsigned long		tags;		/* task ids queued on the card */
+	struct mmc_queue_req	*mqrq;		/* indexed by task id */
+	bool			host_claimed;
+	bool			disabled;	/* back to one request at a time */
+};
+
 struct mmc_queue {
 	struct mmc_card		*card;
 	struct task_struct	*thread;
@@ -52,11 +66,14 @@ struct mmc_queue {
 #define MMC_QUEUE_NEW_REQUEST	(1 << 1)
 
 	int			(*issue_fn)(struct mmc_queue *, struct request *);
+	int			(*cmdq_issue_fn)(struct mmc_queue *,
+						 struct request *);
 	void			*data;
 	struct request_queue	*queue;
 	struct mmc_queue_req	mqrq[2];
 	struct mmc_queue_req	*mqrq_cur;
 	struct mmc_queue_req	*mqrq_prev;
+	struct mmc_cmdq		*cmdq;
 #ifdef CONFIG_MMC_SIMULATE_MAX_SPEED
 	atomic_t max_write_speed;
 	atomic_t max_read_speed;
@@ -81,6 +98,9 @@ extern void mmc_queue_bounce_post(struct mmc_queue_req *);
 extern int mmc_packed_init(struct mmc_queue *, struct mmc_card *);
 extern void mmc_packed_clean(struct mmc_queue *);
 
+extern int mmc_cmdq_init(struct mmc_queue *, struct mmc_card *);
+extern void mmc_cmdq_clean(struct mmc_queue *);
+
 extern int mmc_access_rpmb(struct mmc_queue *);
 
 #endif
@@ -713,6 +713,16 @@ static int mmc_read_ext_csd(struct mmc_card *card, u8 *ext_csd)
 		card->ext_csd.device_life_time_est_typ_b =
 			ext_csd[EXT_CSD_DEVICE_LIFE_TIME_EST_TYPE_B];
 	}
+
+	/* eMMC v5.1 or later */
+	if (card->ext_csd.rev >= 8) {
+		if ((ext_csd[EXT_CSD_CMDQ_SUPPORT] & 0x1) &&
+		    (card->host->caps2 & MMC_CAP2_CMDQ))
+			card->ext_csd.cmdq_depth =
+				(ext_csd[EXT_CSD_CMDQ_DEPTH] & 0x1f) + 1;
+		else
+			card->ext_csd.cmdq_depth = 0;
+	}
 out:
 	return err;
 }
@@ -1749,6 +1759,9 @@ static int mmc_init_card(struct mmc_host *host, u32 ocr,
 		}
 	}
 
+	/* The card comes out of (re)initialization with the queue off */
+	card->ext_csd.cmdq_en = false;
+
 	if (!oldcard)
 		host->card = card;
 
@@ -1911,6 +1924,11 @@ static int _mmc_suspend(struct mmc_host *host, bool is_suspend)
 			goto out;
 	}
 
+	/* Sleep and power off notification are legacy commands */
+	err = mmc_cmdq_switch(host->card, false);
+	if (err)
+		goto out;
+
 	err = mmc_flush_cache(host->card);
 	if (err)
 		goto out;
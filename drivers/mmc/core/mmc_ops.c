@@ -675,3 +675,105 @@ int mmc_send_hpi_cmd(struct mmc_card *card, u32 *status)
 
 	return 0;
 }
+
+/**
+ * mmc_cmdq_switch - turn the card's command queue on or off
+ * @card: eMMC card with a command queue
+ * @enable: new state
+ *
+ * CMDQ_MODE_EN can only be changed with the queue empty, and while it is
+ * set the card rejects the legacy data transfer commands.
+ */
+int mmc_cmdq_switch(struct mmc_card *card, bool enable)
+{
+	int err;
+
+	if (card->ext_csd.cmdq_en == enable)
+		return 0;
+
+	err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_CMDQ_MODE_EN,
+			 enable, card->ext_csd.generic_cmd6_time);
+	if (!err)
+		card->ext_csd.cmdq_en = enable;
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(mmc_cmdq_switch);
+
+/**
+ * mmc_cmdq_queue_task - queue a data transfer task on the card
+ * @card: eMMC card in command queue mode
+ * @params: MMC_QUE_TASK_PARAMS argument, task id included
+ * @addr: data address of the task
+ *
+ * Sends the CMD44/CMD45 pair.  Neither is retried here: a CMD45 that
+ * did not make it leaves the task half defined, the caller has to
+ * discard the queue.
+ */
+int mmc_cmdq_queue_task(struct mmc_card *card, u32 params, u32 addr)
+{
+	struct mmc_command cmd = {0};
+	int err;
+
+	cmd.opcode = MMC_QUE_TASK_PARAMS;
+	cmd.arg = params;
+	cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
+	err = mmc_wait_for_cmd(card->host, &cmd, 0);
+	if (err)
+		return err;
+
+	memset(&cmd, 0, sizeof(struct mmc_command));
+	cmd.opcode = MMC_QUE_TASK_ADDR;
+	cmd.arg = addr;
+	cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
+	err = mmc_wait_for_cmd(card->host, &cmd, 0);
+	if (err)
+		return err;
+
+	/* CMD44 errors are reported in the response to CMD45 */
+	if (cmd.resp[0] & (R1_OUT_OF_RANGE | R1_ADDRESS_ERROR |
+			   R1_ILLEGAL_COMMAND | R1_ERROR))
+		return -EIO;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mmc_cmdq_queue_task);
+
+/**
+ * mmc_cmdq_status - read the card's Queue Status Register
+ * @card: eMMC card in command queue mode
+ * @qsr: one bit per task id, set once the task is ready for execution
+ */
+int mmc_cmdq_status(struct mmc_card *card, u32 *qsr)
+{
+	struct mmc_command cmd = {0};
+	int err;
+
+	cmd.opcode = MMC_SEND_STATUS;
+	cmd.arg = card->rca << 16 | MMC_SEND_STATUS_SQS;
+	cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
+	err = mmc_wait_for_cmd(card->host, &cmd, MMC_CMD_RETRIES);
+	if (err)
+		return err;
+
+	*qsr = cmd.resp[0];
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mmc_cmdq_status);
+
+/**
+ * mmc_cmdq_discard_queue - drop every task queued on the card
+ * @card: eMMC card in command queue mode
+ */
+int mmc_cmdq_discard_queue(struct mmc_card *card)
+{
+	struct mmc_command cmd = {0};
+
+	cmd.opcode = MMC_CMDQ_TASK_MGMT;
+	cmd.arg = MMC_CMDQ_DISCARD_QUEUE;
+	cmd.flags = MMC_RSP_R1B | MMC_CMD_AC;
+	cmd.busy_timeout = card->ext_csd.generic_cmd6_time;
+
+	return mmc_wait_for_cmd(card->host, &cmd, MMC_CMD_RETRIES);
+}
+EXPORT_SYMBOL_GPL(mmc_cmdq_discard_queue);
@@ -679,6 +679,8 @@ static u32 dw_mci_prep_stop_abort(struct dw_mci *host, struct mmc_command *cmd)
 	    cmdr == MMC_READ_MULTIPLE_BLOCK ||
 	    cmdr == MMC_WRITE_BLOCK ||
 	    cmdr == MMC_WRITE_MULTIPLE_BLOCK ||
+	    cmdr == MMC_EXECUTE_READ_TASK ||
+	    cmdr == MMC_EXECUTE_WRITE_TASK ||
 	    cmdr == MMC_SEND_TUNING_BLOCK ||
 	    cmdr == MMC_SEND_TUNING_BLOCK_HS200) {
 		stop->opcode = MMC_STOP_TRANSMISSION;
@@ -834,15 +836,21 @@ static void dw_mci_idmac_complete_dma(struct dw_mci *host)
 extern volatile unsigned int disk_key_flag;
 extern spinlock_t disk_key_lock;
 
-static void dw_mci_translate_sglist(struct dw_mci *host, struct mmc_data *data,
-				    unsigned int sg_len)
+/*
+ * Build the descriptors for @data in descriptor ring @ring.  Returns
+ * nonzero if FMP could not set up a descriptor.
+ */
+static int dw_mci_translate_sglist(struct dw_mci *host, struct mmc_data *data,
+				   unsigned int sg_len, unsigned int ring)
 {
 	int i, j;
 	int desc_cnt = 0;
+	int err = 0;
 	unsigned int rw_size = DW_MMC_MAX_TRANSFER_SIZE;
+	void *ring_cpu = host->sg_cpu + ring * host->desc_ring;
 
 	if (host->dma_64bit_address == true) {
-		struct idmac_desc_64addr *desc = host->sg_cpu;
+		struct idmac_desc_64addr *desc = ring_cpu;
 #if defined(CONFIG_MMC_DW_FMP_DM_CRYPT) || defined(CONFIG_MMC_DW_FMP_ECRYPT_FS)
 		unsigned int sector = 0;
 		unsigned int sector_key = DW_MMC_BYPASS_SECTOR_BEGIN;
@@ -911,7 +919,6 @@ static void dw_mci_translate_sglist(struct dw_mci *host, struct mmc_data *data,
 				/* Physical address to DMA to/from */
 				desc->des4 = mem_addr & 0xffffffff;
 				desc->des5 = mem_addr >> 32;
-				desc->des7 = 0;
 
 #if defined(CONFIG_MMC_DW_FMP_DM_CRYPT) || defined(CONFIG_MMC_DW_FMP_ECRYPT_FS)
 				if (sector_key == DW_MMC_BYPASS_SECTOR_BEGIN) {
@@ -921,13 +928,9 @@ static void dw_mci_translate_sglist(struct dw_mci *host, struct mmc_data *data,
 					int ret;
 
 					ret = fmp_map_sg(host, desc, i, sector_key, sector, data);
-					if (ret) {
+					if (ret && !err) {
 						dev_err(host->dev, "Failed to make mmc fmp descriptor. ret = 0x%x\n", ret);
-						spin_lock(&host->lock);
-						host->mrq->cmd->error = -ENOKEY;
-						dw_mci_request_end(host, host->mrq);
-						host->state = STATE_IDLE;
-						spin_unlock(&host->lock);
+						err = ret;
 					}
 				}
 				sector += rw_size / DW_MMC_SECTOR_SIZE;
@@ -940,17 +943,17 @@ static void dw_mci_translate_sglist(struct dw_mci *host, struct mmc_data *data,
 		}
 
 		/* Set first descriptor */
-		desc = host->sg_cpu;
+		desc = ring_cpu;
 		desc->des0 |= IDMAC_DES0_FD;
 
 		/* Set last descriptor */
-		desc = host->sg_cpu + (desc_cnt - 1) *
+		desc = ring_cpu + (desc_cnt - 1) *
 				sizeof(struct idmac_desc_64addr);
 		desc->des0 &= ~(IDMAC_DES0_CH | IDMAC_DES0_DIC);
 		desc->des0 |= IDMAC_DES0_LD;
 
 	} else {
-		struct idmac_desc *desc = host->sg_cpu;
+		struct idmac_desc *desc = ring_cpu;
 
 		for (i = 0; i < sg_len; i++, desc++) {
 			unsigned int length = sg_dma_len(&data->sg[i]);
@@ -970,23 +973,87 @@ static void dw_mci_translate_sglist(struct dw_mci *host, struct mmc_data *data,
 		}
 
 		/* Set first descriptor */
-		desc = host->sg_cpu;
+		desc = ring_cpu;
 		desc->des0 |= IDMAC_DES0_FD;
 
 		/* Set last descriptor */
-		desc = host->sg_cpu + (i - 1) * sizeof(struct idmac_desc);
+		desc = ring_cpu + (i - 1) * sizeof(struct idmac_desc);
 		desc->des0 &= ~(IDMAC_DES0_CH | IDMAC_DES0_DIC);
 		desc->des0 |= IDMAC_DES0_LD;
 	}
 
 	wmb();
+
+	return err;
+}
+
+static void dw_mci_idmac_set_base(struct dw_mci *host, unsigned int ring)
+{
+	dma_addr_t base = host->sg_dma + ring * host->desc_ring;
+
+	if (host->dma_64bit_address == true) {
+		mci_writel(host, DBADDRL, base & 0xffffffff);
+		mci_writel(host, DBADDRU, (u64)base >> 32);
+	} else {
+		mci_writel(host, DBADDR, base);
+	}
+}
+
+/*
+ * Whether pre_req may build the descriptors of the next request while the
+ * current one is transferred.  FMP fills in its descriptor fields from
+ * the request as it is issued, and with several slots a request can be
+ * started from the tasklet meanwhile.
+ */
+static bool dw_mci_idmac_can_prebuild(struct dw_mci *host)
+{
+	if (host->pdata->num_slots > 1)
+		return false;
+#if defined(CONFIG_MMC_DW_FMP_ECRYPT_FS)
+	return false;
+#elif defined(CONFIG_MMC_DW_FMP_DM_CRYPT)
+	return !(host->pdata->quirks & DW_MCI_QUIRK_USE_SMU);
+#else
+	return true;
+#endif
+}
+
+/*
+ * Called from pre_req with the last transfer possibly still running on
+ * ring desc_cur: build into the other one.
+ */
+static void dw_mci_idmac_prebuild(struct dw_mci *host, struct mmc_data *data,
+				  unsigned int sg_len)
+{
+	if (!dw_mci_idmac_can_prebuild(host))
+		return;
+
+	dw_mci_translate_sglist(host, data, sg_len, host->desc_cur ^ 1);
+	host->desc_pre_data = data;
 }
 
 static void dw_mci_idmac_start_dma(struct dw_mci *host, unsigned int sg_len)
 {
+	struct mmc_data *data = host->data;
 	u32 temp;
+	int err = 0;
+
+	if (data && data == host->desc_pre_data)
+		host->desc_cur ^= 1;
+	else
+		err = dw_mci_translate_sglist(host, data, sg_len,
+					      host->desc_cur);
+	host->desc_pre_data = NULL;
+
+	dw_mci_idmac_set_base(host, host->desc_cur);
 
-	dw_mci_translate_sglist(host, host->data, sg_len);
+	if (err) {
+		spin_lock(&host->lock);
+		host->mrq->cmd->error = -ENOKEY;
+		dw_mci_request_end(host, host->mrq);
+		host->state = STATE_IDLE;
+		spin_unlock(&host->lock);
+	}
 
 	/* Select IDMAC interface */
 	temp = mci_readl(host, CTRL);
@@ -1006,44 +1073,52 @@ static void dw_mci_idmac_start_dma(struct dw_mci *host, unsigned int sg_len)
 
 static int dw_mci_idmac_init(struct dw_mci *host)
 {
-	int i;
-	dma_addr_t addr;
+	int i, ring;
+	dma_addr_t addr, base;
 
+	/* Forward link each of the DW_MCI_DESC_RINGS descriptor rings */
 	if (host->dma_64bit_address == true) {
 		struct idmac_desc_64addr *p;
 		/* Number of descriptors in the ring buffer */
 		host->ring_size = host->desc_sz * PAGE_SIZE / sizeof(struct idmac_desc_64addr);
 
-		/* Forward link the descriptor list */
-		for (i = 0, p = host->sg_cpu; i < host->ring_size *
-				MMC_DW_IDMAC_MULTIPLIER - 1; i++, p++) {
-			addr = host->sg_dma + (sizeof(struct idmac_desc_64addr) *
-					(i + 1));
-			IDMAC_64ADDR_SET_DESC_ADDR(p,addr);
-			IDMAC_64ADDR_SET_DESC_CLEAR(p);
-		}
+		for (ring = 0; ring < DW_MCI_DESC_RINGS; ring++) {
+			base = host->sg_dma + ring * host->desc_ring;
+			p = host->sg_cpu + ring * host->desc_ring;
+			for (i = 0; i < host->ring_size *
+					MMC_DW_IDMAC_MULTIPLIER - 1; i++, p++) {
+				addr = base + (sizeof(struct idmac_desc_64addr) *
+						(i + 1));
+				IDMAC_64ADDR_SET_DESC_ADDR(p,addr);
+				IDMAC_64ADDR_SET_DESC_CLEAR(p);
+			}
 
-		/* Set the last descriptor as the end-of-ring descriptor */
-		IDMAC_64ADDR_SET_DESC_ADDR(p, host->sg_dma);
-		p->des0 = IDMAC_DES0_ER;
+			/* Set the last descriptor as the end-of-ring descriptor */
+			IDMAC_64ADDR_SET_DESC_ADDR(p, base);
+			p->des0 = IDMAC_DES0_ER;
+		}
 
 	} else {
 		struct idmac_desc *p;
 		/* Number of descriptors in the ring buffer */
 		host->ring_size = host->desc_sz * PAGE_SIZE / sizeof(struct idmac_desc);
 
-		/* Forward link the descriptor list */
-		for (i = 0, p = host->sg_cpu; i < host->ring_size - 1; i++, p++) {
-			addr = host->sg_dma + (sizeof(struct idmac_desc) *
+		for (ring = 0; ring < DW_MCI_DESC_RINGS; ring++) {
+			base = host->sg_dma + ring * host->desc_ring;
+			p = host->sg_cpu + ring * host->desc_ring;
+			for (i = 0; i < host->ring_size - 1; i++, p++) {
+				addr = base + (sizeof(struct idmac_desc) *
 								(i + 1));
-			IDMAC_SET_DESC_ADDR(p, addr);
-		}
+				IDMAC_SET_DESC_ADDR(p, addr);
+			}
 
-		/* Set the last descriptor as the end-of-ring descriptor */
-		IDMAC_SET_DESC_ADDR(p, host->sg_dma);
-		p->des0 = IDMAC_DES0_ER;
+			/* Set the last descriptor as the end-of-ring descriptor */
+			IDMAC_SET_DESC_ADDR(p, base);
+			p->des0 = IDMAC_DES0_ER;
+		}
 	}
 
+	host->desc_pre_data = NULL;
 	dw_mci_idmac_reset(host);
 
 	if (host->dma_64bit_address == true) {
@@ -1051,27 +1126,23 @@ static int dw_mci_idmac_init(struct dw_mci *host)
 		mci_writel(host, IDSTS64, IDMAC_INT_CLR);
 		mci_writel(host, IDINTEN64, SDMMC_IDMAC_INT_NI |
 				SDMMC_IDMAC_INT_RI | SDMMC_IDMAC_INT_TI);
-
-		/* Set the descriptor base address */
-		mci_writel(host, DBADDRL, host->sg_dma & 0xffffffff);
-		mci_writel(host, DBADDRU, (u64)host->sg_dma >> 32);
-
 	} else {
 		/* Mask out interrupts - get Tx & Rx complete only */
 		mci_writel(host, IDSTS, IDMAC_INT_CLR);
 		mci_writel(host, IDINTEN, SDMMC_IDMAC_INT_NI |
 				SDMMC_IDMAC_INT_RI | SDMMC_IDMAC_INT_TI);
-
-		/* Set the descriptor base address */
-		mci_writel(host, DBADDR, host->sg_dma);
 	}
 
+	/* Set the descriptor base address */
+	dw_mci_idmac_set_base(host, host->desc_cur);
+
 	return 0;
 }
 
 static const struct dw_mci_dma_ops dw_mci_idmac_ops = {
 	.init = dw_mci_idmac_init,
 	.start = dw_mci_idmac_start_dma,
+	.prepare = dw_mci_idmac_prebuild,
 	.stop = dw_mci_idmac_stop_dma,
 	.reset = dw_mci_idma_reset_dma,
 	.complete = dw_mci_idmac_complete_dma,
@@ -1164,21 +1235,58 @@ static void dw_mci_force_reset(struct dw_mci *host)
 	dw_mci_ciu_reset(host->dev, host);
 }
 
+/*
+ * Program the FIFO thresholds for an SDIO transfer, right before it is
+ * submitted.
+ */
+static void dw_mci_sdio_set_fifoth(struct dw_mci *host, struct mmc_data *data)
+{
+	struct dw_mci_slot *slot = host->cur_slot;
+	struct mmc_card *card = slot->mmc->card;
+	unsigned int rxwmark_val = 0, txwmark_val = 0, msize_val = 0;
+
+	if (!card || !mmc_card_sdio(card))
+		return;
+
+	if (data->blksz >= (4 * (1 << host->data_shift))) {
+		msize_val = 1;
+		rxwmark_val = 3;
+		txwmark_val = 4;
+	} else {
+		msize_val = 0;
+		rxwmark_val = 1;
+		txwmark_val = host->fifo_depth / 2;
+	}
+
+	host->fifoth_val = ((msize_val << 28) | (rxwmark_val << 16) |
+			(txwmark_val << 0));
+	dev_dbg(host->dev,
+			"data->blksz: %d data->blocks %d Transfer Size %d  "
+			"msize_val : %d, rxwmark_val : %d host->fifoth_val: 0x%08x\n",
+			data->blksz, data->blocks, (data->blksz * data->blocks),
+			msize_val, rxwmark_val, host->fifoth_val);
+
+	mci_writel(host, FIFOTH, host->fifoth_val);
+
+	if (mmc_card_uhs(card)
+			&& card->host->caps & MMC_CAP_UHS_SDR104
+			&& data->flags & MMC_DATA_READ)
+		mci_writel(host, CDTHRCTL, data->blksz << 16 | 1);
+}
+
+/*
+ * Map @data for DMA.  With @next set this runs from pre_req, possibly
+ * while another transfer is in progress, and must not touch the
+ * controller.
+ */
 static int dw_mci_pre_dma_transfer(struct dw_mci *host,
 				   struct mmc_data *data,
 				   bool next)
 {
 	struct scatterlist *sg;
-	struct dw_mci_slot *slot = host->cur_slot;
-	struct mmc_card *card = slot->mmc->card;
 	unsigned int i, sg_len;
 	unsigned int align_mask = ((host->data_shift == 3) ? 8 : 4) - 1;
 
-	if (host->quirks & DW_MCI_SW_TRANS) {
-		if (mci_readl(host, MPSTAT) & 0x1)
-			return -EINVAL;
-	}
-
 	if (!next && data->host_cookie)
 		return data->host_cookie;
 
@@ -1198,35 +1306,6 @@ static int dw_mci_pre_dma_transfer(struct dw_mci *host,
 			return -EINVAL;
 	}
 
-	if (card && mmc_card_sdio(card)) {
-		unsigned int rxwmark_val = 0, txwmark_val = 0, msize_val = 0;
-
-		if (data->blksz >= (4 * (1 << host->data_shift))) {
-			msize_val = 1;
-			rxwmark_val = 3;
-			txwmark_val = 4;
-		} else {
-			msize_val = 0;
-			rxwmark_val = 1;
-			txwmark_val = host->fifo_depth / 2;
-		}
-
-		host->fifoth_val = ((msize_val << 28) | (rxwmark_val << 16) |
-				(txwmark_val << 0));
-		dev_dbg(host->dev,
-				"data->blksz: %d data->blocks %d Transfer Size %d  "
-				"msize_val : %d, rxwmark_val : %d host->fifoth_val: 0x%08x\n",
-				data->blksz, data->blocks, (data->blksz * data->blocks),
-				msize_val, rxwmark_val, host->fifoth_val);
-
-		mci_writel(host, FIFOTH, host->fifoth_val);
-
-		if (mmc_card_uhs(card)
-				&& card->host->caps & MMC_CAP_UHS_SDR104
-				&& data->flags & MMC_DATA_READ)
-			mci_writel(host, CDTHRCTL, data->blksz << 16 | 1);
-	}
-
 	sg_len = dma_map_sg(host->dev,
 			    data->sg,
 			    data->sg_len,
@@ -1245,18 +1324,30 @@ static void dw_mci_pre_req(struct mmc_host *mmc,
 			   bool is_first_req)
 {
 	struct dw_mci_slot *slot = mmc_priv(mmc);
+	struct dw_mci *host = slot->host;
 	struct mmc_data *data = mrq->data;
+	int sg_len;
 
-	if (!slot->host->use_dma || !data)
+	if (!host->use_dma || !data)
+		return;
+
+	/* Prepared before and not started yet, still good */
+	if (data->host_cookie)
+		return;
+
+	/* Whether DMA can be used is only known when it is submitted */
+	if (host->quirks & DW_MCI_SW_TRANS)
 		return;
 
-	if (data->host_cookie) {
+	sg_len = dw_mci_pre_dma_transfer(host, data, 1);
+	if (sg_len < 0) {
 		data->host_cookie = 0;
 		return;
 	}
 
-	if (dw_mci_pre_dma_transfer(slot->host, mrq->data, 1) < 0)
-		data->host_cookie = 0;
+	/* Set up the descriptors too, while the current transfer runs */
+	if (host->dma_ops->prepare)
+		host->dma_ops->prepare(host, data, sg_len);
 }
 
 static void dw_mci_post_req(struct mmc_host *mmc,
@@ -1269,6 +1360,10 @@ static void dw_mci_post_req(struct mmc_host *mmc,
 	if (!slot->host->use_dma || !data)
 		return;
 
+	/* Prepared but never started */
+	if (slot->host->desc_pre_data == data)
+		slot->host->desc_pre_data = NULL;
+
 	if (data->host_cookie)
 		dma_unmap_sg(slot->host->dev,
 			     data->sg,
@@ -1379,11 +1474,23 @@ static int dw_mci_submit_data_dma(struct dw_mci *host, struct mmc_data *data)
 	if (!host->use_dma)
 		return -ENODEV;
 
-	if (host->use_dma && host->dma_ops->init && host->dma_ops->reset) {
-		host->dma_ops->init(host);
+	/*
+	 * The descriptor rings were linked up by dma_ops->init() at probe
+	 * and resume, the descriptors themselves are written per transfer.
+	 */
+	if (host->dma_ops->reset)
 		host->dma_ops->reset(host);
+
+	if (host->quirks & DW_MCI_SW_TRANS) {
+		if (mci_readl(host, MPSTAT) & 0x1) {
+			host->dma_ops->stop(host);
+			dw_mci_set_timeout(host, dw_mci_calc_hto_timeout(host));
+			return -EINVAL;
+		}
 	}
 
+	dw_mci_sdio_set_fifoth(host, data);
+
 	sg_len = dw_mci_pre_dma_transfer(host, data, 0);
 	if (sg_len < 0) {
 		host->dma_ops->stop(host);
@@ -3464,8 +3571,9 @@ static void dw_mci_init_dma(struct dw_mci *host)
 		 host->desc_sz = 1;
 
 	/* Alloc memory for sg translation */
+	host->desc_ring = host->desc_sz * PAGE_SIZE * MMC_DW_IDMAC_MULTIPLIER;
 	host->sg_cpu = dmam_alloc_coherent(host->dev,
-			host->desc_sz * PAGE_SIZE * MMC_DW_IDMAC_MULTIPLIER,
+			host->desc_ring * DW_MCI_DESC_RINGS,
 			&host->sg_dma, GFP_KERNEL);
 	if (!host->sg_cpu) {
 		dev_err(host->dev, "%s: could not alloc DMA memory\n",
@@ -3741,6 +3849,9 @@ static struct dw_mci_board *dw_mci_parse_dt(struct dw_mci *host)
 	if (of_find_property(np, "supports-erase", NULL))
 		pdata->caps |= MMC_CAP_ERASE;
 
+	if (of_find_property(np, "supports-cmdq", NULL))
+		pdata->caps2 |= MMC_CAP2_CMDQ;
+
 	if (of_find_property(np, "pm-skip-mmc-resume-init", NULL))
 		pdata->pm_caps |= MMC_PM_SKIP_MMC_RESUME_INIT;
 	if (of_find_property(np, "card-detect-invert-gpio", NULL))
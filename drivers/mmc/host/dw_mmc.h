@@ -24,6 +24,9 @@
 #define MMC_DW_IDMAC_MULTIPLIER	1
 #endif
 
+/* Descriptor rings, so the next request can be set up during a transfer */
+#define DW_MCI_DESC_RINGS	2
+
 #define DW_MMC_240A		0x240a
 #define DW_MMC_260A		0x260a
 
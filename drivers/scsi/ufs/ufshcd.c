@@ -91,6 +91,14 @@
 /* UFS link setup retries */
 #define UFS_LINK_SETUP_RETRIES 5
 
+/*
+ * Drive the host through scsi-mq: per-CPU software queues in front of the
+ * single UTRL doorbell, with completions steered back to the submitting CPU.
+ */
+static bool use_blk_mq = IS_ENABLED(CONFIG_SCSI_UFSHCD_BLK_MQ);
+module_param(use_blk_mq, bool, S_IRUGO);
+MODULE_PARM_DESC(use_blk_mq, "Use the blk-mq I/O path (default: Kconfig)");
+
 #define ufshcd_toggle_vreg(_dev, _vreg, _on)				\
 	({                                                              \
 		int _ret;                                               \
@@ -215,6 +223,7 @@ static int ufshcd_uic_hibern8_enter(struct ufs_hba *hba);
 static int ufshcd_link_hibern8_ctrl(struct ufs_hba *hba, bool en);
 static int ufshcd_host_reset_and_restore(struct ufs_hba *hba);
 static irqreturn_t ufshcd_intr(int irq, void *__hba);
+static int ufshcd_poll(struct request_queue *q);
 static void ufshcd_command_done(struct request *rq);
 static int ufshcd_send_request_sense(struct ufs_hba *hba, struct scsi_device *sdp) ;
 
@@ -1584,25 +1593,28 @@ static int ufshcd_queuecommand(struct Scsi_Host *host, struct scsi_cmnd *cmd)
 
 	tag = cmd->request->tag;
 
-	spin_lock_irqsave(hba->host->host_lock, flags);
-	switch (hba->ufshcd_state) {
+	/*
+	 * Peek at the state without host_lock, the common operational case
+	 * then takes the lock only once, to ring the doorbell.  The state is
+	 * checked again under the lock before the command is issued.
+	 */
+	switch (ACCESS_ONCE(hba->ufshcd_state)) {
 	case UFSHCD_STATE_OPERATIONAL:
 		break;
 	case UFSHCD_STATE_RESET:
 		err = SCSI_MLQUEUE_HOST_BUSY;
-		goto out_unlock;
+		goto out;
 	case UFSHCD_STATE_ERROR:
 		set_host_byte(cmd, DID_ERROR);
 		cmd->scsi_done(cmd);
-		goto out_unlock;
+		goto out;
 	default:
 		dev_WARN_ONCE(hba->dev, 1, "%s: invalid state %d\n",
 				__func__, hba->ufshcd_state);
 		set_host_byte(cmd, DID_BAD_TARGET);
 		cmd->scsi_done(cmd);
-		goto out_unlock;
+		goto out;
 	}
-	spin_unlock_irqrestore(hba->host->host_lock, flags);
 
 	/* acquire the tag to make sure device cmds don't use it */
 	if (test_and_set_bit_lock(tag, &hba->lrb_in_use)) {
@@ -1671,6 +1683,16 @@ static int ufshcd_queuecommand(struct Scsi_Host *host, struct scsi_cmnd *cmd)
 
 	/* issue command to the controller */
 	spin_lock_irqsave(hba->host->host_lock, flags);
+	if (unlikely(hba->ufshcd_state != UFSHCD_STATE_OPERATIONAL)) {
+		/* Lost a race with the error handler, let the midlayer retry */
+		spin_unlock_irqrestore(hba->host->host_lock, flags);
+		scsi_dma_unmap(cmd);
+		ufshcd_release(hba);
+		lrbp->cmd = NULL;
+		clear_bit_unlock(tag, &hba->lrb_in_use);
+		err = SCSI_MLQUEUE_HOST_BUSY;
+		goto out;
+	}
 	if (hba->vops && hba->vops->set_nexus_t_xfer_req)
 		hba->vops->set_nexus_t_xfer_req(hba, tag, lrbp->cmd);
 
@@ -1678,7 +1700,6 @@ static int ufshcd_queuecommand(struct Scsi_Host *host, struct scsi_cmnd *cmd)
 
 	if (hba->debug.flag & UFSHCD_DEBUG_LEVEL1)
 		dev_info(hba->dev, "IO issued(%d)\n", tag);
-out_unlock:
 	spin_unlock_irqrestore(hba->host->host_lock, flags);
 out:
 	return err;
@@ -3480,6 +3501,16 @@ static int ufshcd_slave_configure(struct scsi_device *sdev)
 	blk_queue_max_segment_size(q, PRDT_DATA_BYTE_COUNT_MAX);
 	blk_queue_update_dma_alignment(q, PAGE_SIZE - 1);
 
+	/*
+	 * blk-mq already completes on the submitting CPU's cache domain,
+	 * force the exact CPU: the ufshcd interrupt is routed to a single
+	 * core, which on big.LITTLE shares no cache with half the submitters.
+	 */
+	if (shost_use_blk_mq(sdev->host))
+		queue_flag_set_unlocked(QUEUE_FLAG_SAME_FORCE, q);
+
+	blk_queue_poll(q, ufshcd_poll);
+
 	return 0;
 }
 
@@ -3707,6 +3738,12 @@ static void __ufshcd_transfer_req_compl(struct ufs_hba *hba, int reason)
 			cmd->result = result;
 				if (reason)
 					set_host_byte(cmd, reason);
+			/*
+			 * The legacy path unmaps in ufshcd_command_done(),
+			 * blk-mq has no softirq_done hook for us.
+			 */
+			if (shost_use_blk_mq(hba->host))
+				scsi_dma_unmap(cmd);
 			/* Mark completed command as NULL in LRB */
 			lrbp->cmd = NULL;
 			clear_bit_unlock(index, &hba->lrb_in_use);
@@ -4253,6 +4290,43 @@ static irqreturn_t ufshcd_intr(int irq, void *__hba)
 	return retval;
 }
 
+/**
+ * ufshcd_poll - reap completed transfer requests without the interrupt
+ * @q: request queue of the LU a synchronous read is waiting on
+ *
+ * Compares the doorbell against the outstanding requests directly, which
+ * also sees completions interrupt aggregation is still holding back.
+ *
+ * Returns the number of requests completed.
+ */
+static int ufshcd_poll(struct request_queue *q)
+{
+	struct scsi_device *sdev = q->queuedata;
+	struct ufs_hba *hba = shost_priv(sdev->host);
+	unsigned long flags, completed;
+	u32 tr_doorbell;
+
+	spin_lock_irqsave(hba->host->host_lock, flags);
+	/* nothing outstanding may also mean gated clocks, don't touch */
+	if (!hba->outstanding_reqs ||
+	    hba->ufshcd_state != UFSHCD_STATE_OPERATIONAL ||
+	    ufshcd_eh_in_progress(hba)) {
+		spin_unlock_irqrestore(hba->host->host_lock, flags);
+		return 0;
+	}
+
+	tr_doorbell = ufshcd_readl(hba, REG_UTP_TRANSFER_REQ_DOOR_BELL);
+	completed = tr_doorbell ^ hba->outstanding_reqs;
+	if (completed) {
+		/* spare the interrupt handler a pass that finds nothing */
+		ufshcd_writel(hba, UTP_TRANSFER_REQ_COMPL, REG_INTERRUPT_STATUS);
+		ufshcd_transfer_req_compl(hba);
+	}
+	spin_unlock_irqrestore(hba->host->host_lock, flags);
+
+	return hweight_long(completed);
+}
+
 static int ufshcd_clear_tm_cmd(struct ufs_hba *hba, int tag)
 {
 	int err = 0;
@@ -6272,6 +6346,9 @@ int ufshcd_alloc_host(struct device *dev, struct ufs_hba **hba_handle)
 		err = -ENOMEM;
 		goto out_error;
 	}
+	/* scsi_host_alloc() only honours the global scsi_mod.use_blk_mq */
+	if (use_blk_mq)
+		host->use_blk_mq = 1;
 	hba = shost_priv(host);
 	hba->host = host;
 	hba->dev = dev;
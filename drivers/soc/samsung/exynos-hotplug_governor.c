@@ -50,6 +50,9 @@
 #define DEFAULT_MONITOR_MS		(100)		/* ms */
 #define DEFAULT_BOOT_ENABLE_MS (30000)		/* 30 s */
 #define RETRY_BOOT_ENABLE_MS (100)		/* 100 ms */
+#define DEFAULT_PREDICT_WINDOW	(4)		/* samples */
+#define MAX_PREDICT_WINDOW	(16)		/* samples */
+#define DEFAULT_FLAP_HOLD_MS	(1000)		/* ms */
 
 enum hpgov_event {
 	HPGOV_DYNAMIC,
@@ -66,6 +69,7 @@ typedef enum {
 	GO_DOWN,
 	GO_UP,
 	STAY,
+	PREDICT_UP,
 } action_t;
 
 struct hpgov_attrib {
@@ -74,6 +78,11 @@ struct hpgov_attrib {
 	struct kobj_attribute	down_freq;
 	struct kobj_attribute	rate;
 	struct kobj_attribute	load;
+	struct kobj_attribute	predict;
+	struct kobj_attribute	predict_window;
+	struct kobj_attribute	flap_hold_ms;
+	struct kobj_attribute	predicted_up;
+	struct kobj_attribute	flaps_suppressed;
 
 	struct attribute_group	attrib_group;
 };
@@ -92,6 +101,12 @@ struct {
 	uint32_t			up_freq;
 	uint32_t			rate;
 	uint32_t			load;
+	uint32_t			predict;
+	uint32_t			predict_window;
+	uint32_t			flap_hold_ms;
+	unsigned long			last_up;
+	uint32_t			predicted_up;
+	uint32_t			flaps_suppressed;
 
 	struct hpgov_attrib		attrib;
 	struct mutex			attrib_lock;
@@ -123,6 +138,17 @@ struct cpu_hstate {
 #define DEFAULT_LOAD_THRESHOLD	320
 #define MAX_CLUSTERS   2
 static atomic_t freq_history[MAX_CLUSTERS] =  {ATOMIC_INIT(0), ATOMIC_INIT(0)};
+
+/*
+ * Sliding window of the last samples for the predictive mode, only
+ * touched from the dynamic monitor work.
+ */
+static struct {
+	u64	demand[MAX_PREDICT_WINDOW];	/* sum of freq * util */
+	int	nr[MAX_PREDICT_WINDOW];		/* avg_nr_running() */
+	int	head;
+	int	count;
+} load_history;
 static struct delayed_work hpgov_dynamic_work;
 
 static struct pm_qos_request hpgov_max_pm_qos;
@@ -319,6 +345,37 @@ static int exynos_hpgov_set_down_freq(uint32_t val)
 	return 0;
 }
 
+static void exynos_hpgov_history_reset(void)
+{
+	load_history.head = 0;
+	load_history.count = 0;
+}
+
+static int exynos_hpgov_set_predict(uint32_t val)
+{
+	exynos_hpgov.predict = val ? 1 : 0;
+	exynos_hpgov_history_reset();
+
+	return 0;
+}
+
+static int exynos_hpgov_set_predict_window(uint32_t val)
+{
+	if (val < 2 || val > MAX_PREDICT_WINDOW)
+		return -EINVAL;
+
+	exynos_hpgov.predict_window = val;
+
+	return 0;
+}
+
+static int exynos_hpgov_set_flap_hold_ms(uint32_t val)
+{
+	exynos_hpgov.flap_hold_ms = val;
+
+	return 0;
+}
+
 #define HPGOV_PARAM(_name, _param) \
 static ssize_t exynos_hpgov_attr_##_name##_show(struct kobject *kobj, \
 			struct kobj_attribute *attr, char *buf) \
@@ -350,6 +407,19 @@ static ssize_t exynos_hpgov_attr_##_name##_store(struct kobject *kobj, \
 	return count; \
 }
 
+#define HPGOV_STAT(_name, _param) \
+static ssize_t exynos_hpgov_attr_##_name##_show(struct kobject *kobj, \
+			struct kobj_attribute *attr, char *buf) \
+{ \
+	return snprintf(buf, PAGE_SIZE, "%u\n", _param); \
+}
+
+#define HPGOV_RO_ATTRIB(i, _name) \
+	exynos_hpgov.attrib._name.attr.name = __stringify(_name); \
+	exynos_hpgov.attrib._name.attr.mode = S_IRUGO; \
+	exynos_hpgov.attrib._name.show = exynos_hpgov_attr_##_name##_show; \
+	exynos_hpgov.attrib.attrib_group.attrs[i] = &exynos_hpgov.attrib._name.attr;
+
 #define HPGOV_RW_ATTRIB(i, _name) \
 	exynos_hpgov.attrib._name.attr.name = __stringify(_name); \
 	exynos_hpgov.attrib._name.attr.mode = S_IRUGO | S_IWUSR; \
@@ -362,6 +432,11 @@ HPGOV_PARAM(up_freq, exynos_hpgov.up_freq);
 HPGOV_PARAM(down_freq, exynos_hpgov.down_freq);
 HPGOV_PARAM(rate, exynos_hpgov.rate);
 HPGOV_PARAM(load, exynos_hpgov.load);
+HPGOV_PARAM(predict, exynos_hpgov.predict);
+HPGOV_PARAM(predict_window, exynos_hpgov.predict_window);
+HPGOV_PARAM(flap_hold_ms, exynos_hpgov.flap_hold_ms);
+HPGOV_STAT(predicted_up, exynos_hpgov.predicted_up);
+HPGOV_STAT(flaps_suppressed, exynos_hpgov.flaps_suppressed);
 
 static void hpgov_boot_enable(struct work_struct *work);
 static DECLARE_DELAYED_WORK(hpgov_boot_work, hpgov_boot_enable);
@@ -371,6 +446,48 @@ static void hpgov_boot_enable(struct work_struct *work)
 		schedule_delayed_work_on(0, &hpgov_boot_work, msecs_to_jiffies(RETRY_BOOT_ENABLE_MS));
 }
 
+static void exynos_hpgov_history_add(u64 demand, int nr)
+{
+	load_history.demand[load_history.head] = demand;
+	load_history.nr[load_history.head] = nr;
+	load_history.head = (load_history.head + 1) % MAX_PREDICT_WINDOW;
+	if (load_history.count < MAX_PREDICT_WINDOW)
+		load_history.count++;
+}
+
+/*
+ * Extrapolate the demand and nr_running one monitor period ahead, from
+ * their average slope across the window.  Hotplug takes tens of ms, so
+ * cores have to be asked for before the load gets there.  Only a rising
+ * trend makes a prediction.
+ */
+static bool exynos_hpgov_predict(u64 *demand, int *nr)
+{
+	int win = exynos_hpgov.predict_window;
+	int newest, oldest;
+	s64 demand_slope;
+	int nr_slope;
+
+	if (win < 2 || load_history.count < win)
+		return false;
+
+	newest = (load_history.head + MAX_PREDICT_WINDOW - 1) % MAX_PREDICT_WINDOW;
+	oldest = (load_history.head + MAX_PREDICT_WINDOW - win) % MAX_PREDICT_WINDOW;
+
+	demand_slope = div_s64((s64)(load_history.demand[newest] -
+				     load_history.demand[oldest]), win - 1);
+	nr_slope = (load_history.nr[newest] - load_history.nr[oldest]) / (win - 1);
+
+	/* only a load that grows on both counts is extrapolated */
+	if (demand_slope <= 0 || nr_slope <= 0)
+		return false;
+
+	*demand = load_history.demand[newest] + demand_slope;
+	*nr = load_history.nr[newest] + nr_slope;
+
+	return true;
+}
+
 static action_t exynos_hpgov_select_up_down(void)
 {
 	unsigned int down_freq, up_freq;
@@ -378,6 +495,7 @@ static action_t exynos_hpgov_select_up_down(void)
 	unsigned int c0_util, c1_util;
 	unsigned int load;
 	struct cluster_stats cl_stat[2];
+	u64 demand;
 	int nr;
 
 	nr = avg_nr_running();
@@ -417,8 +535,28 @@ static action_t exynos_hpgov_select_up_down(void)
 
 	if (atomic_read(&freq_history[GO_UP]) > UP_MONITOR_DURATION_NUM)
 		return GO_UP;
-	else if (atomic_read(&freq_history[GO_DOWN]) > DOWN_MONITOR_DURATION_NUM)
+
+	if (exynos_hpgov.predict) {
+		demand = (u64)c0_freq * c0_util + (u64)c1_freq * c1_util;
+		exynos_hpgov_history_add(demand, nr);
+
+		if (num_online_cpus() < hstate_state[H0].cpu_nr &&
+			exynos_hpgov_predict(&demand, &nr) &&
+			demand >= (u64)up_freq * load && nr >= TASKS_THRESHOLD)
+			return PREDICT_UP;
+	}
+
+	if (atomic_read(&freq_history[GO_DOWN]) > DOWN_MONITOR_DURATION_NUM) {
+		/* don't give back cores that were only just brought up */
+		if (exynos_hpgov.predict &&
+			time_before(jiffies, exynos_hpgov.last_up +
+				msecs_to_jiffies(exynos_hpgov.flap_hold_ms))) {
+			exynos_hpgov.flaps_suppressed++;
+			atomic_set(&freq_history[GO_DOWN], 0);
+			return STAY;
+		}
 		return GO_DOWN;
+	}
 
 	return STAY;
 }
@@ -468,10 +606,16 @@ static void hpgov_dynamic_monitor(struct work_struct *work)
 		if (state < MAX_HSTATE && old_state != state) {
 			nr = hstate_state[state].cpu_nr;
 			exynos_hpgov_update_governor(HPGOV_DYNAMIC, NR_CPUS, nr);
+			if (action != GO_DOWN)
+				exynos_hpgov.last_up = jiffies;
+			if (action == PREDICT_UP)
+				exynos_hpgov.predicted_up++;
 		}
 
 		atomic_set(&freq_history[GO_UP], 0);
 		atomic_set(&freq_history[GO_DOWN], 0);
+		/* the load spreads differently now, start the trend over */
+		exynos_hpgov_history_reset();
 	}
 
 	queue_delayed_work_on(0, system_freezable_wq, &hpgov_dynamic_work, msecs_to_jiffies(100));
@@ -488,6 +632,7 @@ static int exynos_cpu_governor_pm_suspend_notifier(struct notifier_block *notifi
 		case PM_SUSPEND_PREPARE:
 			atomic_set(&freq_history[GO_UP], 0);
 			atomic_set(&freq_history[GO_DOWN], 0);
+			exynos_hpgov_history_reset();
 
 			cancel_delayed_work_sync(&hpgov_dynamic_work);
 			exynos_hpgov_update_governor(HPGOV_DYNAMIC, nr, nr);
@@ -528,7 +673,7 @@ static struct notifier_block exynos_cpu_governor_resume_nb = {
 static int __init exynos_hpgov_init(void)
 {
 	int ret = 0;
-	const int attr_count = 5;
+	const int attr_count = 10;
 
 	mutex_init(&exynos_hpgov.attrib_lock);
 	init_waitqueue_head(&exynos_hpgov.wait_q);
@@ -537,7 +682,7 @@ static int __init exynos_hpgov_init(void)
 	INIT_DELAYED_WORK(&hpgov_dynamic_work, hpgov_dynamic_monitor);
 
 	exynos_hpgov.attrib.attrib_group.attrs =
-		kzalloc(attr_count * sizeof(struct attribute *), GFP_KERNEL);
+		kzalloc((attr_count + 1) * sizeof(struct attribute *), GFP_KERNEL);
 	if (!exynos_hpgov.attrib.attrib_group.attrs) {
 		ret = -ENOMEM;
 		goto done;
@@ -549,6 +694,11 @@ static int __init exynos_hpgov_init(void)
 	HPGOV_RW_ATTRIB(2, down_freq);
 	HPGOV_RW_ATTRIB(3, rate);
 	HPGOV_RW_ATTRIB(4, load);
+	HPGOV_RW_ATTRIB(5, predict);
+	HPGOV_RW_ATTRIB(6, predict_window);
+	HPGOV_RW_ATTRIB(7, flap_hold_ms);
+	HPGOV_RO_ATTRIB(8, predicted_up);
+	HPGOV_RO_ATTRIB(9, flaps_suppressed);
 #endif
 
 	exynos_hpgov.attrib.attrib_group.name = "governor";
@@ -574,6 +724,10 @@ static int __init exynos_hpgov_init(void)
 	exynos_hpgov.up_freq = DEFAULT_UP_CHANGE_FREQ;
 	exynos_hpgov.rate = DEFAULT_MONITOR_MS;
 	exynos_hpgov.load = DEFAULT_LOAD_THRESHOLD;
+	exynos_hpgov.predict_window = DEFAULT_PREDICT_WINDOW;
+	exynos_hpgov.flap_hold_ms = DEFAULT_FLAP_HOLD_MS;
+	/* no cores brought up yet, nothing to hold */
+	exynos_hpgov.last_up = jiffies - msecs_to_jiffies(DEFAULT_FLAP_HOLD_MS);
 
 	/* regsiter pm notifier */
 	register_pm_notifier(&exynos_cpu_governor_suspend_nb);
@@ -1740,8 +1740,11 @@ void fs_set_vol_flags(struct super_block *sb, UINT32 new_flag)
 
 void fs_sync(struct super_block *sb, INT32 do_sync)
 {
-	if (do_sync)
+	if (do_sync) {
+		FAT_sync(sb);
+		buf_sync(sb);
 		bdev_sync(sb);
+	}
 }
 
 void fs_error(struct super_block *sb)
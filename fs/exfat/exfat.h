@@ -434,13 +434,21 @@ extern "C" {
 
 		FS_FUNC_T	*fs_func;
 
-		BUF_CACHE_T FAT_cache_array[FAT_CACHE_SIZE];
+		BUF_CACHE_T *FAT_cache_array;
 		BUF_CACHE_T FAT_cache_lru_list;
-		BUF_CACHE_T FAT_cache_hash_list[FAT_CACHE_HASH_SIZE];
+		BUF_CACHE_T *FAT_cache_hash_list;
+		UINT32      FAT_cache_size;
+		UINT32      FAT_cache_hash_mask;
+		CACHE_STAT_T FAT_cache_stat;
 
-		BUF_CACHE_T buf_cache_array[BUF_CACHE_SIZE];
+		BUF_CACHE_T *buf_cache_array;
 		BUF_CACHE_T buf_cache_lru_list;
-		BUF_CACHE_T buf_cache_hash_list[BUF_CACHE_HASH_SIZE];
+		BUF_CACHE_T *buf_cache_hash_list;
+		UINT32      buf_cache_size;
+		UINT32      buf_cache_hash_mask;
+		CACHE_STAT_T buf_cache_stat;
+
+		BUF_CACHE_T **cache_sync_array;
 	} FS_INFO_T;
 
 #define ES_2_ENTRIES		2
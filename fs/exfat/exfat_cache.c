@@ -24,6 +24,10 @@
 #include "exfat_super.h"
 #include "exfat.h"
 
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
+#include <linux/blkdev.h>
+
 extern FS_STRUCT_T      fs_struct[];
 
 #define sm_P(s)
@@ -44,20 +48,70 @@ static BUF_CACHE_T *buf_cache_get(struct super_block *sb, UINT32 sec);
 static void buf_cache_insert_hash(struct super_block *sb, BUF_CACHE_T *bp);
 static void buf_cache_remove_hash(BUF_CACHE_T *bp);
 
+static void cache_sync(struct super_block *sb, BUF_CACHE_T *list, CACHE_STAT_T *stat);
+
 static void push_to_mru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
 static void push_to_lru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
 static void move_to_mru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
 static void move_to_lru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
 
+static void *cache_alloc(size_t size)
+{
+	void *p = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+
+	if (!p)
+		p = vzalloc(size);
+	return p;
+}
+
+static UINT32 cache_size_clamp(UINT32 size, UINT32 min_size, UINT32 max_size)
+{
+	if (size < min_size)
+		return min_size;
+	if (size > max_size)
+		return max_size;
+	return size;
+}
+
 INT32 buf_init(struct super_block *sb)
 {
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	struct exfat_mount_options *opts = &(EXFAT_SB(sb)->options);
+	UINT32 fat_hash_size, buf_hash_size;
 
 	INT32 i;
 
+	p_fs->FAT_cache_size = cache_size_clamp(opts->fat_cache_size,
+			FAT_CACHE_MIN_SIZE, FAT_CACHE_MAX_SIZE);
+	p_fs->buf_cache_size = cache_size_clamp(opts->buf_cache_size,
+			BUF_CACHE_MIN_SIZE, BUF_CACHE_MAX_SIZE);
+
+	/* one bucket per entry keeps hash chains short at any size */
+	fat_hash_size = roundup_pow_of_two(p_fs->FAT_cache_size);
+	buf_hash_size = roundup_pow_of_two(p_fs->buf_cache_size);
+	p_fs->FAT_cache_hash_mask = fat_hash_size - 1;
+	p_fs->buf_cache_hash_mask = buf_hash_size - 1;
+
+	p_fs->FAT_cache_array = cache_alloc(sizeof(BUF_CACHE_T) * p_fs->FAT_cache_size);
+	p_fs->FAT_cache_hash_list = cache_alloc(sizeof(BUF_CACHE_T) * fat_hash_size);
+	p_fs->buf_cache_array = cache_alloc(sizeof(BUF_CACHE_T) * p_fs->buf_cache_size);
+	p_fs->buf_cache_hash_list = cache_alloc(sizeof(BUF_CACHE_T) * buf_hash_size);
+	p_fs->cache_sync_array = cache_alloc(sizeof(BUF_CACHE_T *) *
+			max(p_fs->FAT_cache_size, p_fs->buf_cache_size));
+
+	if (!p_fs->FAT_cache_array || !p_fs->FAT_cache_hash_list ||
+	    !p_fs->buf_cache_array || !p_fs->buf_cache_hash_list ||
+	    !p_fs->cache_sync_array) {
+		buf_shutdown(sb);
+		return(FFS_MEMORYERR);
+	}
+
+	memset(&p_fs->FAT_cache_stat, 0, sizeof(CACHE_STAT_T));
+	memset(&p_fs->buf_cache_stat, 0, sizeof(CACHE_STAT_T));
+
 	p_fs->FAT_cache_lru_list.next = p_fs->FAT_cache_lru_list.prev = &p_fs->FAT_cache_lru_list;
 
-	for (i = 0; i < FAT_CACHE_SIZE; i++) {
+	for (i = 0; i < p_fs->FAT_cache_size; i++) {
 		p_fs->FAT_cache_array[i].drv = -1;
 		p_fs->FAT_cache_array[i].sec = ~0;
 		p_fs->FAT_cache_array[i].flag = 0;
@@ -68,7 +122,7 @@ INT32 buf_init(struct super_block *sb)
 
 	p_fs->buf_cache_lru_list.next = p_fs->buf_cache_lru_list.prev = &p_fs->buf_cache_lru_list;
 
-	for (i = 0; i < BUF_CACHE_SIZE; i++) {
+	for (i = 0; i < p_fs->buf_cache_size; i++) {
 		p_fs->buf_cache_array[i].drv = -1;
 		p_fs->buf_cache_array[i].sec = ~0;
 		p_fs->buf_cache_array[i].flag = 0;
@@ -77,23 +131,23 @@ INT32 buf_init(struct super_block *sb)
 		push_to_mru(&(p_fs->buf_cache_array[i]), &p_fs->buf_cache_lru_list);
 	}
 
-	for (i = 0; i < FAT_CACHE_HASH_SIZE; i++) {
+	for (i = 0; i < fat_hash_size; i++) {
 		p_fs->FAT_cache_hash_list[i].drv = -1;
 		p_fs->FAT_cache_hash_list[i].sec = ~0;
 		p_fs->FAT_cache_hash_list[i].hash_next = p_fs->FAT_cache_hash_list[i].hash_prev = &(p_fs->FAT_cache_hash_list[i]);
 	}
 
-	for (i = 0; i < FAT_CACHE_SIZE; i++) {
+	for (i = 0; i < p_fs->FAT_cache_size; i++) {
 		FAT_cache_insert_hash(sb, &(p_fs->FAT_cache_array[i]));
 	}
 
-	for (i = 0; i < BUF_CACHE_HASH_SIZE; i++) {
+	for (i = 0; i < buf_hash_size; i++) {
 		p_fs->buf_cache_hash_list[i].drv = -1;
 		p_fs->buf_cache_hash_list[i].sec = ~0;
 		p_fs->buf_cache_hash_list[i].hash_next = p_fs->buf_cache_hash_list[i].hash_prev = &(p_fs->buf_cache_hash_list[i]);
 	}
 
-	for (i = 0; i < BUF_CACHE_SIZE; i++) {
+	for (i = 0; i < p_fs->buf_cache_size; i++) {
 		buf_cache_insert_hash(sb, &(p_fs->buf_cache_array[i]));
 	}
 
@@ -102,6 +156,19 @@ INT32 buf_init(struct super_block *sb)
 
 INT32 buf_shutdown(struct super_block *sb)
 {
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	kvfree(p_fs->cache_sync_array);
+	p_fs->cache_sync_array = NULL;
+	kvfree(p_fs->buf_cache_hash_list);
+	p_fs->buf_cache_hash_list = NULL;
+	kvfree(p_fs->buf_cache_array);
+	p_fs->buf_cache_array = NULL;
+	kvfree(p_fs->FAT_cache_hash_list);
+	p_fs->FAT_cache_hash_list = NULL;
+	kvfree(p_fs->FAT_cache_array);
+	p_fs->FAT_cache_array = NULL;
+
 	return(FFS_SUCCESS);
 }
 
@@ -357,10 +424,12 @@ UINT8 *FAT_getblk(struct super_block *sb, UINT32 sec)
 
 	bp = FAT_cache_find(sb, sec);
 	if (bp != NULL) {
+		p_fs->FAT_cache_stat.hit++;
 		move_to_mru(bp, &p_fs->FAT_cache_lru_list);
 		return(bp->buf_bh->b_data);
 	}
 
+	p_fs->FAT_cache_stat.miss++;
 	bp = FAT_cache_get(sb, sec);
 
 	FAT_cache_remove_hash(bp);
@@ -392,6 +461,7 @@ void FAT_modify(struct super_block *sb, UINT32 sec)
 	bp = FAT_cache_find(sb, sec);
 	if (bp != NULL) {
 		sector_write(sb, sec, bp->buf_bh, 0);
+		bp->flag |= DIRTYBIT;
 	}
 }
 
@@ -422,19 +492,11 @@ void FAT_release_all(struct super_block *sb)
 
 void FAT_sync(struct super_block *sb)
 {
-	BUF_CACHE_T *bp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
 	sm_P(&f_sem);
 
-	bp = p_fs->FAT_cache_lru_list.next;
-	while (bp != &p_fs->FAT_cache_lru_list) {
-		if ((bp->drv == p_fs->drv) && (bp->flag & DIRTYBIT)) {
-			sync_dirty_buffer(bp->buf_bh);
-			bp->flag &= ~(DIRTYBIT);
-		}
-		bp = bp->next;
-	}
+	cache_sync(sb, &p_fs->FAT_cache_lru_list, &p_fs->FAT_cache_stat);
 
 	sm_V(&f_sem);
 }
@@ -445,7 +507,7 @@ static BUF_CACHE_T *FAT_cache_find(struct super_block *sb, UINT32 sec)
 	BUF_CACHE_T *bp, *hp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	off = (sec + (sec >> p_fs->sectors_per_clu_bits)) & (FAT_CACHE_HASH_SIZE - 1);
+	off = (sec + (sec >> p_fs->sectors_per_clu_bits)) & p_fs->FAT_cache_hash_mask;
 
 	hp = &(p_fs->FAT_cache_hash_list[off]);
 	for (bp = hp->hash_next; bp != hp; bp = bp->hash_next) {
@@ -480,7 +542,7 @@ static void FAT_cache_insert_hash(struct super_block *sb, BUF_CACHE_T *bp)
 	FS_INFO_T *p_fs;
 
 	p_fs = &(EXFAT_SB(sb)->fs_info);
-	off = (bp->sec + (bp->sec >> p_fs->sectors_per_clu_bits)) & (FAT_CACHE_HASH_SIZE-1);
+	off = (bp->sec + (bp->sec >> p_fs->sectors_per_clu_bits)) & p_fs->FAT_cache_hash_mask;
 
 	hp = &(p_fs->FAT_cache_hash_list[off]);
 	bp->hash_next = hp->hash_next;
@@ -515,10 +577,12 @@ static UINT8 *__buf_getblk(struct super_block *sb, UINT32 sec)
 
 	bp = buf_cache_find(sb, sec);
 	if (bp != NULL) {
+		p_fs->buf_cache_stat.hit++;
 		move_to_mru(bp, &p_fs->buf_cache_lru_list);
 		return(bp->buf_bh->b_data);
 	}
 
+	p_fs->buf_cache_stat.miss++;
 	bp = buf_cache_get(sb, sec);
 
 	buf_cache_remove_hash(bp);
@@ -553,6 +617,7 @@ void buf_modify(struct super_block *sb, UINT32 sec)
 	bp = buf_cache_find(sb, sec);
 	if (likely(bp != NULL)) {
 		sector_write(sb, sec, bp->buf_bh, 0);
+		bp->flag |= DIRTYBIT;
 	}
 
 	WARN(!bp, "[EXFAT] failed to find buffer_cache(sector:%u).\n", sec);
@@ -639,21 +704,82 @@ void buf_release_all(struct super_block *sb)
 
 void buf_sync(struct super_block *sb)
 {
-	BUF_CACHE_T *bp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
 	sm_P(&b_sem);
 
-	bp = p_fs->buf_cache_lru_list.next;
-	while (bp != &p_fs->buf_cache_lru_list) {
-		if ((bp->drv == p_fs->drv) && (bp->flag & DIRTYBIT)) {
-			sync_dirty_buffer(bp->buf_bh);
-			bp->flag &= ~(DIRTYBIT);
-		}
+	cache_sync(sb, &p_fs->buf_cache_lru_list, &p_fs->buf_cache_stat);
+
+	sm_V(&b_sem);
+}
+
+void buf_get_stat(struct super_block *sb, CACHE_STAT_T *fat_stat, CACHE_STAT_T *buf_stat)
+{
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	sm_P(&f_sem);
+	*fat_stat = p_fs->FAT_cache_stat;
+	sm_V(&f_sem);
+
+	sm_P(&b_sem);
+	*buf_stat = p_fs->buf_cache_stat;
+	sm_V(&b_sem);
+}
+
+static int cache_sec_cmp(const void *a, const void *b)
+{
+	const BUF_CACHE_T *bp_a = *(const BUF_CACHE_T **) a;
+	const BUF_CACHE_T *bp_b = *(const BUF_CACHE_T **) b;
+
+	if (bp_a->sec < bp_b->sec)
+		return -1;
+	return (bp_a->sec > bp_b->sec);
+}
+
+/*
+ * Write back all dirty entries of a cache at once. The buffers are
+ * submitted in sector order under a plug, so the block layer merges
+ * adjacent sectors into one request instead of one request per sector.
+ */
+static void cache_sync(struct super_block *sb, BUF_CACHE_T *list, CACHE_STAT_T *stat)
+{
+	BUF_CACHE_T *bp, **array;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	struct blk_plug plug;
+	INT32 i, nr = 0;
+
+	array = p_fs->cache_sync_array;
+
+	bp = list->next;
+	while (bp != list) {
+		if ((bp->drv == p_fs->drv) && (bp->flag & DIRTYBIT))
+			array[nr++] = bp;
 		bp = bp->next;
 	}
 
-	sm_V(&b_sem);
+	if (!nr)
+		return;
+
+	sort(array, nr, sizeof(BUF_CACHE_T *), cache_sec_cmp, NULL);
+
+	blk_start_plug(&plug);
+	for (i = 0; i < nr; i++) {
+		write_dirty_buffer(array[i]->buf_bh, WRITE_SYNC);
+
+		if (!i || (array[i]->sec != array[i-1]->sec + 1))
+			stat->wb_reqs++;
+	}
+	blk_finish_plug(&plug);
+
+	for (i = 0; i < nr; i++) {
+		bp = array[i];
+		wait_on_buffer(bp->buf_bh);
+		if (!buffer_uptodate(bp->buf_bh))
+			PRINT("[EXFAT] cache_sync: write error! (sec = %d)\n", bp->sec);
+		bp->flag &= ~(DIRTYBIT);
+	}
+
+	stat->wb_secs += nr;
 }
 
 static BUF_CACHE_T *buf_cache_find(struct super_block *sb, UINT32 sec)
@@ -662,7 +788,7 @@ static BUF_CACHE_T *buf_cache_find(struct super_block *sb, UINT32 sec)
 	BUF_CACHE_T *bp, *hp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	off = (sec + (sec >> p_fs->sectors_per_clu_bits)) & (BUF_CACHE_HASH_SIZE - 1);
+	off = (sec + (sec >> p_fs->sectors_per_clu_bits)) & p_fs->buf_cache_hash_mask;
 
 	hp = &(p_fs->buf_cache_hash_list[off]);
 	for (bp = hp->hash_next; bp != hp; bp = bp->hash_next) {
@@ -694,7 +820,7 @@ static void buf_cache_insert_hash(struct super_block *sb, BUF_CACHE_T *bp)
 	FS_INFO_T *p_fs;
 
 	p_fs = &(EXFAT_SB(sb)->fs_info);
-	off = (bp->sec + (bp->sec >> p_fs->sectors_per_clu_bits)) & (BUF_CACHE_HASH_SIZE-1);
+	off = (bp->sec + (bp->sec >> p_fs->sectors_per_clu_bits)) & p_fs->buf_cache_hash_mask;
 
 	hp = &(p_fs->buf_cache_hash_list[off]);
 	bp->hash_next = hp->hash_next;
@@ -42,6 +42,13 @@ extern "C" {
 		struct buffer_head   *buf_bh;
 	} BUF_CACHE_T;
 
+	typedef struct __CACHE_STAT_T {
+		UINT64               hit;
+		UINT64               miss;
+		UINT64               wb_secs;     /* sectors written by sync */
+		UINT64               wb_reqs;     /* runs of adjacent sectors */
+	} CACHE_STAT_T;
+
 	INT32  buf_init(struct super_block *sb);
 	INT32  buf_shutdown(struct super_block *sb);
 	INT32  FAT_read(struct super_block *sb, UINT32 loc, UINT32 *content);
@@ -57,6 +64,7 @@ extern "C" {
 	void   buf_release(struct super_block *sb, UINT32 sec);
 	void   buf_release_all(struct super_block *sb);
 	void   buf_sync(struct super_block *sb);
+	void   buf_get_stat(struct super_block *sb, CACHE_STAT_T *fat_stat, CACHE_STAT_T *buf_stat);
 	INT32 buf_cache_readahead(struct super_block * sb, UINT32 sec);
 
 #ifdef __cplusplus
@@ -28,9 +28,11 @@ extern "C" {
 #define MAX_OPEN                20
 #define MAX_DENTRY              512
 #define FAT_CACHE_SIZE          128
-#define FAT_CACHE_HASH_SIZE     64
+#define FAT_CACHE_MIN_SIZE      16
+#define FAT_CACHE_MAX_SIZE      4096
 #define BUF_CACHE_SIZE          256
-#define BUF_CACHE_HASH_SIZE     64
+#define BUF_CACHE_MIN_SIZE      16
+#define BUF_CACHE_MAX_SIZE      8192
 #define DEFAULT_CODEPAGE        437
 #define DEFAULT_IOCHARSET       "utf8"
 #ifdef __cplusplus
@@ -737,6 +737,32 @@ static int exfat_ioctl_volume_id(struct inode *dir)
 	return p_fs->vol_id;
 }
 
+static int exfat_ioctl_cache_stat(struct inode *inode, unsigned long arg)
+{
+	struct super_block *sb = inode->i_sb;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	struct exfat_cache_stat stat;
+	CACHE_STAT_T fat_stat, buf_stat;
+
+	buf_get_stat(sb, &fat_stat, &buf_stat);
+
+	memset(&stat, 0, sizeof(stat));
+	stat.fat_cache_size = p_fs->FAT_cache_size;
+	stat.buf_cache_size = p_fs->buf_cache_size;
+	stat.fat_hit = fat_stat.hit;
+	stat.fat_miss = fat_stat.miss;
+	stat.fat_wb_secs = fat_stat.wb_secs;
+	stat.fat_wb_reqs = fat_stat.wb_reqs;
+	stat.buf_hit = buf_stat.hit;
+	stat.buf_miss = buf_stat.miss;
+	stat.buf_wb_secs = buf_stat.wb_secs;
+	stat.buf_wb_reqs = buf_stat.wb_reqs;
+
+	if (copy_to_user((void __user *)arg, &stat, sizeof(stat)))
+		return -EFAULT;
+	return 0;
+}
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,36)
 static int exfat_generic_ioctl(struct inode *inode, struct file *filp,
 							   unsigned int cmd, unsigned long arg)
@@ -755,6 +781,8 @@ static long exfat_generic_ioctl(struct file *filp,
 	switch (cmd) {
 	case EXFAT_IOCTL_GET_VOLUME_ID:
 		return exfat_ioctl_volume_id(inode);
+	case EXFAT_IOCTL_GET_CACHE_STAT:
+		return exfat_ioctl_cache_stat(inode, arg);
 #if EXFAT_CONFIG_KERNEL_DEBUG
 	case EXFAT_IOC_GET_DEBUGFLAGS: {
 		struct super_block *sb = inode->i_sb;
@@ -2255,6 +2283,10 @@ static int exfat_show_options(struct seq_file *m, struct vfsmount *mnt)
 	if (opts->discard)
 		seq_printf(m, ",discard");
 #endif
+	if (p_fs->FAT_cache_size != FAT_CACHE_SIZE)
+		seq_printf(m, ",fat_cache=%u", p_fs->FAT_cache_size);
+	if (p_fs->buf_cache_size != BUF_CACHE_SIZE)
+		seq_printf(m, ",buf_cache=%u", p_fs->buf_cache_size);
 	if (p_fs->dev_ejected)
 		seq_puts(m, ",ejected");
 	return 0;
@@ -2295,6 +2327,8 @@ enum {
 	Opt_err_cont,
 	Opt_err_panic,
 	Opt_err_ro,
+	Opt_fat_cache,
+	Opt_buf_cache,
 	Opt_err,
 #if EXFAT_CONFIG_DISCARD
 	Opt_discard,
@@ -2316,6 +2350,8 @@ static const match_table_t exfat_tokens = {
 	{Opt_err_cont, "errors=continue"},
 	{Opt_err_panic, "errors=panic"},
 	{Opt_err_ro, "errors=remount-ro"},
+	{Opt_fat_cache, "fat_cache=%u"},
+	{Opt_buf_cache, "buf_cache=%u"},
 #if EXFAT_CONFIG_DISCARD
 	{Opt_discard, "discard"},
 #endif
@@ -2342,6 +2378,8 @@ static int parse_options(char *options, int silent, int *debug,
 #if EXFAT_CONFIG_DISCARD
 	opts->discard = 0;
 #endif
+	opts->fat_cache_size = FAT_CACHE_SIZE;
+	opts->buf_cache_size = BUF_CACHE_SIZE;
 	*debug = 0;
 
 	if (!options)
@@ -2409,6 +2447,16 @@ static int parse_options(char *options, int silent, int *debug,
 		case Opt_err_ro:
 			opts->errors = EXFAT_ERRORS_RO;
 			break;
+		case Opt_fat_cache:
+			if (match_int(&args[0], &option))
+				return 0;
+			opts->fat_cache_size = option;
+			break;
+		case Opt_buf_cache:
+			if (match_int(&args[0], &option))
+				return 0;
+			opts->buf_cache_size = option;
+			break;
 		case Opt_debug:
 			*debug = 1;
 			break;
@@ -45,6 +45,20 @@
 #define EXFAT_ERRORS_RO    3
 
 #define EXFAT_IOCTL_GET_VOLUME_ID _IOR('r', 0x12, __u32)
+#define EXFAT_IOCTL_GET_CACHE_STAT _IOR('r', 0x13, struct exfat_cache_stat)
+
+struct exfat_cache_stat {
+	__u32 fat_cache_size;
+	__u32 buf_cache_size;
+	__u64 fat_hit;
+	__u64 fat_miss;
+	__u64 fat_wb_secs;
+	__u64 fat_wb_reqs;
+	__u64 buf_hit;
+	__u64 buf_miss;
+	__u64 buf_wb_secs;
+	__u64 buf_wb_reqs;
+};
 
 struct exfat_mount_options {
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,5,0)
@@ -65,6 +79,8 @@ struct exfat_mount_options {
 #if EXFAT_CONFIG_DISCARD
 	unsigned char discard;
 #endif
+	unsigned int fat_cache_size;
+	unsigned int buf_cache_size;
 };
 
 #define EXFAT_HASH_BITS    8
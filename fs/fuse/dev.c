@@ -28,15 +28,80 @@ MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_dev *fuse_get_dev(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
-	 * once during mount and is valid until the file is released.
+	 * once during mount (or clone) and is valid until the file is
+	 * released.
 	 */
 	return file->private_data;
 }
 
+static struct fuse_conn *fuse_get_conn(struct file *file)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+
+	return fud ? fud->fc : NULL;
+}
+
+static unsigned fuse_nr_chans(struct fuse_conn *fc)
+{
+	return fc->nr_chans ? fc->nr_chans : 1;
+}
+
+/* Channel for requests submitted from this CPU; any one will do */
+static struct fuse_chan *fuse_cpu_chan(struct fuse_conn *fc)
+{
+	return &fc->chans[raw_smp_processor_id() % fuse_nr_chans(fc)];
+}
+
+/*
+ * Wake one reader for work queued on @ch.  Its own readers go first.  A
+ * woken reader leaves the waitqueue, so a burst of requests spills over
+ * to idle readers of the other channels, which steal them on read.
+ */
+static void fuse_wake_reader(struct fuse_conn *fc, struct fuse_chan *ch)
+{
+	unsigned n = fuse_nr_chans(fc);
+	unsigned idx = ch - fc->chans;
+	unsigned i;
+
+	/*
+	 * Pairs with the barrier in prepare_to_wait_exclusive(): either the
+	 * reader sees the queued work or we see it on the waitqueue.
+	 */
+	smp_mb();
+	for (i = 0; i < n; i++) {
+		ch = &fc->chans[(idx + i) % n];
+		if (waitqueue_active(&ch->waitq)) {
+			wake_up(&ch->waitq);
+			break;
+		}
+	}
+	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+}
+
+void fuse_dev_wake_all(struct fuse_conn *fc)
+{
+	int i;
+
+	for (i = 0; i < FUSE_MAX_CHANS; i++)
+		wake_up_all(&fc->chans[i].waitq);
+}
+
+/* Channel a request or interrupt with this unique ID was queued on */
+static struct fuse_chan *fuse_unique_chan(struct fuse_conn *fc, u64 unique)
+{
+	return &fc->chans[unique & (FUSE_MAX_CHANS - 1)];
+}
+
+static struct list_head *fuse_pq_list(struct fuse_chan *ch, u64 unique)
+{
+	return &ch->processing[(unique >> FUSE_CHAN_BITS) &
+			       (FUSE_PQ_HASH_SIZE - 1)];
+}
+
 static void fuse_request_init(struct fuse_req *req, struct page **pages,
 			      struct fuse_page_desc *page_descs,
 			      unsigned npages)
@@ -282,6 +347,12 @@ void fuse_put_request(struct fuse_conn *fc, struct fuse_req *req)
 		if (req->waiting)
 			atomic_dec(&fc->num_waiting);
 
+		/* Opener went away before taking the backing file */
+		if (unlikely(req->passthrough_filp)) {
+			fput(req->passthrough_filp);
+			req->passthrough_filp = NULL;
+		}
+
 		if (req->stolen_file)
 			put_reserved_req(fc, req);
 		else
@@ -301,28 +372,31 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 	return nbytes;
 }
 
-static u64 fuse_get_unique(struct fuse_conn *fc)
+/* Called with ch->lock */
+static u64 fuse_get_unique(struct fuse_conn *fc, struct fuse_chan *ch)
 {
-	fc->reqctr++;
+	ch->reqctr++;
 	/* zero is special */
-	if (fc->reqctr == 0)
-		fc->reqctr = 1;
+	if (ch->reqctr == 0)
+		ch->reqctr = 1;
 
-	return fc->reqctr;
+	return (ch->reqctr << FUSE_CHAN_BITS) | (ch - fc->chans);
 }
 
-static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
+/* Called with ch->lock */
+static void queue_request(struct fuse_conn *fc, struct fuse_chan *ch,
+			  struct fuse_req *req)
 {
+	req->chan = ch;
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	list_add_tail(&req->list, &ch->pending);
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	fuse_wake_reader(fc, ch);
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
@@ -335,8 +409,7 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 	if (fc->connected) {
 		fc->forget_list_tail->next = forget;
 		fc->forget_list_tail = forget;
-		wake_up(&fc->waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+		fuse_wake_reader(fc, fuse_cpu_chan(fc));
 	} else {
 		kfree(forget);
 	}
@@ -347,13 +420,16 @@ static void flush_bg_queue(struct fuse_conn *fc)
 {
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
+		struct fuse_chan *ch = fuse_cpu_chan(fc);
 		struct fuse_req *req;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		spin_lock(&ch->lock);
+		req->in.h.unique = fuse_get_unique(fc, ch);
+		queue_request(fc, ch, req);
+		spin_unlock(&ch->lock);
 	}
 }
 
@@ -365,17 +441,19 @@ static void flush_bg_queue(struct fuse_conn *fc)
  * the 'end' callback is called if given, else the reference to the
  * request is released
  *
- * Called with fc->lock, unlocks it
+ * Called with the lock of the request's channel, unlocks it
  */
 static void request_end(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
+__releases(req->chan->lock)
 {
 	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 	req->end = NULL;
 	list_del(&req->list);
 	list_del(&req->intr_entry);
 	req->state = FUSE_REQ_FINISHED;
+	spin_unlock(&req->chan->lock);
 	if (req->background) {
+		spin_lock(&fc->lock);
 		req->background = 0;
 
 		if (fc->num_background == fc->max_background) {
@@ -400,8 +478,8 @@ __releases(fc->lock)
 		fc->num_background--;
 		fc->active_background--;
 		flush_bg_queue(fc);
+		spin_unlock(&fc->lock);
 	}
-	spin_unlock(&fc->lock);
 	wake_up(&req->waitq);
 	if (end)
 		end(fc, req);
@@ -410,27 +488,27 @@ __releases(fc->lock)
 
 static void wait_answer_interruptible(struct fuse_conn *fc,
 				      struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(req->chan->lock)
+__acquires(req->chan->lock)
 {
 	if (signal_pending(current))
 		return;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&req->chan->lock);
 	wait_event_interruptible(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	spin_lock(&req->chan->lock);
 }
 
+/* Called with the lock of the request's channel */
 static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
 {
-	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	list_add_tail(&req->intr_entry, &req->chan->interrupts);
+	fuse_wake_reader(fc, req->chan);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(req->chan->lock)
+__acquires(req->chan->lock)
 {
 	if (!fc->no_interrupt) {
 		/* Any signal may interrupt this */
@@ -472,12 +550,12 @@ __acquires(fc->lock)
 	 * Either request is already in userspace, or it was forced.
 	 * Wait it out.
 	 */
-	spin_unlock(&fc->lock);
+	spin_unlock(&req->chan->lock);
 
 	while (req->state != FUSE_REQ_FINISHED)
 		wait_event_freezable(req->waitq,
 				     req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	spin_lock(&req->chan->lock);
 
 	if (!req->aborted)
 		return;
@@ -490,30 +568,32 @@ __acquires(fc->lock)
 		   locked state, there mustn't be any filesystem
 		   operation (e.g. page fault), since that could lead
 		   to deadlock */
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->chan->lock);
 		wait_event(req->waitq, !req->locked);
-		spin_lock(&fc->lock);
+		spin_lock(&req->chan->lock);
 	}
 }
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_chan *ch = fuse_cpu_chan(fc);
+
 	BUG_ON(req->background);
-	spin_lock(&fc->lock);
+	spin_lock(&ch->lock);
 	if (!fc->connected)
 		req->out.h.error = -ENOTCONN;
 	else if (fc->conn_error)
 		req->out.h.error = -ECONNREFUSED;
 	else {
-		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		req->in.h.unique = fuse_get_unique(fc, ch);
+		queue_request(fc, ch, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
 		__fuse_get_request(req);
 
 		request_wait_answer(fc, req);
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 }
 
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
@@ -546,7 +626,10 @@ static void fuse_request_send_nowait(struct fuse_conn *fc, struct fuse_req *req)
 		fuse_request_send_nowait_locked(fc, req);
 		spin_unlock(&fc->lock);
 	} else {
+		spin_unlock(&fc->lock);
 		req->out.h.error = -ENOTCONN;
+		req->chan = fuse_cpu_chan(fc);
+		spin_lock(&req->chan->lock);
 		request_end(fc, req);
 	}
 }
@@ -561,16 +644,17 @@ EXPORT_SYMBOL_GPL(fuse_request_send_background);
 static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 					  struct fuse_req *req, u64 unique)
 {
+	struct fuse_chan *ch = fuse_cpu_chan(fc);
 	int err = -ENODEV;
 
 	req->isreply = 0;
 	req->in.h.unique = unique;
-	spin_lock(&fc->lock);
+	spin_lock(&ch->lock);
 	if (fc->connected) {
-		queue_request(fc, req);
+		queue_request(fc, ch, req);
 		err = 0;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 
 	return err;
 }
@@ -617,12 +701,12 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	int err = 0;
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->chan->lock);
 		if (req->aborted)
 			err = -ENOENT;
 		else
 			req->locked = 1;
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->chan->lock);
 	}
 	return err;
 }
@@ -635,11 +719,11 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
 static void unlock_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->chan->lock);
 		req->locked = 0;
 		if (req->aborted)
 			wake_up(&req->waitq);
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->chan->lock);
 	}
 }
 
@@ -858,12 +942,12 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 		lru_cache_add_file(newpage);
 
 	err = 0;
-	spin_lock(&cs->fc->lock);
+	spin_lock(&cs->req->chan->lock);
 	if (cs->req->aborted)
 		err = -ENOENT;
 	else
 		*pagep = newpage;
-	spin_unlock(&cs->fc->lock);
+	spin_unlock(&cs->req->chan->lock);
 
 	if (err) {
 		unlock_page(newpage);
@@ -1014,31 +1098,90 @@ static int forget_pending(struct fuse_conn *fc)
 	return fc->forget_list_head.next != NULL;
 }
 
+/* First channel with pending requests, starting from channel @idx */
+static struct fuse_chan *pending_chan(struct fuse_conn *fc, unsigned idx)
+{
+	unsigned n = fuse_nr_chans(fc);
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		struct fuse_chan *ch = &fc->chans[(idx + i) % n];
+
+		if (!list_empty(&ch->pending))
+			return ch;
+	}
+	return NULL;
+}
+
+/* First channel with an interrupt queued, starting from channel @idx */
+static struct fuse_chan *interrupt_chan(struct fuse_conn *fc, unsigned idx)
+{
+	unsigned n = fuse_nr_chans(fc);
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		struct fuse_chan *ch = &fc->chans[(idx + i) % n];
+
+		if (!list_empty(&ch->interrupts))
+			return ch;
+	}
+	return NULL;
+}
+
+/*
+ * The lists are peeked at without the channel locks; whoever acts on the
+ * answer locks the channel and checks again.
+ */
 static int request_pending(struct fuse_conn *fc)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
-		forget_pending(fc);
+	return forget_pending(fc) || interrupt_chan(fc, 0) ||
+		pending_chan(fc, 0);
 }
 
-/* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+/*
+ * Lock the first channel from @idx with an interrupt queued (@intr) or a
+ * pending request.  NULL if there is none, e.g. another reader got there
+ * first.
+ */
+static struct fuse_chan *lock_ready_chan(struct fuse_conn *fc, unsigned idx,
+					 bool intr)
+{
+	unsigned n = fuse_nr_chans(fc);
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		struct fuse_chan *ch = &fc->chans[(idx + i) % n];
+		struct list_head *head = intr ? &ch->interrupts : &ch->pending;
+
+		if (list_empty(head))
+			continue;
+		spin_lock(&ch->lock);
+		if (!list_empty(head))
+			return ch;
+		spin_unlock(&ch->lock);
+	}
+	return NULL;
+}
+
+/*
+ * Wait until a request is available on any pending list.  The wait entry
+ * is removed on wakeup, which fuse_wake_reader() relies on.
+ */
+static void request_wait(struct fuse_conn *fc, struct fuse_chan *ch)
 {
-	DECLARE_WAITQUEUE(wait, current);
+	DEFINE_WAIT(wait);
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
-		set_current_state(TASK_INTERRUPTIBLE);
+	for (;;) {
+		prepare_to_wait_exclusive(&ch->waitq, &wait,
+					  TASK_INTERRUPTIBLE);
+		if (!fc->connected || request_pending(fc))
+			break;
 		if (signal_pending(current))
 			break;
 
-		spin_unlock(&fc->lock);
 		schedule();
-		spin_lock(&fc->lock);
 	}
-	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	finish_wait(&ch->waitq, &wait);
 }
 
 /*
@@ -1047,11 +1190,11 @@ __acquires(fc->lock)
  * Unlike other requests this is assembled on demand, without a need
  * to allocate a separate fuse_req structure.
  *
- * Called with fc->lock held, releases it
+ * Called with the lock of the request's channel held, releases it
  */
 static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_copy_state *cs,
 			       size_t nbytes, struct fuse_req *req)
-__releases(fc->lock)
+__releases(req->chan->lock)
 {
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
@@ -1059,7 +1202,8 @@ __releases(fc->lock)
 	int err;
 
 	list_del_init(&req->intr_entry);
-	req->intr_unique = fuse_get_unique(fc);
+	/* On the request's channel, where the reply will look for it */
+	req->intr_unique = fuse_get_unique(fc, req->chan);
 	memset(&ih, 0, sizeof(ih));
 	memset(&arg, 0, sizeof(arg));
 	ih.len = reqsize;
@@ -1067,7 +1211,7 @@ __releases(fc->lock)
 	ih.unique = req->intr_unique;
 	arg.unique = req->in.h.unique;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&req->chan->lock);
 	if (nbytes < reqsize)
 		return -EINVAL;
 
@@ -1079,6 +1223,19 @@ __releases(fc->lock)
 	return err ? err : reqsize;
 }
 
+/* FORGETs get no reply, so any channel may number them */
+static u64 fuse_get_forget_unique(struct fuse_conn *fc)
+{
+	struct fuse_chan *ch = fuse_cpu_chan(fc);
+	u64 unique;
+
+	spin_lock(&ch->lock);
+	unique = fuse_get_unique(fc, ch);
+	spin_unlock(&ch->lock);
+
+	return unique;
+}
+
 static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
 					       unsigned max,
 					       unsigned *countp)
@@ -1114,7 +1271,7 @@ __releases(fc->lock)
 	struct fuse_in_header ih = {
 		.opcode = FUSE_FORGET,
 		.nodeid = forget->forget_one.nodeid,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_forget_unique(fc),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
@@ -1145,7 +1302,7 @@ __releases(fc->lock)
 	struct fuse_batch_forget_in arg = { .count = 0 };
 	struct fuse_in_header ih = {
 		.opcode = FUSE_BATCH_FORGET,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_forget_unique(fc),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
@@ -1208,40 +1365,55 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	int err;
 	struct fuse_req *req;
 	struct fuse_in *in;
+	struct fuse_chan *ch;
+	unsigned chan = fuse_get_dev(file)->chan;
 	unsigned reqsize;
 
  restart:
-	spin_lock(&fc->lock);
-	err = -EAGAIN;
 	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
 	    !request_pending(fc))
-		goto err_unlock;
+		return -EAGAIN;
 
-	request_wait(fc);
-	err = -ENODEV;
+	request_wait(fc, &fc->chans[chan]);
 	if (!fc->connected)
-		goto err_unlock;
-	err = -ERESTARTSYS;
-	if (!request_pending(fc))
-		goto err_unlock;
+		return -ENODEV;
+	if (!request_pending(fc)) {
+		if (signal_pending(current))
+			return -ERESTARTSYS;
+		goto restart;
+	}
 
-	if (!list_empty(&fc->interrupts)) {
-		req = list_entry(fc->interrupts.next, struct fuse_req,
+	ch = lock_ready_chan(fc, chan, true);
+	if (ch) {
+		req = list_entry(ch->interrupts.next, struct fuse_req,
 				 intr_entry);
 		return fuse_read_interrupt(fc, cs, nbytes, req);
 	}
 
 	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
-			return fuse_read_forget(fc, cs, nbytes);
+		spin_lock(&fc->lock);
+		if (forget_pending(fc)) {
+			if (!pending_chan(fc, chan) || fc->forget_batch-- > 0)
+				return fuse_read_forget(fc, cs, nbytes);
 
-		if (fc->forget_batch <= -8)
-			fc->forget_batch = 16;
+			if (fc->forget_batch <= -8)
+				fc->forget_batch = 16;
+		}
+		spin_unlock(&fc->lock);
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	/* Nothing left if other readers took it all meanwhile */
+	ch = lock_ready_chan(fc, chan, false);
+	if (!ch)
+		goto restart;
+
+	err = -ENODEV;
+	if (!fc->connected)
+		goto err_unlock;
+
+	req = list_entry(ch->pending.next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &ch->io);
 
 	in = &req->in;
 	reqsize = in->h.len;
@@ -1254,14 +1426,14 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 		goto restart;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 	cs->req = req;
 	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
 		err = fuse_copy_args(cs, in->numargs, in->argpages,
 				     (struct fuse_arg *) in->args, 0);
 	fuse_copy_finish(cs);
-	spin_lock(&fc->lock);
+	spin_lock(&ch->lock);
 	req->locked = 0;
 	if (req->aborted) {
 		request_end(fc, req);
@@ -1276,15 +1448,15 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		list_move_tail(&req->list, fuse_pq_list(ch, in->h.unique));
 		if (req->interrupted)
 			queue_interrupt(fc, req);
-		spin_unlock(&fc->lock);
+		spin_unlock(&ch->lock);
 	}
 	return reqsize;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 	return err;
 }
 
@@ -1762,15 +1934,24 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 	}
 }
 
-/* Look up request on processing list by unique ID */
-static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
+/* Look up request on the processing lists of a channel by unique ID */
+static struct fuse_req *request_find(struct fuse_chan *ch, u64 unique)
 {
 	struct fuse_req *req;
+	int i;
 
-	list_for_each_entry(req, &fc->processing, list) {
-		if (req->in.h.unique == unique || req->intr_unique == unique)
+	list_for_each_entry(req, fuse_pq_list(ch, unique), list) {
+		if (req->in.h.unique == unique)
 			return req;
 	}
+
+	/* Interrupt replies are rare; their unique is not the hash key */
+	for (i = 0; i < FUSE_PQ_HASH_SIZE; i++) {
+		list_for_each_entry(req, &ch->processing[i], list) {
+			if (req->intr_unique == unique)
+				return req;
+		}
+	}
 	return NULL;
 }
 
@@ -1809,6 +1990,7 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 {
 	int err;
 	struct fuse_req *req;
+	struct fuse_chan *ch;
 	struct fuse_out_header oh;
 
 	if (nbytes < sizeof(struct fuse_out_header))
@@ -1835,19 +2017,20 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	if (oh.error <= -1000 || oh.error > 0)
 		goto err_finish;
 
-	spin_lock(&fc->lock);
+	ch = fuse_unique_chan(fc, oh.unique);
+	spin_lock(&ch->lock);
 	err = -ENOENT;
 	if (!fc->connected)
 		goto err_unlock;
 
-	req = request_find(fc, oh.unique);
+	req = request_find(ch, oh.unique);
 	if (!req)
 		goto err_unlock;
 
 	if (req->aborted) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&ch->lock);
 		fuse_copy_finish(cs);
-		spin_lock(&fc->lock);
+		spin_lock(&ch->lock);
 		request_end(fc, req);
 		return -ENOENT;
 	}
@@ -1860,25 +2043,29 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 			goto err_unlock;
 		}
 
-		if (oh.error == -ENOSYS)
-			fc->no_interrupt = 1;
-		else if (oh.error == -EAGAIN)
+		if (oh.error == -EAGAIN)
 			queue_interrupt(fc, req);
 		fuse_put_request(fc, req);
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&ch->lock);
+		/* A bitfield next to others that fc->lock protects */
+		if (oh.error == -ENOSYS) {
+			spin_lock(&fc->lock);
+			fc->no_interrupt = 1;
+			spin_unlock(&fc->lock);
+		}
 		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
 	req->state = FUSE_REQ_WRITING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &ch->io);
 	req->out.h = oh;
 	req->locked = 1;
 	cs->req = req;
 	if (!req->out.page_replace)
 		cs->move_pages = 0;
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	if (req->in.h.opcode == FUSE_CANONICAL_PATH) {
@@ -1887,9 +2074,11 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 		path[req->out.args[0].size - 1] = 0;
 		req->out.h.error = kern_path(path, 0, req->canonical_path);
 	}
+	if (!err)
+		fuse_passthrough_setup(fc, req);
 	fuse_copy_finish(cs);
 
-	spin_lock(&fc->lock);
+	spin_lock(&ch->lock);
 	req->locked = 0;
 	if (!err) {
 		if (req->aborted)
@@ -1901,7 +2090,7 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	return err ? err : nbytes;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&ch->lock);
  err_finish:
 	fuse_copy_finish(cs);
 	return err;
@@ -2007,18 +2196,18 @@ out_free:
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_conn *fc;
+	if (!fud)
 		return POLLERR;
 
-	poll_wait(file, &fc->waitq, wait);
+	fc = fud->fc;
+	poll_wait(file, &fc->chans[fud->chan].waitq, wait);
 
-	spin_lock(&fc->lock);
 	if (!fc->connected)
 		mask = POLLERR;
 	else if (request_pending(fc))
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fc->lock);
 
 	return mask;
 }
@@ -2026,18 +2215,19 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 /*
  * Abort all requests on the given list (pending or processing)
  *
- * This function releases and reacquires fc->lock
+ * This function releases and reacquires ch->lock
  */
-static void end_requests(struct fuse_conn *fc, struct list_head *head)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_requests(struct fuse_conn *fc, struct fuse_chan *ch,
+			 struct list_head *head)
+__releases(ch->lock)
+__acquires(ch->lock)
 {
 	while (!list_empty(head)) {
 		struct fuse_req *req;
 		req = list_entry(head->next, struct fuse_req, list);
 		req->out.h.error = -ECONNABORTED;
 		request_end(fc, req);
-		spin_lock(&fc->lock);
+		spin_lock(&ch->lock);
 	}
 }
 
@@ -2052,13 +2242,13 @@ __acquires(fc->lock)
  * called after waiting for the request to be unlocked (if it was
  * locked).
  */
-static void end_io_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_io_requests(struct fuse_conn *fc, struct fuse_chan *ch)
+__releases(ch->lock)
+__acquires(ch->lock)
 {
-	while (!list_empty(&fc->io)) {
+	while (!list_empty(&ch->io)) {
 		struct fuse_req *req =
-			list_entry(fc->io.next, struct fuse_req, list);
+			list_entry(ch->io.next, struct fuse_req, list);
 		void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 
 		req->aborted = 1;
@@ -2069,25 +2259,39 @@ __acquires(fc->lock)
 		if (end) {
 			req->end = NULL;
 			__fuse_get_request(req);
-			spin_unlock(&fc->lock);
+			spin_unlock(&ch->lock);
 			wait_event(req->waitq, !req->locked);
 			end(fc, req);
 			fuse_put_request(fc, req);
-			spin_lock(&fc->lock);
+			spin_lock(&ch->lock);
 		}
 	}
 }
 
+/*
+ * Called without locks, after fc->connected was cleared: nothing is
+ * queued on a channel once its lock has seen that.
+ */
 static void end_queued_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
 {
+	int i, j;
+
+	spin_lock(&fc->lock);
 	fc->max_background = UINT_MAX;
 	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
-	end_requests(fc, &fc->processing);
 	while (forget_pending(fc))
 		kfree(dequeue_forget(fc, 1, NULL));
+	spin_unlock(&fc->lock);
+
+	for (i = 0; i < FUSE_MAX_CHANS; i++) {
+		struct fuse_chan *ch = &fc->chans[i];
+
+		spin_lock(&ch->lock);
+		end_requests(fc, ch, &ch->pending);
+		for (j = 0; j < FUSE_PQ_HASH_SIZE; j++)
+			end_requests(fc, ch, &ch->processing[j]);
+		spin_unlock(&ch->lock);
+	}
 }
 
 static void end_polls(struct fuse_conn *fc)
@@ -2122,45 +2326,176 @@ static void end_polls(struct fuse_conn *fc)
  *
  * Progression of requests under I/O to the processing list is
  * prevented by the req->aborted flag being true for these requests.
- * For this reason requests on the io list must be aborted first.
+ * For this reason requests on the io lists must be aborted first.
  */
 void fuse_abort_conn(struct fuse_conn *fc)
 {
+	int i;
+
 	spin_lock(&fc->lock);
-	if (fc->connected) {
-		fc->connected = 0;
-		fc->blocked = 0;
-		fc->initialized = 1;
-		end_io_requests(fc);
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->waitq);
-		wake_up_all(&fc->blocked_waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	if (!fc->connected) {
+		spin_unlock(&fc->lock);
+		return;
 	}
+	fc->connected = 0;
+	fc->blocked = 0;
+	fc->initialized = 1;
 	spin_unlock(&fc->lock);
+
+	for (i = 0; i < FUSE_MAX_CHANS; i++) {
+		struct fuse_chan *ch = &fc->chans[i];
+
+		spin_lock(&ch->lock);
+		end_io_requests(fc, ch);
+		spin_unlock(&ch->lock);
+	}
+	end_queued_requests(fc);
+
+	spin_lock(&fc->lock);
+	end_polls(fc);
+	spin_unlock(&fc->lock);
+	fuse_dev_wake_all(fc);
+	wake_up_all(&fc->blocked_waitq);
+	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc)
+{
+	struct fuse_dev *fud;
+
+	fud = kzalloc(sizeof(struct fuse_dev), GFP_KERNEL);
+	if (!fud)
+		return NULL;
+
+	fud->fc = fuse_conn_get(fc);
+	spin_lock(&fc->lock);
+	/* Past FUSE_MAX_CHANS, clones share the existing channels */
+	if (fc->nr_chans < FUSE_MAX_CHANS)
+		fud->chan = fc->nr_chans++;
+	else
+		fud->chan = fc->dev_count % FUSE_MAX_CHANS;
+	fc->dev_count++;
+	spin_unlock(&fc->lock);
+
+	return fud;
+}
+EXPORT_SYMBOL_GPL(fuse_dev_alloc);
+
+void fuse_dev_free(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+
+	spin_lock(&fc->lock);
+	fc->dev_count--;
+	spin_unlock(&fc->lock);
+	fuse_conn_put(fc);
+	kfree(fud);
+}
+EXPORT_SYMBOL_GPL(fuse_dev_free);
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (fud) {
+		struct fuse_conn *fc = fud->fc;
+		bool last;
+
 		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		fc->initialized = 1;
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->blocked_waitq);
+		/*
+		 * Requests of this fd stay queued for the remaining clones;
+		 * the connection goes away with the last one.
+		 */
+		last = --fc->dev_count == 0;
+		if (last) {
+			fc->connected = 0;
+			fc->blocked = 0;
+			fc->initialized = 1;
+		}
 		spin_unlock(&fc->lock);
+		if (last) {
+			end_queued_requests(fc);
+			spin_lock(&fc->lock);
+			end_polls(fc);
+			spin_unlock(&fc->lock);
+			wake_up_all(&fc->blocked_waitq);
+		}
 		fuse_conn_put(fc);
+		kfree(fud);
 	}
 
 	return 0;
 }
 EXPORT_SYMBOL_GPL(fuse_dev_release);
 
+static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
+{
+	struct fuse_dev *fud;
+
+	if (new->private_data)
+		return -EINVAL;
+
+	fud = fuse_dev_alloc(fc);
+	if (!fud)
+		return -ENOMEM;
+
+	new->private_data = fud;
+	return 0;
+}
+
+static long fuse_dev_ioctl_passthrough_open(struct file *file,
+					    unsigned long arg)
+{
+	struct fuse_passthrough_out pto;
+	struct fuse_dev *fud = fuse_get_dev(file);
+
+	if (!fud)
+		return -EINVAL;
+
+	if (copy_from_user(&pto, (void __user *) arg, sizeof(pto)))
+		return -EFAULT;
+
+	return fuse_passthrough_open(fud->fc, pto.fd);
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct fuse_dev *fud;
+	struct file *old;
+	u32 oldfd;
+	int err;
+
+	if (cmd == FUSE_DEV_IOC_PASSTHROUGH_OPEN)
+		return fuse_dev_ioctl_passthrough_open(file, arg);
+
+	if (cmd != FUSE_DEV_IOC_CLONE)
+		return -ENOTTY;
+
+	if (get_user(oldfd, (u32 __user *) arg))
+		return -EFAULT;
+
+	old = fget(oldfd);
+	if (!old)
+		return -EINVAL;
+
+	/*
+	 * Only plain /dev/fuse can be cloned: CUSE tears its device down
+	 * whenever one of its channel fds is released.
+	 */
+	err = -EINVAL;
+	fud = fuse_get_dev(old);
+	if (old->f_op == &fuse_dev_operations &&
+	    file->f_op == &fuse_dev_operations && fud) {
+		mutex_lock(&fuse_mutex);
+		err = fuse_device_clone(fud->fc, file);
+		mutex_unlock(&fuse_mutex);
+	}
+	fput(old);
+
+	return err;
+}
+
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
 	struct fuse_conn *fc = fuse_get_conn(file);
@@ -2183,6 +2518,8 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+	.compat_ioctl	= fuse_dev_ioctl,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
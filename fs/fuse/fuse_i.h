@@ -22,6 +22,7 @@
 #include <linux/rbtree.h>
 #include <linux/poll.h>
 #include <linux/workqueue.h>
+#include <linux/idr.h>
 
 /** Max number of pages that can be used in a single read request */
 #define FUSE_MAX_PAGES_PER_REQ 32
@@ -47,6 +48,47 @@
 /** Number of page pointers embedded in fuse_req */
 #define FUSE_REQ_INLINE_PAGES 1
 
+#define FUSE_SUPER_MAGIC 0x65735546
+
+/*
+ * Passthrough protocol, to move into the uapi <linux/fuse.h> (which this
+ * tree does not carry) together with a minor version bump.  The values are
+ * those of the Android common kernels; the guard lets the uapi header's
+ * definitions take over once it has them.
+ *
+ * The INIT reply sets FUSE_PASSTHROUGH.  The daemon then registers a
+ * backing fd with FUSE_DEV_IOC_PASSTHROUGH_OPEN, which returns an id, and
+ * an OPEN/CREATE reply sets FOPEN_PASSTHROUGH with that id in the padding
+ * word of fuse_open_out.  Data I/O then goes to the backing file.
+ */
+#ifndef FUSE_DEV_IOC_PASSTHROUGH_OPEN
+#define FUSE_PASSTHROUGH	(1 << 31)
+#define FOPEN_PASSTHROUGH	(1 << 7)
+
+struct fuse_passthrough_out {
+	uint32_t	fd;
+	/* For future implementation */
+	uint32_t	len;
+	void		*vec;
+};
+
+#define FUSE_DEV_IOC_PASSTHROUGH_OPEN \
+	_IOW(229, 1, struct fuse_passthrough_out)
+#endif
+
+/**
+ * Issued on a freshly opened /dev/fuse with the fd of a mounted one:
+ * attach the new fd to the same connection with its own request queue.
+ */
+#define FUSE_DEV_IOC_CLONE	_IOR(229, 0, uint32_t)
+
+/** Maximum number of request queues per connection */
+#define FUSE_CHAN_BITS 4
+#define FUSE_MAX_CHANS (1 << FUSE_CHAN_BITS)
+
+/** Number of hash buckets per channel for requests awaiting a reply */
+#define FUSE_PQ_HASH_SIZE 16
+
 /** List of active connections */
 extern struct list_head fuse_conn_list;
 
@@ -157,6 +199,9 @@ struct fuse_file {
 
 	/** Has flock been performed on this file? */
 	bool flock:1;
+
+	/** Backing file for passthrough I/O, or NULL */
+	struct file *passthrough_filp;
 };
 
 /** One input argument of a request */
@@ -252,9 +297,12 @@ struct fuse_io_priv {
  */
 struct fuse_req {
 	/** This can be on either pending processing or io lists in
-	    fuse_conn */
+	    fuse_chan */
 	struct list_head list;
 
+	/** Channel the request was queued on, set when leaving INIT */
+	struct fuse_chan *chan;
+
 	/** Entry on the interrupts list  */
 	struct list_head intr_entry;
 
@@ -355,6 +403,9 @@ struct fuse_req {
 	/** Path used for completing d_canonical_path */
 	struct path *canonical_path;
 
+	/** Backing file from an OPEN/CREATE reply, until fuse_file takes it */
+	struct file *passthrough_filp;
+
 	/** AIO control block */
 	struct fuse_io_priv *io;
 
@@ -368,6 +419,49 @@ struct fuse_req {
 	struct file *stolen_file;
 };
 
+/**
+ * A request queue of a connection.  Each /dev/fuse fd (the mount one or a
+ * clone) prefers the requests on its own channel, and steals from the
+ * others when that one is empty.
+ *
+ * A request stays on the channel it was queued on until it ends, and the
+ * low FUSE_CHAN_BITS of its unique ID name that channel, so a reply finds
+ * it whichever fd it is written to.  The lists, the request state and
+ * reqctr are protected by ->lock; when both are needed, fuse_conn->lock
+ * is taken first.
+ */
+struct fuse_chan {
+	/** Lock protecting the lists and the requests on them */
+	spinlock_t lock;
+
+	/** Requests not yet read by userspace */
+	struct list_head pending;
+
+	/** Pending interrupts of requests on this channel */
+	struct list_head interrupts;
+
+	/** Requests being processed, hashed by unique ID */
+	struct list_head processing[FUSE_PQ_HASH_SIZE];
+
+	/** Requests under I/O */
+	struct list_head io;
+
+	/** The next unique request id of this channel */
+	u64 reqctr;
+
+	/** Readers of this channel are waiting on this */
+	wait_queue_head_t waitq;
+} ____cacheline_aligned_in_smp;
+
+/** Per-file state of an open /dev/fuse, in file->private_data */
+struct fuse_dev {
+	/** Connection this fd belongs to; holds a reference */
+	struct fuse_conn *fc;
+
+	/** Index of this fd's channel in fc->chans */
+	unsigned chan;
+};
+
 /**
  * A Fuse connection.
  *
@@ -376,7 +470,8 @@ struct fuse_req {
  * unmounted.
  */
 struct fuse_conn {
-	/** Lock protecting accessess to  members of this structure */
+	/** Lock protecting accessess to  members of this structure,
+	    except for the request queues in chans */
 	spinlock_t lock;
 
 	/** Refcount */
@@ -399,17 +494,14 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
-	wait_queue_head_t waitq;
-
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Request queues, requests go to the one of the submitting CPU */
+	struct fuse_chan chans[FUSE_MAX_CHANS];
 
-	/** The list of requests being processed */
-	struct list_head processing;
+	/** Number of chans in use */
+	unsigned nr_chans;
 
-	/** The list of requests under I/O */
-	struct list_head io;
+	/** Number of open device files, including clones */
+	unsigned dev_count;
 
 	/** The next unique kernel file handle */
 	u64 khctr;
@@ -432,9 +524,6 @@ struct fuse_conn {
 	/** The list of background requests set aside for later queuing */
 	struct list_head bg_queue;
 
-	/** Pending interrupts */
-	struct list_head interrupts;
-
 	/** Queue of pending forgets */
 	struct fuse_forget_link forget_list_head;
 	struct fuse_forget_link *forget_list_tail;
@@ -457,9 +546,6 @@ struct fuse_conn {
 	/** waitq for reserved requests */
 	wait_queue_head_t reserved_req_waitq;
 
-	/** The next unique request id */
-	u64 reqctr;
-
 	/** Connection established, cleared on umount, connection
 	    abort and device release */
 	unsigned connected;
@@ -561,6 +647,12 @@ struct fuse_conn {
 	/** Does the filesystem support asynchronous direct-IO submission? */
 	unsigned async_dio:1;
 
+	/** May open replies hand over a backing file? */
+	unsigned passthrough:1;
+
+	/** Backing files registered for passthrough, by id */
+	struct idr passthrough_req;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -894,6 +986,9 @@ long fuse_ioctl_common(struct file *file, unsigned int cmd,
 		       unsigned long arg, unsigned int flags);
 unsigned fuse_file_poll(struct file *file, poll_table *wait);
 int fuse_dev_release(struct inode *inode, struct file *file);
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
+void fuse_dev_free(struct fuse_dev *fud);
+void fuse_dev_wake_all(struct fuse_conn *fc);
 
 bool fuse_write_update_size(struct inode *inode, loff_t pos);
 
@@ -903,4 +998,17 @@ int fuse_write_inode(struct inode *inode, struct writeback_control *wbc);
 int fuse_do_setattr(struct dentry *dentry, struct iattr *attr,
 		    struct file *file);
 
+/* passthrough.c */
+int fuse_passthrough_open(struct fuse_conn *fc, u32 fd);
+void fuse_passthrough_conn_release(struct fuse_conn *fc);
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req);
+void fuse_passthrough_release(struct fuse_file *ff);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb,
+				    struct iov_iter *from);
+ssize_t fuse_passthrough_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe,
+				     size_t len, unsigned int flags);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
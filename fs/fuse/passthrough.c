@@ -0,0 +1,286 @@
+/*
+  FUSE: Filesystem in Userspace
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+#include "fuse_i.h"
+
+#include <linux/aio.h>
+#include <linux/cred.h>
+#include <linux/file.h>
+#include <linux/fsnotify.h>
+#include <linux/idr.h>
+#include <linux/mm.h>
+#include <linux/security.h>
+#include <linux/splice.h>
+
+/*
+ * FUSE_DEV_IOC_PASSTHROUGH_OPEN: the daemon registers one of its fds as
+ * a backing file and gets back an id to put in an OPEN/CREATE reply.  The
+ * fd is resolved here, in the daemon's own ioctl, never while a reply is
+ * written to /dev/fuse.  Each id is good for a single open.
+ */
+int fuse_passthrough_open(struct fuse_conn *fc, u32 fd)
+{
+	struct file *backing;
+	struct inode *inode;
+	int id;
+
+	if (!fc->passthrough)
+		return -EPERM;
+
+	backing = fget(fd);
+	if (!backing)
+		return -EBADF;
+
+	/* No stacking on top of another FUSE file, that way lies recursion */
+	inode = file_inode(backing);
+	id = -EINVAL;
+	if (!S_ISREG(inode->i_mode) ||
+	    inode->i_sb->s_magic == FUSE_SUPER_MAGIC ||
+	    !backing->f_op->read_iter || !backing->f_op->write_iter)
+		goto out_fput;
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&fc->lock);
+	id = idr_alloc(&fc->passthrough_req, backing, 1, 0, GFP_ATOMIC);
+	spin_unlock(&fc->lock);
+	idr_preload_end();
+	if (id > 0)
+		return id;
+
+out_fput:
+	fput(backing);
+	return id;
+}
+
+/*
+ * Called from the daemon's write() to /dev/fuse with the reply copied in:
+ * take the backing file registered under the id in the reply.  An unknown
+ * id is ignored and the file falls back to ordinary FUSE I/O.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_open_out *outarg;
+	struct file *backing;
+
+	if (!fc->passthrough || req->out.h.error)
+		return;
+
+	if (req->in.h.opcode == FUSE_OPEN && req->out.numargs == 1)
+		outarg = req->out.args[0].value;
+	else if (req->in.h.opcode == FUSE_CREATE && req->out.numargs == 2)
+		outarg = req->out.args[1].value;
+	else
+		return;
+
+	if (!(outarg->open_flags & FOPEN_PASSTHROUGH) || !outarg->padding)
+		return;
+
+	spin_lock(&fc->lock);
+	backing = idr_find(&fc->passthrough_req, outarg->padding);
+	if (backing)
+		idr_remove(&fc->passthrough_req, outarg->padding);
+	spin_unlock(&fc->lock);
+
+	req->passthrough_filp = backing;
+}
+
+static int fuse_passthrough_put_backing(int id, void *p, void *data)
+{
+	fput(p);
+	return 0;
+}
+
+/* Drop backing files that were registered but never used */
+void fuse_passthrough_conn_release(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->passthrough_req, fuse_passthrough_put_backing, NULL);
+	idr_destroy(&fc->passthrough_req);
+}
+
+/*
+ * The checks rw_verify_area() does for vfs_read()/vfs_write(), which are
+ * not reachable from here for an iov_iter.
+ */
+static int fuse_passthrough_verify_area(struct file *backing, loff_t pos,
+					size_t count, int mask)
+{
+	struct inode *inode = file_inode(backing);
+	int ret;
+
+	if (unlikely(pos < 0 || (loff_t)(pos + count) < 0))
+		return -EINVAL;
+
+	if (inode->i_flock && mandatory_lock(inode)) {
+		ret = locks_mandatory_area(mask == MAY_READ ?
+				FLOCK_VERIFY_READ : FLOCK_VERIFY_WRITE,
+				inode, backing, pos, count);
+		if (ret < 0)
+			return ret;
+	}
+
+	return security_file_permission(backing, mask);
+}
+
+void fuse_passthrough_release(struct fuse_file *ff)
+{
+	if (ff->passthrough_filp) {
+		fput(ff->passthrough_filp);
+		ff->passthrough_filp = NULL;
+	}
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct fuse_file *ff = iocb->ki_filp->private_data;
+	struct file *backing = ff->passthrough_filp;
+	const struct cred *old_cred;
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	if (!(backing->f_mode & FMODE_READ))
+		return -EBADF;
+	if (!(backing->f_mode & FMODE_CAN_READ))
+		return -EINVAL;
+
+	iov_iter_truncate(to, MAX_RW_COUNT);
+	if (!iov_iter_count(to))
+		return 0;
+
+	ret = fuse_passthrough_verify_area(backing, iocb->ki_pos,
+					   iov_iter_count(to), MAY_READ);
+	if (ret)
+		return ret;
+
+	old_cred = override_creds(backing->f_cred);
+	init_sync_kiocb(&kiocb, backing);
+	kiocb.ki_pos = iocb->ki_pos;
+	kiocb.ki_nbytes = iov_iter_count(to);
+	ret = backing->f_op->read_iter(&kiocb, to);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+	revert_creds(old_cred);
+	iocb->ki_pos = kiocb.ki_pos;
+
+	if (ret > 0)
+		fsnotify_access(backing);
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file_inode(file);
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough_filp;
+	const struct cred *old_cred;
+	struct kiocb kiocb;
+	loff_t pos = iocb->ki_pos;
+	ssize_t ret;
+
+	if (!(backing->f_mode & FMODE_WRITE))
+		return -EBADF;
+	if (!(backing->f_mode & FMODE_CAN_WRITE))
+		return -EINVAL;
+
+	iov_iter_truncate(from, MAX_RW_COUNT);
+	if (!iov_iter_count(from))
+		return 0;
+
+	ret = fuse_passthrough_verify_area(backing, pos, iov_iter_count(from),
+					   MAY_WRITE);
+	if (ret)
+		return ret;
+
+	old_cred = override_creds(backing->f_cred);
+	init_sync_kiocb(&kiocb, backing);
+	kiocb.ki_pos = pos;
+	kiocb.ki_nbytes = iov_iter_count(from);
+	file_start_write(backing);
+	ret = backing->f_op->write_iter(&kiocb, from);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+	file_end_write(backing);
+	revert_creds(old_cred);
+	iocb->ki_pos = kiocb.ki_pos;
+
+	if (ret > 0) {
+		fsnotify_modify(backing);
+		/* O_APPEND on the backing file may have moved the write */
+		pos = kiocb.ki_pos - ret;
+		fuse_write_update_size(inode, kiocb.ki_pos);
+		/* Drop anything cached through a non-passthrough open */
+		if (inode->i_mapping->nrpages)
+			invalidate_inode_pages2_range(inode->i_mapping,
+					pos >> PAGE_CACHE_SHIFT,
+					(kiocb.ki_pos - 1) >> PAGE_CACHE_SHIFT);
+	}
+	fuse_invalidate_attr(inode);
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe,
+				     size_t len, unsigned int flags)
+{
+	struct fuse_file *ff = in->private_data;
+	struct file *backing = ff->passthrough_filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!(backing->f_mode & FMODE_READ))
+		return -EBADF;
+
+	ret = fuse_passthrough_verify_area(backing, *ppos, len, MAY_READ);
+	if (ret)
+		return ret;
+
+	old_cred = override_creds(backing->f_cred);
+	if (backing->f_op->splice_read)
+		ret = backing->f_op->splice_read(backing, ppos, pipe, len,
+						 flags);
+	else
+		ret = generic_file_splice_read(backing, ppos, pipe, len, flags);
+	revert_creds(old_cred);
+
+	if (ret > 0)
+		fsnotify_access(backing);
+
+	return ret;
+}
+
+/*
+ * Hand the vma over to the backing file, so faults are served from its
+ * page cache and FUSE never sees them.
+ */
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough_filp;
+	int err;
+
+	if (!backing->f_op->mmap)
+		return -ENODEV;
+
+	/* Don't let the mapping allow more than the backing file does */
+	if ((vma->vm_flags & VM_SHARED) && !(backing->f_mode & FMODE_WRITE)) {
+		if (vma->vm_flags & VM_WRITE)
+			return -EACCES;
+		vma->vm_flags &= ~VM_MAYWRITE;
+	}
+
+	err = backing->f_op->mmap(backing, vma);
+	if (err)
+		return err;
+
+	vma->vm_file = get_file(backing);
+	fput(file);
+	file_accessed(file);
+
+	return 0;
+}
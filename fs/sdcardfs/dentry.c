@@ -115,6 +115,10 @@ static int sdcardfs_d_revalidate(struct dentry *dentry, unsigned int flags)
 		iput(inode);
 	}
 
+	/* Pick up any package list change since the owner was derived */
+	if (err)
+		sdcardfs_refresh_perm(dentry);
+
 out:
 	dput(parent_dentry);
 	dput(lower_cur_parent_dentry);
@@ -46,6 +46,7 @@ void setup_derived_state(struct inode *inode, perm_t perm, userid_t userid,
 	info->data->under_android = false;
 	info->data->under_cache = false;
 	info->data->under_obb = false;
+	info->data->pkgl_gen = atomic_read(&sdcardfs_pkgl_gen);
 }
 
 /* While renaming, there is a point where we want the path from dentry,
@@ -76,6 +77,8 @@ void get_derived_permission_new(struct dentry *parent, struct dentry *dentry,
 	 */
 
 	inherit_derived_state(parent->d_inode, dentry->d_inode);
+	/* Sample before the lookup so a racing update is seen as stale */
+	info->data->pkgl_gen = atomic_read(&sdcardfs_pkgl_gen);
 
 	/* Files don't get special labels */
 	if (!S_ISDIR(dentry->d_inode->i_mode)) {
@@ -130,8 +133,9 @@ void get_derived_permission_new(struct dentry *parent, struct dentry *dentry,
 	case PERM_ANDROID_DATA:
 	case PERM_ANDROID_MEDIA:
 		info->data->perm = PERM_ANDROID_PACKAGE;
-		appid = get_appid(name->name);
-		if (appid != 0 && !is_excluded(name->name, parent_data->userid))
+		/* name->hash is already case-folded by sdcardfs_hash_ci() */
+		appid = get_appid_qstr(name);
+		if (appid != 0 && !is_excluded_qstr(name, parent_data->userid))
 			info->data->d_uid =
 				multiuser_get_uid(parent_data->userid, appid);
 		break;
@@ -266,67 +270,69 @@ retry_deleg:
 	sdcardfs_put_lower_path(dentry, &path);
 }
 
-static int descendant_may_need_fixup(struct sdcardfs_inode_data *data,
-		struct limit_search *limit)
+static bool data_is_stale(struct sdcardfs_inode_data *data)
 {
-	if (data->perm == PERM_ROOT)
-		return (limit->flags & BY_USERID) ?
-				data->userid == limit->userid : 1;
-	if (data->perm == PERM_PRE_ROOT || data->perm == PERM_ANDROID)
-		return 1;
-	return 0;
+	/* Only package directories take their owner from the package list */
+	return data->perm == PERM_ANDROID_PACKAGE &&
+		data->pkgl_gen != atomic_read(&sdcardfs_pkgl_gen);
 }
 
-static int needs_fixup(perm_t perm)
+/* true if the owner of @inode must be re-derived before it is used */
+bool sdcardfs_perm_stale(struct inode *inode)
 {
-	if (perm == PERM_ANDROID_DATA || perm == PERM_ANDROID_OBB
-			|| perm == PERM_ANDROID_MEDIA)
-		return 1;
-	return 0;
+	struct sdcardfs_inode_data *top = top_data_get(SDCARDFS_I(inode));
+	bool stale;
+
+	if (!top)
+		return false;
+	stale = data_is_stale(top);
+	data_put(top);
+	return stale;
 }
 
-static void __fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit, int depth)
+/*
+ * Package list updates only bump sdcardfs_pkgl_gen rather than walking
+ * every mounted tree. The package directory that owns @dentry (its top)
+ * is re-derived here the next time @dentry is used; everything below it
+ * reads the owner through top_data, so nothing else needs a fixup.
+ */
+void sdcardfs_refresh_perm(struct dentry *dentry)
 {
-	struct dentry *child;
-	struct sdcardfs_inode_info *info;
+	struct sdcardfs_inode_data *top;
+	struct dentry *owner, *parent;
 
-	/*
-	 * All paths will terminate their recursion on hitting PERM_ANDROID_OBB,
-	 * PERM_ANDROID_MEDIA, or PERM_ANDROID_DATA. This happens at a depth of
-	 * at most 3.
-	 */
-	WARN(depth > 3, "%s: Max expected depth exceeded!\n", __func__);
-	spin_lock_nested(&dentry->d_lock, depth);
-	if (!dentry->d_inode) {
-		spin_unlock(&dentry->d_lock);
+	if (!dentry->d_inode)
+		return;
+	top = top_data_get(SDCARDFS_I(dentry->d_inode));
+	if (!top)
 		return;
+	if (!data_is_stale(top))
+		goto out;
+
+	/* Find the dentry whose own data is the top, at most a few levels up */
+	owner = dget(dentry);
+	while (!IS_ROOT(owner) &&
+			!(owner->d_inode && SDCARDFS_I(owner->d_inode)->data == top)) {
+		parent = dget_parent(owner);
+		dput(owner);
+		owner = parent;
 	}
-	info = SDCARDFS_I(dentry->d_inode);
 
-	if (needs_fixup(info->data->perm)) {
-		list_for_each_entry(child, &dentry->d_subdirs, d_child) {
-			spin_lock_nested(&child->d_lock, depth + 1);
-			if (!(limit->flags & BY_NAME) || qstr_case_eq(&child->d_name, &limit->name)) {
-				if (child->d_inode) {
-					get_derived_permission(dentry, child);
-					fixup_tmp_permissions(child->d_inode);
-					spin_unlock(&child->d_lock);
-					break;
-				}
-			}
-			spin_unlock(&child->d_lock);
-		}
-	} else if (descendant_may_need_fixup(info->data, limit)) {
-		list_for_each_entry(child, &dentry->d_subdirs, d_child) {
-			__fixup_perms_recursive(child, limit, depth + 1);
+	if (!IS_ROOT(owner)) {
+		parent = dget_parent(owner);
+		spin_lock(&parent->d_lock);
+		spin_lock_nested(&owner->d_lock, DENTRY_D_LOCK_NESTED);
+		if (owner->d_inode && data_is_stale(SDCARDFS_I(owner->d_inode)->data)) {
+			get_derived_permission(parent, owner);
+			fixup_tmp_permissions(owner->d_inode);
 		}
+		spin_unlock(&owner->d_lock);
+		spin_unlock(&parent->d_lock);
+		dput(parent);
 	}
-	spin_unlock(&dentry->d_lock);
-}
-
-void fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit)
-{
-	__fixup_perms_recursive(dentry, limit, 0);
+	dput(owner);
+out:
+	data_put(top);
 }
 
 /* main function for updating derived permission */
@@ -195,6 +195,26 @@ static int sdcardfs_mmap(struct file *file, struct vm_area_struct *vma)
 		goto out;
 	}
 
+	/*
+	 * In passthrough mode the vma is handed to the lower file outright,
+	 * so faults go straight to the lower address_space.
+	 */
+	if (sdcardfs_passthrough(file)) {
+		if (!lower_file->f_op->mmap) {
+			err = -ENODEV;
+			goto out;
+		}
+		err = lower_file->f_op->mmap(lower_file, vma);
+		if (err) {
+			pr_err("sdcardfs: lower mmap failed %d\n", err);
+			goto out;
+		}
+		vma->vm_file = get_file(lower_file);
+		fput(file);
+		file_accessed(file);
+		goto out;
+	}
+
 	/*
 	 * find and save lower vm_ops.
 	 *
@@ -275,6 +295,11 @@ static int sdcardfs_open(struct inode *inode, struct file *file)
 		}
 	} else {
 		sdcardfs_set_lower_file(file, lower_file);
+		/* share the lower page cache instead of keeping our own */
+		if (sdcardfs_passthrough(file)) {
+			file->f_mapping = lower_file->f_mapping;
+			file_ra_state_init(&file->f_ra, file->f_mapping);
+		}
 	}
 
 	if (err)
@@ -296,7 +321,9 @@ static int sdcardfs_flush(struct file *file, fl_owner_t id)
 
 	lower_file = sdcardfs_lower_file(file);
 	if (lower_file && lower_file->f_op && lower_file->f_op->flush) {
-		filemap_write_and_wait(file->f_mapping);
+		/* in passthrough mode f_mapping is the lower one; leave it be */
+		if (!sdcardfs_passthrough(file))
+			filemap_write_and_wait(file->f_mapping);
 		err = lower_file->f_op->flush(lower_file, id);
 	}
 
@@ -326,9 +353,12 @@ static int sdcardfs_fsync(struct file *file, loff_t start, loff_t end,
 	struct path lower_path;
 	struct dentry *dentry = file->f_path.dentry;
 
-	err = __generic_file_fsync(file, start, end, datasync);
-	if (err)
-		goto out;
+	/* nothing of ours to write back when the data lives below */
+	if (!sdcardfs_passthrough(file)) {
+		err = __generic_file_fsync(file, start, end, datasync);
+		if (err)
+			goto out;
+	}
 
 	lower_file = sdcardfs_lower_file(file);
 	sdcardfs_get_lower_path(dentry, &lower_path);
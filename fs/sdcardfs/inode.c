@@ -554,10 +554,23 @@ static int sdcardfs_permission(struct vfsmount *mnt, struct inode *inode, int ma
 {
 	int err;
 	struct inode tmp;
-	struct sdcardfs_inode_data *top = top_data_get(SDCARDFS_I(inode));
+	struct sdcardfs_inode_data *top;
+	struct dentry *alias;
 
 	if (IS_ERR(mnt))
 		return PTR_ERR(mnt);
+
+	if (sdcardfs_perm_stale(inode)) {
+		if (mask & MAY_NOT_BLOCK)
+			return -ECHILD;
+		alias = d_find_alias(inode);
+		if (alias) {
+			sdcardfs_refresh_perm(alias);
+			dput(alias);
+		}
+	}
+
+	top = top_data_get(SDCARDFS_I(inode));
 	if (!top)
 		return -EINVAL;
 
@@ -766,6 +779,8 @@ static int sdcardfs_getattr(struct vfsmount *mnt, struct dentry *dentry,
 	}
 	dput(parent);
 
+	sdcardfs_refresh_perm(dentry);
+
 	sdcardfs_get_lower_path(dentry, &lower_path);
 	err = vfs_getattr(&lower_path, &lower_stat);
 	if (err)
@@ -36,6 +36,7 @@ enum {
 	Opt_default_normal,
 	Opt_nocache,
 	Opt_unshared_obb,
+	Opt_passthrough,
 	Opt_err,
 };
 
@@ -52,6 +53,7 @@ static const match_table_t sdcardfs_tokens = {
 	{Opt_unshared_obb, "unshared_obb"},
 	{Opt_reserved_mb, "reserved_mb=%u"},
 	{Opt_nocache, "nocache"},
+	{Opt_passthrough, "passthrough"},
 	{Opt_err, NULL}
 };
 
@@ -76,6 +78,7 @@ static int parse_options(struct super_block *sb, char *options, int silent,
 	opts->gid_derivation = false;
 	opts->default_normal = false;
 	opts->nocache = false;
+	opts->passthrough = false;
 
 	*debug = 0;
 
@@ -139,6 +142,9 @@ static int parse_options(struct super_block *sb, char *options, int silent,
 		case Opt_unshared_obb:
 			opts->unshared_obb = true;
 			break;
+		case Opt_passthrough:
+			opts->passthrough = true;
+			break;
 		/* unknown option */
 		default:
 			if (!silent)
@@ -193,6 +199,7 @@ int parse_options_remount(struct super_block *sb, char *options, int silent,
 			vfsopts->mask = option;
 			break;
 		case Opt_unshared_obb:
+		case Opt_passthrough:
 		case Opt_default_normal:
 		case Opt_multiuser:
 		case Opt_userid:
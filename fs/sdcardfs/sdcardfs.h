@@ -167,6 +167,8 @@ struct sdcardfs_inode_data {
 	bool under_android;
 	bool under_cache;
 	bool under_obb;
+	/* sdcardfs_pkgl_gen when d_uid was derived from the package list */
+	unsigned int pkgl_gen;
 };
 
 /* sdcardfs inode data in memory */
@@ -200,6 +202,7 @@ struct sdcardfs_mount_options {
 	bool unshared_obb;
 	unsigned int reserved_mb;
 	bool nocache;
+	bool passthrough;
 };
 
 struct sdcardfs_vfsmount_options {
@@ -257,6 +260,16 @@ static inline void sdcardfs_set_lower_file(struct file *f, struct file *val)
 	SDCARDFS_F(f)->lower_file = val;
 }
 
+/*
+ * With the passthrough mount option, regular file data lives only in the
+ * lower inode's address_space; the upper file just points at it.
+ */
+static inline bool sdcardfs_passthrough(const struct file *f)
+{
+	return SDCARDFS_SB(f->f_path.dentry->d_sb)->options.passthrough &&
+		S_ISREG(file_inode(f)->i_mode);
+}
+
 /* inode to lower inode. */
 static inline struct inode *sdcardfs_lower_inode(const struct inode *i)
 {
@@ -487,27 +500,23 @@ extern struct mutex sdcardfs_super_list_lock;
 extern struct list_head sdcardfs_super_list;
 
 /* for packagelist.c */
+extern atomic_t sdcardfs_pkgl_gen;
 extern appid_t get_appid(const char *app_name);
+extern appid_t get_appid_qstr(const struct qstr *app_name);
 extern appid_t get_ext_gid(const char *app_name);
 extern appid_t is_excluded(const char *app_name, userid_t userid);
+extern appid_t is_excluded_qstr(const struct qstr *app_name, userid_t userid);
 extern int check_caller_access_to_name(struct inode *parent_node, const struct qstr *name);
 extern int packagelist_init(void);
 extern void packagelist_exit(void);
 
 /* for derived_perm.c */
-#define BY_NAME		(1 << 0)
-#define BY_USERID	(1 << 1)
-struct limit_search {
-	unsigned int flags;
-	struct qstr name;
-	userid_t userid;
-};
-
 extern void setup_derived_state(struct inode *inode, perm_t perm,
 			userid_t userid, uid_t uid);
 extern void get_derived_permission(struct dentry *parent, struct dentry *dentry);
 extern void get_derived_permission_new(struct dentry *parent, struct dentry *dentry, const struct qstr *name);
-extern void fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit);
+extern bool sdcardfs_perm_stale(struct inode *inode);
+extern void sdcardfs_refresh_perm(struct dentry *dentry);
 
 extern void update_derived_permission_lock(struct dentry *dentry);
 void fixup_lower_ownership(struct dentry *dentry, const char *name);
@@ -88,6 +88,8 @@ s32 fsapi_mount(struct super_block *sb)
 	/* acquire the core lock for file system ccritical section */
 	mutex_lock(&_lock_core);
 
+	/* the meta cache shrinker must not run before mount completes */
+	mutex_lock(&(SDFAT_SB(sb)->s_vlock));
 	err = meta_cache_init(sb);
 	if (err)
 		goto out;
@@ -96,6 +98,7 @@ s32 fsapi_mount(struct super_block *sb)
 out:
 	if (err)
 		meta_cache_shutdown(sb);
+	mutex_unlock(&(SDFAT_SB(sb)->s_vlock));
 
 	/* release the core lock for file system critical section */
 	mutex_unlock(&_lock_core);
@@ -619,6 +622,18 @@ s32 fsapi_dfr_check_dfr_on(struct inode *inode, loff_t start, loff_t end, s32 ca
 }
 EXPORT_SYMBOL(fsapi_dfr_check_dfr_on);
 
+s32 fsapi_dfr_collect_chunks(struct inode *inode, void *chunks, int max_chunks, int *nr_chunks, u32 max_clus)
+{
+	s32 ret;
+	struct super_block *sb = inode->i_sb;
+
+	mutex_lock(&(SDFAT_SB(sb)->s_vlock));
+	ret = defrag_collect_chunks(inode, chunks, max_chunks, nr_chunks, max_clus);
+	mutex_unlock(&(SDFAT_SB(sb)->s_vlock));
+	return ret;
+}
+EXPORT_SYMBOL(fsapi_dfr_collect_chunks);
+
 
 
 #ifdef CONFIG_SDFAT_DFR_DEBUG
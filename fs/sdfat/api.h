@@ -18,6 +18,11 @@
 #ifndef _SDFAT_API_H
 #define _SDFAT_API_H
 
+#include <linux/list.h>
+#include <linux/list_nulls.h>
+#include <linux/shrinker.h>
+#include <linux/spinlock.h>
+
 #include "config.h"
 #include "sdfat_fs.h"
 
@@ -30,17 +35,26 @@ extern "C" {
 /*  Configure Constant & Macro Definitions                              */
 /*----------------------------------------------------------------------*/
 /* cache size (in number of sectors)                */
-/* (should be an exponential value of 2)            */
-#define FAT_CACHE_SIZE          128
-#define FAT_CACHE_HASH_SIZE     64
-#define BUF_CACHE_SIZE          256
-#define BUF_CACHE_HASH_SIZE     64
+/* caches start at MIN, grow on misses up to a RAM  */
+/* scaled size bounded by MAX and are trimmed back  */
+/* by the memory shrinker (should be pow of 2)      */
+#define FAT_CACHE_MIN_SIZE      128
+#define FAT_CACHE_MAX_SIZE      4096
+#define BUF_CACHE_MIN_SIZE      256
+#define BUF_CACHE_MAX_SIZE      8192
+#define META_CACHE_MAX_SHARDS   8
 
 /* Read-ahead related                                */
 /* First config vars. should be pow of 2             */
 #define FCACHE_MAX_RA_SIZE	(PAGE_SIZE)
 #define DCACHE_MAX_RA_SIZE	(128*1024)
 
+/* FAT chain prefetch for sequential file reads      */
+/* (file data ahead of the current position and FAT  */
+/*  read-ahead unit when the chain leaves the cache) */
+#define FCHAIN_RA_WINDOW	(4*1024*1024)
+#define FCHAIN_MAX_RA_SIZE	(64*1024)
+
 /*----------------------------------------------------------------------*/
 /*  Constant & Macro Definitions                                        */
 /*----------------------------------------------------------------------*/
@@ -157,6 +171,9 @@ typedef struct {
 	struct list_head cache_lru;
 	s32 nr_caches;
 	u32 cache_valid_id;	// for avoiding the race between alloc and free
+	u32 ra_last;		// last cluster looked up (sequential detection)
+	u32 ra_fclus;		// FAT chain prefetched up to this file cluster
+	u32 ra_dclus;		// ... which is mapped to this disk cluster
 } EXTENT_T;
 
 /* first empty entry hint information */
@@ -205,15 +222,33 @@ typedef struct {
 typedef struct __cache_entry {
 	struct __cache_entry *next;
 	struct __cache_entry *prev;
-	struct {
-		struct __cache_entry *next;
-		struct __cache_entry *prev;
-	} hash;
+	struct hlist_nulls_node hash;
 	u64 sec;
 	u32 flag;
+	atomic_t refcnt;              // 0 while unhashed, see cache.c
 	struct buffer_head   *bh;
 } cache_ent_t;
 
+/* one slice of a meta cache, see cache.c for the locking rules */
+typedef struct {
+	spinlock_t lock;
+	cache_ent_t lru_list;
+	cache_ent_t keep_list;        // CACHEs in this list will not be kicked by normal lru operations
+	cache_ent_t free_list;        // CACHEs without buffer
+	u32 nr_used;                  // number of CACHEs holding a buffer
+	u32 nr_limit;                 // adaptive upper bound of nr_used
+} ____cacheline_aligned_in_smp cache_shard_t;
+
+typedef struct {
+	cache_ent_t *pool;
+	cache_shard_t *shards;
+	struct hlist_nulls_head *hash_list;
+	u32 nr_shards;                // power of 2
+	u32 hash_size;                // power of 2, multiple of nr_shards
+	u32 nr_max;                   // CACHEs per shard
+	u32 nr_min;                   // lower bound of nr_limit per shard
+} meta_cache_t;
+
 /*----------------------------------------------------------------------*/
 /*  Type Definitions : Wrapper & In-Core                                */
 /*----------------------------------------------------------------------*/
@@ -288,19 +323,13 @@ typedef struct __FS_INFO_T {
 	void        *amap;                  // AU Allocation Map
 
 	/* fat cache */
-	struct {
-		cache_ent_t pool[FAT_CACHE_SIZE];
-		cache_ent_t lru_list;
-		cache_ent_t hash_list[FAT_CACHE_HASH_SIZE];
-	} fcache;
+	meta_cache_t fcache;
 
 	/* meta cache */
-	struct {
-		cache_ent_t pool[BUF_CACHE_SIZE];
-		cache_ent_t lru_list;
-		cache_ent_t keep_list;        // CACHEs in this list will not be kicked by normal lru operations
-		cache_ent_t hash_list[BUF_CACHE_HASH_SIZE];
-	} dcache;
+	meta_cache_t dcache;
+
+	/* trims both caches under memory pressure */
+	struct shrinker mcache_shrinker;
 } FS_INFO_T;
 
 /*======================================================================*/
@@ -382,6 +411,7 @@ void fsapi_dfr_free_clus(struct super_block *sb, u32 clus);
 
 s32 fsapi_dfr_check_dfr_required(struct super_block *sb, int *totalau, int *cleanau, int *fullau);
 s32 fsapi_dfr_check_dfr_on(struct inode *inode, loff_t start, loff_t end, s32 cancel, const char *caller);
+s32 fsapi_dfr_collect_chunks(struct inode *inode, void *chunks, int max_chunks, int *nr_chunks, u32 max_clus);
 
 
 #ifdef CONFIG_SDFAT_DFR_DEBUG
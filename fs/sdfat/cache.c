@@ -29,19 +29,38 @@
 /************************************************************************/
 
 #include <linux/swap.h> /* for mark_page_accessed() */
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/rculist_nulls.h>
 #include <asm/unaligned.h>
 
 #include "sdfat.h"
 #include "core.h"
 
-#define DEBUG_HASH_LIST
-#define DEBUG_HASH_PREV	(0xAAAA5555)
-#define DEBUG_HASH_NEXT	(0x5555AAAA)
-
 /*----------------------------------------------------------------------*/
 /*  Global Variable Definitions                                         */
 /*----------------------------------------------------------------------*/
-/* All buffer structures are protected w/ fsi->v_sem */
+/*
+ * Both caches are split into power-of-2 shards picked by sector. Every
+ * shard owns a fixed slice of the entry pool and its own LRU, keep and
+ * free lists. The hash table is shared; a bucket only ever holds entries
+ * of the shard given by its low bits.
+ *
+ * - Lookups walk a hash chain under rcu_read_lock() only. The pool is
+ *   freed at unmount, so an entry may be recycled under the walker; the
+ *   nulls value ending each chain tells whether the walk strayed into
+ *   another bucket, and it then restarts.
+ * - A hashed entry holds one reference of its own. A lookup pins the
+ *   entry it returns with atomic_inc_not_zero() and checks the sector
+ *   again, as the entry may have been recycled in between. Drop the pin
+ *   with __mcache_put(). Recycling freezes refcnt from 1 to 0 first, so
+ *   it never takes a pinned entry, and discarding waits the pins out.
+ * - Hash chains, lists and shard counters change under the shard lock.
+ * - Entry flags, and the b_data handed out by fcache/dcache_getblk(),
+ *   belong to the holder of sbi->s_vlock. The shrinker only trylocks it,
+ *   so it never blocks fs operations.
+ */
 
 /*----------------------------------------------------------------------*/
 /*  Local Variable Definitions                                          */
@@ -54,14 +73,12 @@
 /*  Cache handling function declarations                                */
 /*----------------------------------------------------------------------*/
 static cache_ent_t *__fcache_find(struct super_block *sb, u64 sec);
-static cache_ent_t *__fcache_get(struct super_block *sb);
+static cache_ent_t *__fcache_get(struct super_block *sb, u64 sec);
 static void __fcache_insert_hash(struct super_block *sb, cache_ent_t *bp);
-static void __fcache_remove_hash(cache_ent_t *bp);
 
 static cache_ent_t *__dcache_find(struct super_block *sb, u64 sec);
-static cache_ent_t *__dcache_get(struct super_block *sb);
+static cache_ent_t *__dcache_get(struct super_block *sb, u64 sec);
 static void __dcache_insert_hash(struct super_block *sb, cache_ent_t *bp);
-static void __dcache_remove_hash(cache_ent_t *bp);
 
 /*----------------------------------------------------------------------*/
 /*  Static functions                                                    */
@@ -96,30 +113,349 @@ static void move_to_lru(cache_ent_t *bp, cache_ent_t *list)
 	push_to_lru(bp, list);
 }
 
-static inline s32 __check_hash_valid(cache_ent_t *bp)
+static inline void __init_list(cache_ent_t *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+/*----------------------------------------------------------------------*/
+/*  Pool handling functions (common to FAT & buffer cache)              */
+/*----------------------------------------------------------------------*/
+static inline u32 __mcache_bucket(struct super_block *sb,
+					meta_cache_t *mc, u64 sec)
 {
-#ifdef DEBUG_HASH_LIST
-	if ((bp->hash.next == (cache_ent_t *)DEBUG_HASH_NEXT) ||
-		(bp->hash.prev == (cache_ent_t *)DEBUG_HASH_PREV)) {
-		return -EINVAL;
+	u64 key = sec + (sec >> SDFAT_SB(sb)->fsi.sect_per_clus_bits);
+
+	return (u32)key & (mc->hash_size - 1);
+}
+
+static inline cache_shard_t *__mcache_shard(struct super_block *sb,
+					meta_cache_t *mc, u64 sec)
+{
+	return &mc->shards[__mcache_bucket(sb, mc, sec) & (mc->nr_shards - 1)];
+}
+
+/* entries never leave the shard owning their pool slice */
+static inline cache_shard_t *__mcache_ent_shard(meta_cache_t *mc, cache_ent_t *bp)
+{
+	return &mc->shards[(u32)(bp - mc->pool) / mc->nr_max];
+}
+
+static inline u32 __mcache_pool_size(meta_cache_t *mc)
+{
+	return mc->nr_shards * mc->nr_max;
+}
+
+static inline void __mcache_put(cache_ent_t *bp)
+{
+	atomic_dec(&bp->refcnt);
+}
+
+/* Take the hash's own reference of an entry nobody has pinned */
+static inline bool __mcache_freeze(cache_ent_t *bp)
+{
+	return atomic_cmpxchg(&bp->refcnt, 1, 0) == 1;
+}
+
+/* Returns the entry caching sec pinned, or NULL */
+static cache_ent_t *__mcache_find(struct super_block *sb, meta_cache_t *mc, u64 sec)
+{
+	u32 off = __mcache_bucket(sb, mc, sec);
+	struct hlist_nulls_node *pos;
+	cache_ent_t *bp;
+
+	rcu_read_lock();
+begin:
+	hlist_nulls_for_each_entry_rcu(bp, pos, &mc->hash_list[off], hash) {
+		if (ACCESS_ONCE(bp->sec) != sec)
+			continue;
+
+		if (!atomic_inc_not_zero(&bp->refcnt))
+			goto begin;
+
+		/* recycled between the compare and the pin */
+		if (unlikely(ACCESS_ONCE(bp->sec) != sec)) {
+			__mcache_put(bp);
+			goto begin;
+		}
+		goto out;
+	}
+
+	/* bp was moved to another chain while we were walking */
+	if (get_nulls_value(pos) != off)
+		goto begin;
+	bp = NULL;
+out:
+	rcu_read_unlock();
+	return bp;
+}
+
+/* Make a frozen entry holding sec and bh visible to lookups */
+static void __mcache_insert_hash(struct super_block *sb, meta_cache_t *mc, cache_ent_t *bp)
+{
+	cache_shard_t *shard = __mcache_ent_shard(mc, bp);
+
+	spin_lock(&shard->lock);
+	/* a stale walker may pin bp as soon as refcnt is set */
+	smp_wmb();
+	atomic_set(&bp->refcnt, 1);
+	hlist_nulls_add_head_rcu(&bp->hash,
+			&mc->hash_list[__mcache_bucket(sb, mc, bp->sec)]);
+	spin_unlock(&shard->lock);
+}
+
+/* Mark a pinned entry as just used, unless it waits in the keep list */
+static void __mcache_touch(meta_cache_t *mc, cache_ent_t *bp)
+{
+	cache_shard_t *shard = __mcache_ent_shard(mc, bp);
+
+	spin_lock(&shard->lock);
+	if (!(bp->flag & KEEPBIT))
+		move_to_mru(bp, &shard->lru_list);
+	spin_unlock(&shard->lock);
+}
+
+/*
+ * Take an entry without buffer from the free list, under the shard lock.
+ * Unless @force is set, this fails once the shard reached its current limit
+ * and the caller has to recycle the LRU entry instead.
+ */
+static cache_ent_t *__mcache_get_free(cache_shard_t *shard, bool force)
+{
+	cache_ent_t *bp = shard->free_list.prev;
+
+	if (bp == &shard->free_list)
+		return NULL;
+
+	if (!force && (shard->nr_used >= shard->nr_limit))
+		return NULL;
+
+	move_to_mru(bp, &shard->lru_list);
+	shard->nr_used++;
+	return bp;
+}
+
+/* Let the shard grow back on misses after the shrinker trimmed it */
+static inline void __mcache_grow(meta_cache_t *mc, cache_shard_t *shard)
+{
+	if (shard->nr_limit < mc->nr_max)
+		shard->nr_limit++;
+}
+
+/* Take a frozen LRU entry over for a new sector, under the shard lock */
+static inline cache_ent_t *__mcache_recycle(cache_shard_t *shard, cache_ent_t *bp)
+{
+	hlist_nulls_del_init_rcu(&bp->hash);
+	move_to_mru(bp, &shard->lru_list);
+	return bp;
+}
+
+/* Give a frozen entry back to the free list, under the shard lock */
+static void __mcache_ent_release(cache_shard_t *shard, cache_ent_t *bp)
+{
+	if (!hlist_nulls_unhashed(&bp->hash))
+		hlist_nulls_del_init_rcu(&bp->hash);
+	bp->sec = ~0;
+	bp->flag = 0;
+
+	if (bp->bh) {
+		__brelse(bp->bh);
+		bp->bh = NULL;
+	}
+
+	move_to_lru(bp, &shard->free_list);
+	shard->nr_used--;
+}
+
+/* Drop the buffer of bp and give it back to the free list */
+static void __mcache_ent_discard(meta_cache_t *mc, cache_ent_t *bp)
+{
+	cache_shard_t *shard = __mcache_ent_shard(mc, bp);
+
+	WARN_ON(bp->flag & DIRTYBIT);
+
+	/*
+	 * Once unhashed, nothing new can pin bp. Lookups that already did
+	 * only move it to the MRU end before they let go, so wait for them
+	 * without holding the lock they need.
+	 */
+	spin_lock(&shard->lock);
+	if (!hlist_nulls_unhashed(&bp->hash))
+		hlist_nulls_del_init_rcu(&bp->hash);
+	spin_unlock(&shard->lock);
+
+	while (atomic_read(&bp->refcnt) && !__mcache_freeze(bp))
+		cpu_relax();
+
+	spin_lock(&shard->lock);
+	__mcache_ent_release(shard, bp);
+	spin_unlock(&shard->lock);
+}
+
+/* Release clean unpinned LRU entries of every shard, down to the minimum */
+static unsigned long __mcache_shrink(meta_cache_t *mc, unsigned long nr_to_scan)
+{
+	unsigned long freed = 0;
+	u32 i;
+
+	for (i = 0; (i < mc->nr_shards) && (freed < nr_to_scan); i++) {
+		cache_shard_t *shard = &mc->shards[i];
+		cache_ent_t *bp;
+
+		spin_lock(&shard->lock);
+		bp = shard->lru_list.prev;
+		while ((bp != &shard->lru_list) && (freed < nr_to_scan) &&
+				(shard->nr_used > mc->nr_min)) {
+			cache_ent_t *bp_prev = bp->prev;
+
+			if (!(bp->flag & (DIRTYBIT | LOCKBIT)) &&
+					__mcache_freeze(bp)) {
+				__mcache_ent_release(shard, bp);
+				freed++;
+			}
+			bp = bp_prev;
+		}
+		shard->nr_limit = max(shard->nr_used, mc->nr_min);
+		spin_unlock(&shard->lock);
+	}
+
+	return freed;
+}
+
+static unsigned long __mcache_reclaimable(meta_cache_t *mc)
+{
+	unsigned long nr = 0;
+	u32 i;
+
+	for (i = 0; i < mc->nr_shards; i++) {
+		u32 nr_used = ACCESS_ONCE(mc->shards[i].nr_used);
+
+		if (nr_used > mc->nr_min)
+			nr += nr_used - mc->nr_min;
+	}
+	return nr;
+}
+
+static unsigned long meta_cache_shrink_count(struct shrinker *shrink,
+					struct shrink_control *sc)
+{
+	FS_INFO_T *fsi = container_of(shrink, FS_INFO_T, mcache_shrinker);
+
+	return __mcache_reclaimable(&fsi->fcache) +
+		__mcache_reclaimable(&fsi->dcache);
+}
+
+static unsigned long meta_cache_shrink_scan(struct shrinker *shrink,
+					struct shrink_control *sc)
+{
+	FS_INFO_T *fsi = container_of(shrink, FS_INFO_T, mcache_shrinker);
+	struct sdfat_sb_info *sbi = container_of(fsi, struct sdfat_sb_info, fsi);
+	unsigned long freed;
+
+	if (!(sc->gfp_mask & __GFP_FS))
+		return SHRINK_STOP;
+
+	/* We may be called from inside an fs operation: never wait here */
+	if (!mutex_trylock(&sbi->s_vlock))
+		return SHRINK_STOP;
+
+	/* Dentry buffers are cheaper to re-read than FAT buffers */
+	freed = __mcache_shrink(&fsi->dcache, sc->nr_to_scan);
+	if (freed < sc->nr_to_scan)
+		freed += __mcache_shrink(&fsi->fcache, sc->nr_to_scan - freed);
+
+	mutex_unlock(&sbi->s_vlock);
+
+	MMSG("BD: shrink meta cache (%lu/%lu)\n", freed, sc->nr_to_scan);
+	return freed;
+}
+
+static void *__mcache_zalloc(size_t size)
+{
+	void *p = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+
+	if (!p)
+		p = vzalloc(size);
+	return p;
+}
+
+/* Scale a cache with system RAM : 1 entry per (1 << shift) pages */
+static u32 __mcache_scaled_size(u32 min_size, u32 max_size, u32 shift)
+{
+	unsigned long nr = max(totalram_pages >> shift, 1UL);
+
+	return (u32)clamp_t(unsigned long, rounddown_pow_of_two(nr),
+			min_size, max_size);
+}
+
+/* Sizes are powers of 2 and split evenly among the shards */
+static s32 __mcache_init(meta_cache_t *mc, u32 min_size, u32 max_size)
+{
+	u32 i, nr_shards;
+
+	max_size = max(max_size, min_size);
+	nr_shards = min_t(u32, roundup_pow_of_two(num_possible_cpus()),
+			META_CACHE_MAX_SHARDS);
+	nr_shards = min(nr_shards, min_size);
+
+	mc->nr_shards = nr_shards;
+	mc->nr_min = min_size / nr_shards;
+	mc->nr_max = max_size / nr_shards;
+	mc->hash_size = roundup_pow_of_two(max(max_size >> 1, nr_shards));
+
+	mc->pool = __mcache_zalloc(sizeof(cache_ent_t) * __mcache_pool_size(mc));
+	mc->shards = __mcache_zalloc(sizeof(cache_shard_t) * nr_shards);
+	mc->hash_list = __mcache_zalloc(sizeof(struct hlist_nulls_head) * mc->hash_size);
+	if (!mc->pool || !mc->shards || !mc->hash_list)
+		return -ENOMEM;
+
+	for (i = 0; i < mc->hash_size; i++)
+		INIT_HLIST_NULLS_HEAD(&mc->hash_list[i], i);
+
+	for (i = 0; i < nr_shards; i++) {
+		cache_shard_t *shard = &mc->shards[i];
+
+		spin_lock_init(&shard->lock);
+		__init_list(&shard->lru_list);
+		__init_list(&shard->keep_list);
+		__init_list(&shard->free_list);
+		shard->nr_used = 0;
+		shard->nr_limit = mc->nr_min;
+	}
+
+	// Initially, all the CACHEs are in the free list of their shard
+	for (i = 0; i < __mcache_pool_size(mc); i++) {
+		cache_ent_t *bp = &mc->pool[i];
+
+		bp->sec = ~0;
+		bp->flag = 0;
+		bp->bh = NULL;
+		bp->hash.pprev = NULL;
+		atomic_set(&bp->refcnt, 0);
+		push_to_mru(bp, &__mcache_ent_shard(mc, bp)->free_list);
 	}
-#endif
-	if ((bp->hash.next == bp) || (bp->hash.prev == bp))
-		return -EINVAL;
 
 	return 0;
 }
 
-static inline void __remove_from_hash(cache_ent_t *bp)
+static void __mcache_destroy(meta_cache_t *mc)
 {
-	(bp->hash.prev)->hash.next = bp->hash.next;
-	(bp->hash.next)->hash.prev = bp->hash.prev;
-	bp->hash.next = bp;
-	bp->hash.prev = bp;
-#ifdef DEBUG_HASH_LIST
-	bp->hash.next = (cache_ent_t *)DEBUG_HASH_NEXT;
-	bp->hash.prev = (cache_ent_t *)DEBUG_HASH_PREV;
-#endif
+	u32 i;
+
+	if (mc->pool) {
+		for (i = 0; i < __mcache_pool_size(mc); i++) {
+			if (mc->pool[i].bh)
+				__brelse(mc->pool[i].bh);
+		}
+		kvfree(mc->pool);
+		mc->pool = NULL;
+	}
+
+	kvfree(mc->shards);
+	mc->shards = NULL;
+	kvfree(mc->hash_list);
+	mc->hash_list = NULL;
 }
 
 /* Do FAT mirroring (don't sync)
@@ -175,15 +511,7 @@ static s32 __fcache_ent_discard(struct super_block *sb, cache_ent_t *bp)
 {
 	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
 
-	__fcache_remove_hash(bp);
-	bp->sec = ~0;
-	bp->flag = 0;
-
-	if (bp->bh) {
-		__brelse(bp->bh);
-		bp->bh = NULL;
-	}
-	move_to_lru(bp, &fsi->fcache.lru_list);
+	__mcache_ent_discard(&fsi->fcache, bp);
 	return 0;
 }
 
@@ -192,25 +520,29 @@ u8 *fcache_getblk(struct super_block *sb, u64 sec)
 	cache_ent_t *bp;
 	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
 	u32 page_ra_count = FCACHE_MAX_RA_SIZE >> sb->s_blocksize_bits;
+	u8 *data;
 
 	bp = __fcache_find(sb, sec);
 	if (bp) {
 		if (bdev_check_bdi_valid(sb)) {
 			__fcache_ent_flush(sb, bp, 0);
+			__mcache_put(bp);
 			__fcache_ent_discard(sb, bp);
 			return NULL;
 		}
-		move_to_mru(bp, &fsi->fcache.lru_list);
-		return bp->bh->b_data;
+		__mcache_touch(&fsi->fcache, bp);
+		data = bp->bh->b_data;
+		__mcache_put(bp);
+		return data;
 	}
 
-	bp = __fcache_get(sb);
-	if (!__check_hash_valid(bp))
-		__fcache_remove_hash(bp);
+	/* bp is unhashed until it holds the sector, lookups can't see it */
+	bp = __fcache_get(sb, sec);
+	if (!bp)
+		return NULL;
 
 	bp->sec = sec;
 	bp->flag = 0;
-	__fcache_insert_hash(sb, bp);
 
 	/* Naive FAT read-ahead (increase I/O unit to page_ra_count) */
 	if ((sec & (page_ra_count - 1)) == 0)
@@ -227,6 +559,7 @@ u8 *fcache_getblk(struct super_block *sb, u64 sec)
 		return NULL;
 	}
 
+	__fcache_insert_hash(sb, bp);
 	return bp->bh->b_data;
 }
 
@@ -249,6 +582,7 @@ static inline int __mark_delayed_dirty(struct super_block *sb, cache_ent_t *bp)
 
 s32 fcache_modify(struct super_block *sb, u64 sec)
 {
+	s32 ret = 0;
 	cache_ent_t *bp;
 
 	bp = __fcache_find(sb, sec);
@@ -258,15 +592,13 @@ s32 fcache_modify(struct super_block *sb, u64 sec)
 	}
 
 	if (!__mark_delayed_dirty(sb, bp))
-		return 0;
-
-	if (write_sect(sb, sec, bp->bh, 0))
-		return -EIO;
+		goto out;
 
-	if (__fat_copy(sb, sec, bp->bh, 0))
-		return -EIO;
-
-	return 0;
+	if (write_sect(sb, sec, bp->bh, 0) || __fat_copy(sb, sec, bp->bh, 0))
+		ret = -EIO;
+out:
+	__mcache_put(bp);
+	return ret;
 }
 
 /*======================================================================*/
@@ -275,62 +607,48 @@ s32 fcache_modify(struct super_block *sb, u64 sec)
 s32 meta_cache_init(struct super_block *sb)
 {
 	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
-	s32 i;
-
-	/* LRU list */
-	fsi->fcache.lru_list.next = &fsi->fcache.lru_list;
-	fsi->fcache.lru_list.prev = fsi->fcache.lru_list.next;
-
-	for (i = 0; i < FAT_CACHE_SIZE; i++) {
-		fsi->fcache.pool[i].sec = ~0;
-		fsi->fcache.pool[i].flag = 0;
-		fsi->fcache.pool[i].bh = NULL;
-		fsi->fcache.pool[i].prev = NULL;
-		fsi->fcache.pool[i].next = NULL;
-		push_to_mru(&(fsi->fcache.pool[i]), &fsi->fcache.lru_list);
-	}
-
-	fsi->dcache.lru_list.next = &fsi->dcache.lru_list;
-	fsi->dcache.lru_list.prev = fsi->dcache.lru_list.next;
-	fsi->dcache.keep_list.next = &fsi->dcache.keep_list;
-	fsi->dcache.keep_list.prev = fsi->dcache.keep_list.next;
-
-	// Initially, all the BUF_CACHEs are in the LRU list
-	for (i = 0; i < BUF_CACHE_SIZE; i++) {
-		fsi->dcache.pool[i].sec = ~0;
-		fsi->dcache.pool[i].flag = 0;
-		fsi->dcache.pool[i].bh = NULL;
-		fsi->dcache.pool[i].prev = NULL;
-		fsi->dcache.pool[i].next = NULL;
-		push_to_mru(&(fsi->dcache.pool[i]), &fsi->dcache.lru_list);
-	}
-
-	/* HASH list */
-	for (i = 0; i < FAT_CACHE_HASH_SIZE; i++) {
-		fsi->fcache.hash_list[i].sec = ~0;
-		fsi->fcache.hash_list[i].hash.next = &(fsi->fcache.hash_list[i]);
-;
-		fsi->fcache.hash_list[i].hash.prev = fsi->fcache.hash_list[i].hash.next;
-	}
-
-	for (i = 0; i < FAT_CACHE_SIZE; i++)
-		__fcache_insert_hash(sb, &(fsi->fcache.pool[i]));
-
-	for (i = 0; i < BUF_CACHE_HASH_SIZE; i++) {
-		fsi->dcache.hash_list[i].sec = ~0;
-		fsi->dcache.hash_list[i].hash.next = &(fsi->dcache.hash_list[i]);
-
-		fsi->dcache.hash_list[i].hash.prev = fsi->dcache.hash_list[i].hash.next;
+	s32 err;
+
+	err = __mcache_init(&fsi->fcache, FAT_CACHE_MIN_SIZE,
+		__mcache_scaled_size(FAT_CACHE_MIN_SIZE, FAT_CACHE_MAX_SIZE, 8));
+	if (err)
+		goto out;
+
+	err = __mcache_init(&fsi->dcache, BUF_CACHE_MIN_SIZE,
+		__mcache_scaled_size(BUF_CACHE_MIN_SIZE, BUF_CACHE_MAX_SIZE, 7));
+	if (err)
+		goto out;
+
+	fsi->mcache_shrinker.count_objects = meta_cache_shrink_count;
+	fsi->mcache_shrinker.scan_objects = meta_cache_shrink_scan;
+	fsi->mcache_shrinker.seeks = DEFAULT_SEEKS;
+	err = register_shrinker(&fsi->mcache_shrinker);
+	if (err) {
+		memset(&fsi->mcache_shrinker, 0, sizeof(struct shrinker));
+		goto out;
 	}
 
-	for (i = 0; i < BUF_CACHE_SIZE; i++)
-		__dcache_insert_hash(sb, &(fsi->dcache.pool[i]));
-
+	DMSG("BD: meta cache (fat:%u~%u, buf:%u~%u)\n",
+		fsi->fcache.nr_min, fsi->fcache.nr_max,
+		fsi->dcache.nr_min, fsi->dcache.nr_max);
 	return 0;
+out:
+	EMSG("%s: failed to allocate meta cache (err:%d)\n", __func__, err);
+	return err;
 }
 
 s32 meta_cache_shutdown(struct super_block *sb)
 {
+	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+
+	/* count_objects is only set while the shrinker is registered */
+	if (fsi->mcache_shrinker.count_objects) {
+		unregister_shrinker(&fsi->mcache_shrinker);
+		memset(&fsi->mcache_shrinker, 0, sizeof(struct shrinker));
+	}
+
+	__mcache_destroy(&fsi->fcache);
+	__mcache_destroy(&fsi->dcache);
 	return 0;
 }
 
@@ -343,24 +661,23 @@ s32 fcache_release_all(struct super_block *sb)
 	cache_ent_t *bp;
 	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
 	s32 dirtycnt = 0;
+	u32 i;
 
-	bp = fsi->fcache.lru_list.next;
-	while (bp != &fsi->fcache.lru_list) {
-		s32 ret_tmp = __fcache_ent_flush(sb, bp, 0);
+	for (i = 0; i < __mcache_pool_size(&fsi->fcache); i++) {
+		s32 ret_tmp;
 
+		bp = &fsi->fcache.pool[i];
+		if (hlist_nulls_unhashed(&bp->hash))
+			continue;
+
+		ret_tmp = __fcache_ent_flush(sb, bp, 0);
 		if (ret_tmp < 0)
 			ret = ret_tmp;
 		else
 			dirtycnt += ret_tmp;
 
-		bp->sec = ~0;
 		bp->flag = 0;
-
-		if (bp->bh) {
-			__brelse(bp->bh);
-			bp->bh = NULL;
-		}
-		bp = bp->next;
+		__fcache_ent_discard(sb, bp);
 	}
 
 	DMSG("BD:Release / dirty fat cache: %d (err:%d)\n", dirtycnt, ret);
@@ -375,15 +692,19 @@ s32 fcache_flush(struct super_block *sb, u32 sync)
 	cache_ent_t *bp;
 	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
 	s32 dirtycnt = 0;
+	u32 i;
+
+	/* s_vlock keeps hashed entries in place, their order does not matter */
+	for (i = 0; i < __mcache_pool_size(&fsi->fcache); i++) {
+		bp = &fsi->fcache.pool[i];
+		if (hlist_nulls_unhashed(&bp->hash))
+			continue;
 
-	bp = fsi->fcache.lru_list.next;
-	while (bp != &fsi->fcache.lru_list) {
 		ret = __fcache_ent_flush(sb, bp, sync);
 		if (ret < 0)
 			break;
 
 		dirtycnt += ret;
-		bp = bp->next;
 	}
 
 	MMSG("BD: flush / dirty fat cache: %d (err:%d)\n", dirtycnt, ret);
@@ -392,81 +713,69 @@ s32 fcache_flush(struct super_block *sb, u32 sync)
 
 static cache_ent_t *__fcache_find(struct super_block *sb, u64 sec)
 {
-	s32 off;
-	cache_ent_t *bp, *hp;
-	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+	cache_ent_t *bp;
 
-	off = (sec + (sec >> fsi->sect_per_clus_bits)) & (FAT_CACHE_HASH_SIZE - 1);
-	hp = &(fsi->fcache.hash_list[off]);
-	for (bp = hp->hash.next; bp != hp; bp = bp->hash.next) {
-		if (bp->sec == sec) {
-			/*
-			 * patch 1.2.4 : for debugging
-			 */
-			WARN(!bp->bh, "[SDFAT] fcache has no bh. "
-					  "It will make system panic.\n");
-
-			touch_buffer(bp->bh);
-			return bp;
-		}
+	bp = __mcache_find(sb, &(SDFAT_SB(sb)->fsi.fcache), sec);
+	if (bp) {
+		/*
+		 * patch 1.2.4 : for debugging
+		 */
+		WARN(!bp->bh, "[SDFAT] fcache has no bh. "
+				  "It will make system panic.\n");
+
+		touch_buffer(bp->bh);
 	}
-	return NULL;
+	return bp;
 }
 
-static cache_ent_t *__fcache_get(struct super_block *sb)
+/* Returns an unhashed, frozen entry of the shard of sec */
+static cache_ent_t *__fcache_get(struct super_block *sb, u64 sec)
 {
 	cache_ent_t *bp;
-	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+	meta_cache_t *mc = &(SDFAT_SB(sb)->fsi.fcache);
+	cache_shard_t *shard = __mcache_shard(sb, mc, sec);
 
-	bp = fsi->fcache.lru_list.prev;
-#ifdef CONFIG_SDFAT_DELAYED_META_DIRTY
-	while (bp->flag & DIRTYBIT) {
-		cache_ent_t *bp_prev = bp->prev;
+	spin_lock(&shard->lock);
+	__mcache_grow(mc, shard);
+	bp = __mcache_get_free(shard, false);
+	if (bp)
+		goto out;
 
-		bp = bp_prev;
-		if (bp == &fsi->fcache.lru_list) {
+	bp = shard->lru_list.prev;
+#ifdef CONFIG_SDFAT_DELAYED_META_DIRTY
+	while ((bp == &shard->lru_list) || (bp->flag & DIRTYBIT) ||
+			!__mcache_freeze(bp)) {
+		if (bp == &shard->lru_list) {
 			DMSG("BD: fat cache flooding\n");
+			spin_unlock(&shard->lock);
 			fcache_flush(sb, 0);	// flush all dirty FAT caches
-			bp = fsi->fcache.lru_list.prev;
+			spin_lock(&shard->lock);
+			bp = shard->lru_list.prev;
+			continue;
 		}
+		bp = bp->prev;
+	}
+#else
+	while ((bp != &shard->lru_list) && !__mcache_freeze(bp))
+		bp = bp->prev;
+
+	if (bp == &shard->lru_list) {
+		bp = __mcache_get_free(shard, true);
+		goto out;
 	}
 #endif
 //	if (bp->flag & DIRTYBIT)
 //       sync_dirty_buffer(bp->bh);
 
-	move_to_mru(bp, &fsi->fcache.lru_list);
+	__mcache_recycle(shard, bp);
+out:
+	spin_unlock(&shard->lock);
 	return bp;
 }
 
 static void __fcache_insert_hash(struct super_block *sb, cache_ent_t *bp)
 {
-	s32 off;
-	cache_ent_t *hp;
-	FS_INFO_T *fsi;
-
-	fsi = &(SDFAT_SB(sb)->fsi);
-	off = (bp->sec + (bp->sec >> fsi->sect_per_clus_bits)) & (FAT_CACHE_HASH_SIZE-1);
-
-	hp = &(fsi->fcache.hash_list[off]);
-	bp->hash.next = hp->hash.next;
-	bp->hash.prev = hp;
-	hp->hash.next->hash.prev = bp;
-	hp->hash.next = bp;
-}
-
-
-static void __fcache_remove_hash(cache_ent_t *bp)
-{
-#ifdef DEBUG_HASH_LIST
-	if ((bp->hash.next == (cache_ent_t *)DEBUG_HASH_NEXT) ||
-		(bp->hash.prev == (cache_ent_t *)DEBUG_HASH_PREV)) {
-		EMSG("%s: FATAL: tried to remove already-removed-cache-entry"
-			"(bp:%p)\n", __func__, bp);
-		return;
-	}
-#endif
-	WARN_ON(bp->flag & DIRTYBIT);
-	__remove_from_hash(bp);
+	__mcache_insert_hash(sb, &(SDFAT_SB(sb)->fsi.fcache), bp);
 }
 
 /*======================================================================*/
@@ -531,21 +840,10 @@ static s32 __dcache_ent_discard(struct super_block *sb, cache_ent_t *bp)
 {
 	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
 
-	MMSG("%s : bp[%p] (sec:%016llx flag:%08x bh:%p) list(prev:%p next:%p) "
-		"hash(prev:%p next:%p)\n", __func__,
-		bp, bp->sec, bp->flag, bp->bh, bp->prev, bp->next,
-		bp->hash.prev, bp->hash.next);
-
-	__dcache_remove_hash(bp);
-	bp->sec = ~0;
-	bp->flag = 0;
-
-	if (bp->bh) {
-		__brelse(bp->bh);
-		bp->bh = NULL;
-	}
+	MMSG("%s : bp[%p] (sec:%016llx flag:%08x bh:%p) list(prev:%p next:%p)\n",
+		__func__, bp, bp->sec, bp->flag, bp->bh, bp->prev, bp->next);
 
-	move_to_lru(bp, &fsi->dcache.lru_list);
+	__mcache_ent_discard(&fsi->dcache, bp);
 	return 0;
 }
 
@@ -553,6 +851,7 @@ u8 *dcache_getblk(struct super_block *sb, u64 sec)
 {
 	cache_ent_t *bp;
 	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+	u8 *data;
 
 	bp = __dcache_find(sb, sec);
 	if (bp) {
@@ -560,30 +859,31 @@ u8 *dcache_getblk(struct super_block *sb, u64 sec)
 			MMSG("%s: found cache(%p, sect:%llu). But invalid BDI\n"
 				, __func__, bp, sec);
 			__dcache_ent_flush(sb, bp, 0);
+			__mcache_put(bp);
 			__dcache_ent_discard(sb, bp);
 			return NULL;
 		}
 
-		if (!(bp->flag & KEEPBIT))	// already in keep list
-			move_to_mru(bp, &fsi->dcache.lru_list);
-
-		return bp->bh->b_data;
+		__mcache_touch(&fsi->dcache, bp);
+		data = bp->bh->b_data;
+		__mcache_put(bp);
+		return data;
 	}
 
-	bp = __dcache_get(sb);
-
-	if (!__check_hash_valid(bp))
-		__dcache_remove_hash(bp);
+	/* bp is unhashed until it holds the sector, lookups can't see it */
+	bp = __dcache_get(sb, sec);
+	if (!bp)
+		return NULL;
 
 	bp->sec = sec;
 	bp->flag = 0;
-	__dcache_insert_hash(sb, bp);
 
 	if (read_sect(sb, sec, &(bp->bh), 1)) {
 		__dcache_ent_discard(sb, bp);
 		return NULL;
 	}
 
+	__dcache_insert_hash(sb, bp);
 	return bp->bh->b_data;
 
 }
@@ -603,6 +903,7 @@ s32 dcache_modify(struct super_block *sb, u64 sec)
 #ifdef CONFIG_SDFAT_DELAYED_META_DIRTY
 	if (SDFAT_SB(sb)->fsi.vol_type != EXFAT) {
 		bp->flag |= DIRTYBIT;
+		__mcache_put(bp);
 		return 0;
 	}
 #endif
@@ -613,6 +914,7 @@ s32 dcache_modify(struct super_block *sb, u64 sec)
 			__func__, ret, sec, bp);
 	}
 
+	__mcache_put(bp);
 	return ret;
 }
 
@@ -623,6 +925,7 @@ s32 dcache_lock(struct super_block *sb, u64 sec)
 	bp = __dcache_find(sb, sec);
 	if (likely(bp)) {
 		bp->flag |= LOCKBIT;
+		__mcache_put(bp);
 		return 0;
 	}
 
@@ -637,6 +940,7 @@ s32 dcache_unlock(struct super_block *sb, u64 sec)
 	bp = __dcache_find(sb, sec);
 	if (likely(bp))  {
 		bp->flag &= ~(LOCKBIT);
+		__mcache_put(bp);
 		return 0;
 	}
 
@@ -647,7 +951,6 @@ s32 dcache_unlock(struct super_block *sb, u64 sec)
 s32 dcache_release(struct super_block *sb, u64 sec)
 {
 	cache_ent_t *bp;
-	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
 
 	bp = __dcache_find(sb, sec);
 	if (unlikely(!bp))
@@ -655,20 +958,41 @@ s32 dcache_release(struct super_block *sb, u64 sec)
 
 #ifdef CONFIG_SDFAT_DELAYED_META_DIRTY
 	if (bp->flag & DIRTYBIT) {
-		if (write_sect(sb, bp->sec, bp->bh, 0))
+		if (write_sect(sb, bp->sec, bp->bh, 0)) {
+			__mcache_put(bp);
 			return -EIO;
+		}
 	}
 #endif
-	bp->sec = ~0;
 	bp->flag = 0;
+	__mcache_put(bp);
+	__dcache_ent_discard(sb, bp);
+	return 0;
+}
 
-	if (bp->bh) {
-		__brelse(bp->bh);
-		bp->bh = NULL;
+/* Connect list elements:
+ * LRU list : (A - B - ... - bp_front) + (bp_first + ... + bp_last)
+ */
+static s32 __dcache_drain_keep_list(meta_cache_t *mc)
+{
+	s32 keepcnt = 0;
+	u32 i;
+
+	for (i = 0; i < mc->nr_shards; i++) {
+		cache_shard_t *shard = &mc->shards[i];
+
+		spin_lock(&shard->lock);
+		while (shard->keep_list.prev != &shard->keep_list) {
+			cache_ent_t *bp_keep = shard->keep_list.prev;
+
+			bp_keep->flag &= ~(KEEPBIT);
+			move_to_mru(bp_keep, &shard->lru_list);
+			keepcnt++;
+		}
+		spin_unlock(&shard->lock);
 	}
 
-	move_to_lru(bp, &fsi->dcache.lru_list);
-	return 0;
+	return keepcnt;
 }
 
 s32 dcache_release_all(struct super_block *sb)
@@ -677,18 +1001,14 @@ s32 dcache_release_all(struct super_block *sb)
 	cache_ent_t *bp;
 	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
 	s32 dirtycnt = 0;
+	u32 i;
 
-	/* Connect list elements:
-	 * LRU list : (A - B - ... - bp_front) + (bp_first + ... + bp_last)
-	 */
-	while (fsi->dcache.keep_list.prev != &fsi->dcache.keep_list) {
-		cache_ent_t *bp_keep = fsi->dcache.keep_list.prev;
-		// bp_keep->flag &= ~(KEEPBIT);		// Will be 0-ed later
-		move_to_mru(bp_keep, &fsi->dcache.lru_list);
-	}
+	__dcache_drain_keep_list(&fsi->dcache);
 
-	bp = fsi->dcache.lru_list.next;
-	while (bp != &fsi->dcache.lru_list) {
+	for (i = 0; i < __mcache_pool_size(&fsi->dcache); i++) {
+		bp = &fsi->dcache.pool[i];
+		if (hlist_nulls_unhashed(&bp->hash))
+			continue;
 #ifdef CONFIG_SDFAT_DELAYED_META_DIRTY
 		if (bp->flag & DIRTYBIT) {
 			dirtycnt++;
@@ -696,14 +1016,8 @@ s32 dcache_release_all(struct super_block *sb)
 				ret = -EIO;
 		}
 #endif
-		bp->sec = ~0;
 		bp->flag = 0;
-
-		if (bp->bh) {
-			__brelse(bp->bh);
-			bp->bh = NULL;
-		}
-		bp = bp->next;
+		__dcache_ent_discard(sb, bp);
 	}
 
 	DMSG("BD:Release / dirty buf cache: %d (err:%d)", dirtycnt, ret);
@@ -718,26 +1032,22 @@ s32 dcache_flush(struct super_block *sb, u32 sync)
 	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
 	s32 dirtycnt = 0;
 	s32 keepcnt = 0;
+	u32 i;
 
-	/* Connect list elements:
-	 * LRU list : (A - B - ... - bp_front) + (bp_first + ... + bp_last)
-	 */
-	while (fsi->dcache.keep_list.prev != &fsi->dcache.keep_list) {
-		cache_ent_t *bp_keep = fsi->dcache.keep_list.prev;
+	keepcnt = __dcache_drain_keep_list(&fsi->dcache);
 
-		bp_keep->flag &= ~(KEEPBIT);		// Will be 0-ed later
-		move_to_mru(bp_keep, &fsi->dcache.lru_list);
-		keepcnt++;
-	}
+	/* s_vlock keeps hashed entries in place, their order does not matter */
+	for (i = 0; i < __mcache_pool_size(&fsi->dcache); i++) {
+		bp = &fsi->dcache.pool[i];
+		if (hlist_nulls_unhashed(&bp->hash))
+			continue;
 
-	bp = fsi->dcache.lru_list.next;
-	while (bp != &fsi->dcache.lru_list) {
 		if (bp->flag & DIRTYBIT) {
 #ifdef CONFIG_SDFAT_DELAYED_META_DIRTY
 			// Make buffer dirty (XXX: Naive impl.)
 			if (write_sect(sb, bp->sec, bp->bh, 0)) {
 				ret = -EIO;
-				break;
+				goto out;
 			}
 
 #endif
@@ -747,9 +1057,8 @@ s32 dcache_flush(struct super_block *sb, u32 sync)
 			if (sync != 0)
 				sync_dirty_buffer(bp->bh);
 		}
-		bp = bp->next;
 	}
-
+out:
 	MMSG("BD: flush / dirty dentry cache: %d (%d from keeplist, err:%d)\n",
 						dirtycnt, keepcnt, ret);
 	return ret;
@@ -757,85 +1066,76 @@ s32 dcache_flush(struct super_block *sb, u32 sync)
 
 static cache_ent_t *__dcache_find(struct super_block *sb, u64 sec)
 {
-	s32 off;
-	cache_ent_t *bp, *hp;
-	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
-
-	off = (sec + (sec >> fsi->sect_per_clus_bits)) & (BUF_CACHE_HASH_SIZE - 1);
+	cache_ent_t *bp;
 
-	hp = &(fsi->dcache.hash_list[off]);
-	for (bp = hp->hash.next; bp != hp; bp = bp->hash.next) {
-		if (bp->sec == sec) {
-			touch_buffer(bp->bh);
-			return bp;
-		}
-	}
-	return NULL;
+	bp = __mcache_find(sb, &(SDFAT_SB(sb)->fsi.dcache), sec);
+	if (bp)
+		touch_buffer(bp->bh);
+	return bp;
 }
 
-static cache_ent_t *__dcache_get(struct super_block *sb)
+/* Returns an unhashed, frozen entry of the shard of sec */
+static cache_ent_t *__dcache_get(struct super_block *sb, u64 sec)
 {
 	cache_ent_t *bp;
-	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+	meta_cache_t *mc = &(SDFAT_SB(sb)->fsi.dcache);
+	cache_shard_t *shard = __mcache_shard(sb, mc, sec);
 
-	bp = fsi->dcache.lru_list.prev;
+	spin_lock(&shard->lock);
+	__mcache_grow(mc, shard);
+	bp = __mcache_get_free(shard, false);
+	if (bp)
+		goto out;
+
+	bp = shard->lru_list.prev;
 #ifdef CONFIG_SDFAT_DELAYED_META_DIRTY
-	while (bp->flag & (DIRTYBIT | LOCKBIT)) {
+	while ((bp == &shard->lru_list) || (bp->flag & (DIRTYBIT | LOCKBIT)) ||
+			!__mcache_freeze(bp)) {
 		cache_ent_t *bp_prev = bp->prev; // hold prev
 
+		/* If all dcaches are dirty */
+		if (bp == &shard->lru_list) {
+			bp = __mcache_get_free(shard, true);
+			if (bp)
+				goto out;
+
+			DMSG("BD: buf cache flooding\n");
+			spin_unlock(&shard->lock);
+			dcache_flush(sb, 0);
+			spin_lock(&shard->lock);
+			bp = shard->lru_list.prev;
+			continue;
+		}
+
 		if (bp->flag & DIRTYBIT) {
 			MMSG("BD: Buf cache => Keep list\n");
 			bp->flag |= KEEPBIT;
-			move_to_mru(bp, &fsi->dcache.keep_list);
+			move_to_mru(bp, &shard->keep_list);
 		}
 		bp = bp_prev;
-
-		/* If all dcaches are dirty */
-		if (bp == &fsi->dcache.lru_list) {
-			DMSG("BD: buf cache flooding\n");
-			dcache_flush(sb, 0);
-			bp = fsi->dcache.lru_list.prev;
-		}
 	}
 #else
-	while (bp->flag & LOCKBIT)
+	while ((bp != &shard->lru_list) &&
+			((bp->flag & LOCKBIT) || !__mcache_freeze(bp)))
 		bp = bp->prev;
+
+	if (bp == &shard->lru_list) {
+		bp = __mcache_get_free(shard, true);
+		goto out;
+	}
 #endif
 //	if (bp->flag & DIRTYBIT)
 //       sync_dirty_buffer(bp->bh);
 
-	move_to_mru(bp, &fsi->dcache.lru_list);
+	__mcache_recycle(shard, bp);
+out:
+	spin_unlock(&shard->lock);
 	return bp;
 }
 
 static void __dcache_insert_hash(struct super_block *sb, cache_ent_t *bp)
 {
-	s32 off;
-	cache_ent_t *hp;
-	FS_INFO_T *fsi;
-
-	fsi = &(SDFAT_SB(sb)->fsi);
-	off = (bp->sec + (bp->sec >> fsi->sect_per_clus_bits)) & (BUF_CACHE_HASH_SIZE-1);
-
-	hp = &(fsi->dcache.hash_list[off]);
-	bp->hash.next = hp->hash.next;
-	bp->hash.prev = hp;
-	hp->hash.next->hash.prev = bp;
-	hp->hash.next = bp;
-}
-
-static void __dcache_remove_hash(cache_ent_t *bp)
-{
-#ifdef DEBUG_HASH_LIST
-	if ((bp->hash.next == (cache_ent_t *)DEBUG_HASH_NEXT) ||
-		(bp->hash.prev == (cache_ent_t *)DEBUG_HASH_PREV)) {
-		EMSG("%s: FATAL: tried to remove already-removed-cache-entry"
-			"(bp:%p)\n", __func__, bp);
-		return;
-	}
-#endif
-	WARN_ON(bp->flag & DIRTYBIT);
-	__remove_from_hash(bp);
+	__mcache_insert_hash(sb, &(SDFAT_SB(sb)->fsi.dcache), bp);
 }
 
 
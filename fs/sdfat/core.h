@@ -142,6 +142,7 @@ s32 fat_ent_ops_init(struct super_block *sb);
 s32 fat_ent_get(struct super_block *sb, u32 loc, u32 *content);
 s32 fat_ent_set(struct super_block *sb, u32 loc, u32 content);
 s32 fat_ent_get_safe(struct super_block *sb, u32 loc, u32 *content);
+bool fat_ent_ready(struct super_block *sb, u32 loc, u32 ra_secs);
 
 /* core_fat.c : core code for fat */
 s32 fat_generate_dos_name_new(struct super_block *sb, CHAIN_T *p_dir, DOS_NAME_T *p_dosname, s32 n_entries);
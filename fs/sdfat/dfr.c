@@ -415,7 +415,8 @@ defrag_validate_cluster(
 
 	/* Check chunk's clusters */
 	for (i = 0; i < chunk->nr_clus; i++) {
-		err = fsapi_map_clus(inode, chunk->f_clus + i, &clus, ALLOC_NOWHERE);
+		/* volume lock is already held here */
+		err = fscore_map_clus(inode, chunk->f_clus + i, &clus, ALLOC_NOWHERE);
 		if (err || (chunk->d_clus + i != clus)) {
 			if (!err)
 				err = -ENXIO;
@@ -1270,6 +1271,139 @@ defrag_check_defrag_required(
 }
 
 
+/**
+ * @fn		__defrag_add_chunk
+ * @brief	append requests for a fragment, split at AU boundaries
+ * @return	# of clusters queued
+ * @param	sb			super block
+ * @param	chunk_info	request to split (f_clus, d_clus, nr_clus, prev_clus, next_clus)
+ * @param	chunks		output array
+ * @param	max_chunks	size of chunks
+ * @param	nr_chunks	# of chunks filled
+ */
+static unsigned int
+__defrag_add_chunk(
+	IN struct super_block *sb,
+	IN struct defrag_chunk_info *frag,
+	OUT struct defrag_chunk_info *chunks,
+	IN int max_chunks,
+	INOUT int *nr_chunks)
+{
+	AMAP_T *amap = SDFAT_SB(sb)->fsi.amap;
+	unsigned int f_clus = frag->f_clus, d_clus = frag->d_clus;
+	unsigned int prev_clus = frag->prev_clus, left = frag->nr_clus;
+	unsigned int queued = 0;
+
+	while (left && (*nr_chunks < max_chunks)) {
+		struct defrag_chunk_info *chunk = &chunks[(*nr_chunks)++];
+		unsigned int au_end = CLU_of_i_AU(amap, i_AU_of_CLU(amap, d_clus) + 1, 0);
+		unsigned int nr = min(left, au_end - d_clus);
+
+		memset(chunk, 0, sizeof(struct defrag_chunk_info));
+		chunk->i_pos = frag->i_pos;
+		chunk->f_clus = f_clus;
+		chunk->d_clus = d_clus;
+		chunk->nr_clus = nr;
+		chunk->prev_clus = prev_clus;
+		chunk->next_clus = (nr == left) ? frag->next_clus : (d_clus + nr);
+		/* Used clusters of the AU as seen now, re-checked at validation */
+		chunk->au_clus = CLUS_PER_AU(sb) - amap_get_freeclus(sb, d_clus);
+
+		f_clus += nr;
+		prev_clus = d_clus + nr - 1;
+		d_clus += nr;
+		left -= nr;
+		queued += nr;
+	}
+
+	return queued;
+}
+
+
+/**
+ * @fn		defrag_collect_chunks
+ * @brief	count fragments of a file and build requests for the small ones
+ * @return	# of fragments on success, -errno otherwise
+ * @param	inode		inode of a regular file
+ * @param	chunks		output array (may be NULL to only count fragments)
+ * @param	max_chunks	size of chunks
+ * @param	nr_chunks	# of chunks filled
+ * @param	max_clus	max # of clusters to request
+ * @remark	protected by super_block and volume lock
+ *
+ * Fragments shorter than an AU are the ones that cost a seek per AU on
+ * read; they are queued in file order so that the cold aligned allocator
+ * lays them out back to back.
+ */
+int
+defrag_collect_chunks(
+	IN struct inode *inode,
+	OUT struct defrag_chunk_info *chunks,
+	IN int max_chunks,
+	OUT int *nr_chunks,
+	IN unsigned int max_clus)
+{
+	struct super_block *sb = inode->i_sb;
+	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+	FILE_ID_T *fid = &(SDFAT_I(inode)->fid);
+	struct defrag_chunk_info frag;
+	unsigned int clus = 0, next = 0, nr_queued = 0;
+	int nr_frags = 0, err = 0;
+
+	*nr_chunks = 0;
+
+	if ((fsi->vol_type != FAT32) || !fsi->amap)
+		return -ENOTSUPP;
+
+	/* If this inode is unlink-ed or has no cluster, skip it */
+	if ((fid->dir.dir == DIR_DELETED) || IS_CLUS_EOF(fid->start_clu) ||
+		IS_CLUS_FREE(fid->start_clu))
+		return 0;
+
+	memset(&frag, 0, sizeof(struct defrag_chunk_info));
+	frag.i_pos = SDFAT_I(inode)->i_pos;
+	frag.d_clus = clus = fid->start_clu;
+	frag.nr_clus = 1;
+
+	while (1) {
+		FAT32_CHECK_CLUSTER(fsi, clus, err);
+		ERR_HANDLE(err);
+		err = fat_ent_get(sb, clus, &next);
+		ERR_HANDLE(err);
+
+		if (!IS_CLUS_EOF(next) && (next == clus + 1)) {
+			frag.nr_clus++;
+			clus = next;
+			continue;
+		}
+
+		/* End of a fragment */
+		nr_frags++;
+		frag.next_clus = next & FAT32_EOF;
+		if (chunks && (frag.nr_clus < CLUS_PER_AU(sb)) &&
+			(nr_queued + frag.nr_clus <= max_clus))
+			nr_queued += __defrag_add_chunk(sb, &frag, chunks,
+						max_chunks, nr_chunks);
+
+		if (IS_CLUS_EOF(next))
+			break;
+
+		/* prevent the infinite loop of cluster chain */
+		ERR_HANDLE2((frag.f_clus + frag.nr_clus > fsi->num_clusters), err, -EIO);
+
+		frag.f_clus += frag.nr_clus;
+		frag.prev_clus = clus;
+		frag.d_clus = clus = next;
+		frag.nr_clus = 1;
+	}
+
+	return nr_frags;
+error:
+	*nr_chunks = 0;
+	return err;
+}
+
+
 /**
  * @fn		defrag_check_defrag_required
  * @brief	check defrag status on inode
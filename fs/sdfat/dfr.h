@@ -36,6 +36,14 @@
 
 #define	DFR_MAX_AU_MOVED		(16)	// Maximum # of AUs for a request
 
+/* In-kernel defrag daemon */
+#define	DFR_AUTO_INTERVAL		(60 * HZ)	// Period to check fragmentation
+#define	DFR_AUTO_IDLE_TIME		(5 * HZ)	// No bdev I/O for this long means idle
+#define	DFR_AUTO_RESCAN			(3600 * HZ)	// Re-evaluate a file at most once per hour
+#define	DFR_AUTO_MIN_SIZE		(1024 * 1024)	// Skip files smaller than 1MB
+#define	DFR_AUTO_MIN_FRAGS		(8)		// Defrag files with 8 or more fragments
+#define	DFR_AUTO_NR_CANDIDATES		(16)	// Files evaluated per wake-up
+
 
 /* Debugging support*/
 #define dfr_err(fmt, args...) pr_err("DFR: " fmt "\n", args)
@@ -205,6 +213,7 @@ struct defrag_chunk_info {
 #define	DFR_MODE_FOREGROUND		(0x2)
 #define DFR_MODE_ONESHOT		(0x4)
 #define	DFR_MODE_BATCHED		(0x8)
+#define	DFR_MODE_AUTO			(0x10)	// Issued by the in-kernel daemon
 #define	DFR_MODE_TEST			(DFR_MODE_BACKGROUND | 0x10000000)
 
 #define	DFR_SB_STAT_IDLE		(0)
@@ -222,6 +231,32 @@ struct defrag_info {
 };
 
 
+#define	DFR_AUTO_STAT_OFF		(0)
+#define	DFR_AUTO_STAT_SLEEP		(1)
+#define	DFR_AUTO_STAT_SCAN		(2)
+#define	DFR_AUTO_STAT_MOVE		(3)
+struct defrag_auto_info {
+	struct task_struct *task;
+	int enable;
+	int stat;
+	/* progress */
+	unsigned long nr_runs;
+	unsigned long nr_busy;		// wake-ups skipped due to I/O
+	unsigned long nr_files;		// files defragmented
+	unsigned long nr_chunks;
+	unsigned long nr_clus;
+	unsigned long nr_errs;
+	/* fragmentation metrics of evaluated files */
+	unsigned long nr_scanned;
+	unsigned long nr_scanned_frags;
+	unsigned int max_frags;
+	unsigned int last_frags_before;
+	unsigned int last_frags_after;
+	/* idleness */
+	unsigned long last_ios;
+};
+
+
 /* SPO test flags */
 #define	DFR_SPO_NONE			(0)
 #define	DFR_SPO_NORMAL			(1)
@@ -249,6 +284,8 @@ void defrag_check_discard(struct super_block *sb);
 int defrag_free_cluster(struct super_block *sb, unsigned int clus);
 
 int defrag_check_defrag_required(struct super_block *sb, int *totalau, int *cleanau, int *fullau);
+int defrag_collect_chunks(struct inode *inode, struct defrag_chunk_info *chunks,
+		int max_chunks, int *nr_chunks, unsigned int max_clus);
 int defrag_check_defrag_on(struct inode *inode, loff_t start, loff_t end, int cancel, const char *caller);
 
 #ifdef CONFIG_SDFAT_DFR_DEBUG
@@ -44,6 +44,8 @@
 #define EXTENT_CACHE_VALID	0
 /* this must be > 0. */
 #define EXTENT_MAX_CACHE	16
+/* fragments the FAT chain prefetcher may add to the cache at once */
+#define EXTENT_MAX_RA_FRAGS	(EXTENT_MAX_CACHE >> 1)
 
 struct extent_cache {
 	struct list_head cache_list;
@@ -94,6 +96,9 @@ void extent_cache_init_inode(struct inode *inode)
 	extent->nr_caches = 0;
 	extent->cache_valid_id = EXTENT_CACHE_VALID + 1;
 	INIT_LIST_HEAD(&extent->cache_lru);
+	extent->ra_last = 0;
+	extent->ra_fclus = 0;
+	extent->ra_dclus = CLUS_EOF;
 }
 
 static inline struct extent_cache *extent_cache_alloc(void)
@@ -244,6 +249,10 @@ static void __extent_cache_inval_inode(struct inode *inode)
 	extent->cache_valid_id++;
 	if (extent->cache_valid_id == EXTENT_CACHE_VALID)
 		extent->cache_valid_id++;
+
+	/* the prefetched chain may not exist anymore */
+	extent->ra_fclus = 0;
+	extent->ra_dclus = CLUS_EOF;
 }
 
 void extent_cache_inval_inode(struct inode *inode)
@@ -269,6 +278,80 @@ static inline void cache_init(struct extent_cache_id *cid, u32 fclus, u32 dclus)
 	cid->nr_contig = 0;
 }
 
+/*
+ * FAT chain prefetch for sequential access.
+ *
+ * Follows the cluster chain ahead of "cluster" while its FAT sectors are
+ * already in memory and records the runs found in the extent cache, so the
+ * next lookups hit the cache instead of walking the FAT one entry at a time.
+ * At the first FAT sector which is not uptodate, an asynchronous read is
+ * started and the walk stops; a later lookup resumes it from ra_fclus.
+ */
+static void extent_chain_readahead(struct inode *inode, u32 cluster,
+		u32 fclus, u32 dclus)
+{
+	struct super_block *sb = inode->i_sb;
+	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+	EXTENT_T *extent = &(SDFAT_I(inode)->fid.extent);
+	u32 ra_secs = FCHAIN_MAX_RA_SIZE >> sb->s_blocksize_bits;
+	u32 window = max_t(u32, FCHAIN_RA_WINDOW >> fsi->cluster_size_bits, 2);
+	u32 limit = fsi->num_clusters;
+	u32 nr_frags = 0;
+	u32 content;
+	struct extent_cache_id cid;
+	bool sequential;
+
+	sequential = ((cluster == extent->ra_last) ||
+			(cluster == extent->ra_last + 1));
+	extent->ra_last = cluster;
+	if (!sequential || IS_CLUS_EOF(dclus))
+		return;
+
+	/* Still far enough ahead, or resume from the prefetched position */
+	if (!IS_CLUS_EOF(extent->ra_dclus) && (extent->ra_fclus >= fclus)) {
+		if (extent->ra_fclus >= cluster + (window >> 1))
+			return;
+		fclus = extent->ra_fclus;
+		dclus = extent->ra_dclus;
+	}
+
+	cache_init(&cid, fclus, dclus);
+	while (fclus < cluster + window) {
+		/* prevent the infinite loop of cluster chain */
+		if (fclus > limit)
+			break;
+
+		if (!fat_ent_ready(sb, dclus, ra_secs))
+			break;
+
+		/* errors are reported by the lookup which really needs it */
+		if (fat_ent_get(sb, dclus, &content))
+			break;
+
+		if (IS_CLUS_EOF(content) || IS_CLUS_FREE(content) ||
+				IS_CLUS_BAD(content))
+			break;
+
+		fclus++;
+		dclus = content;
+
+		if (!cache_contiguous(&cid, dclus)) {
+			/* cache_contiguous() counted dclus into the old run */
+			cid.nr_contig--;
+			extent_cache_add(inode, &cid);
+			if (++nr_frags >= EXTENT_MAX_RA_FRAGS)
+				break;
+			cache_init(&cid, fclus, dclus);
+		}
+	}
+
+	if (nr_frags < EXTENT_MAX_RA_FRAGS)
+		extent_cache_add(inode, &cid);
+
+	extent->ra_fclus = fclus;
+	extent->ra_dclus = dclus;
+}
+
 s32 extent_get_clus(struct inode *inode, u32 cluster, u32 *fclus,
 		u32 *dclus, u32 *last_dclus, s32 allow_eof)
 {
@@ -311,7 +394,7 @@ s32 extent_get_clus(struct inode *inode, u32 cluster, u32 *fclus,
 	}
 
 	if (*fclus == cluster)
-		return 0;
+		goto out;
 
 	while (*fclus < cluster) {
 		/* prevent the infinite loop of cluster chain */
@@ -347,5 +430,7 @@ s32 extent_get_clus(struct inode *inode, u32 cluster, u32 *fclus,
 	}
 
 	extent_cache_add(inode, &cid);
+out:
+	extent_chain_readahead(inode, cluster, *fclus, *dclus);
 	return 0;
 }
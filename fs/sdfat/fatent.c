@@ -395,6 +395,60 @@ s32 fat_ent_set(struct super_block *sb, u32 loc, u32 content)
 	return fsi->fatent_ops->ent_set(sb, loc, content);
 }
 
+/* sector of FAT1 holding the (first byte of) entry of loc */
+static inline u64 __fat_ent_sect(struct super_block *sb, u32 loc)
+{
+	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+
+	switch (fsi->vol_type) {
+	case FAT12:
+		return fsi->FAT1_start_sector +
+			((loc + (loc >> 1)) >> sb->s_blocksize_bits);
+	case FAT16:
+		return fsi->FAT1_start_sector + (loc >> (sb->s_blocksize_bits-1));
+	default:
+		return fsi->FAT1_start_sector + (loc >> (sb->s_blocksize_bits-2));
+	}
+}
+
+static inline bool __fat_sect_uptodate(struct super_block *sb, u64 sec)
+{
+	struct buffer_head *bh = sb_find_get_block(sb, (sector_t)sec);
+	bool uptodate = (bh && buffer_uptodate(bh));
+
+	brelse(bh);
+	return uptodate;
+}
+
+/*
+ * Returns true if the FAT entry of loc can be read without waiting for I/O.
+ * Otherwise starts an asynchronous read of its sector and of the following
+ * ones (up to ra_secs in total, bounded by the end of FAT1) and returns false.
+ */
+bool fat_ent_ready(struct super_block *sb, u32 loc, u32 ra_secs)
+{
+	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+	u64 sec, fat_end;
+
+	if (!is_valid_clus(fsi, loc))
+		return false;
+
+	sec = __fat_ent_sect(sb, loc);
+	if (__fat_sect_uptodate(sb, sec)) {
+		/* FAT12 entry may straddle two sectors */
+		if ((fsi->vol_type != FAT12) ||
+			(((loc + (loc >> 1)) & (u32)(sb->s_blocksize - 1)) !=
+				(u32)(sb->s_blocksize - 1)) ||
+			__fat_sect_uptodate(sb, ++sec))
+			return true;
+	}
+
+	fat_end = fsi->FAT1_start_sector + fsi->num_FAT_sectors;
+	ra_secs = (u32)min_t(u64, max(ra_secs, 1U), fat_end - sec);
+	bdev_readahead(sb, sec, (u64)ra_secs);
+	return false;
+}
+
 s32 fat_ent_get_safe(struct super_block *sb, u32 loc, u32 *content)
 {
 	s32 err = fat_ent_get(sb, loc, content);
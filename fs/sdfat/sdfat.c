@@ -52,6 +52,8 @@
 #include <linux/blkdev.h>
 #include <linux/swap.h> /* for mark_page_accessed() */
 #include <linux/vmalloc.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include <asm/current.h>
 #include <asm/unaligned.h>
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 10, 0)
@@ -1688,6 +1690,103 @@ defrag_check_fs_busy(
 }
 
 
+/**
+ * @fn		defrag_run_reqs
+ * @brief	validate defrag requests and wait until they are relocated
+ * @return	0 on success, -errno otherwise
+ * @param	sb		super block
+ * @param	chunks	requests (chunks[REQ_HEADER_IDX] is the header)
+ * @param	len		# of entries in chunks
+ * @param	mode	DFR_MODE_*
+ * @param	umount_held	caller holds sb->s_umount (in-kernel daemon only)
+ * @remark	caller owns sb_dfr->stat and calls defrag_cleanup_reqs()
+ */
+static int
+defrag_run_reqs(
+	IN struct super_block *sb,
+	INOUT struct defrag_chunk_info *chunks,
+	IN unsigned int len,
+	IN int mode,
+	IN bool umount_held)
+{
+	struct sdfat_sb_info *sbi = SDFAT_SB(sb);
+	struct defrag_info *sb_dfr = &(sbi->dfr_info);
+	unsigned long timeout = 0;
+	int err = 0;
+
+	/* Initialize sb_dfr */
+	sb_dfr->chunks = chunks;
+	sb_dfr->nr_chunks = len;
+
+	/* Validate reqs & mark defrag/dirty */
+	err = defrag_validate_reqs(sb, sb_dfr->chunks);
+	if (err)
+		return err;
+
+	atomic_set(&sb_dfr->stat, DFR_SB_STAT_VALID);
+
+	/* Wait for defrag completion */
+	if (mode == DFR_MODE_ONESHOT)
+		timeout = 0;
+	else if (mode & DFR_MODE_BACKGROUND)
+		timeout = DFR_DEFAULT_TIMEOUT;
+	else
+		timeout = DFR_MIN_TIMEOUT;
+
+	dfr_debug("Wait for completion (timeout %ld)", timeout);
+	init_completion(&sbi->dfr_complete);
+	timeout = wait_for_completion_timeout(&sbi->dfr_complete, timeout);
+
+	if (!timeout) {
+		/* Force defrag_updat_fat() after timeout. */
+		dfr_debug("Force sync(), mode %d, left-timeout %ld", mode, timeout);
+
+		if (!umount_held)
+			down_read(&sb->s_umount);
+
+		sync_inodes_sb(sb);
+
+		__lock_super(sb);
+		fsapi_dfr_update_fat_next(sb);
+
+		fsapi_sync_fs(sb, 1);
+
+#ifdef	CONFIG_SDFAT_DFR_DEBUG
+		/* SPO test */
+		fsapi_dfr_spo_test(sb, DFR_SPO_FAT_NEXT, __func__);
+#endif
+
+		fsapi_dfr_update_fat_prev(sb, 1);
+		fsapi_sync_fs(sb, 1);
+
+		__unlock_super(sb);
+
+		if (!umount_held)
+			up_read(&sb->s_umount);
+	}
+
+#ifdef	CONFIG_SDFAT_DFR_DEBUG
+		/* SPO test */
+		fsapi_dfr_spo_test(sb, DFR_SPO_NORMAL, __func__);
+#endif
+
+	__lock_super(sb);
+	/* Send DISCARD to clean-ed AUs */
+	fsapi_dfr_check_discard(sb);
+
+#ifdef	CONFIG_SDFAT_DFR_DEBUG
+	/* SPO test */
+	fsapi_dfr_spo_test(sb, DFR_SPO_DISCARD, __func__);
+#endif
+
+	/* Unmark IGNORE flag to all victim AUs */
+	fsapi_dfr_unmark_ignore_all(sb);
+	__unlock_super(sb);
+
+	return 0;
+}
+
+
 /**
  * @fn		sdfat_ioctl_defrag_req
  * @brief	ioctl to send defrag requests
@@ -1707,7 +1806,6 @@ sdfat_ioctl_defrag_req(
 	struct defrag_chunk_info *chunks = NULL;
 	unsigned int len = 0;
 	int err = 0;
-	unsigned long timeout = 0;
 
 	/* Check overlapped defrag */
 	if (atomic_cmpxchg(&sb_dfr->stat, DFR_SB_STAT_IDLE, DFR_SB_STAT_REQ)) {
@@ -1761,72 +1859,11 @@ sdfat_ioctl_defrag_req(
 	err = copy_from_user(chunks, uarg, len * sizeof(struct defrag_chunk_info));
 	ERR_HANDLE(err);
 
-	/* Initialize sb_dfr */
-	sb_dfr->chunks = chunks;
-	sb_dfr->nr_chunks = len;
-
-	/* Validate reqs & mark defrag/dirty */
-	err = defrag_validate_reqs(sb, sb_dfr->chunks);
+	/* Only the in-kernel daemon issues DFR_MODE_AUTO */
+	head.mode &= ~DFR_MODE_AUTO;
+	err = defrag_run_reqs(sb, chunks, len, head.mode, false);
 	ERR_HANDLE(err);
 
-	atomic_set(&sb_dfr->stat, DFR_SB_STAT_VALID);
-
-	/* Wait for defrag completion */
-	if (head.mode == DFR_MODE_ONESHOT)
-		timeout = 0;
-	else if (head.mode & DFR_MODE_BACKGROUND)
-		timeout = DFR_DEFAULT_TIMEOUT;
-	else
-		timeout = DFR_MIN_TIMEOUT;
-
-	dfr_debug("Wait for completion (timeout %ld)", timeout);
-	init_completion(&sbi->dfr_complete);
-	timeout = wait_for_completion_timeout(&sbi->dfr_complete, timeout);
-
-	if (!timeout) {
-		/* Force defrag_updat_fat() after timeout. */
-		dfr_debug("Force sync(), mode %d, left-timeout %ld", head.mode, timeout);
-
-		down_read(&sb->s_umount);
-
-		sync_inodes_sb(sb);
-
-		__lock_super(sb);
-		fsapi_dfr_update_fat_next(sb);
-
-		fsapi_sync_fs(sb, 1);
-
-#ifdef	CONFIG_SDFAT_DFR_DEBUG
-		/* SPO test */
-		fsapi_dfr_spo_test(sb, DFR_SPO_FAT_NEXT, __func__);
-#endif
-
-		fsapi_dfr_update_fat_prev(sb, 1);
-		fsapi_sync_fs(sb, 1);
-
-		__unlock_super(sb);
-
-		up_read(&sb->s_umount);
-	}
-
-#ifdef	CONFIG_SDFAT_DFR_DEBUG
-		/* SPO test */
-		fsapi_dfr_spo_test(sb, DFR_SPO_NORMAL, __func__);
-#endif
-
-	__lock_super(sb);
-	/* Send DISCARD to clean-ed AUs */
-	fsapi_dfr_check_discard(sb);
-
-#ifdef	CONFIG_SDFAT_DFR_DEBUG
-	/* SPO test */
-	fsapi_dfr_spo_test(sb, DFR_SPO_DISCARD, __func__);
-#endif
-
-	/* Unmark IGNORE flag to all victim AUs */
-	fsapi_dfr_unmark_ignore_all(sb);
-	__unlock_super(sb);
-
 	err = copy_to_user(uarg, sb_dfr->chunks, sizeof(struct defrag_chunk_info) * len);
 	ERR_HANDLE(err);
 
@@ -1955,6 +1992,303 @@ error:
 	return err;
 }
 
+/*----------------------------------------------------------------------*/
+/*  In-kernel defrag daemon                                             */
+/*----------------------------------------------------------------------*/
+/**
+ * @fn		defrag_auto_pick_files
+ * @brief	grab in-core regular files worth evaluating
+ * @return	# of inodes grabbed
+ * @param	sb		super block
+ * @param	cands	output array (DFR_AUTO_NR_CANDIDATES entries)
+ * @remark	Files in use are the ones whose read throughput matters, so
+ *		the candidates are taken from the inode hash instead of a
+ *		full directory walk.
+ */
+static int
+defrag_auto_pick_files(
+	IN struct super_block *sb,
+	OUT struct inode **cands)
+{
+	struct sdfat_sb_info *sbi = SDFAT_SB(sb);
+	struct hlist_node *pos;
+	int i, nr = 0;
+
+	spin_lock(&sbi->inode_hash_lock);
+	for (i = 0; (i < SDFAT_HASH_SIZE) && (nr < DFR_AUTO_NR_CANDIDATES); i++) {
+		hlist_for_each(pos, &sbi->inode_hashtable[i]) {
+			struct sdfat_inode_info *info =
+				hlist_entry(pos, struct sdfat_inode_info, i_hash_fat);
+			struct inode *inode = &info->vfs_inode;
+
+			if (!S_ISREG(inode->i_mode) ||
+				(i_size_read(inode) < DFR_AUTO_MIN_SIZE))
+				continue;
+
+			/* Evaluated recently */
+			if (info->dfr_auto_jiffies &&
+				time_before(jiffies, info->dfr_auto_jiffies + DFR_AUTO_RESCAN))
+				continue;
+
+			/* Victim pages must be clean and unmapped */
+			if ((atomic_read(&inode->i_writecount) > 0) ||
+				mapping_mapped(inode->i_mapping) ||
+				mapping_tagged(inode->i_mapping, PAGECACHE_TAG_DIRTY))
+				continue;
+
+			if (!igrab(inode))
+				continue;
+
+			info->dfr_auto_jiffies = jiffies;
+			cands[nr++] = inode;
+			if (nr >= DFR_AUTO_NR_CANDIDATES)
+				break;
+		}
+	}
+	spin_unlock(&sbi->inode_hash_lock);
+
+	return nr;
+}
+
+/**
+ * @fn		defrag_auto_collect
+ * @brief	count fragments of a file and optionally build its requests
+ * @return	# of fragments on success, -errno otherwise
+ * @param	inode		inode
+ * @param	chunks		output array (may be NULL)
+ * @param	max_chunks	size of chunks
+ * @param	nr_chunks	# of chunks filled
+ */
+static int
+defrag_auto_collect(
+	IN struct inode *inode,
+	OUT struct defrag_chunk_info *chunks,
+	IN int max_chunks,
+	OUT int *nr_chunks)
+{
+	struct super_block *sb = inode->i_sb;
+	int ret;
+
+	/**
+	 * Lock ordering: inode_lock -> lock_super
+	 */
+	inode_lock(inode);
+	__lock_super(sb);
+	/* Each cluster needs an entry in dfr_new_clus */
+	ret = fsapi_dfr_collect_chunks(inode, chunks, max_chunks, nr_chunks,
+			(PAGE_SIZE / sizeof(int)) - 2);
+	__unlock_super(sb);
+	inode_unlock(inode);
+
+	return ret;
+}
+
+/**
+ * @fn		defrag_auto_read_pages
+ * @brief	bring victim pages uptodate as defrag_validate_pages() requires
+ * @return	0 on success, -errno otherwise
+ * @param	inode		inode
+ * @param	chunks		requests
+ * @param	nr_chunks	# of requests
+ */
+static int
+defrag_auto_read_pages(
+	IN struct inode *inode,
+	IN struct defrag_chunk_info *chunks,
+	IN int nr_chunks)
+{
+	struct super_block *sb = inode->i_sb;
+	pgoff_t end = (i_size_read(inode) + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	int i;
+
+	for (i = 0; i < nr_chunks; i++) {
+		pgoff_t index = chunks[i].f_clus * PAGES_PER_CLUS(sb);
+		pgoff_t last = index + chunks[i].nr_clus * PAGES_PER_CLUS(sb);
+
+		for (; (index < last) && (index < end); index++) {
+			struct page *page = read_mapping_page(inode->i_mapping, index, NULL);
+
+			if (IS_ERR(page))
+				return PTR_ERR(page);
+			put_page(page);
+
+			if (kthread_should_stop())
+				return -EINTR;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @fn		defrag_auto_run
+ * @brief	pick the most fragmented candidate and relocate its small fragments
+ * @return	void
+ * @param	sb		super block
+ */
+static void defrag_auto_run(IN struct super_block *sb)
+{
+	struct sdfat_sb_info *sbi = SDFAT_SB(sb);
+	struct defrag_info *sb_dfr = &(sbi->dfr_info);
+	struct defrag_auto_info *dfr_auto = &(sbi->dfr_auto);
+	struct inode *cands[DFR_AUTO_NR_CANDIDATES];
+	struct inode *victim = NULL;
+	struct defrag_chunk_info *chunks = NULL;
+	struct defrag_chunk_header *head = NULL;
+	int reserved_clus = 0, queued_pages = 0;
+	int nr_cands = 0, nr_chunks = 0, max_frags = 0;
+	int i, frags, err = 0;
+
+	/* Keep umount/remount/freeze away while requests are in flight */
+	if (!down_read_trylock(&sb->s_umount))
+		return;
+
+	if ((sb->s_flags & MS_RDONLY) || !sb_start_write_trylock(sb)) {
+		up_read(&sb->s_umount);
+		return;
+	}
+
+	/* Check overlapped defrag */
+	if (atomic_cmpxchg(&sb_dfr->stat, DFR_SB_STAT_IDLE, DFR_SB_STAT_REQ))
+		goto out;
+
+	if (defrag_check_fs_busy(sb, &reserved_clus, &queued_pages)) {
+		dfr_auto->nr_busy++;
+		goto out_idle;
+	}
+
+	__lock_super(sb);
+	err = fsapi_dfr_check_dfr_required(sb, NULL, NULL, NULL);
+	__unlock_super(sb);
+	if (!err)
+		goto out_idle;
+
+	dfr_auto->stat = DFR_AUTO_STAT_SCAN;
+	dfr_auto->nr_runs++;
+
+	/* Find the most fragmented file among the candidates */
+	nr_cands = defrag_auto_pick_files(sb, cands);
+	for (i = 0; i < nr_cands; i++) {
+		frags = defrag_auto_collect(cands[i], NULL, 0, &nr_chunks);
+		if (frags <= 0)
+			continue;
+
+		dfr_auto->nr_scanned++;
+		dfr_auto->nr_scanned_frags += frags;
+		if (frags > dfr_auto->max_frags)
+			dfr_auto->max_frags = frags;
+
+		if ((frags >= DFR_AUTO_MIN_FRAGS) && (frags > max_frags)) {
+			max_frags = frags;
+			victim = cands[i];
+		}
+	}
+	if (!victim)
+		goto out_put;
+
+	chunks = (struct defrag_chunk_info *) get_zeroed_page(GFP_KERNEL);
+	if (!chunks) {
+		err = -ENOMEM;
+		goto out_err;
+	}
+
+	/* chunks[REQ_HEADER_IDX] is the header */
+	err = defrag_auto_collect(victim, &chunks[REQ_HEADER_IDX + 1],
+			(PAGE_SIZE / sizeof(struct defrag_chunk_info)) - 1, &nr_chunks);
+	if (err < 0)
+		goto out_err;
+	if (!nr_chunks)
+		goto out_put;
+
+	dfr_auto->stat = DFR_AUTO_STAT_MOVE;
+
+	err = defrag_auto_read_pages(victim, &chunks[REQ_HEADER_IDX + 1], nr_chunks);
+	if (err)
+		goto out_err;
+
+	head = (struct defrag_chunk_header *) &chunks[REQ_HEADER_IDX];
+	head->mode = DFR_MODE_BACKGROUND | DFR_MODE_AUTO;
+	head->nr_chunks = nr_chunks + 1;
+
+	dfr_debug("auto: inode %p, frags %d, nr_req %d", victim, max_frags, nr_chunks);
+	err = defrag_run_reqs(sb, chunks, nr_chunks + 1, head->mode, true);
+	defrag_cleanup_reqs(sb, err);
+	if (err)
+		goto out_err;
+
+	for (i = REQ_HEADER_IDX + 1; i <= nr_chunks; i++) {
+		if (chunks[i].stat != DFR_CHUNK_STAT_PASS)
+			continue;
+		dfr_auto->nr_chunks++;
+		dfr_auto->nr_clus += chunks[i].nr_clus;
+	}
+	dfr_auto->nr_files++;
+	dfr_auto->last_frags_before = max_frags;
+	frags = defrag_auto_collect(victim, NULL, 0, &nr_chunks);
+	dfr_auto->last_frags_after = (frags > 0) ? frags : 0;
+	goto out_put;
+
+out_err:
+	dfr_auto->nr_errs++;
+	dfr_debug("auto: err %d", err);
+out_put:
+	if (chunks)
+		free_page((unsigned long) chunks);
+	for (i = 0; i < nr_cands; i++)
+		iput(cands[i]);
+out_idle:
+	atomic_set(&sb_dfr->stat, DFR_SB_STAT_IDLE);
+out:
+	sb_end_write(sb);
+	up_read(&sb->s_umount);
+}
+
+static inline unsigned long defrag_auto_bdev_ios(IN struct super_block *sb)
+{
+	struct hd_struct *part = sb->s_bdev->bd_part;
+
+	return part_stat_read(part, ios[READ]) + part_stat_read(part, ios[WRITE]);
+}
+
+/**
+ * @fn		defrag_auto_thread
+ * @brief	wake up periodically and defrag a file when the device is idle
+ * @return	0
+ * @param	data	super block
+ */
+static int defrag_auto_thread(void *data)
+{
+	struct super_block *sb = data;
+	struct defrag_auto_info *dfr_auto = &(SDFAT_SB(sb)->dfr_auto);
+	unsigned long ios;
+
+	set_freezable();
+	while (!kthread_should_stop()) {
+		dfr_auto->stat = DFR_AUTO_STAT_SLEEP;
+		schedule_timeout_interruptible(DFR_AUTO_INTERVAL);
+		if (try_to_freeze() || !dfr_auto->enable)
+			continue;
+
+		/* Throttle: the device must stay idle for DFR_AUTO_IDLE_TIME */
+		ios = defrag_auto_bdev_ios(sb);
+		schedule_timeout_interruptible(DFR_AUTO_IDLE_TIME);
+		if (kthread_should_stop())
+			break;
+
+		if ((ios != defrag_auto_bdev_ios(sb)) ||
+			part_in_flight(sb->s_bdev->bd_part)) {
+			dfr_auto->nr_busy++;
+			continue;
+		}
+		dfr_auto->last_ios = ios;
+
+		defrag_auto_run(sb);
+	}
+	dfr_auto->stat = DFR_AUTO_STAT_OFF;
+
+	return 0;
+}
+
 #endif	/* CONFIG_SDFAT_DFR */
 
 static inline int __do_dfr_map_cluster(struct inode *inode, u32 clu_offset, unsigned int *clus_ptr)
@@ -2006,6 +2340,7 @@ static inline void __init_dfr_info(struct inode *inode)
 	memset(&(SDFAT_I(inode)->dfr_info), 0, sizeof(struct defrag_info));
 	INIT_LIST_HEAD(&(SDFAT_I(inode)->dfr_info.entry));
 	mutex_init(&(SDFAT_I(inode)->dfr_info.lock));
+	SDFAT_I(inode)->dfr_auto_jiffies = 0;
 #endif
 }
 
@@ -2063,6 +2398,40 @@ static void __free_dfr_mem_if_required(struct super_block *sb)
 #endif
 }
 
+static inline void __start_dfr_auto_if_required(struct super_block *sb)
+{
+#ifdef	CONFIG_SDFAT_DFR
+	struct sdfat_sb_info *sbi = SDFAT_SB(sb);
+	struct task_struct *task;
+
+	if (!sbi->options.defrag)
+		return;
+
+	memset(&sbi->dfr_auto, 0, sizeof(struct defrag_auto_info));
+	task = kthread_run(defrag_auto_thread, sb, "sdfat_dfr/%s", sb->s_id);
+	if (IS_ERR(task)) {
+		/* Userspace can still drive defrag through ioctl */
+		sdfat_msg(sb, KERN_WARNING, "failed to start defrag daemon (%ld)",
+				PTR_ERR(task));
+		return;
+	}
+	sbi->dfr_auto.task = task;
+	sbi->dfr_auto.enable = 1;
+#endif
+}
+
+static inline void __stop_dfr_auto_if_required(struct super_block *sb)
+{
+#ifdef	CONFIG_SDFAT_DFR
+	struct sdfat_sb_info *sbi = SDFAT_SB(sb);
+
+	if (sbi->dfr_auto.task) {
+		kthread_stop(sbi->dfr_auto.task);
+		sbi->dfr_auto.task = NULL;
+	}
+#endif
+}
+
 
 static int sdfat_file_mmap(struct file *file, struct vm_area_struct *vm_struct)
 {
@@ -4071,6 +4440,7 @@ static void sdfat_put_super(struct super_block *sb)
 	if (__is_sb_dirty(sb))
 		sdfat_write_super(sb);
 
+	__stop_dfr_auto_if_required(sb);
 	__free_dfr_mem_if_required(sb);
 	err = fsapi_umount(sb);
 
@@ -4454,6 +4824,58 @@ static ssize_t fullau_show(struct sdfat_sb_info *sbi, char *buf)
 }
 SDFAT_ATTR(fullau, 0444, fullau_show, NULL);
 
+#ifdef	CONFIG_SDFAT_DFR
+static ssize_t dfr_auto_show(struct sdfat_sb_info *sbi, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%d\n",
+			sbi->dfr_auto.task ? sbi->dfr_auto.enable : 0);
+}
+
+static ssize_t dfr_auto_store(struct sdfat_sb_info *sbi, const char *buf, size_t count)
+{
+	int enable;
+
+	if (!sbi->dfr_auto.task)
+		return -EOPNOTSUPP;
+
+	if (kstrtoint(buf, 10, &enable))
+		return -EINVAL;
+
+	sbi->dfr_auto.enable = !!enable;
+	return count;
+}
+SDFAT_ATTR(dfr_auto, 0644, dfr_auto_show, dfr_auto_store);
+
+static ssize_t dfr_stat_show(struct sdfat_sb_info *sbi, char *buf)
+{
+	struct defrag_auto_info *dfr_auto = &(sbi->dfr_auto);
+	static const char * const stat_str[] = { "off", "sleep", "scan", "move" };
+	unsigned long avg_frags = 0;
+
+	if (dfr_auto->nr_scanned)
+		avg_frags = dfr_auto->nr_scanned_frags / dfr_auto->nr_scanned;
+
+	return snprintf(buf, PAGE_SIZE,
+			"state: %s\n"
+			"runs: %lu\n"
+			"busy: %lu\n"
+			"errors: %lu\n"
+			"files: %lu\n"
+			"chunks: %lu\n"
+			"clusters: %lu\n"
+			"scanned: %lu\n"
+			"avg_frags: %lu\n"
+			"max_frags: %u\n"
+			"last_frags: %u -> %u\n",
+			stat_str[dfr_auto->stat],
+			dfr_auto->nr_runs, dfr_auto->nr_busy, dfr_auto->nr_errs,
+			dfr_auto->nr_files, dfr_auto->nr_chunks, dfr_auto->nr_clus,
+			dfr_auto->nr_scanned, avg_frags, dfr_auto->max_frags,
+			dfr_auto->last_frags_before, dfr_auto->last_frags_after);
+}
+SDFAT_ATTR(dfr_stat, 0444, dfr_stat_show, NULL);
+#endif	/* CONFIG_SDFAT_DFR */
+
 static struct attribute *sdfat_attrs[] = {
 	&sdfat_attr_type.attr,
 	&sdfat_attr_eio.attr,
@@ -4461,6 +4883,10 @@ static struct attribute *sdfat_attrs[] = {
 	&sdfat_attr_totalau.attr,
 	&sdfat_attr_cleanau.attr,
 	&sdfat_attr_fullau.attr,
+#ifdef	CONFIG_SDFAT_DFR
+	&sdfat_attr_dfr_auto.attr,
+	&sdfat_attr_dfr_stat.attr,
+#endif
 	NULL,
 };
 
@@ -4940,6 +5366,8 @@ static int sdfat_fill_super(struct super_block *sb, void *data, int silent)
 		goto failed_mount3;
 	}
 
+	__start_dfr_auto_if_required(sb);
+
 	sdfat_log_msg(sb, KERN_INFO, "mounted successfully!");
 	/* FOR BIGDATA */
 	sdfat_statistics_set_mnt(&sbi->fsi);
@@ -172,6 +172,7 @@ struct sdfat_sb_info {
 	unsigned int dfr_hint_clus;
 	unsigned int dfr_hint_idx;
 	int dfr_reserved_clus;
+	struct defrag_auto_info dfr_auto;
 
 #ifdef	CONFIG_SDFAT_DFR_DEBUG
 	int dfr_spo_flag;
@@ -205,6 +206,7 @@ struct sdfat_inode_info {
 #endif
 #ifdef	CONFIG_SDFAT_DFR
 	struct defrag_info dfr_info;
+	unsigned long dfr_auto_jiffies;	/* last evaluated by the defrag daemon */
 #endif
 	struct inode vfs_inode;
 };
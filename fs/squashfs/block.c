@@ -29,6 +29,7 @@
 #include <linux/fs.h>
 #include <linux/vfs.h>
 #include <linux/bio.h>
+#include <linux/blkdev.h>
 #include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/pagemap.h>
@@ -69,18 +70,31 @@ struct squashfs_read_request {
 	int nr_buffers;
 	struct buffer_head **bh;
 	struct work_struct offload;
+
+	/*
+	 * Asynchronous requests: number of our BIOs in flight, plus one held
+	 * by the submitter.  The last to drop it queues the decompression.
+	 */
+	atomic_t bio_pending;
 };
 
 struct squashfs_bio_request {
 	struct buffer_head **bh;
 	int nr_buffers;
+	struct squashfs_read_request *req;
 };
 
 static int squashfs_bio_submit(struct squashfs_read_request *req);
 
 int squashfs_init_read_wq(void)
 {
-	squashfs_read_wq = create_workqueue("SquashFS read wq");
+	/*
+	 * Unbound, so that the blocks of one readahead window are
+	 * decompressed on whichever CPUs are idle (each with its own percpu
+	 * stream) rather than all on the CPU that submitted them.
+	 */
+	squashfs_read_wq = alloc_workqueue("SquashFS read wq",
+					   WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
 	return !!squashfs_read_wq;
 }
 
@@ -100,6 +114,11 @@ static void free_read_request(struct squashfs_read_request *req, int error)
 	kfree(req);
 }
 
+static bool squashfs_bh_done(void *data)
+{
+	return !buffer_locked(data);
+}
+
 static void squashfs_process_blocks(struct squashfs_read_request *req)
 {
 	int error = 0;
@@ -112,6 +131,10 @@ static void squashfs_process_blocks(struct squashfs_read_request *req)
 	for (i = 0; i < nr_buffers; ++i) {
 		if (!bh[i])
 			continue;
+		/* somebody is faulting on this, try not to sleep */
+		if (req->synchronous && buffer_locked(bh[i]))
+			blk_poll(bdev_get_queue(req->sb->s_bdev),
+				 squashfs_bh_done, bh[i]);
 		wait_on_buffer(bh[i]);
 		if (!buffer_uptodate(bh[i]))
 			error = -EIO;
@@ -156,8 +179,11 @@ static void squashfs_process_blocks(struct squashfs_read_request *req)
 		squashfs_bh_to_actor(bh, nr_buffers, req->output, req->offset,
 			req->length, msblk->devblksize);
 	} else if (req->data_processing == SQUASHFS_DECOMPRESS) {
+		if (msblk->decompressor->linear_output)
+			squashfs_actor_map_linear(actor);
 		req->length = squashfs_decompress(msblk, bh, nr_buffers,
 			req->offset, req->length, actor);
+		squashfs_actor_unmap_linear(actor);
 		if (req->length < 0) {
 			error = -EIO;
 			goto cleanup;
@@ -187,10 +213,17 @@ static void read_wq_handler(struct work_struct *work)
 		    struct squashfs_read_request, offload));
 }
 
+static void squashfs_read_request_put(struct squashfs_read_request *req)
+{
+	if (atomic_dec_and_test(&req->bio_pending))
+		queue_work(squashfs_read_wq, &req->offload);
+}
+
 static void squashfs_bio_end_io(struct bio *bio, int error)
 {
 	int i;
 	struct squashfs_bio_request *bio_req = bio->bi_private;
+	struct squashfs_read_request *req = bio_req->req;
 
 	bio_put(bio);
 
@@ -204,6 +237,10 @@ static void squashfs_bio_end_io(struct bio *bio, int error)
 		unlock_buffer(bio_req->bh[i]);
 	}
 	kfree(bio_req);
+
+	/* Start decompressing as soon as the data is in */
+	if (req)
+		squashfs_read_request_put(req);
 }
 
 static int bh_is_optional(struct squashfs_read_request *req, int idx)
@@ -277,6 +314,11 @@ static int squashfs_bio_submit(struct squashfs_read_request *req)
 	if (actor_getblks(req, block) < 0)
 		goto getblk_failed;
 
+	if (!req->synchronous) {
+		INIT_WORK(&req->offload, read_wq_handler);
+		atomic_set(&req->bio_pending, 1);
+	}
+
 	/* Create and submit the BIOs */
 	for (b = 0; b < nr_buffers; ++b, offset += blksz) {
 		bh = req->bh[b];
@@ -313,6 +355,10 @@ static int squashfs_bio_submit(struct squashfs_read_request *req)
 				       << (msblk->devblksize_log2 - 9);
 		bio->bi_private = bio_req;
 		bio->bi_end_io = squashfs_bio_end_io;
+		if (!req->synchronous) {
+			bio_req->req = req;
+			atomic_inc(&req->bio_pending);
+		}
 
 		bio_add_page(bio, bh->b_page, blksz, offset);
 		bio_req->nr_buffers += 1;
@@ -323,16 +369,22 @@ static int squashfs_bio_submit(struct squashfs_read_request *req)
 
 	if (req->synchronous)
 		squashfs_process_blocks(req);
-	else {
-		INIT_WORK(&req->offload, read_wq_handler);
-		schedule_work(&req->offload);
-	}
+	else
+		squashfs_read_request_put(req);
 	return 0;
 
 bio_alloc_failed:
 	kfree(bio_req);
 req_alloc_failed:
 	unlock_buffer(bh);
+	if (!req->synchronous) {
+		/*
+		 * BIOs already in flight still reference req.  Buffers never
+		 * read are not uptodate, so the work fails the pages with -EIO.
+		 */
+		squashfs_read_request_put(req);
+		return -ENOMEM;
+	}
 	while (--nr_buffers >= b)
 		if (req->bh[nr_buffers])
 			put_bh(req->bh[nr_buffers]);
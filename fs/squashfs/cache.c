@@ -23,7 +23,8 @@
 
 /*
  * Blocks in Squashfs are compressed.  To avoid repeatedly decompressing
- * recently accessed data Squashfs uses two small metadata and fragment caches.
+ * recently accessed data Squashfs uses small metadata and fragment caches,
+ * hashed on block number and recycled least recently used first.
  *
  * This file implements a generic cache implementation used for both caches,
  * plus functions layered ontop of the generic cache implementation to
@@ -52,12 +53,33 @@
 #include <linux/spinlock.h>
 #include <linux/wait.h>
 #include <linux/pagemap.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs.h"
 #include "page_actor.h"
 
+static struct hlist_head *squashfs_cache_bucket(struct squashfs_cache *cache,
+	u64 block)
+{
+	return &cache->hash[hash_64(block, cache->hash_bits)];
+}
+
+
+static struct squashfs_cache_entry *squashfs_cache_lookup(
+	struct squashfs_cache *cache, u64 block)
+{
+	struct squashfs_cache_entry *entry;
+
+	hlist_for_each_entry(entry, squashfs_cache_bucket(cache, block), hash)
+		if (entry->block == block)
+			return entry;
+	return NULL;
+}
+
+
 /*
  * Look-up block in cache, and increment usage count.  If not in cache, read
  * and decompress it from disk.
@@ -65,21 +87,14 @@
 struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 	struct squashfs_cache *cache, u64 block, int length)
 {
-	int i, n;
 	struct squashfs_cache_entry *entry;
 
 	spin_lock(&cache->lock);
 
 	while (1) {
-		for (i = cache->curr_blk, n = 0; n < cache->entries; n++) {
-			if (cache->entry[i].block == block) {
-				cache->curr_blk = i;
-				break;
-			}
-			i = (i + 1) % cache->entries;
-		}
+		entry = squashfs_cache_lookup(cache, block);
 
-		if (n == cache->entries) {
+		if (entry == NULL) {
 			/*
 			 * Block not in cache, if all cache entries are used
 			 * go to sleep waiting for one to become available.
@@ -94,19 +109,15 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			}
 
 			/*
-			 * At least one unused cache entry.  A simple
-			 * round-robin strategy is used to choose the entry to
-			 * be evicted from the cache.
+			 * At least one unused cache entry.  Evict the one
+			 * released longest ago, unused entries are kept on
+			 * the LRU list in the order they were released.
 			 */
-			i = cache->next_blk;
-			for (n = 0; n < cache->entries; n++) {
-				if (cache->entry[i].refcount == 0)
-					break;
-				i = (i + 1) % cache->entries;
-			}
-
-			cache->next_blk = (i + 1) % cache->entries;
-			entry = &cache->entry[i];
+			cache->misses++;
+			entry = list_first_entry(&cache->lru,
+				struct squashfs_cache_entry, lru);
+			list_del_init(&entry->lru);
+			hlist_del_init(&entry->hash);
 
 			/*
 			 * Initialise chosen cache entry, and fill it in from
@@ -114,6 +125,8 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			 */
 			cache->unused--;
 			entry->block = block;
+			hlist_add_head(&entry->hash,
+				squashfs_cache_bucket(cache, block));
 			entry->refcount = 1;
 			entry->pending = 1;
 			entry->num_waiters = 0;
@@ -150,9 +163,11 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		 * previously unused there's one less cache entry available
 		 * for reuse.
 		 */
-		entry = &cache->entry[i];
-		if (entry->refcount == 0)
+		cache->hits++;
+		if (entry->refcount == 0) {
+			list_del_init(&entry->lru);
 			cache->unused--;
+		}
 		entry->refcount++;
 
 		/*
@@ -171,7 +186,8 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 
 out:
 	TRACE("Got %s %d, start block %lld, refcount %d, error %d\n",
-		cache->name, i, entry->block, entry->refcount, entry->error);
+		cache->name, (int) (entry - cache->entry), entry->block,
+		entry->refcount, entry->error);
 
 	if (entry->error)
 		ERROR("Unable to read %s cache entry [%llx]\n", cache->name,
@@ -190,6 +206,16 @@ void squashfs_cache_put(struct squashfs_cache_entry *entry)
 	spin_lock(&cache->lock);
 	entry->refcount--;
 	if (entry->refcount == 0) {
+		/*
+		 * A failed read is not worth keeping, let the next lookup
+		 * retry it and reuse this entry first.
+		 */
+		if (entry->error) {
+			hlist_del_init(&entry->hash);
+			entry->block = SQUASHFS_INVALID_BLK;
+			list_add(&entry->lru, &cache->lru);
+		} else
+			list_add_tail(&entry->lru, &cache->lru);
 		cache->unused++;
 		/*
 		 * If there's any processes waiting for a block to become
@@ -204,6 +230,19 @@ void squashfs_cache_put(struct squashfs_cache_entry *entry)
 	spin_unlock(&cache->lock);
 }
 
+
+/*
+ * Snapshot the hit/miss counters, for squashfs_show_stats().
+ */
+void squashfs_cache_stats(struct squashfs_cache *cache, unsigned long *hits,
+	unsigned long *misses)
+{
+	spin_lock(&cache->lock);
+	*hits = cache->hits;
+	*misses = cache->misses;
+	spin_unlock(&cache->lock);
+}
+
 /*
  * Delete cache reclaiming all kmalloced buffers.
  */
@@ -220,6 +259,7 @@ void squashfs_cache_delete(struct squashfs_cache *cache)
 		kfree(cache->entry[i].actor);
 	}
 
+	kfree(cache->hash);
 	kfree(cache->entry);
 	kfree(cache);
 }
@@ -229,6 +269,8 @@ void squashfs_cache_delete(struct squashfs_cache *cache)
  * Initialise cache allocating the specified number of entries, each of
  * size block_size.  To avoid vmalloc fragmentation issues each entry
  * is allocated as a sequence of kmalloced PAGE_CACHE_SIZE buffers.
+ * The hash table has a bucket per entry (rounded up to a power of two),
+ * so a lookup stays constant time however big the cache is configured.
  */
 struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 	int block_size)
@@ -247,8 +289,15 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		goto cleanup;
 	}
 
-	cache->curr_blk = 0;
-	cache->next_blk = 0;
+	/* hash_64() needs at least one bit, a single entry gets two buckets */
+	cache->hash_bits = max(order_base_2(entries), 1);
+	cache->hash = kcalloc(1 << cache->hash_bits, sizeof(*(cache->hash)),
+		GFP_KERNEL);
+	if (cache->hash == NULL) {
+		ERROR("Failed to allocate %s cache\n", name);
+		goto cleanup;
+	}
+
 	cache->unused = entries;
 	cache->entries = entries;
 	cache->block_size = block_size;
@@ -256,6 +305,7 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 	cache->pages = cache->pages ? cache->pages : 1;
 	cache->name = name;
 	cache->num_waiters = 0;
+	INIT_LIST_HEAD(&cache->lru);
 	spin_lock_init(&cache->lock);
 	init_waitqueue_head(&cache->wait_queue);
 
@@ -265,6 +315,8 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		init_waitqueue_head(&cache->entry[i].wait_queue);
 		entry->cache = cache;
 		entry->block = SQUASHFS_INVALID_BLK;
+		INIT_HLIST_NODE(&entry->hash);
+		list_add_tail(&entry->lru, &cache->lru);
 		entry->page = alloc_page_array(cache->pages, GFP_KERNEL);
 		if (!entry->page) {
 			ERROR("Failed to allocate %s cache entry\n", name);
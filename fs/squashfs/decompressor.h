@@ -33,6 +33,8 @@ struct squashfs_decompressor {
 	int	id;
 	char	*name;
 	int	supported;
+	/* decompress() can write into a vm_map_ram()ed output actor */
+	int	linear_output;
 };
 
 static inline void *squashfs_comp_opts(struct squashfs_sb_info *msblk,
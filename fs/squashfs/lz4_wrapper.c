@@ -100,6 +100,14 @@ static int lz4_uncompress(struct squashfs_sb_info *msblk, void *strm,
 
 	squashfs_bh_to_buf(bh, b, stream->input, offset, length,
 		msblk->devblksize);
+
+	/* Fast path, decompress straight into the mapped pages */
+	if (output->linear) {
+		res = lz4_decompress_unknownoutputsize(stream->input, length,
+						output->linear, &dest_len);
+		return res ? -EIO : dest_len;
+	}
+
 	res = lz4_decompress_unknownoutputsize(stream->input, length,
 					stream->output, &dest_len);
 	if (res)
@@ -116,5 +124,6 @@ const struct squashfs_decompressor squashfs_lz4_comp_ops = {
 	.decompress = lz4_uncompress,
 	.id = LZ4_COMPRESSION,
 	.name = "lz4",
-	.supported = 1
+	.supported = 1,
+	.linear_output = 1
 };
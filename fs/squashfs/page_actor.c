@@ -10,6 +10,7 @@
 #include <linux/slab.h>
 #include <linux/pagemap.h>
 #include <linux/buffer_head.h>
+#include <linux/vmalloc.h>
 #include "page_actor.h"
 
 struct squashfs_page_actor *squashfs_page_actor_init(struct page **page,
@@ -25,10 +26,39 @@ struct squashfs_page_actor *squashfs_page_actor_init(struct page **page,
 	actor->pages = pages;
 	actor->next_page = 0;
 	actor->pageaddr = NULL;
+	actor->linear = NULL;
 	actor->release_pages = release_pages;
 	return actor;
 }
 
+/*
+ * Map the output pages virtually contiguous, so a decompressor can write
+ * straight into them rather than into its own buffer followed by a copy.
+ * May sleep, so this has to be done before taking a decompressor stream.
+ * Failing is fine, actor->linear stays NULL and the copy path is used.
+ */
+void squashfs_actor_map_linear(struct squashfs_page_actor *actor)
+{
+	int i;
+
+	/* Holes in the page array (pages already uptodate) can't be mapped */
+	for (i = 0; i < actor->pages; i++)
+		if (!actor->page[i])
+			return;
+
+	actor->linear = vm_map_ram(actor->page, actor->pages, -1, PAGE_KERNEL);
+}
+
+void squashfs_actor_unmap_linear(struct squashfs_page_actor *actor)
+{
+	if (actor->linear) {
+		flush_kernel_vmap_range(actor->linear,
+					actor->pages * PAGE_SIZE);
+		vm_unmap_ram(actor->linear, actor->pages);
+		actor->linear = NULL;
+	}
+}
+
 void squashfs_page_actor_free(struct squashfs_page_actor *actor, int error)
 {
 	if (!actor)
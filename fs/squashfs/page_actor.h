@@ -14,12 +14,15 @@ struct squashfs_page_actor {
 	int	pages;
 	int	length;
 	int	next_page;
+	void	*linear;
 	void	(*release_pages)(struct page **, int, int);
 };
 
 extern struct squashfs_page_actor *squashfs_page_actor_init(struct page **,
 	int, int, void (*)(struct page **, int, int));
 extern void squashfs_page_actor_free(struct squashfs_page_actor *, int);
+extern void squashfs_actor_map_linear(struct squashfs_page_actor *);
+extern void squashfs_actor_unmap_linear(struct squashfs_page_actor *);
 
 extern void squashfs_actor_to_buf(struct squashfs_page_actor *, void *, int);
 extern void squashfs_buf_to_actor(void *, struct squashfs_page_actor *, int);
@@ -28,12 +28,15 @@
 struct squashfs_cache {
 	char			*name;
 	int			entries;
-	int			curr_blk;
-	int			next_blk;
 	int			num_waiters;
 	int			unused;
 	int			block_size;
 	int			pages;
+	unsigned int		hash_bits;
+	struct hlist_head	*hash;
+	struct list_head	lru;
+	unsigned long		hits;
+	unsigned long		misses;
 	spinlock_t		lock;
 	wait_queue_head_t	wait_queue;
 	struct squashfs_cache_entry *entry;
@@ -41,6 +44,8 @@ struct squashfs_cache {
 
 struct squashfs_cache_entry {
 	u64			block;
+	struct hlist_node	hash;
+	struct list_head	lru;
 	int			length;
 	int			refcount;
 	u64			next_index;
@@ -38,6 +38,7 @@
 #include <linux/module.h>
 #include <linux/magic.h>
 #include <linux/xattr.h>
+#include <linux/seq_file.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -372,6 +373,34 @@ static int squashfs_statfs(struct dentry *dentry, struct kstatfs *buf)
 }
 
 
+static void squashfs_show_cache_stats(struct seq_file *m,
+	struct squashfs_cache *cache)
+{
+	unsigned long hits, misses;
+
+	if (cache == NULL)
+		return;
+
+	squashfs_cache_stats(cache, &hits, &misses);
+	seq_printf(m, "\n\t%s cache: entries %d hits %lu misses %lu",
+		cache->name, cache->entries, hits, misses);
+}
+
+
+/*
+ * Per-cache hit/miss counts, shown in /proc/<pid>/mountstats.
+ */
+static int squashfs_show_stats(struct seq_file *m, struct dentry *root)
+{
+	struct squashfs_sb_info *msblk = root->d_sb->s_fs_info;
+
+	squashfs_show_cache_stats(m, msblk->block_cache);
+	squashfs_show_cache_stats(m, msblk->fragment_cache);
+	squashfs_show_cache_stats(m, msblk->read_page);
+	return 0;
+}
+
+
 static int squashfs_remount(struct super_block *sb, int *flags, char *data)
 {
 	sync_filesystem(sb);
@@ -505,6 +534,7 @@ static const struct super_operations squashfs_super_ops = {
 	.alloc_inode = squashfs_alloc_inode,
 	.destroy_inode = squashfs_destroy_inode,
 	.statfs = squashfs_statfs,
+	.show_stats = squashfs_show_stats,
 	.put_super = squashfs_put_super,
 	.remount_fs = squashfs_remount
 };
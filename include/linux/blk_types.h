@@ -100,6 +100,15 @@ struct bio {
 
 	struct bio_set		*bi_pool;
 
+#ifdef CONFIG_BLK_CGROUP_IOLATENCY
+	/*
+	 * Group charged for this bio and when it was submitted.  Kept by
+	 * bio_reset(), the charge is only dropped by blk_iolatency_done().
+	 */
+	struct blkcg_gq		*bi_iolat_blkg;
+	u64			bi_iolat_issue_ns;
+#endif
+
 	/*
 	 * We can inline a number of vecs at the end of the bio, to avoid
 	 * double allocations for a small number of bio_vecs. This member
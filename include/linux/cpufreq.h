@@ -626,4 +626,34 @@ int cpufreq_generic_init(struct cpufreq_policy *policy,
 
 void acct_update_power(struct task_struct *p, cputime_t cputime);
 
+/* Who a frequency transition was made for */
+enum cpufreq_requester {
+	CPUFREQ_REQ_GOVERNOR,
+	CPUFREQ_REQ_PM_QOS,
+	CPUFREQ_REQ_THERMAL,
+	CPUFREQ_REQ_NR,
+};
+
+/* Parts of a frequency transition, as timed by the driver */
+enum cpufreq_trans_phase {
+	CPUFREQ_PHASE_REQUEST,	/* request reaching the driver to the switch */
+	CPUFREQ_PHASE_SWITCH,	/* voltage and clock changes */
+	CPUFREQ_PHASE_NOTIFY,	/* transition notifier chains */
+	CPUFREQ_PHASE_NR,
+};
+
+/*
+ * The drivers that time their transitions are built in, so they only get
+ * to call into a built-in cpufreq_stats; a modular one leaves them the stub.
+ */
+#if IS_BUILTIN(CONFIG_CPU_FREQ_STAT)
+void cpufreq_stats_transition(struct cpufreq_policy *policy,
+		unsigned int old_freq, unsigned int new_freq,
+		enum cpufreq_requester req, const u64 *phase_ns);
+#else
+static inline void cpufreq_stats_transition(struct cpufreq_policy *policy,
+		unsigned int old_freq, unsigned int new_freq,
+		enum cpufreq_requester req, const u64 *phase_ns) { }
+#endif
+
 #endif /* _LINUX_CPUFREQ_H */
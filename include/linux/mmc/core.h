@@ -161,6 +161,10 @@ extern int __mmc_switch(struct mmc_card *, u8, u8, u8, unsigned int, bool,
 			bool, bool);
 extern int mmc_switch(struct mmc_card *, u8, u8, u8, unsigned int);
 extern int mmc_send_ext_csd(struct mmc_card *card, u8 *ext_csd);
+extern int mmc_cmdq_switch(struct mmc_card *card, bool enable);
+extern int mmc_cmdq_queue_task(struct mmc_card *card, u32 params, u32 addr);
+extern int mmc_cmdq_status(struct mmc_card *card, u32 *qsr);
+extern int mmc_cmdq_discard_queue(struct mmc_card *card);
 
 #define MMC_ERASE_ARG		0x00000000
 #define MMC_SECURE_ERASE_ARG	0x80000000
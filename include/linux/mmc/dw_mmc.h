@@ -58,6 +58,10 @@ struct mmc_data;
  * @dma_64bit_address: Whether DMA supports 64-bit address mode or not.
  * @sg_dma: Bus address of DMA buffer.
  * @sg_cpu: Virtual address of DMA buffer.
+ * @desc_ring: Size of one descriptor ring, the DMA buffer holds
+ *	DW_MCI_DESC_RINGS of them.
+ * @desc_cur: Descriptor ring used by the last transfer.
+ * @desc_pre_data: Data whose descriptors pre_req built in the other ring.
  * @dma_ops: Pointer to platform-specific DMA callbacks.
  * @cmd_status: Snapshot of SR taken upon completion of the current
  *	command. Only valid when EVENT_CMD_COMPLETE is pending.
@@ -154,6 +158,9 @@ struct dw_mci {
 	struct dw_mci_dma_data	*dma_data;
 #endif
 	unsigned short          desc_sz;
+	unsigned int		desc_ring;
+	unsigned int		desc_cur;
+	struct mmc_data		*desc_pre_data;
 	struct pm_qos_request	pm_qos_int;
 	u32			cmd_status;
 	u32			data_status;
@@ -240,6 +247,8 @@ struct dw_mci_dma_ops {
 	/* DMA Ops */
 	int (*init)(struct dw_mci *host);
 	void (*start)(struct dw_mci *host, unsigned int sg_len);
+	void (*prepare)(struct dw_mci *host, struct mmc_data *data,
+			unsigned int sg_len);
 	void (*complete)(struct dw_mci *host);
 	void (*stop)(struct dw_mci *host);
 	void (*reset)(struct dw_mci *host);
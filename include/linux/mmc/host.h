@@ -306,6 +306,7 @@ struct mmc_host {
 #define MMC_CAP2_SKIP_INIT_SCAN		(1 << 19) /* skip init mmc scan */
 #define MMC_CAP2_DETECT_ON_ERR	(1 << 22)	/* On I/O err check card removal */
 #define MMC_CAP2_PWR_SHUT_DOWN		(1 << 23) /* emmc cntrl pwr in shutdown */
+#define MMC_CAP2_CMDQ		(1 << 24)	/* Allow eMMC command queueing */
 
 	mmc_pm_flag_t		pm_caps;	/* supported pm features */
 
@@ -89,12 +89,44 @@ extern const u8 tuning_blk_pattern_8bit[MMC_TUNING_BLK_PATTERN_8BIT_SIZE];
 #define MMC_APP_CMD              55   /* ac   [31:16] RCA        R1  */
 #define MMC_GEN_CMD              56   /* adtc [0] RD/WR          R1  */
 
+  /* class 11 */
+#define MMC_QUE_TASK_PARAMS      44   /* ac   [20:16] task id    R1  */
+#define MMC_QUE_TASK_ADDR        45   /* ac   [31:0] data addr   R1  */
+#define MMC_EXECUTE_READ_TASK    46   /* adtc [20:16] task id    R1  */
+#define MMC_EXECUTE_WRITE_TASK   47   /* adtc [20:16] task id    R1  */
+#define MMC_CMDQ_TASK_MGMT       48   /* ac   [20:16] task id    R1b */
+
 static inline bool mmc_op_multi(u32 opcode)
 {
 	return opcode == MMC_WRITE_MULTIPLE_BLOCK ||
 	       opcode == MMC_READ_MULTIPLE_BLOCK;
 }
 
+/*
+ * MMC_QUE_TASK_PARAMS argument format:
+ *
+ *	[31]	Reliable Write
+ *	[30]	Data Direction (1 = read)
+ *	[29]	Tag Request
+ *	[28:25]	Context ID
+ *	[24]	Forced Programming
+ *	[23]	Priority
+ *	[20:16]	Task ID
+ *	[15:00]	Number of Blocks
+ */
+#define MMC_CMDQ_REL_WR		(1 << 31)
+#define MMC_CMDQ_DATA_DIR_READ	(1 << 30)
+#define MMC_CMDQ_DATA_TAG	(1 << 29)
+#define MMC_CMDQ_PRIO		(1 << 23)
+#define MMC_CMDQ_TASK_ID(t)	(((t) & 0x1f) << 16)
+
+/* MMC_SEND_STATUS argument bit returning the Queue Status Register */
+#define MMC_SEND_STATUS_SQS	(1 << 15)
+
+/* MMC_CMDQ_TASK_MGMT operation codes, [3:0] */
+#define MMC_CMDQ_DISCARD_QUEUE	1
+#define MMC_CMDQ_DISCARD_TASK	2
+
 /*
  * MMC_SWITCH argument format:
  *
@@ -277,6 +309,7 @@ struct _mmc_csd {
  * EXT_CSD fields
  */
 
+#define EXT_CSD_CMDQ_MODE_EN		15	/* R/W */
 #define EXT_CSD_FLUSH_CACHE		32      /* W */
 #define EXT_CSD_CACHE_CTRL		33      /* R/W */
 #define EXT_CSD_POWER_OFF_NOTIFICATION	34	/* R/W */
@@ -349,6 +382,8 @@ struct _mmc_csd {
 #define EXT_CSD_PREv5_PRE_EOL_INFO		255	/* RO */
 #define EXT_CSD_PREv5_LIFE_TIME_EST		254	/* RO */
 
+#define EXT_CSD_CMDQ_DEPTH		307	/* RO */
+#define EXT_CSD_CMDQ_SUPPORT		308	/* RO */
 #define EXT_CSD_TAG_UNIT_SIZE		498	/* RO */
 #define EXT_CSD_DATA_TAG_SUPPORT	499	/* RO */
 #define EXT_CSD_MAX_PACKED_WRITES	500	/* RO */
@@ -185,6 +185,25 @@ extern unsigned long nr_running_cpu(unsigned int cpu);
 extern int register_hmp_task_migration_notifier(struct notifier_block *nb);
 #define HMP_UP_MIGRATION       0
 #define HMP_DOWN_MIGRATION     1
+extern unsigned long hmp_cpu_util(int cpu, bool *freq_invariant);
+#endif
+
+#ifdef CONFIG_CPU_FREQ
+/* Why the scheduler calls the cpufreq hook of a cpu */
+#define SCHED_CPUFREQ_ENQUEUE	(1U << 0)
+#define SCHED_CPUFREQ_DEQUEUE	(1U << 1)
+#define SCHED_CPUFREQ_TICK	(1U << 2)
+
+struct update_util_data {
+	void (*func)(struct update_util_data *data, u64 time,
+		     unsigned int flags);
+};
+
+extern void cpufreq_add_update_util_hook(int cpu,
+		struct update_util_data *data,
+		void (*func)(struct update_util_data *data, u64 time,
+			     unsigned int flags));
+extern void cpufreq_remove_update_util_hook(int cpu);
 #endif
 
 extern void calc_global_load(unsigned long ticks);
@@ -1211,6 +1230,12 @@ struct sched_entity {
 	/* Per-entity load-tracking */
 	struct sched_avg	avg;
 #endif
+
+#ifdef CONFIG_SCHED_HMP
+	/* heaviest and lightest task below run_node, by load_avg_ratio */
+	struct sched_entity	*hmp_heaviest;
+	struct sched_entity	*hmp_lightest;
+#endif
 };
 
 struct sched_rt_entity {
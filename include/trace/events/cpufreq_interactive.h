@@ -109,6 +109,32 @@ DEFINE_EVENT(loadeval, cpufreq_interactive_notyet,
 	    TP_ARGS(cpu_id, load, curtarg, curactual, newtarg)
 );
 
+TRACE_EVENT(cpufreq_interactive_ramp,
+	    TP_PROTO(unsigned long cpu_id, unsigned long curactual,
+		     unsigned long newtarg, u64 latency, bool sched),
+	    TP_ARGS(cpu_id, curactual, newtarg, latency, sched),
+
+	    TP_STRUCT__entry(
+		    __field(unsigned long, cpu_id    )
+		    __field(unsigned long, curactual )
+		    __field(unsigned long, newtarg   )
+		    __field(u64,           latency   )
+		    __field(bool,          sched     )
+	    ),
+
+	    TP_fast_assign(
+		    __entry->cpu_id = cpu_id;
+		    __entry->curactual = curactual;
+		    __entry->newtarg = newtarg;
+		    __entry->latency = latency;
+		    __entry->sched = sched;
+	    ),
+
+	    TP_printk("cpu=%lu actual=%lu targ=%lu latency_us=%llu by=%s",
+		      __entry->cpu_id, __entry->curactual, __entry->newtarg,
+		      __entry->latency, __entry->sched ? "sched" : "timer")
+);
+
 TRACE_EVENT(cpufreq_interactive_boost,
 	    TP_PROTO(const char *s),
 	    TP_ARGS(s),
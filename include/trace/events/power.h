@@ -136,6 +136,49 @@ TRACE_EVENT(cpu_frequency_limits,
 		  (unsigned long)__entry->cpu_id)
 );
 
+/* requester values are enum cpufreq_requester */
+TRACE_EVENT(cpu_frequency_transition,
+
+	TP_PROTO(unsigned int cpu_id, unsigned int old_freq,
+		unsigned int new_freq, unsigned int requester,
+		u64 request_ns, u64 switch_ns, u64 notify_ns),
+
+	TP_ARGS(cpu_id, old_freq, new_freq, requester,
+		request_ns, switch_ns, notify_ns),
+
+	TP_STRUCT__entry(
+		__field(	u32,		cpu_id		)
+		__field(	u32,		old_freq	)
+		__field(	u32,		new_freq	)
+		__field(	u32,		requester	)
+		__field(	u64,		request_ns	)
+		__field(	u64,		switch_ns	)
+		__field(	u64,		notify_ns	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu_id = cpu_id;
+		__entry->old_freq = old_freq;
+		__entry->new_freq = new_freq;
+		__entry->requester = requester;
+		__entry->request_ns = request_ns;
+		__entry->switch_ns = switch_ns;
+		__entry->notify_ns = notify_ns;
+	),
+
+	TP_printk("cpu_id=%lu old=%lu new=%lu requester=%s request_ns=%llu switch_ns=%llu notify_ns=%llu",
+		  (unsigned long)__entry->cpu_id,
+		  (unsigned long)__entry->old_freq,
+		  (unsigned long)__entry->new_freq,
+		  __print_symbolic(__entry->requester,
+				   { 0, "governor" },
+				   { 1, "pm_qos" },
+				   { 2, "thermal" }),
+		  (unsigned long long)__entry->request_ns,
+		  (unsigned long long)__entry->switch_ns,
+		  (unsigned long long)__entry->notify_ns)
+);
+
 DEFINE_EVENT(cpu, cpu_capacity,
 
 	TP_PROTO(unsigned int capacity, unsigned int cpu_id),
@@ -737,6 +737,7 @@ TRACE_EVENT(sched_task_usage_ratio,
 #define HMP_MIGRATE_FORCE	1
 #define HMP_MIGRATE_OFFLOAD	2
 #define HMP_MIGRATE_IDLE_PULL	3
+#define HMP_MIGRATE_ENERGY	4
 TRACE_EVENT(sched_hmp_migrate,
 
 	TP_PROTO(struct task_struct *tsk, int dest, int force),
@@ -7032,6 +7032,10 @@ int in_sched_functions(unsigned long addr)
  */
 struct task_group root_task_group;
 LIST_HEAD(task_groups);
+
+#ifdef CONFIG_SCHEDSTATS
+static DEFINE_PER_CPU(struct sched_lat_hist, root_wakeup_lat);
+#endif
 #endif
 
 DECLARE_PER_CPU(cpumask_var_t, load_balance_mask);
@@ -7096,6 +7100,9 @@ void __init sched_init(void)
 #endif /* CONFIG_RT_GROUP_SCHED */
 
 #ifdef CONFIG_CGROUP_SCHED
+#ifdef CONFIG_SCHEDSTATS
+	root_task_group.wakeup_lat = &root_wakeup_lat;
+#endif
 	list_add(&root_task_group.list, &task_groups);
 	INIT_LIST_HEAD(&root_task_group.children);
 	INIT_LIST_HEAD(&root_task_group.siblings);
@@ -7370,6 +7377,9 @@ static void free_sched_group(struct task_group *tg)
 	free_fair_sched_group(tg);
 	free_rt_sched_group(tg);
 	autogroup_free(tg);
+#ifdef CONFIG_SCHEDSTATS
+	free_percpu(tg->wakeup_lat);
+#endif
 	kfree(tg);
 }
 
@@ -7388,6 +7398,12 @@ struct task_group *sched_create_group(struct task_group *parent)
 	if (!alloc_rt_sched_group(tg, parent))
 		goto err;
 
+#ifdef CONFIG_SCHEDSTATS
+	tg->wakeup_lat = alloc_percpu(struct sched_lat_hist);
+	if (!tg->wakeup_lat)
+		goto err;
+#endif
+
 	return tg;
 
 err:
@@ -8238,6 +8254,50 @@ static u64 cpu_rt_period_read_uint(struct cgroup_subsys_state *css,
 }
 #endif /* CONFIG_RT_GROUP_SCHED */
 
+#ifdef CONFIG_SCHEDSTATS
+static int cpu_wakeup_latency_show(struct seq_file *sf, void *v)
+{
+	struct task_group *tg = css_tg(seq_css(sf));
+	struct sched_lat_hist *hist, *sum;
+	int cpu, class, i;
+
+	sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		hist = per_cpu_ptr(tg->wakeup_lat, cpu);
+		for (class = 0; class < SCHED_LAT_NR_CLASS; class++)
+			for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+				sum->bucket[class][i] += hist->bucket[class][i];
+	}
+	sched_lat_hist_show(sf, sum);
+
+	kfree(sum);
+	return 0;
+}
+
+/* Any value clears the histograms */
+static int cpu_wakeup_latency_write(struct cgroup_subsys_state *css,
+				    struct cftype *cft, u64 val)
+{
+	struct task_group *tg = css_tg(css);
+	unsigned long flags;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+
+		raw_spin_lock_irqsave(&rq->lock, flags);
+		memset(per_cpu_ptr(tg->wakeup_lat, cpu), 0,
+		       sizeof(struct sched_lat_hist));
+		raw_spin_unlock_irqrestore(&rq->lock, flags);
+	}
+
+	return 0;
+}
+#endif /* CONFIG_SCHEDSTATS */
+
 static struct cftype cpu_files[] = {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	{
@@ -8273,6 +8333,13 @@ static struct cftype cpu_files[] = {
 		.read_u64 = cpu_rt_period_read_uint,
 		.write_u64 = cpu_rt_period_write_uint,
 	},
+#endif
+#ifdef CONFIG_SCHEDSTATS
+	{
+		.name = "wakeup_latency",
+		.seq_show = cpu_wakeup_latency_show,
+		.write_u64 = cpu_wakeup_latency_write,
+	},
 #endif
 	{ }	/* terminate */
 };
@@ -0,0 +1,45 @@
+/*
+ * Scheduler hooks for cpufreq governors
+ *
+ * A governor can register a callback per cpu that the scheduler invokes
+ * whenever the load of that cpu changes, instead of sampling it on a
+ * timer.  The callback runs with the runqueue lock held and must not
+ * sleep or wake up tasks directly.
+ */
+#include "sched.h"
+
+DEFINE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_add_update_util_hook - register a load change callback for @cpu
+ * @cpu:	cpu to be notified about
+ * @data:	passed back to @func, embed it in the governor's per-cpu data
+ * @func:	callback
+ */
+void cpufreq_add_update_util_hook(int cpu, struct update_util_data *data,
+		void (*func)(struct update_util_data *data, u64 time,
+			     unsigned int flags))
+{
+	if (WARN_ON(!data || !func))
+		return;
+
+	if (WARN_ON(per_cpu(cpufreq_update_util_data, cpu)))
+		return;
+
+	data->func = func;
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), data);
+}
+EXPORT_SYMBOL_GPL(cpufreq_add_update_util_hook);
+
+/**
+ * cpufreq_remove_update_util_hook - stop notifying about @cpu
+ * @cpu:	cpu to stop notifying about
+ *
+ * The callback may still be running when this returns; callers need
+ * synchronize_sched() before freeing what it uses.
+ */
+void cpufreq_remove_update_util_hook(int cpu)
+{
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), NULL);
+}
+EXPORT_SYMBOL_GPL(cpufreq_remove_update_util_hook);
@@ -326,6 +326,12 @@ do {									\
 	P(ttwu_count);
 	P(ttwu_local);
 
+#ifdef CONFIG_SCHED_HMP
+	P(hmp_force_count);
+	P64(hmp_force_time);
+	P(hmp_search_scan);
+#endif
+
 #undef P
 #undef P64
 #endif
@@ -22,6 +22,7 @@
 
 #include <linux/latencytop.h>
 #include <linux/sched.h>
+#include <linux/rbtree_augmented.h>
 #include <linux/cpumask.h>
 #include <linux/cpuidle.h>
 #include <linux/slab.h>
@@ -501,6 +502,131 @@ static void update_min_vruntime(struct cfs_rq *cfs_rq)
 /*
  * Enqueue an entity into the rb-tree:
  */
+#ifdef CONFIG_SCHED_HMP
+/*
+ * The timeline is augmented with the heaviest and the lightest task of
+ * every subtree, so that HMP migration finds its candidates at the root
+ * rather than by walking the queue.  Group entities do not count.
+ */
+static inline struct sched_entity *hmp_heavier(struct sched_entity *a,
+					       struct sched_entity *b)
+{
+	if (!a || (b && b->avg.load_avg_ratio > a->avg.load_avg_ratio))
+		return b;
+	return a;
+}
+
+static inline struct sched_entity *hmp_lighter(struct sched_entity *a,
+					       struct sched_entity *b)
+{
+	if (!a || (b && b->avg.load_avg_ratio < a->avg.load_avg_ratio))
+		return b;
+	return a;
+}
+
+static void hmp_load_compute(struct sched_entity *se)
+{
+	struct sched_entity *heaviest = entity_is_task(se) ? se : NULL;
+	struct sched_entity *lightest = heaviest;
+	struct sched_entity *child;
+
+	if (se->run_node.rb_left) {
+		child = rb_entry(se->run_node.rb_left, struct sched_entity,
+				 run_node);
+		heaviest = hmp_heavier(heaviest, child->hmp_heaviest);
+		lightest = hmp_lighter(lightest, child->hmp_lightest);
+	}
+	if (se->run_node.rb_right) {
+		child = rb_entry(se->run_node.rb_right, struct sched_entity,
+				 run_node);
+		heaviest = hmp_heavier(heaviest, child->hmp_heaviest);
+		lightest = hmp_lighter(lightest, child->hmp_lightest);
+	}
+	se->hmp_heaviest = heaviest;
+	se->hmp_lightest = lightest;
+}
+
+/*
+ * No early stop: an ancestor may point at the entity whose load changed
+ * and have to pick another one, without its own pointers changing first.
+ */
+static void hmp_load_propagate(struct rb_node *rb, struct rb_node *stop)
+{
+	while (rb != stop) {
+		hmp_load_compute(rb_entry(rb, struct sched_entity, run_node));
+		rb = rb_parent(rb);
+	}
+}
+
+static void hmp_load_copy(struct rb_node *rb_old, struct rb_node *rb_new)
+{
+	struct sched_entity *old = rb_entry(rb_old, struct sched_entity,
+					    run_node);
+	struct sched_entity *new = rb_entry(rb_new, struct sched_entity,
+					    run_node);
+
+	new->hmp_heaviest = old->hmp_heaviest;
+	new->hmp_lightest = old->hmp_lightest;
+}
+
+static void hmp_load_rotate(struct rb_node *rb_old, struct rb_node *rb_new)
+{
+	hmp_load_copy(rb_old, rb_new);
+	hmp_load_compute(rb_entry(rb_old, struct sched_entity, run_node));
+}
+
+static const struct rb_augment_callbacks hmp_load_callbacks = {
+	hmp_load_propagate, hmp_load_copy, hmp_load_rotate
+};
+
+/* On the way down to where @se is inserted */
+static inline void hmp_load_insert_path(struct sched_entity *entry,
+					struct sched_entity *se)
+{
+	if (entity_is_task(se)) {
+		entry->hmp_heaviest = hmp_heavier(entry->hmp_heaviest, se);
+		entry->hmp_lightest = hmp_lighter(entry->hmp_lightest, se);
+	}
+}
+
+static inline void hmp_load_insert(struct cfs_rq *cfs_rq,
+				   struct sched_entity *se)
+{
+	se->hmp_heaviest = se->hmp_lightest = entity_is_task(se) ? se : NULL;
+	rb_insert_augmented(&se->run_node, &cfs_rq->tasks_timeline,
+			    &hmp_load_callbacks);
+}
+
+static inline void hmp_load_erase(struct cfs_rq *cfs_rq,
+				  struct sched_entity *se)
+{
+	rb_erase_augmented(&se->run_node, &cfs_rq->tasks_timeline,
+			   &hmp_load_callbacks);
+}
+
+/* load_avg_ratio of @se changed, it is in the timeline if queued and not curr */
+static inline void hmp_load_update(struct sched_entity *se)
+{
+	if (se->on_rq && se != cfs_rq_of(se)->curr)
+		hmp_load_propagate(&se->run_node, NULL);
+}
+#else
+static inline void hmp_load_insert_path(struct sched_entity *entry,
+					struct sched_entity *se) { }
+
+static inline void hmp_load_insert(struct cfs_rq *cfs_rq,
+				   struct sched_entity *se)
+{
+	rb_insert_color(&se->run_node, &cfs_rq->tasks_timeline);
+}
+
+static inline void hmp_load_erase(struct cfs_rq *cfs_rq,
+				  struct sched_entity *se)
+{
+	rb_erase(&se->run_node, &cfs_rq->tasks_timeline);
+}
+#endif /* CONFIG_SCHED_HMP */
+
 static void __enqueue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
 	struct rb_node **link = &cfs_rq->tasks_timeline.rb_node;
@@ -514,6 +640,7 @@ static void __enqueue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 	while (*link) {
 		parent = *link;
 		entry = rb_entry(parent, struct sched_entity, run_node);
+		hmp_load_insert_path(entry, se);
 		/*
 		 * We dont care about collisions. Nodes with
 		 * the same key stay together.
@@ -534,7 +661,7 @@ static void __enqueue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 		cfs_rq->rb_leftmost = &se->run_node;
 
 	rb_link_node(&se->run_node, parent, link);
-	rb_insert_color(&se->run_node, &cfs_rq->tasks_timeline);
+	hmp_load_insert(cfs_rq, se);
 }
 
 static void __dequeue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
@@ -546,7 +673,7 @@ static void __dequeue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 		cfs_rq->rb_leftmost = next_node;
 	}
 
-	rb_erase(&se->run_node, &cfs_rq->tasks_timeline);
+	hmp_load_erase(cfs_rq, se);
 }
 
 struct sched_entity *__pick_first_entity(struct cfs_rq *cfs_rq)
@@ -2336,9 +2463,9 @@ struct hmp_global_attr {
 };
 
 #ifdef CONFIG_HMP_FREQUENCY_INVARIANT_SCALE
-#define HMP_DATA_SYSFS_MAX 14
+#define HMP_DATA_SYSFS_MAX 15
 #else
-#define HMP_DATA_SYSFS_MAX 13
+#define HMP_DATA_SYSFS_MAX 14
 #endif
 
 struct hmp_data_struct {
@@ -2737,6 +2864,7 @@ static inline void __update_task_entity_contrib(struct sched_entity *se)
 	contrib /= (se->avg.runnable_avg_period + 1);
 	se->avg.load_avg_ratio = scale_load(contrib);
 #ifdef CONFIG_SCHED_HMP
+	hmp_load_update(se);
 	if (!hmp_cpu_is_fastest(cpu_of(se->cfs_rq->rq)) &&
 		se->avg.load_avg_ratio > hmp_up_threshold)
 		cpu_rq(smp_processor_id())->next_balance = jiffies;
@@ -3242,8 +3370,9 @@ set_next_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 		 * runqueue.
 		 */
 		update_stats_wait_end(cfs_rq, se);
-		__dequeue_entity(cfs_rq, se);
+		/* while still in the tree, for the HMP load augmentation */
 		update_entity_load_avg(se, 1);
+		__dequeue_entity(cfs_rq, se);
 	}
 
 	update_stats_curr_start(cfs_rq, se);
@@ -3340,10 +3469,10 @@ static void put_prev_entity(struct cfs_rq *cfs_rq, struct sched_entity *prev)
 	check_spread(cfs_rq, prev);
 	if (prev->on_rq) {
 		update_stats_wait_start(cfs_rq, prev);
-		/* Put 'current' back into the tree. */
-		__enqueue_entity(cfs_rq, prev);
 		/* in !on_rq case, update occurred at dequeue */
 		update_entity_load_avg(prev, 1);
+		/* Put 'current' back into the tree. */
+		__enqueue_entity(cfs_rq, prev);
 	}
 	cfs_rq->curr = NULL;
 }
@@ -4327,6 +4456,7 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		update_rq_runnable_avg(rq, rq->nr_running);
 		add_nr_running(rq, 1);
 	}
+	cpufreq_update_util(rq, SCHED_CPUFREQ_ENQUEUE);
 	hrtick_update(rq);
 }
 
@@ -4387,6 +4517,7 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		sub_nr_running(rq, 1);
 		update_rq_runnable_avg(rq, 1);
 	}
+	cpufreq_update_util(rq, SCHED_CPUFREQ_DEQUEUE);
 	hrtick_update(rq);
 }
 
@@ -4925,76 +5056,115 @@ static void hmp_offline_cpu(int cpu)
 		cpumask_clear_cpu(cpu, &domain->cpus);
 }
 
-/* must hold runqueue lock for queue se is currently on */
+static inline bool hmp_task_allowed(struct sched_entity *se,
+				    const struct cpumask *mask)
+{
+	return cpumask_intersects(mask, tsk_cpus_allowed(task_of(se)));
+}
 
-static struct sched_entity *hmp_get_heaviest_task(struct sched_entity* se, int migrate_up)
+/*
+ * Fallback for when the task the timeline points at cannot run in the
+ * target domain: look at the first hmp_max_tasks entities instead.
+ */
+static struct sched_entity *hmp_scan_task(struct cfs_rq *cfs_rq,
+					  struct sched_entity *best,
+					  unsigned long best_ratio,
+					  const struct cpumask *mask,
+					  int heaviest)
 {
 	int num_tasks = hmp_max_tasks;
-	struct sched_entity *max_se = se;
-	unsigned long int max_ratio = se->avg.load_avg_ratio;
+	struct sched_entity *se;
+
+	schedstat_inc(rq_of(cfs_rq), hmp_search_scan);
+
+	se = __pick_first_entity(cfs_rq);
+	while(num_tasks && se) {
+		if (entity_is_task(se) && hmp_task_allowed(se, mask)) {
+			if (heaviest ? se->avg.load_avg_ratio > best_ratio :
+				       se->avg.load_avg_ratio < best_ratio) {
+				best = se;
+				best_ratio = se->avg.load_avg_ratio;
+			}
+		}
+		se = __pick_next_entity(se);
+		num_tasks--;
+	}
+	return best;
+}
+
+static inline struct sched_entity *hmp_timeline_root(struct cfs_rq *cfs_rq)
+{
+	struct rb_node *root = cfs_rq->tasks_timeline.rb_node;
+
+	if (!root)
+		return NULL;
+	return rb_entry(root, struct sched_entity, run_node);
+}
+
+/*
+ * must hold runqueue lock for queue se is currently on
+ *
+ * The heaviest and lightest queued tasks are kept at the root of the
+ * timeline, see hmp_load_compute().
+ */
+
+static struct sched_entity *hmp_get_heaviest_task(struct sched_entity* se, int migrate_up)
+{
+	struct cfs_rq *cfs_rq = cfs_rq_of(se);
+	struct sched_entity *root, *max_se;
 	const struct cpumask *hmp_target_mask = NULL;
 
 	if (migrate_up) {
 		struct hmp_domain *hmp;
 		if(hmp_cpu_is_fastest(cpu_of(se->cfs_rq->rq)))
-			return max_se;
+			return se;
 
 		hmp = hmp_faster_domain(cpu_of(se->cfs_rq->rq));
 		hmp_target_mask = &hmp->cpus;
 	}
 
 	/* The currently running task is not on the runqueue */
-	se = __pick_first_entity(cfs_rq_of(se));
+	root = hmp_timeline_root(cfs_rq);
+	if (!hmp_target_mask || !root)
+		return se;
 
-	while(num_tasks && se) {
-		if (entity_is_task(se)) {
-			if(se->avg.load_avg_ratio > max_ratio &&
-					(hmp_target_mask &&
-					 cpumask_intersects(hmp_target_mask,
-						 tsk_cpus_allowed(task_of(se))))) {
-				max_se = se;
-				max_ratio = se->avg.load_avg_ratio;
-			}
-		}
-		se = __pick_next_entity(se);
-		num_tasks--;
-	}
-	return max_se;
+	max_se = root->hmp_heaviest;
+	if (!max_se || max_se->avg.load_avg_ratio <= se->avg.load_avg_ratio)
+		return se;
+	if (hmp_task_allowed(max_se, hmp_target_mask))
+		return max_se;
+
+	return hmp_scan_task(cfs_rq, se, se->avg.load_avg_ratio,
+			     hmp_target_mask, 1);
 }
 
 static struct sched_entity *hmp_get_lightest_task(struct sched_entity* se, int migrate_down)
 {
-	int num_tasks = hmp_max_tasks;
-	struct sched_entity *min_se = se;
-	unsigned long int min_ratio = ULONG_MAX;
+	struct cfs_rq *cfs_rq = cfs_rq_of(se);
+	struct sched_entity *root, *min_se;
 	const struct cpumask *hmp_target_mask = NULL;
 
 	if (migrate_down) {
 		struct hmp_domain *hmp;
 		if(hmp_cpu_is_slowest(cpu_of(se->cfs_rq->rq)))
-			return min_se;
+			return se;
 
 		hmp = hmp_slower_domain(cpu_of(se->cfs_rq->rq));
 		hmp_target_mask = &hmp->cpus;
 	}
 
 	/* The currently running task is not on the runqueue */
-	se = __pick_first_entity(cfs_rq_of(se));
+	root = hmp_timeline_root(cfs_rq);
+	if (!hmp_target_mask || !root)
+		return se;
 
-	while(num_tasks && se) {
-		if (entity_is_task(se)) {
-			if(se->avg.load_avg_ratio < min_ratio &&
-					(hmp_target_mask &&
-					 cpumask_intersects(hmp_target_mask,
-						 tsk_cpus_allowed(task_of(se))))) {
-				min_se = se;
-				min_ratio = se->avg.load_avg_ratio;
-			}
-		}
-		se = __pick_next_entity(se);
-		num_tasks--;
-	}
-	return min_se;
+	min_se = root->hmp_lightest;
+	if (!min_se)
+		return se;
+	if (hmp_task_allowed(min_se, hmp_target_mask))
+		return min_se;
+
+	return hmp_scan_task(cfs_rq, se, ULONG_MAX, hmp_target_mask, 0);
 }
 
 /*
@@ -5010,6 +5180,7 @@ static int hmp_boostpulse;
 static int hmp_active_down_migration;
 static int hmp_aggressive_up_migration;
 static int hmp_aggressive_yield;
+static int hmp_energy_aware;
 static DEFINE_RAW_SPINLOCK(hmp_boost_lock);
 static DEFINE_RAW_SPINLOCK(hmp_semiboost_lock);
 static DEFINE_RAW_SPINLOCK(hmp_sysfs_lock);
@@ -5149,6 +5320,240 @@ static inline void hmp_next_down_delay(struct sched_entity *se, int cpu)
 	cpu_rq(cpu)->avg.hmp_last_up_migration = 0;
 }
 
+/*
+ * Energy aware placement
+ *
+ * Instead of the fixed up/down thresholds, wakeups go to the cpu where the
+ * task's load costs the least energy, among the cpus with the capacity for
+ * it, and running tasks only move up once they no longer fit their cpu.
+ *
+ * The model comes from the sched-energy-costs binding of the first cpu of
+ * each hmp_domain: a core and a cluster cost node, each with busy-cost-data
+ * <capacity power> pairs for increasing frequencies, and idle-cost-data
+ * with the shallowest idle state first.  Capacities are on one scale for
+ * all domains, the fastest cpu at its top frequency being 1024.
+ */
+struct hmp_energy_state {
+	unsigned long cap;
+	unsigned long power;		/* per busy cpu */
+	unsigned long cluster_power;	/* while any cpu is busy */
+};
+
+struct hmp_energy {
+	unsigned long idle_power;	/* per idle cpu */
+	int nr_states;
+	struct hmp_energy_state states[];
+};
+
+static DEFINE_PER_CPU(struct hmp_energy *, hmp_cpu_energy);
+static bool hmp_energy_model;
+
+/* Keep ~20% headroom: load * 1280 / 1024 has to fit the capacity */
+#define HMP_ENERGY_MARGIN	1280
+
+/* Boosts ask for performance, they keep the threshold behaviour */
+static inline int hmp_energy_placement(void)
+{
+	return hmp_energy_aware && !hmp_boost() && !hmp_semiboost();
+}
+
+static inline unsigned long hmp_cpu_max_cap(int cpu)
+{
+	struct hmp_energy *nrg = per_cpu(hmp_cpu_energy, cpu);
+
+	return nrg->states[nrg->nr_states - 1].cap;
+}
+
+/*
+ * Load tracked on @cpu, turned into capacity.  Without frequency invariant
+ * scaling the ratio is against the current frequency rather than the top
+ * one, which overestimates the load at low speeds.
+ */
+static inline unsigned long hmp_energy_util(unsigned long ratio, int cpu)
+{
+	return ratio * hmp_cpu_max_cap(cpu) >> 10;
+}
+
+static inline bool hmp_energy_fits(unsigned long util, unsigned long cap)
+{
+	return util * HMP_ENERGY_MARGIN < cap * 1024;
+}
+
+/* Is @se still small enough for the cpu it runs on? */
+static inline bool hmp_energy_task_fits(struct sched_entity *se, int cpu)
+{
+	return hmp_energy_fits(hmp_energy_util(se->avg.load_avg_ratio, cpu),
+			       hmp_cpu_max_cap(cpu));
+}
+
+/*
+ * Energy the online cpus of @hmpd use over a period, with @util added to
+ * @dst_cpu (-1 for none).  The domain shares a clock, so it runs at the
+ * lowest state that fits its busiest cpu.  Returns ULONG_MAX if @dst_cpu
+ * would not fit even at the top state.
+ */
+static unsigned long hmp_domain_energy(struct hmp_domain *hmpd,
+		struct hmp_energy *nrg, int dst_cpu, unsigned long util)
+{
+	struct hmp_energy_state *cs;
+	unsigned long cpu_util, max_util = 0, busy, max_busy = 0;
+	unsigned long energy = 0;
+	int cpu, i;
+
+	for_each_cpu_and(cpu, &hmpd->cpus, cpu_online_mask) {
+		cpu_util = hmp_energy_util(cpu_rq(cpu)->avg.load_avg_ratio, cpu);
+		if (cpu == dst_cpu) {
+			cpu_util += util;
+			if (!hmp_energy_fits(cpu_util, hmp_cpu_max_cap(cpu)))
+				return ULONG_MAX;
+		}
+		max_util = max(max_util, cpu_util);
+	}
+
+	for (i = 0; i < nrg->nr_states - 1; i++)
+		if (hmp_energy_fits(max_util, nrg->states[i].cap))
+			break;
+	cs = &nrg->states[i];
+
+	for_each_cpu_and(cpu, &hmpd->cpus, cpu_online_mask) {
+		cpu_util = hmp_energy_util(cpu_rq(cpu)->avg.load_avg_ratio, cpu);
+		if (cpu == dst_cpu)
+			cpu_util += util;
+		busy = min(cpu_util * 1024 / cs->cap, 1024UL);
+		energy += busy * cs->power + (1024 - busy) * nrg->idle_power;
+		max_busy = max(max_busy, busy);
+	}
+
+	return energy + max_busy * cs->cluster_power;
+}
+
+/*
+ * The allowed cpu where @p's load adds the least energy.  Between equal
+ * costs the less loaded cpu wins, so that tasks still spread within a
+ * domain.  Returns NR_CPUS if @p fits nowhere.
+ */
+static int hmp_energy_select_cpu(struct task_struct *p, int prev_cpu)
+{
+	struct hmp_domain *hmpd;
+	struct hmp_energy *nrg;
+	unsigned long util, base, cost, cpu_util;
+	unsigned long best_cost = ULONG_MAX, best_util = ULONG_MAX;
+	int cpu, best_cpu = NR_CPUS;
+
+	util = hmp_energy_util(p->se.avg.load_avg_ratio, prev_cpu);
+
+	list_for_each_entry(hmpd, &hmp_domains, hmp_domains) {
+		nrg = per_cpu(hmp_cpu_energy, cpumask_first(&hmpd->possible_cpus));
+		base = hmp_domain_energy(hmpd, nrg, -1, 0);
+
+		for_each_cpu_and(cpu, &hmpd->cpus, tsk_cpus_allowed(p)) {
+			if (!cpu_online(cpu))
+				continue;
+			cost = hmp_domain_energy(hmpd, nrg, cpu, util);
+			if (cost == ULONG_MAX)
+				continue;
+			cost -= min(cost, base);
+			cpu_util = cpu_rq(cpu)->avg.load_avg_ratio;
+			if (cost < best_cost ||
+			    (cost == best_cost && cpu_util < best_util)) {
+				best_cost = cost;
+				best_util = cpu_util;
+				best_cpu = cpu;
+			}
+		}
+	}
+
+	return best_cpu;
+}
+
+static struct hmp_energy * __init hmp_energy_parse(int cpu)
+{
+	struct device_node *cn, *core, *cluster;
+	struct hmp_energy *nrg = NULL;
+	const __be32 *val, *cval = NULL;
+	int len, clen, nr, i;
+
+	cn = of_get_cpu_node(cpu, NULL);
+	if (!cn)
+		return NULL;
+	core = of_parse_phandle(cn, "sched-energy-costs", 0);
+	cluster = of_parse_phandle(cn, "sched-energy-costs", 1);
+	of_node_put(cn);
+	if (!core)
+		goto out;
+
+	val = of_get_property(core, "busy-cost-data", &len);
+	nr = val ? len / (2 * sizeof(u32)) : 0;
+	if (!nr)
+		goto out;
+	if (cluster) {
+		cval = of_get_property(cluster, "busy-cost-data", &clen);
+		if (cval && clen != len) {
+			pr_warn("cpu%d: cluster and core costs differ in size\n",
+				cpu);
+			cval = NULL;
+		}
+	}
+
+	nrg = kzalloc(sizeof(*nrg) + nr * sizeof(nrg->states[0]), GFP_KERNEL);
+	if (!nrg)
+		goto out;
+
+	nrg->nr_states = nr;
+	for (i = 0; i < nr; i++) {
+		nrg->states[i].cap = be32_to_cpup(val++);
+		nrg->states[i].power = be32_to_cpup(val++);
+		if (cval) {
+			cval++;
+			nrg->states[i].cluster_power = be32_to_cpup(cval++);
+		}
+	}
+	val = of_get_property(core, "idle-cost-data", &len);
+	if (val && len >= sizeof(u32))
+		nrg->idle_power = be32_to_cpup(val);
+
+	if (!nrg->states[nr - 1].cap) {
+		kfree(nrg);
+		nrg = NULL;
+	}
+out:
+	of_node_put(core);
+	of_node_put(cluster);
+	return nrg;
+}
+
+static int __init hmp_energy_init(void)
+{
+	struct hmp_domain *hmpd;
+	struct hmp_energy *nrg;
+	int cpu;
+
+	if (list_empty(&hmp_domains))
+		return 0;
+
+	list_for_each_entry(hmpd, &hmp_domains, hmp_domains) {
+		nrg = hmp_energy_parse(cpumask_first(&hmpd->possible_cpus));
+		if (!nrg)
+			goto fail;
+		for_each_cpu(cpu, &hmpd->possible_cpus)
+			per_cpu(hmp_cpu_energy, cpu) = nrg;
+	}
+
+	hmp_energy_model = true;
+	return 0;
+
+fail:
+	pr_info("HMP: no energy model, energy aware placement unavailable\n");
+	list_for_each_entry(hmpd, &hmp_domains, hmp_domains) {
+		nrg = per_cpu(hmp_cpu_energy, cpumask_first(&hmpd->possible_cpus));
+		kfree(nrg);
+		for_each_cpu(cpu, &hmpd->possible_cpus)
+			per_cpu(hmp_cpu_energy, cpu) = NULL;
+	}
+	return 0;
+}
+late_initcall(hmp_energy_init);
+
 #ifdef CONFIG_HMP_VARIABLE_SCALE
 /*
  * Heterogenous multiprocessor (HMP) optimizations
@@ -5419,6 +5824,18 @@ static int hmp_aggressive_yield_from_sysfs(int value)
 	return ret;
 }
 
+static int hmp_energy_aware_from_sysfs(int value)
+{
+	if (value < 0 || value > 1)
+		return -EINVAL;
+	if (value && !hmp_energy_model)
+		return -ENODEV;
+
+	hmp_energy_aware = value;
+
+	return 0;
+}
+
 int set_hmp_boost(int enable)
 {
 	return hmp_boost_from_sysfs(enable);
@@ -5576,6 +5993,11 @@ static int hmp_attr_init(void)
 		NULL,
 		hmp_aggressive_yield_from_sysfs);
 
+	hmp_attr_add("energy_aware",
+		&hmp_energy_aware,
+		NULL,
+		hmp_energy_aware_from_sysfs);
+
 #ifdef CONFIG_HMP_FREQUENCY_INVARIANT_SCALE
 	/* default frequency-invariant scaling ON */
 	hmp_data.freqinvar_load_scale_enabled = 1;
@@ -5809,6 +6231,23 @@ unlock:
 #ifdef CONFIG_SCHED_HMP
 	prev_cpu = task_cpu(p);
 
+	if (hmp_energy_placement()) {
+		int nrg_cpu = hmp_energy_select_cpu(p, prev_cpu);
+
+		if (nrg_cpu < NR_CPUS) {
+			if (hmp_cpu_domain(nrg_cpu) != hmp_cpu_domain(prev_cpu)) {
+				if (hmp_cpu_domain(nrg_cpu) ==
+				    hmp_faster_domain(prev_cpu))
+					hmp_next_up_delay(&p->se, nrg_cpu);
+				else
+					hmp_next_down_delay(&p->se, nrg_cpu);
+				trace_sched_hmp_migrate(p, nrg_cpu,
+							HMP_MIGRATE_ENERGY);
+			}
+			return nrg_cpu;
+		}
+	}
+
 	if (hmp_up_migration(prev_cpu, &new_cpu, &p->se)) {
 		hmp_next_up_delay(&p->se, new_cpu);
 		trace_sched_hmp_migrate(p, new_cpu, HMP_MIGRATE_WAKEUP);
@@ -8796,7 +9235,10 @@ static unsigned int hmp_up_migration(int cpu, int *target_cpu, struct sched_enti
 	if (p->prio >= hmp_up_prio)
 		return 0;
 #endif
-	if (!hmp_boost()) {
+	if (hmp_energy_placement()) {
+		if (hmp_energy_task_fits(se, cpu))
+			return 0;
+	} else if (!hmp_boost()) {
 		if (hmp_semiboost())
 			up_threshold = hmp_semiboost_up_threshold;
 		else
@@ -8985,6 +9427,27 @@ static int hmp_down_migration_noti(void)
 			HMP_DOWN_MIGRATION, NULL);
 }
 
+/*
+ * Utilization of @cpu for frequency selection: the HMP load ratios of the
+ * tasks queued there, capped at 1024.  With frequency invariant load
+ * scaling it is relative to the max frequency of @cpu, and @freq_invariant
+ * is set, otherwise to its current one.
+ */
+unsigned long hmp_cpu_util(int cpu, bool *freq_invariant)
+{
+	unsigned long util = cpu_rq(cpu)->avg.load_avg_ratio;
+
+#if defined(CONFIG_HMP_VARIABLE_SCALE) && \
+	defined(CONFIG_HMP_FREQUENCY_INVARIANT_SCALE)
+	*freq_invariant = hmp_data.freqinvar_load_scale_enabled &&
+		!(freq_scale[cpu].flags & SCHED_LOAD_FREQINVAR_SINGLEFREQ);
+#else
+	*freq_invariant = false;
+#endif
+	return min(util, 1024UL);
+}
+EXPORT_SYMBOL_GPL(hmp_cpu_util);
+
 /*
  * hmp_active_task_migration_cpu_stop is run by cpu stopper and used to
  * migrate a specific task from one runqueue to another.
@@ -9143,7 +9606,7 @@ static DEFINE_SPINLOCK(hmp_force_migration);
  * hmp_force_up_migration checks runqueues for tasks that need to
  * be actively migrated to a faster cpu.
  */
-static void hmp_force_up_migration(int this_cpu)
+static void __hmp_force_up_migration(int this_cpu)
 {
 	int cpu, target_cpu;
 	struct sched_entity *curr, *orig;
@@ -9194,11 +9657,7 @@ static void hmp_force_up_migration(int this_cpu)
 			}
 		}
 		if (!force && !target->active_balance) {
-			/*
-			 * For now we just check the currently running task.
-			 * Selecting the lightest task for offloading will
-			 * require extensive book keeping.
-			 */
+			/* the lightest queued task, or curr if none fits */
 			curr = hmp_get_lightest_task(orig, 1);
 			p = task_of(curr);
 			target->push_cpu = hmp_offload_down(cpu, curr);
@@ -9221,6 +9680,21 @@ static void hmp_force_up_migration(int this_cpu)
 	spin_unlock(&hmp_force_migration);
 	//trace_printk("spinlock RELEASE cpu %d\n", this_cpu);
 }
+
+static void hmp_force_up_migration(int this_cpu)
+{
+#ifdef CONFIG_SCHEDSTATS
+	struct rq *rq = cpu_rq(this_cpu);
+	u64 start = sched_clock_cpu(this_cpu);
+
+	__hmp_force_up_migration(this_cpu);
+
+	schedstat_inc(rq, hmp_force_count);
+	schedstat_add(rq, hmp_force_time, sched_clock_cpu(this_cpu) - start);
+#else
+	__hmp_force_up_migration(this_cpu);
+#endif
+}
 #else
 static void hmp_force_up_migration(int this_cpu) { }
 #endif /* CONFIG_SCHED_HMP */
@@ -9280,7 +9754,9 @@ static unsigned int hmp_idle_pull(int this_cpu)
 		else
 			up_threshold = hmp_up_threshold;
 
-		if (hmp_boost() || curr->avg.load_avg_ratio > up_threshold)
+		if (hmp_energy_placement() ?
+		    !hmp_energy_task_fits(curr, cpu) :
+		    (hmp_boost() || curr->avg.load_avg_ratio > up_threshold))
 			if (curr->avg.load_avg_ratio > ratio) {
 				p = task_of(curr);
 				target = rq;
@@ -9397,6 +9873,7 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		task_tick_numa(rq, curr);
 
 	update_rq_runnable_avg(rq, 1);
+	cpufreq_update_util(rq, SCHED_CPUFREQ_TICK);
 }
 
 /*
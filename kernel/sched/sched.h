@@ -207,6 +207,27 @@ struct cfs_bandwidth {
 #endif
 };
 
+#ifdef CONFIG_SCHEDSTATS
+/*
+ * Enqueue-to-run latency histograms.  Bucket 0 counts latencies under
+ * 1024ns, bucket i those in [2^(i-1), 2^i) of 1024ns, roughly usecs, the
+ * last one everything longer.
+ */
+#define SCHED_LAT_BUCKETS	16
+
+enum sched_lat_class {
+	SCHED_LAT_STOP,
+	SCHED_LAT_DL,
+	SCHED_LAT_RT,
+	SCHED_LAT_FAIR,
+	SCHED_LAT_NR_CLASS,
+};
+
+struct sched_lat_hist {
+	unsigned int bucket[SCHED_LAT_NR_CLASS][SCHED_LAT_BUCKETS];
+};
+#endif
+
 /* task group related information */
 struct task_group {
 	struct cgroup_subsys_state css;
@@ -243,6 +264,11 @@ struct task_group {
 	struct autogroup *autogroup;
 #endif
 
+#ifdef CONFIG_SCHEDSTATS
+	/* latency of this group's own tasks, not of its children */
+	struct sched_lat_hist __percpu *wakeup_lat;
+#endif
+
 	struct cfs_bandwidth cfs_bandwidth;
 };
 
@@ -645,6 +671,17 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	/* enqueue-to-run latency, by sched class */
+	struct sched_lat_hist wakeup_lat;
+
+#ifdef CONFIG_SCHED_HMP
+	/* hmp_force_up_migration() stats */
+	unsigned int hmp_force_count;
+	u64 hmp_force_time;
+	/* heaviest/lightest task lookups that had to scan the queue */
+	unsigned int hmp_search_scan;
+#endif
 #endif
 
 #ifdef CONFIG_SMP
@@ -684,6 +721,27 @@ static inline u64 rq_clock_task(struct rq *rq)
 	return rq->clock_task;
 }
 
+#ifdef CONFIG_CPU_FREQ
+DECLARE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/*
+ * Let the cpufreq governor of @rq's cpu know that its load changed.  Called
+ * with @rq->lock held, also for remote cpus, so that a task migrating to an
+ * idle cpu is seen there right away.
+ */
+static inline void cpufreq_update_util(struct rq *rq, unsigned int flags)
+{
+	struct update_util_data *data;
+
+	data = rcu_dereference_sched(per_cpu(cpufreq_update_util_data,
+					     cpu_of(rq)));
+	if (data)
+		data->func(data, rq_clock(rq), flags);
+}
+#else
+static inline void cpufreq_update_util(struct rq *rq, unsigned int flags) {}
+#endif
+
 #ifdef CONFIG_NUMA_BALANCING
 extern void sched_setnuma(struct task_struct *p, int node);
 extern int migrate_task_to(struct task_struct *p, int cpu);
@@ -822,6 +880,15 @@ static inline void sched_ttwu_pending(void) { }
 
 #endif /* CONFIG_SMP */
 
+#ifdef CONFIG_SCHEDSTATS
+struct seq_file;
+
+extern void sched_lat_account(struct rq *rq, struct task_struct *p,
+			      unsigned long long delta);
+extern void sched_lat_hist_show(struct seq_file *seq,
+				struct sched_lat_hist *hist);
+#endif
+
 #include "stats.h"
 #include "auto_group.h"
 
@@ -10,7 +10,58 @@
  * bump this up when changing the output format or the meaning of an existing
  * format, so that tools can adapt (or abort)
  */
-#define SCHEDSTAT_VERSION 15
+#define SCHEDSTAT_VERSION 16
+
+static const char * const sched_lat_class_name[SCHED_LAT_NR_CLASS] = {
+	[SCHED_LAT_STOP]	= "stop",
+	[SCHED_LAT_DL]		= "dl",
+	[SCHED_LAT_RT]		= "rt",
+	[SCHED_LAT_FAIR]	= "fair",
+};
+
+static inline int sched_lat_class(struct task_struct *p)
+{
+	if (likely(p->sched_class == &fair_sched_class))
+		return SCHED_LAT_FAIR;
+	if (p->sched_class == &rt_sched_class)
+		return SCHED_LAT_RT;
+	if (p->sched_class == &dl_sched_class)
+		return SCHED_LAT_DL;
+	return SCHED_LAT_STOP;
+}
+
+/*
+ * Called from sched_info_arrive() with rq->lock held, @p is about to run
+ * on @rq after waiting @delta ns.  A shift and an fls, no division.
+ */
+void sched_lat_account(struct rq *rq, struct task_struct *p,
+		       unsigned long long delta)
+{
+	int class = sched_lat_class(p);
+	int bucket = min(fls64(delta >> 10), SCHED_LAT_BUCKETS - 1);
+#ifdef CONFIG_CGROUP_SCHED
+	struct sched_lat_hist *tg_hist;
+
+	tg_hist = per_cpu_ptr(task_group(p)->wakeup_lat, cpu_of(rq));
+	tg_hist->bucket[class][bucket]++;
+#endif
+	rq->wakeup_lat.bucket[class][bucket]++;
+}
+
+/*
+ * One line per sched class: the class name followed by the buckets.
+ */
+void sched_lat_hist_show(struct seq_file *seq, struct sched_lat_hist *hist)
+{
+	int class, i;
+
+	for (class = 0; class < SCHED_LAT_NR_CLASS; class++) {
+		seq_printf(seq, "lat_%s", sched_lat_class_name[class]);
+		for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+			seq_printf(seq, " %u", hist->bucket[class][i]);
+		seq_printf(seq, "\n");
+	}
+}
 
 static int show_schedstat(struct seq_file *seq, void *v)
 {
@@ -44,6 +95,9 @@ static int show_schedstat(struct seq_file *seq, void *v)
 
 		seq_printf(seq, "\n");
 
+		/* enqueue-to-run latency histograms */
+		sched_lat_hist_show(seq, &rq->wakeup_lat);
+
 #ifdef CONFIG_SMP
 		/* domain-specific stats */
 		rcu_read_lock();
@@ -130,16 +184,39 @@ static int schedstat_open(struct inode *inode, struct file *file)
 	return seq_open(file, &schedstat_sops);
 }
 
+/*
+ * Any write clears the latency histograms of all cpus, the other counters
+ * keep running as before.
+ */
+static ssize_t schedstat_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	unsigned long flags;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+
+		raw_spin_lock_irqsave(&rq->lock, flags);
+		memset(&rq->wakeup_lat, 0, sizeof(rq->wakeup_lat));
+		raw_spin_unlock_irqrestore(&rq->lock, flags);
+	}
+
+	return count;
+}
+
 static const struct file_operations proc_schedstat_operations = {
 	.open    = schedstat_open,
 	.read    = seq_read,
+	.write   = schedstat_write,
 	.llseek  = seq_lseek,
 	.release = seq_release,
 };
 
 static int __init proc_schedstat_init(void)
 {
-	proc_create("schedstat", 0, NULL, &proc_schedstat_operations);
+	proc_create("schedstat", S_IRUGO | S_IWUSR, NULL,
+		    &proc_schedstat_operations);
 	return 0;
 }
 subsys_initcall(proc_schedstat_init);
@@ -0,0 +1,147 @@
+/*
+ * Sequential read throughput of a stacked file system against its lower one
+ *
+ * Reads the same file once through each path given on the command line
+ * and prints MB/s for both, e.g. an sdcardfs file and the f2fs file below
+ * it:
+ *
+ *	seq_read_bench /storage/emulated/0/big /data/media/0/big
+ *
+ * The page cache is dropped before every pass unless -w is given, in which
+ * case every pass is preceded by an untimed one so that all of them run warm.
+ * A missing file is created with -s MB of data first.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define DEFAULT_BUF_KB	128
+#define DEFAULT_SIZE_MB	256
+
+static size_t buf_size = DEFAULT_BUF_KB * 1024;
+static size_t file_mb = DEFAULT_SIZE_MB;
+static int warm;
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3", 1) != 1)
+		fprintf(stderr, "cannot drop caches (%s), results are warm\n",
+			strerror(errno));
+	if (fd >= 0)
+		close(fd);
+}
+
+static int create_file(const char *path, char *buf)
+{
+	size_t done;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd < 0)
+		return errno == EEXIST ? 0 : -1;
+
+	memset(buf, 0x5a, buf_size);
+	for (done = 0; done < file_mb * 1024 * 1024; done += buf_size) {
+		if (write(fd, buf, buf_size) != (ssize_t)buf_size) {
+			close(fd);
+			return -1;
+		}
+	}
+	fsync(fd);
+	close(fd);
+	return 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int read_pass(const char *path, char *buf, double *mbps)
+{
+	unsigned long long total = 0;
+	double start;
+	ssize_t ret;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	start = now();
+	while ((ret = read(fd, buf, buf_size)) > 0)
+		total += ret;
+	*mbps = total / (1024.0 * 1024.0) / (now() - start);
+
+	close(fd);
+	return ret < 0 ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	double mbps;
+	char *buf;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "b:s:w")) != -1) {
+		switch (opt) {
+		case 'b':
+			buf_size = strtoul(optarg, NULL, 0) * 1024;
+			break;
+		case 's':
+			file_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			warm = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind >= argc || !buf_size)
+		goto usage;
+
+	buf = malloc(buf_size);
+	if (!buf)
+		return 1;
+
+	if (create_file(argv[optind], buf)) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	for (i = optind; i < argc; i++) {
+		if (warm)
+			read_pass(argv[i], buf, &mbps);
+		else
+			drop_caches();
+
+		if (read_pass(argv[i], buf, &mbps)) {
+			perror(argv[i]);
+			return 1;
+		}
+		printf("%-40s %10.1f MB/s\n", argv[i], mbps);
+	}
+
+	free(buf);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-b buf_kb] [-s size_mb] [-w] file [file...]\n",
+		argv[0]);
+	return 1;
+}
@@ -0,0 +1,199 @@
+/*
+ * Parallel small-file stat/read rate of a file system
+ *
+ * Starts -t threads that stat, open, read and close the files of a
+ * directory round robin for -d seconds, and prints the operations per
+ * second.  On a FUSE mount this measures how well the daemon's threads
+ * scale, e.g. with and without one cloned /dev/fuse fd per thread:
+ *
+ *	small_file_bench -t 8 /mnt/fuse/dir
+ *
+ * Missing files are created first: -n files of -s bytes each.  Every
+ * pass runs warm, as only the request path is of interest.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define DEFAULT_THREADS	4
+#define DEFAULT_FILES	1000
+#define DEFAULT_SIZE	4096
+#define DEFAULT_SECS	5
+
+static unsigned nr_threads = DEFAULT_THREADS;
+static unsigned nr_files = DEFAULT_FILES;
+static size_t file_size = DEFAULT_SIZE;
+static unsigned secs = DEFAULT_SECS;
+static const char *dir;
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	unsigned idx;
+	unsigned long long ops;
+	int err;
+};
+
+static void file_path(char *path, size_t len, unsigned i)
+{
+	snprintf(path, len, "%s/f%05u", dir, i);
+}
+
+static int create_files(void)
+{
+	char path[4096];
+	char *buf;
+	unsigned i;
+	int fd;
+
+	buf = malloc(file_size);
+	if (!buf)
+		return -1;
+	memset(buf, 0x5a, file_size);
+
+	for (i = 0; i < nr_files; i++) {
+		file_path(path, sizeof(path), i);
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd < 0) {
+			if (errno == EEXIST)
+				continue;
+			goto err;
+		}
+		if (write(fd, buf, file_size) != (ssize_t)file_size) {
+			close(fd);
+			goto err;
+		}
+		close(fd);
+	}
+	free(buf);
+	return 0;
+
+err:
+	perror(path);
+	free(buf);
+	return -1;
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	char path[4096];
+	struct stat st;
+	unsigned i = w->idx;
+	char *buf;
+	int fd;
+
+	buf = malloc(file_size);
+	if (!buf) {
+		w->err = ENOMEM;
+		return NULL;
+	}
+
+	while (!stop) {
+		file_path(path, sizeof(path), i);
+		if (stat(path, &st) || (fd = open(path, O_RDONLY)) < 0) {
+			w->err = errno;
+			break;
+		}
+		if (read(fd, buf, file_size) < 0)
+			w->err = errno;
+		close(fd);
+		if (w->err)
+			break;
+
+		w->ops++;
+		i += nr_threads;
+		if (i >= nr_files)
+			i -= nr_files;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long total = 0;
+	struct worker *workers;
+	struct timespec start, end;
+	double elapsed;
+	unsigned i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:n:s:d:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nr_files = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			file_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			secs = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || !nr_threads || !nr_files || !file_size)
+		goto usage;
+	dir = argv[optind];
+
+	if (create_files())
+		return 1;
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		return 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].idx = i % nr_files;
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i])) {
+			fprintf(stderr, "cannot start thread %u\n", i);
+			stop = 1;
+			nr_threads = i;
+			break;
+		}
+	}
+	if (!stop)
+		sleep(secs);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (workers[i].err) {
+			fprintf(stderr, "thread %u: %s\n", i,
+				strerror(workers[i].err));
+			return 1;
+		}
+		total += workers[i].ops;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = end.tv_sec - start.tv_sec +
+		  (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("%-40s %u threads %12.0f files/s\n", dir, nr_threads,
+	       total / elapsed);
+
+	free(workers);
+	return 0;
+
+usage:
+	fprintf(stderr,
+		"usage: %s [-t threads] [-n files] [-s size] [-d secs] dir\n",
+		argv[0]);
+	return 1;
+}